@@ -5,6 +5,7 @@ option(LUTEFISK3D_UI "Build with UI component" ON)
 option(LUTEFISK3D_IK "Inverse kinematics subsystem enabled" ON)
 option(LUTEFISK3D_NAVIGATION "Navigation subsystem enabled" ON)
 option(LUTEFISK3D_PHYSICS "Physics subsystem enabled" ON)
+option(LUTEFISK3D_PHYSICS_THREADED "Build Bullet thread-safe, allowing the multithreaded physics world" OFF)
 option(LUTEFISK3D_2D "2D subsystem enabled" ON)
 option(LUTEFISK3D_NETWORK "Networking subsystem enabled" ON)
 option(LUTEFISK3D_PROFILING "Profiler support enabled" ON)
@@ -58,8 +58,8 @@ void RefCounted::AddRef()
 void RefCounted::ReleaseRef()
 {
     assert(refCount_->refs_ > 0);
-    (refCount_->refs_)--;
-    if (!refCount_->refs_)
+    // Decrement and test at once, so that only one of several threads releasing the object deletes it
+    if (!--(refCount_->refs_))
     {
         if (deleter_ != nullptr)
             deleter_(this);
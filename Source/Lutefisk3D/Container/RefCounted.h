@@ -22,6 +22,7 @@
 
 #pragma once
 #include "Lutefisk3D/Core/Lutefisk3D.h"
+#include <atomic>
 #include <functional>
 
 namespace Urho3D
@@ -36,8 +37,8 @@ struct RefCount
         refs_ = -1;
         weakRefs_ = -1;
     }
-    int refs_     = 0; //!< Reference count. If below zero, the object has been destroyed.
-    int weakRefs_ = 0; //!< Weak reference count.
+    std::atomic<int> refs_{0}; //!< Reference count. If below zero, the object has been destroyed.
+    int weakRefs_ = 0;         //!< Weak reference count.
 };
 
 /// Base class for intrusively reference-counted objects. These are noncopyable and non-assignable.
@@ -68,6 +68,7 @@ void Condition::Wait()
 #else
 Condition::Condition() :
     mutex_(new pthread_mutex_t),
+    signaled_(false),
     event_(new pthread_cond_t)
 {
     pthread_mutex_init((pthread_mutex_t*)mutex_, nullptr);
@@ -89,7 +90,13 @@ Condition::~Condition()
 /// Set the condition. Will be automatically reset once a waiting thread wakes up.
 void Condition::Set()
 {
+    pthread_mutex_t* mutex = (pthread_mutex_t*)mutex_;
+
+    // Remember the signal so that it is not lost when no thread is waiting yet, like a Windows auto-reset event
+    pthread_mutex_lock(mutex);
+    signaled_ = true;
     pthread_cond_signal((pthread_cond_t*)event_);
+    pthread_mutex_unlock(mutex);
 }
 
 /// Wait on the condition.
@@ -99,7 +106,9 @@ void Condition::Wait()
     pthread_mutex_t* mutex = (pthread_mutex_t*)mutex_;
 
     pthread_mutex_lock(mutex);
-    pthread_cond_wait(cond, mutex);
+    while (!signaled_)
+        pthread_cond_wait(cond, mutex);
+    signaled_ = false;
     pthread_mutex_unlock(mutex);
 }
 #endif
@@ -35,6 +35,7 @@ public:
 private:
 #ifndef _WIN32
     void* mutex_;
+    bool signaled_;
 #endif
     void* event_;
 };
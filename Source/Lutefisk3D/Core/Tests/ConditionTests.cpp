@@ -0,0 +1,35 @@
+#include <QTest>
+#include "../Condition.h"
+
+#include <atomic>
+#include <thread>
+
+class ConditionTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifySetBeforeWait() {
+        Urho3D::Condition condition;
+        // A Set with no thread waiting is remembered, so the Wait returns at once
+        condition.Set();
+        condition.Wait();
+    }
+    void verifyAutoReset() {
+        Urho3D::Condition condition;
+        std::atomic<bool> woken(false);
+        condition.Set();
+        condition.Wait();
+        // The Wait above consumed the signal, so the thread below must block until the next Set
+        std::thread waiter([&condition, &woken]() {
+            condition.Wait();
+            woken = true;
+        });
+        QTest::qWait(50);
+        QVERIFY(!woken);
+        condition.Set();
+        waiter.join();
+        QVERIFY(woken);
+    }
+};
+
+QTEST_MAIN(ConditionTests)
+#include "ConditionTests.moc"
@@ -27,11 +27,15 @@
 #include "Profiler.h"
 #include "Variant.h"
 
+#include <cerrno>
 #include <ctime>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <mmsystem.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
 #else
 #include <sys/time.h>
 #include <unistd.h>
@@ -161,6 +165,41 @@ void Time::Sleep(unsigned mSec)
 #endif
 }
 
+void Time::SleepUSec(long long uSec)
+{
+    if (uSec <= 0)
+        return;
+#ifdef _WIN32
+    // A high resolution waitable timer is not rounded up to the timer period like ::Sleep()
+    HANDLE timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+        timer = CreateWaitableTimerW(nullptr, TRUE, nullptr);
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -uSec * 10; // Negative for a relative time, in 100 nanosecond units
+    if (timer && SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+    else
+        ::Sleep((DWORD)((uSec + 999) / 1000));
+    if (timer)
+        CloseHandle(timer);
+#elif defined(__linux__)
+    // Sleep until an absolute deadline, so that being woken up by a signal does not lengthen the sleep
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    long long nSec = deadline.tv_nsec + uSec * 1000LL;
+    deadline.tv_sec += nSec / 1000000000LL;
+    deadline.tv_nsec = nSec % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+        ;
+#else
+    timespec time;
+    time.tv_sec = uSec / 1000000LL;
+    time.tv_nsec = (uSec % 1000000LL) * 1000;
+    while (nanosleep(&time, &time) == -1 && errno == EINTR)
+        ;
+#endif
+}
+
 float Time::GetFramesPerSecond() const
 {
     return 1.0f / timeStep_;
@@ -111,6 +111,8 @@ public:
     static QString GetTimeStamp();
     /// Sleep for a number of milliseconds.
     static void Sleep(unsigned mSec);
+    /// Sleep for a number of microseconds, using the most precise timer available.
+    static void SleepUSec(long long uSec);
 
 private:
     /// Elapsed time since program start.
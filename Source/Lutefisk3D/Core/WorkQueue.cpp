@@ -30,6 +30,9 @@
 #include "Timer.h"
 
 #include "Lutefisk3D/IO/Log.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <algorithm>
 
 namespace Urho3D
 {
@@ -302,6 +305,26 @@ void WorkQueue::Complete(unsigned priority)
     completing_ = false;
 }
 
+void WorkQueue::ProcessRange(unsigned count, unsigned minPartSize, const std::function<void(unsigned, unsigned)>& function)
+{
+    unsigned numParts = std::min((unsigned)threads_.size() + 1, count / std::max(minPartSize, 1U));
+    // Completing again from inside a work item run by the main thread would recurse into the queue
+    if (numParts < 2 || completing_ || !Thread::IsMainThread())
+    {
+        if (count)
+            function(0, count);
+        return;
+    }
+
+    unsigned partSize = (count + numParts - 1) / numParts;
+    for (unsigned start = 0; start < count; start += partSize)
+    {
+        unsigned end = std::min(start + partSize, count);
+        AddWorkItem([&function, start, end]() { function(start, end); }, M_MAX_UNSIGNED);
+    }
+    Complete(M_MAX_UNSIGNED);
+}
+
 bool WorkQueue::IsCompleted(unsigned priority) const
 {
     for (const SharedPtr<WorkItem> & elem : workItems_)
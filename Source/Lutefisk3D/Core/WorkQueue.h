@@ -27,6 +27,7 @@
 #include "Lutefisk3D/Engine/jlsignal/Signal.h"
 #include <vector>
 #include <deque>
+#include <functional>
 #include <set>
 namespace Urho3D
 {
@@ -94,6 +95,9 @@ public:
     void Resume();
     /// Finish all queued work which has at least the specified priority. Main thread will also execute priority work. Pause worker threads if no more work remains.
     void Complete(unsigned priority);
+    /// Split the range [0, count) into parts of at least minPartSize for the worker threads and the main thread, and wait
+    /// for them to finish. Processes the whole range in the calling thread when not called from the main thread.
+    void ProcessRange(unsigned count, unsigned minPartSize, const std::function<void(unsigned, unsigned)>& function);
     /// Set the pool telerance before it starts deleting pool items.
     void SetTolerance(int tolerance) { tolerance_ = tolerance; }
     /// Set how many milliseconds maximum per frame to spend on low-priority work, when there are no worker threads.
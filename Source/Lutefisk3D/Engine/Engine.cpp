@@ -80,6 +80,7 @@
 #include "jlsignal/StaticSignalConnectionAllocators.h"
 
 
+
 #if defined(_MSC_VER) && defined(_DEBUG)
 // From dbgint.h
 #define nNoMansLandSize 4
@@ -155,7 +156,12 @@ Engine::Engine(Context* context) :
     initialized_(false),
     exiting_(false),
     headless_(false),
-    audioPaused_(false)
+    audioPaused_(false),
+    tickAccumulator_(0),
+    tickTimeIndex_(0),
+    tickRate_(0),
+    maxTickCatchUp_(5),
+    droppedTicks_(0)
 {
     context->m_Engine = this;
     if(!oSignalConnectionAllocator)
@@ -270,6 +276,10 @@ bool Engine::Initialize(const VariantMap& parameters)
     if (GetParameter(parameters, EP_FRAME_LIMITER, true) == false)
         SetMaxFps(0);
 
+    // Fixed tick loop is only used by headless servers; windowed applications keep the variable frame timestep
+    if (headless_ && HasParameter(parameters, EP_TICK_RATE) && !SetTickRate(GetParameter(parameters, EP_TICK_RATE, 0).GetInt()))
+        return false;
+
     // Set amount of worker threads according to the available physical CPU cores. Using also hyperthreaded cores results in
     // unpredictable extra synchronization overhead. Also reserve one core for the main thread
     unsigned numThreads = GetParameter(parameters, EP_WORKER_THREADS, true).GetBool() ? GetNumPhysicalCPUs() - 1 : 0;
@@ -520,6 +530,12 @@ void Engine::RunFrame()
     if (exiting_)
         return;
 
+    if (headless_ && tickRate_)
+    {
+        RunFixedTicks();
+        return;
+    }
+
     // Note: there is a minimal performance cost to looking up subsystems (uses a hashmap); if they would be looked up several
     // times per frame it would be better to cache the pointers
     Time* time = context_->m_TimeSystem.get();
@@ -619,6 +635,39 @@ void Engine::SetMaxInactiveFps(unsigned fps)
 {
     maxInactiveFps_ = fps;
 }
+/// Set fixed ticks per second (at most 1000) for headless mode. 0 (default) runs variable timestep frames like a windowed application. Return false and keep the current rate if out of range.
+bool Engine::SetTickRate(unsigned ticksPerSecond)
+{
+    static const unsigned MAX_TICK_RATE = 1000;
+
+    // The tick loop works in whole microseconds per tick, so the rate is limited well below the point where a tick
+    // would round down to nothing. This also catches a negative rate given on the command line
+    if (ticksPerSecond > MAX_TICK_RATE)
+    {
+        URHO3D_LOGERROR(QString("Tick rate %1 out of range, must be at most %2").arg((int)ticksPerSecond).arg(MAX_TICK_RATE));
+        return false;
+    }
+    tickRate_ = ticksPerSecond;
+    tickAccumulator_ = 0;
+    tickTimer_.Reset();
+    return true;
+}
+/// Set maximum number of ticks run back to back when the tick loop falls behind. Further backlog is dropped.
+void Engine::SetMaxTickCatchUp(unsigned ticks)
+{
+    maxTickCatchUp_ = std::max(ticks, 1U);
+}
+/// Return a tick processing time percentile (0-100) in microseconds over the recent ticks.
+long long Engine::GetTickTimePercentile(float percentile) const
+{
+    if (tickTimes_.empty())
+        return 0;
+
+    std::vector<long long> sorted(tickTimes_);
+    unsigned index = (unsigned)(Clamp(percentile, 0.0f, 100.0f) / 100.0f * (sorted.size() - 1) + 0.5f);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
 
 void Engine::Exit()
 {
@@ -710,6 +759,63 @@ void Engine::Update()
     // Post-render update event
     g_coreSignals.postRenderUpdate(timeStep_);
 }
+/// Run due fixed timestep ticks in headless mode, sleeping until the next tick is due.
+void Engine::RunFixedTicks()
+{
+    static const unsigned TICK_TIME_SAMPLES = 1024;
+
+    Time* time = context_->m_TimeSystem.get();
+    const long long tickUSec = 1000000LL / tickRate_;
+    const float tickStep = 1.0f / tickRate_;
+
+    // Sleep until the next tick is due. Waking up late only delays that tick, as the overslept time is carried over to
+    // the next one
+    tickAccumulator_ += tickTimer_.GetUSec(true);
+    while (tickAccumulator_ < tickUSec)
+    {
+        Time::SleepUSec(tickUSec - tickAccumulator_);
+        tickAccumulator_ += tickTimer_.GetUSec(true);
+    }
+
+    // Run the due ticks back to back to catch up under load. Only the update signals used by scene, physics and network
+    // are sent; there is nothing to render or to draw debug geometry for
+    timeStep_ = tickStep;
+    unsigned numTicks = 0;
+    for (; tickAccumulator_ >= tickUSec && numTicks < maxTickCatchUp_ && !exiting_; ++numTicks)
+    {
+        URHO3D_PROFILE(Tick);
+        HiresTimer tickTime;
+
+        time->BeginFrame(tickStep);
+        g_coreSignals.update(tickStep);
+        g_coreSignals.postUpdate(tickStep);
+        g_coreSignals.renderUpdate(tickStep);
+        time->EndFrame();
+
+        if (tickTimes_.size() < TICK_TIME_SAMPLES)
+            tickTimes_.push_back(tickTime.GetUSec(false));
+        else
+            tickTimes_[tickTimeIndex_] = tickTime.GetUSec(false);
+        tickTimeIndex_ = (tickTimeIndex_ + 1) % TICK_TIME_SAMPLES;
+        tickAccumulator_ -= tickUSec;
+    }
+
+    // Drop the backlog that could not be caught up, so that a stall does not turn into a spiral of ever longer catch-ups
+    if (tickAccumulator_ >= tickUSec)
+    {
+        droppedTicks_ += (unsigned)(tickAccumulator_ / tickUSec);
+        tickAccumulator_ %= tickUSec;
+    }
+
+#ifdef LUTEFISK3D_TESTING
+    if (timeOut_ > 0)
+    {
+        timeOut_ -= numTicks * tickUSec;
+        if (timeOut_ <= 0)
+            Exit();
+    }
+#endif
+}
 /// Render after frame update.
 void Engine::Render()
 {
@@ -835,6 +941,14 @@ VariantMap Engine::ParseParameters(const QStringList& arguments)
                 ret[EP_SHADOWS] = false;
             else if (argument == "lqshadows")
                 ret[EP_LOW_QUALITY_SHADOWS] = true;
+            else if (argument == "tickrate" && !value.isEmpty())
+            {
+                // A rate that is not a number is passed on as invalid, for Initialize() to reject
+                bool ok;
+                int tickRate = value.toInt(&ok);
+                ret[EP_TICK_RATE] = ok ? tickRate : -1;
+                ++i;
+            }
             else if (argument == "nothreads")
                 ret[EP_WORKER_THREADS] = false;
             else if (argument == "v")
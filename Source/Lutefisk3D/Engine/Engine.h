@@ -52,6 +52,8 @@ public:
     void SetMaxFps(unsigned fps);
     void SetMaxInactiveFps(unsigned fps);
     void SetTimeStepSmoothing(int frames);
+    bool SetTickRate(unsigned ticksPerSecond);
+    void SetMaxTickCatchUp(unsigned ticks);
     /// Set whether to pause update events and audio when minimized.
     void SetPauseMinimized(bool enable) { pauseMinimized_ = enable; }
     /// Set whether to exit automatically on exit request (window close button.)
@@ -85,11 +87,20 @@ public:
     bool IsExiting() const { return exiting_; }
     /// Return whether the engine has been created in headless mode.
     bool IsHeadless() const { return headless_; }
+    /// Return the fixed tick rate used in headless mode, or 0 if headless mode runs variable frames.
+    unsigned GetTickRate() const { return tickRate_; }
+    /// Return the maximum number of ticks run back to back to catch up after a stall.
+    unsigned GetMaxTickCatchUp() const { return maxTickCatchUp_; }
+    /// Return the number of ticks dropped because catching up would have exceeded the maximum catch-up ticks.
+    unsigned GetDroppedTicks() const { return droppedTicks_; }
+    /// Return a tick processing time percentile (0-100) in microseconds over the recent ticks.
+    long long GetTickTimePercentile(float percentile) const;
 
 
     void Update();
     void Render();
     void ApplyFrameLimit();
+    void RunFixedTicks();
 
     /// Parse the engine startup parameters map from command line arguments.
     static VariantMap ParseParameters(const QStringList& arguments);
@@ -113,6 +124,13 @@ private:
     bool               exiting_;           ///< Exiting flag.
     bool               headless_;          ///< Headless mode flag.
     bool               audioPaused_;       ///< Audio paused flag.
+    HiresTimer         tickTimer_;         ///< Fixed tick loop timer.
+    long long          tickAccumulator_;   ///< Real time not yet consumed by fixed ticks, in microseconds.
+    std::vector<long long> tickTimes_;     ///< Recent tick processing times in microseconds, used as a ring buffer.
+    unsigned           tickTimeIndex_;     ///< Next write position in the tick time ring buffer.
+    unsigned           tickRate_;          ///< Fixed ticks per second in headless mode, 0 to run variable frames.
+    unsigned           maxTickCatchUp_;    ///< Maximum number of ticks run back to back when behind.
+    unsigned           droppedTicks_;      ///< Number of ticks dropped when unable to catch up.
 #ifdef LUTEFISK3D_TESTING
     /// Time out counter for testing.
     long long timeOut_;
@@ -57,6 +57,7 @@ static const QLatin1String EP_SOUND_MIX_RATE("SoundMixRate"); // 0 - use device'
 static const QLatin1String EP_TEXTURE_ANISOTROPY("TextureAnisotropy");
 static const QLatin1String EP_TEXTURE_FILTER_MODE("TextureFilterMode");
 static const QLatin1String EP_TEXTURE_QUALITY("TextureQuality");
+static const QLatin1String EP_TICK_RATE("TickRate");
 static const QLatin1String EP_TIME_OUT("TimeOut");
 static const QLatin1String EP_TRIPLE_BUFFER("TripleBuffer");
 static const QLatin1String EP_VSYNC("VSync");
@@ -0,0 +1,79 @@
+#include <QTest>
+#include "../Engine.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
+#include "Lutefisk3D/Core/Timer.h"
+#include "Lutefisk3D/Engine/EngineDefs.h"
+
+namespace
+{
+unsigned numUpdates = 0;
+void CountUpdate(float timeStep)
+{
+    Q_UNUSED(timeStep);
+    ++numUpdates;
+}
+}
+
+class EngineTickTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyTickRateRange() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Engine> engine(new Urho3D::Engine(&context));
+        QVERIFY(engine->SetTickRate(60));
+        QCOMPARE(engine->GetTickRate(), 60U);
+        // Out of range rates are rejected and leave the current rate in place
+        QVERIFY(!engine->SetTickRate(5000000));
+        QCOMPARE(engine->GetTickRate(), 60U);
+        // A negative command line value wraps around when read as unsigned
+        QVERIFY(!engine->SetTickRate(unsigned(-20)));
+        QCOMPARE(engine->GetTickRate(), 60U);
+
+        Urho3D::VariantMap parameters = Urho3D::Engine::ParseParameters(QStringList() << "-tickrate" << "abc");
+        QCOMPARE(parameters[Urho3D::EP_TICK_RATE].GetInt(), -1);
+        parameters = Urho3D::Engine::ParseParameters(QStringList() << "-tickrate" << "30");
+        QCOMPARE(parameters[Urho3D::EP_TICK_RATE].GetInt(), 30);
+    }
+    void verifyTickPacing() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Engine> engine(new Urho3D::Engine(&context));
+        Urho3D::g_coreSignals.update.Connect(&CountUpdate);
+        engine->SetTickRate(100);
+
+        // Ticks keep to the rate without drifting, although each sleep may wake up a little late
+        numUpdates = 0;
+        Urho3D::HiresTimer timer;
+        while (numUpdates < 50)
+            engine->RunFixedTicks();
+        const long long elapsed = timer.GetUSec(false);
+        QVERIFY(elapsed >= 490000LL && elapsed < 750000LL);
+        QCOMPARE(engine->GetDroppedTicks(), 0U);
+        Urho3D::g_coreSignals.update.Disconnect(&CountUpdate);
+    }
+    void verifyDroppedTicks() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Engine> engine(new Urho3D::Engine(&context));
+        Urho3D::g_coreSignals.update.Connect(&CountUpdate);
+        engine->SetTickRate(100);
+        engine->SetMaxTickCatchUp(2);
+
+        // Runs at least the one tick it waits for
+        numUpdates = 0;
+        engine->RunFixedTicks();
+        QVERIFY(numUpdates >= 1 && numUpdates <= 2);
+        QCOMPARE(engine->GetDroppedTicks(), 0U);
+
+        // A stall of about 20 ticks is caught up by at most 2 ticks, the rest of the backlog is dropped
+        Urho3D::Time::Sleep(200);
+        numUpdates = 0;
+        engine->RunFixedTicks();
+        QCOMPARE(numUpdates, 2U);
+        QVERIFY(engine->GetDroppedTicks() >= 15);
+        QVERIFY(engine->GetTickTimePercentile(50.0f) >= 0);
+        Urho3D::g_coreSignals.update.Disconnect(&CountUpdate);
+    }
+};
+
+QTEST_MAIN(EngineTickTests)
+#include "EngineTickTests.moc"
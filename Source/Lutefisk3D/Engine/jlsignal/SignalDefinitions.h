@@ -127,6 +127,12 @@ public:
         return isConnected( Delegate(pObject, fpMethod) );
     }
 
+    // Returns the number of connections to this signal.
+    unsigned CountConnections() const
+    {
+        return m_oConnections.size();
+    }
+
     void operator()( Types... p1 ) const
     {
         for ( const Connection &conn : m_oConnections )
@@ -39,7 +39,8 @@ Geometry::Geometry(Context* context) :
     vertexCount_(0),
     lodDistance_(0.0f),
     rawVertexSize_(0),
-    rawIndexSize_(0)
+    rawIndexSize_(0),
+    dataVersion_(GetNextDataVersion())
 {
     SetNumVertexBuffers(1);
 }
@@ -56,6 +57,7 @@ bool Geometry::SetNumVertexBuffers(unsigned num)
         return false;
     }
 
+    dataVersion_ = GetNextDataVersion();
     vertexBuffers_.resize(num);
 
     return true;
@@ -68,6 +70,7 @@ bool Geometry::SetVertexBuffer(unsigned index, VertexBuffer* buffer)
         URHO3D_LOGERROR("Stream index out of bounds");
         return false;
     }
+    dataVersion_ = GetNextDataVersion();
     vertexBuffers_[index] = buffer;
 
     return true;
@@ -75,6 +78,7 @@ bool Geometry::SetVertexBuffer(unsigned index, VertexBuffer* buffer)
 
 void Geometry::SetIndexBuffer(IndexBuffer* buffer)
 {
+    dataVersion_ = GetNextDataVersion();
     indexBuffer_ = buffer;
 }
 
@@ -94,6 +98,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
         return false;
     }
 
+    dataVersion_ = GetNextDataVersion();
     primitiveType_ = type;
     indexStart_ = indexStart;
     indexCount_ = indexCount;
@@ -136,6 +141,7 @@ bool Geometry::SetDrawRange(PrimitiveType type, unsigned indexStart, unsigned in
         indexCount = 0;
     }
 
+    dataVersion_ = GetNextDataVersion();
     primitiveType_ = type;
     indexStart_ = indexStart;
     indexCount_ = indexCount;
@@ -155,6 +161,7 @@ void Geometry::SetLodDistance(float distance)
 
 void Geometry::SetRawVertexData(SharedArrayPtr<uint8_t> data, const std::vector<VertexElement>& elements)
 {
+    dataVersion_ = GetNextDataVersion();
     rawVertexData_ = data;
     rawVertexSize_ = VertexBuffer::GetVertexSize(elements);
     rawElements_ = elements;
@@ -162,6 +169,7 @@ void Geometry::SetRawVertexData(SharedArrayPtr<uint8_t> data, const std::vector<
 
 void Geometry::SetRawVertexData(SharedArrayPtr<uint8_t> data, unsigned elementMask)
 {
+    dataVersion_ = GetNextDataVersion();
     rawVertexData_ = data;
     rawVertexSize_ = VertexBuffer::GetVertexSize(elementMask);
     rawElements_ = VertexBuffer::GetElements(elementMask);
@@ -169,6 +177,7 @@ void Geometry::SetRawVertexData(SharedArrayPtr<uint8_t> data, unsigned elementMa
 
 void Geometry::SetRawIndexData(SharedArrayPtr<uint8_t> data, unsigned indexSize)
 {
+    dataVersion_ = GetNextDataVersion();
     rawIndexData_ = data;
     rawIndexSize_ = indexSize;
 }
@@ -192,6 +201,19 @@ VertexBuffer* Geometry::GetVertexBuffer(unsigned index) const
 {
     return index < vertexBuffers_.size() ? vertexBuffers_[index] : nullptr;
 }
+unsigned Geometry::GetDataVersion() const
+{
+    // All versions come from one increasing counter, so the latest change has the largest version
+    unsigned version = dataVersion_;
+    for (const SharedPtr<VertexBuffer>& buffer : vertexBuffers_)
+    {
+        if (buffer)
+            version = Max(version, buffer->GetDataVersion());
+    }
+    if (indexBuffer_)
+        version = Max(version, indexBuffer_->GetDataVersion());
+    return version;
+}
 /// Return buffers' combined hash value for state sorting.
 unsigned short Geometry::GetBufferHash() const
 {
@@ -100,6 +100,8 @@ public:
     bool IsInside(const Ray& ray) const;
     /// Return whether has empty draw range.
     bool IsEmpty() const { return indexCount_ == 0 && vertexCount_ == 0; }
+    /// Return data version, which changes whenever the buffers, draw range or raw data change, including the data in the buffers.
+    unsigned GetDataVersion() const;
 
 private:
     std::vector<SharedPtr<VertexBuffer>> vertexBuffers_; //!< Vertex buffers.
@@ -115,5 +117,6 @@ private:
     SharedArrayPtr<uint8_t>              rawIndexData_;  //!< Raw index data override.
     unsigned                             rawVertexSize_; //!< Raw vertex data override size.
     unsigned                             rawIndexSize_;  //!< Raw index data override size.
+    unsigned                             dataVersion_;   //!< Version of the geometry's own state.
 };
 }
@@ -24,6 +24,8 @@
 #include "Lutefisk3D/Math/StringHash.h"
 #include "Lutefisk3D/Math/Vector3.h"
 
+#include <atomic>
+
 namespace Urho3D
 {
 // The extern keyword is required when building Urho3D.dll for Windows platform
@@ -116,4 +118,10 @@ extern LUTEFISK3D_EXPORT const unsigned ELEMENT_TYPESIZES[] =
     sizeof(unsigned),
     sizeof(unsigned)
 };
+
+unsigned GetNextDataVersion()
+{
+    static std::atomic<unsigned> nextVersion{1};
+    return nextVersion++;
+}
 }
@@ -215,6 +215,9 @@ extern LUTEFISK3D_EXPORT const unsigned ELEMENT_TYPESIZES[];
 /// Vertex element definitions for the legacy elements.
 extern LUTEFISK3D_EXPORT const VertexElement LEGACY_VERTEXELEMENTS[];
 
+/// Return a new geometry data version, different from all returned before. Thread-safe.
+LUTEFISK3D_EXPORT unsigned GetNextDataVersion();
+
 /// Texture filtering mode.
 enum TextureFilterMode : unsigned
 {
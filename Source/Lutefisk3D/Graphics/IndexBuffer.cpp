@@ -43,7 +43,8 @@ IndexBuffer::IndexBuffer(Context* context, bool forceHeadless) :
     lockScratchData_(nullptr),
     dynamic_(false),
     shadowed_(false),
-    discardLock_(false)
+    discardLock_(false),
+    dataVersion_(GetNextDataVersion())
 {
     // Force shadowing mode if graphics subsystem does not exist
     if (!graphics_)
@@ -85,6 +86,7 @@ bool IndexBuffer::SetSize(size_t indexCount, bool largeIndices, bool dynamic)
     else
         shadowData_.Reset();
 
+    dataVersion_ = GetNextDataVersion();
     return Create();
 }
 
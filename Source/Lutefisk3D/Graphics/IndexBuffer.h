@@ -81,6 +81,8 @@ public:
     unsigned char* GetShadowData() const { return shadowData_.get(); }
     /// Return shared array pointer to the CPU memory shadow data.
     SharedArrayPtr<unsigned char> GetShadowDataShared() const { return shadowData_; }
+    /// Return data version, which changes whenever the buffer is resized or its data is set.
+    unsigned GetDataVersion() const { return dataVersion_; }
 
 private:
     /// Create buffer.
@@ -112,6 +114,8 @@ private:
     bool shadowed_;
     /// Discard lock flag. Used by OpenGL only.
     bool discardLock_;
+    /// Data version.
+    unsigned dataVersion_;
 };
 /*
 struct IndexBufferManager : public HandleManager<IndexBuffer> {
@@ -63,7 +63,8 @@ unsigned LookupIndexBuffer(IndexBuffer* buffer, const std::vector<SharedPtr<Inde
 }
 
 Model::Model(Context* context) :
-    ResourceWithMetadata(context)
+    ResourceWithMetadata(context),
+    dataVersion_(GetNextDataVersion())
 {
 }
 
@@ -362,6 +363,7 @@ bool Model::EndLoad()
     loadVBData_.clear();
     loadIBData_.clear();
     loadGeometries_.clear();
+    dataVersion_ = GetNextDataVersion();
     return true;
 }
 
@@ -539,6 +541,7 @@ bool Model::SetIndexBuffers(const std::vector<SharedPtr<IndexBuffer> >& buffers)
 
 void Model::SetNumGeometries(unsigned num)
 {
+    dataVersion_ = GetNextDataVersion();
     geometries_.resize(num);
     geometryBoneMappings_.resize(num);
     geometryCenters_.resize(num);
@@ -565,6 +568,7 @@ bool Model::SetNumGeometryLodLevels(unsigned index, unsigned num)
     }
 
     geometries_[index].resize(num);
+    dataVersion_ = GetNextDataVersion();
     return true;
 }
 
@@ -582,6 +586,7 @@ bool Model::SetGeometry(unsigned index, unsigned lodLevel, Geometry* geometry)
     }
 
     geometries_[index][lodLevel] = geometry;
+    dataVersion_ = GetNextDataVersion();
     return true;
 }
 
@@ -168,6 +168,8 @@ public:
     Geometry* GetGeometry(unsigned index, unsigned lodLevel) const;
     /// Return geometry center by index.
     const Vector3& GetGeometryCenter(unsigned index) const { return index < geometryCenters_.size() ? geometryCenters_[index] : Vector3::ZERO; }
+    /// Return data version, which changes when the model is reloaded or its geometries are replaced. Changes inside a geometry are versioned by the geometry.
+    unsigned GetDataVersion() const { return dataVersion_; }
     /// Return geometery bone mappings.
     const std::vector<std::vector<unsigned> >& GetGeometryBoneMappings() const { return geometryBoneMappings_; }
     /// Return vertex morphs.
@@ -212,6 +214,8 @@ private:
     std::vector<IndexBufferDesc> loadIBData_;
     /// Geometry definitions for asynchronous loading.
     std::vector<std::vector<GeometryDesc> > loadGeometries_;
+    /// Data version.
+    unsigned dataVersion_;
 };
 
 }
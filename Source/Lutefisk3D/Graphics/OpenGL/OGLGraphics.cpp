@@ -1857,6 +1857,9 @@ uint32_t Graphics::GetFormat(CompressedFormat format) const
     case CF_DXT5:
         return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 
+    case CF_BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+
     default:
         return GL_NONE;
     }
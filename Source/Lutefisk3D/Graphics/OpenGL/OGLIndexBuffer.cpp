@@ -82,6 +82,7 @@ bool IndexBuffer::SetData(const void* data)
         return false;
     }
 
+    dataVersion_ = GetNextDataVersion();
     if (shadowData_ && data != shadowData_.get())
         memcpy(shadowData_.get(), data, indexCount_ * indexSize_);
 
@@ -129,6 +130,7 @@ bool IndexBuffer::SetDataRange(const void* data, unsigned start, unsigned count,
     if (!count)
         return true;
 
+    dataVersion_ = GetNextDataVersion();
     if (shadowData_ && shadowData_.get() + start * indexSize_ != data)
         memcpy(shadowData_.get() + start * indexSize_, data, count * indexSize_);
 
@@ -153,7 +153,7 @@ bool Texture::GetParametersDirty() const
 bool Texture::IsCompressed() const
 {
     return format_ == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || format_ == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT ||
-        format_ == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ;
+        format_ == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format_ == GL_COMPRESSED_RG_RGTC2;
 }
 
 unsigned Texture::GetRowDataSize(int width) const
@@ -195,6 +195,7 @@ unsigned Texture::GetRowDataSize(int width) const
 
     case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
     case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    case GL_COMPRESSED_RG_RGTC2:
         return (unsigned)(((width + 3) >> 2) * 16);
     default:
         return 0;
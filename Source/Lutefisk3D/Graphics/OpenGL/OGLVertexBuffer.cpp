@@ -88,6 +88,7 @@ bool VertexBuffer::SetData(const void* data)
         return false;
     }
 
+    dataVersion_ = GetNextDataVersion();
     if (shadowData_ && data != shadowData_.get())
         memcpy(shadowData_.get(), data, vertexCount_ * vertexSize_);
 
@@ -135,6 +136,7 @@ bool VertexBuffer::SetDataRange(const void* data, unsigned start, unsigned count
     if (!count)
         return true;
 
+    dataVersion_ = GetNextDataVersion();
     if (shadowData_ && shadowData_.get() + start * vertexSize_ != data)
         memcpy(shadowData_.get() + start * vertexSize_, data, count * vertexSize_);
 
@@ -43,6 +43,7 @@
 #include "Lutefisk3D/Graphics/Technique.h"
 #include "Lutefisk3D/Graphics/Texture2D.h"
 #include "Lutefisk3D/Graphics/TextureCube.h"
+#include "Lutefisk3D/Graphics/TextureStreamer.h"
 #include "Lutefisk3D/Graphics/VertexBuffer.h"
 #include "Lutefisk3D/Graphics/View.h"
 #include "Lutefisk3D/Resource/XMLFile.h"
@@ -393,7 +394,8 @@ inline std::vector<VertexElement> CreateInstancingBufferElements(unsigned numExt
 Renderer::Renderer(Context* context) :
     SignalObserver(context->observerAllocator()),
     m_context(context),
-    defaultZone_(new Zone(context))
+    defaultZone_(new Zone(context)),
+    textureStreamer_(new TextureStreamer(context))
 {
     g_graphicsSignals.newScreenMode.Connect(this,&Renderer::HandleScreenMode);
 
@@ -801,6 +803,9 @@ void Renderer::Update(float timeStep)
 
     queuedViewports_.clear();
     resetViews_ = false;
+
+    // The views have requested the texture levels they need, load or drop levels accordingly
+    textureStreamer_->Update(frame_.frameNumber_);
 }
 
 /// Render. Called by Engine.
@@ -51,6 +51,7 @@ class Technique;
 class Texture;
 class Texture2D;
 class TextureCube;
+class TextureStreamer;
 class VertexBuffer;
 class View;
 class Zone;
@@ -292,6 +293,8 @@ public:
     Zone* GetDefaultZone() const { return defaultZone_.get(); }
     /// Return the default material.
     Material* GetDefaultMaterial() const { return defaultMaterial_.get(); }
+    /// Return the texture mip level streamer.
+    TextureStreamer* GetTextureStreamer() const { return textureStreamer_.get(); }
     /// Return the default range attenuation texture.
     Texture2D* GetDefaultLightRamp() const { return defaultLightRamp_; }
     /// Return the default spotlight attenuation texture.
@@ -363,6 +366,7 @@ private:
     std::unique_ptr<Geometry>               pointLightGeometry_;
     std::unique_ptr<VertexBuffer> instancingBuffer_;
     std::unique_ptr<Material> defaultMaterial_;
+    std::unique_ptr<TextureStreamer> textureStreamer_;
     SharedPtr<Texture2D> defaultLightRamp_;
     SharedPtr<Texture2D> defaultLightSpot_;
     SharedPtr<TextureCube> faceSelectCubeMap_;
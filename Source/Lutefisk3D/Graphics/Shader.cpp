@@ -174,9 +174,27 @@ bool Shader::ProcessSource(QString& code, Deserializer& source)
     if (source.GetName() != GetName())
         cache->StoreResourceDependency(this, source.GetName());
 
-    while (!source.IsEof())
+    // Memory-resident sources are split into lines in place instead of being read byte by byte
+    unsigned viewSize = source.GetSize() - source.GetPosition();
+    const char* view = (const char*)source.ReadMapped(viewSize);
+    unsigned viewPos = 0;
+
+    while (view ? viewPos < viewSize : !source.IsEof())
     {
-        QString line = source.ReadLine();
+        QString line;
+        if (view)
+        {
+            unsigned lineEnd = viewPos;
+            while (lineEnd < viewSize && view[lineEnd] != 10 && view[lineEnd] != 13)
+                ++lineEnd;
+            line = QString::fromLatin1(view + viewPos, lineEnd - viewPos);
+            // Skip the line break, treating CR LF as one
+            viewPos = lineEnd + 1;
+            if (viewPos < viewSize && view[lineEnd] == 13 && view[viewPos] == 10)
+                ++viewPos;
+        }
+        else
+            line = source.ReadLine();
 
         if (line.startsWith("#include"))
         {
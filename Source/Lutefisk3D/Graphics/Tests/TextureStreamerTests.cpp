@@ -0,0 +1,93 @@
+#include <QTest>
+#include "../Texture2D.h"
+#include "../TextureStreamer.h"
+#include "Lutefisk3D/Core/Context.h"
+
+namespace
+/// Streamer that finishes level loads immediately instead of loading the images on the work queue.
+/// Streamer that finishes level loads immediately instead of going through the background loader.
+class ImmediateTextureStreamer : public Urho3D::TextureStreamer
+{
+public:
+    ImmediateTextureStreamer(Urho3D::Context* context) : TextureStreamer(context) {}
+    unsigned numLoadCalls_ = 0;
+
+protected:
+    void LoadLevels(Urho3D::StreamedTexture& entry, unsigned level) override
+    {
+        Q_UNUSED(level);
+        ++numLoadCalls_;
+        LevelsLoaded(entry.texture_.Get(), true);
+    }
+};
+const uint64_t LEVEL0_SIZE = 2048 * 2048 * 4;
+}
+
+class TextureStreamerTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyInitialLevel() {
+        Urho3D::Context context;
+        ImmediateTextureStreamer streamer(&context);
+        Urho3D::SharedPtr<Urho3D::Texture2D> texture(new Urho3D::Texture2D(&context));
+        QCOMPARE(streamer.AddTexture(texture, 2048, 2048, 12, LEVEL0_SIZE), 3U);
+        QCOMPARE(streamer.GetResidentLevel(texture), 3U);
+        // The texture quality setting limits the most detailed level
+        streamer.SetInitialSize(4096);
+        QCOMPARE(streamer.AddTexture(texture, 2048, 2048, 12, LEVEL0_SIZE, 1), 1U);
+    }
+    void verifyScreenSizeRequest() {
+        Urho3D::Context context;
+        ImmediateTextureStreamer streamer(&context);
+        Urho3D::SharedPtr<Urho3D::Texture2D> texture(new Urho3D::Texture2D(&context));
+        streamer.AddTexture(texture, 2048, 2048, 12, LEVEL0_SIZE);
+        streamer.RequestScreenSize(texture, 600.0f);
+        streamer.Update(1);
+        QCOMPARE(streamer.numLoadCalls_, 1U);
+        QCOMPARE(streamer.GetResidentLevel(texture), 1U);
+        QCOMPARE(streamer.GetNumLoads(), 0U);
+        // Requesting less detail keeps the resident levels while there is no memory pressure
+        streamer.RequestScreenSize(texture, 100.0f);
+        streamer.Update(2);
+        QCOMPARE(streamer.numLoadCalls_, 1U);
+        QCOMPARE(streamer.GetResidentLevel(texture), 1U);
+    }
+    void verifyBudgetAndExpiry() {
+        Urho3D::Context context;
+        ImmediateTextureStreamer streamer(&context);
+        streamer.SetKeepFrames(2);
+        Urho3D::SharedPtr<Urho3D::Texture2D> nearTexture(new Urho3D::Texture2D(&context));
+        Urho3D::SharedPtr<Urho3D::Texture2D> farTexture(new Urho3D::Texture2D(&context));
+        streamer.AddTexture(nearTexture, 2048, 2048, 12, LEVEL0_SIZE);
+        streamer.AddTexture(farTexture, 2048, 2048, 12, LEVEL0_SIZE);
+        streamer.RequestLevel(nearTexture, 0);
+        streamer.RequestLevel(farTexture, 0);
+        streamer.Update(1);
+        QCOMPARE(streamer.GetResidentLevel(farTexture), 0U);
+
+        // Only one of the textures fits at full resolution. The texture no longer requested gives up its levels
+        streamer.SetMemoryBudget(Urho3D::TextureStreamer::GetLevelsMemory(LEVEL0_SIZE, 12, 0) +
+                                 Urho3D::TextureStreamer::GetLevelsMemory(LEVEL0_SIZE, 12, 1));
+        streamer.RequestLevel(nearTexture, 0);
+        streamer.Update(2);
+        QCOMPARE(streamer.GetResidentLevel(nearTexture), 0U);
+        QCOMPARE(streamer.GetResidentLevel(farTexture), 1U);
+        QVERIFY(streamer.GetResidentMemory() <= streamer.GetMemoryBudget());
+
+        // After the keep period the unrequested texture falls back to its initial levels
+        for (unsigned frame = 3; frame < 6; ++frame)
+        {
+            streamer.RequestLevel(nearTexture, 0);
+            streamer.Update(frame);
+        }
+        QCOMPARE(streamer.GetResidentLevel(farTexture), 3U);
+
+        // Expired textures are no longer streamed
+        farTexture.Reset();
+        streamer.Update(6);
+        QCOMPARE(streamer.GetNumTextures(), 1U);
+    }
+};
+
+QTEST_MAIN(TextureStreamerTests)
+#include "TextureStreamerTests.moc"
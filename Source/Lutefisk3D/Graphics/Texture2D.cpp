@@ -27,6 +27,7 @@
 #include "GraphicsImpl.h"
 #include "Renderer.h"
 #include "RenderSurface.h"
+#include "TextureStreamer.h"
 
 #include "Lutefisk3D/Core/Context.h"
 #include "Lutefisk3D/Core/Profiler.h"
@@ -37,6 +38,7 @@
 #include "Lutefisk3D/Resource/XMLFile.h"
 
 #include <GL/glew.h>
+#include <vector>
 
 namespace Urho3D
 {
@@ -102,6 +104,11 @@ bool Texture2D::EndLoad()
     CheckTextureBudget(GetTypeStatic());
 
     SetParameters(loadParameters_);
+    // Static textures start with their low resolution levels when streamed
+    Renderer* renderer = context_->m_Renderer.get();
+    TextureStreamer* streamer = renderer ? renderer->GetTextureStreamer() : nullptr;
+    if (streamer && streamer->IsEnabled() && usage_ == TEXTURE_STATIC)
+        streamingLevel_ = streamer->AddTexture(this, loadImage_);
     bool success = SetData(loadImage_);
 
     loadImage_.Reset();
@@ -270,7 +277,8 @@ bool Texture2D::SetData(Urho3D::Image *image, bool useAlpha)
         GLenum format = GL_NONE;
 
         // Discard unnecessary mip levels
-        for (unsigned i = 0; i < mipsToSkip_[quality]; ++i)
+        unsigned mipsToSkip = Max(mipsToSkip_[quality], streamingLevel_);
+        for (unsigned i = 0; i < mipsToSkip; ++i)
         {
             mipImage = image->GetNextLevel();
             image = mipImage;
@@ -338,7 +346,7 @@ bool Texture2D::SetData(Urho3D::Image *image, bool useAlpha)
             needDecompress = true;
         }
 
-        unsigned mipsToSkip = mipsToSkip_[quality];
+        unsigned mipsToSkip = Max(mipsToSkip_[quality], streamingLevel_);
         if (mipsToSkip >= levels)
             mipsToSkip = levels - 1;
         while (mipsToSkip && (width / (1 << mipsToSkip) < 4 || height / (1 << mipsToSkip) < 4))
@@ -360,7 +368,7 @@ bool Texture2D::SetData(Urho3D::Image *image, bool useAlpha)
             else
             {
                 unsigned char* rgbaData = new unsigned char[level.width_ * level.height_ * 4];
-                level.Decompress(rgbaData);
+                level.Decompress(rgbaData, context_->m_WorkQueueSystem.get());
                 SetData(i, 0, 0, level.width_, level.height_, rgbaData);
                 memoryUse += level.width_ * level.height_ * 4;
                 delete[] rgbaData;
@@ -417,6 +425,47 @@ bool Texture2D::GetData(unsigned level, void* dest) const
     return true;
 }
 
+/// Drop the most detailed levels of a static texture, keeping the rest. The remaining levels are read back from the GPU
+/// and the texture is recreated from them, so no image needs to be loaded. Return true if successful. Fails on OpenGL ES,
+/// which can not read texture data back; the caller then has to reload the image.
+bool Texture2D::DropLevels(unsigned numLevels)
+{
+    if (!numLevels)
+        return true;
+    if (!object_ || usage_ != TEXTURE_STATIC || numLevels >= levels_)
+        return false;
+#ifdef GL_ES_VERSION_2_0
+    return false;
+#endif
+
+    URHO3D_PROFILE(DropTextureLevels);
+
+    const unsigned remainingLevels = levels_ - numLevels;
+    std::vector<std::vector<unsigned char> > levelData(remainingLevels);
+    for (unsigned i = 0; i < remainingLevels; ++i)
+    {
+        levelData[i].resize(GetDataSize(GetLevelWidth(numLevels + i), GetLevelHeight(numLevels + i)));
+        if (!GetData(numLevels + i, levelData[i].data()))
+            return false;
+    }
+
+    const int width = GetLevelWidth(numLevels);
+    const int height = GetLevelHeight(numLevels);
+    SetNumLevels(remainingLevels);
+    if (!SetSize(width, height, format_, usage_))
+        return false;
+
+    unsigned memoryUse = sizeof(Texture2D);
+    for (unsigned i = 0; i < remainingLevels && i < levels_; ++i)
+    {
+        SetData(i, 0, 0, GetLevelWidth(i), GetLevelHeight(i), levelData[i].data());
+        memoryUse += levelData[i].size();
+    }
+    SetMemoryUse(memoryUse);
+    streamingLevel_ += numLevels;
+    return true;
+}
+
 bool Texture2D::Create()
 {
     Release();
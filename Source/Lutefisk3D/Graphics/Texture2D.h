@@ -51,10 +51,15 @@ public:
     bool SetData(unsigned level, int x, int y, int width, int height, const void* data);
     bool SetData(Image *image, bool useAlpha = false);
     bool GetData(unsigned level, void* dest) const;
+    bool DropLevels(unsigned numLevels);
     /// Get image data from zero mip level. Only RGB and RGBA textures are supported.
     SharedPtr<Image> GetImage() const;
+    /// Set most detailed level used when the texture is created from an image. Used by texture streaming.
+    void SetStreamingLevel(unsigned level) { streamingLevel_ = level; }
     /// Return render surface.
     RenderSurface* GetRenderSurface() const { return renderSurface_; }
+    /// Return most detailed level used when the texture is created from an image.
+    unsigned GetStreamingLevel() const { return streamingLevel_; }
 
 protected:
     /// Create the GPU texture.
@@ -69,6 +74,8 @@ private:
     SharedPtr<Image> loadImage_;
     /// Parameter file acquired during BeginLoad.
     SharedPtr<XMLFile> loadParameters_;
+    /// Mip levels to skip when created from an image, in addition to the texture quality setting.
+    unsigned streamingLevel_ = 0;
 };
 
 }
@@ -0,0 +1,386 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Lutefisk3D/Graphics/TextureStreamer.h"
+
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/Graphics/Renderer.h"
+#include "Lutefisk3D/Graphics/Texture2D.h"
+#include "Lutefisk3D/IO/File.h"
+#include "Lutefisk3D/IO/Log.h"
+#include "Lutefisk3D/Resource/Image.h"
+#include "Lutefisk3D/Resource/ResourceCache.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace Urho3D
+{
+
+/// Image load of a streamed texture. The image is private to the streamer and never enters the resource cache.
+struct TextureLevelLoad
+{
+    /// Texture the levels are for, null if the texture stopped streaming before the load finished.
+    Texture2D* texture_;
+    /// Resource name of the image.
+    QString name_;
+    /// Image being loaded.
+    SharedPtr<Image> image_;
+    /// Success flag, valid once finished.
+    bool success_ = false;
+    /// Finished flag, set by the thread doing the load.
+    std::atomic<bool> finished_{false};
+};
+
+TextureStreamer::TextureStreamer(Context* context) :
+    m_context(context)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+/// Start streaming a texture loaded from an image. Return the most detailed level the texture should be created with.
+unsigned TextureStreamer::AddTexture(Texture2D* texture, Image* image)
+{
+    int quality = QUALITY_HIGH;
+    if (m_context->m_Renderer)
+        quality = m_context->m_Renderer->GetTextureQuality();
+    unsigned minLevel = (unsigned)texture->GetMipsToSkip(quality);
+    int width = image->GetWidth();
+    int height = image->GetHeight();
+
+    if (image->IsCompressed())
+    {
+        CompressedLevel level = image->GetCompressedLevel(0);
+        return AddTexture(texture, width, height, image->GetNumCompressedLevels(), (uint64_t)level.rows_ * level.rowSize_,
+                          minLevel);
+    }
+
+    // Images with one or two components are converted to RGBA when loaded to a texture
+    unsigned components = image->GetComponents() <= 2 ? 4 : image->GetComponents();
+    return AddTexture(texture, width, height, Texture::CheckMaxLevels(width, height, 0),
+                      (uint64_t)width * height * components, minLevel);
+}
+/// Start streaming a texture. Return the most detailed level the texture should be created with, which is the first
+/// level not larger than the initial size. Adding a texture again, e.g. on reload, restarts its streaming.
+unsigned TextureStreamer::AddTexture(Texture2D* texture, int width, int height, unsigned numLevels, uint64_t level0Size,
+                                     unsigned minLevel)
+{
+    RemoveTexture(texture);
+
+    StreamedTexture& entry = textures_[texture];
+    entry.texture_ = texture;
+    entry.name_ = texture->GetName();
+    entry.size_ = Max(width, height);
+    entry.numLevels_ = Max(numLevels, 1U);
+    entry.level0Size_ = level0Size;
+    entry.minLevel_ = Min(minLevel, entry.numLevels_ - 1);
+
+    unsigned level = entry.minLevel_;
+    while (level + 1 < entry.numLevels_ && (entry.size_ >> level) > initialSize_)
+        ++level;
+    entry.initialLevel_ = entry.residentLevel_ = entry.targetLevel_ = level;
+    entry.lastRequestFrame_ = frameNumber_;
+    return level;
+}
+/// Stop streaming a texture. Its resident levels stay as they are.
+void TextureStreamer::RemoveTexture(Texture2D* texture)
+{
+    auto i = textures_.find(texture);
+    if (i == textures_.end())
+        return;
+
+    if (MAP_VALUE(i).loadingLevel_ != M_MAX_UNSIGNED)
+    {
+        AbandonLevelLoad(texture);
+        --numLoads_;
+    }
+    textures_.erase(i);
+}
+/// Request a level of a texture for this frame. The most detailed of the levels requested during a frame is loaded.
+void TextureStreamer::RequestLevel(Texture2D* texture, unsigned level)
+{
+    auto i = textures_.find(texture);
+    if (i == textures_.end())
+        return;
+
+    StreamedTexture& entry = MAP_VALUE(i);
+    level = Clamp(level, entry.minLevel_, entry.numLevels_ - 1);
+    entry.requestedLevel_ = Min(entry.requestedLevel_, level);
+}
+/// Request the level of a texture matching an approximate on-screen size in pixels for this frame.
+void TextureStreamer::RequestScreenSize(Texture2D* texture, float screenSize)
+{
+    auto i = textures_.find(texture);
+    if (i == textures_.end())
+        return;
+
+    const StreamedTexture& entry = MAP_VALUE(i);
+    unsigned level = 0;
+    float levelSize = (float)entry.size_;
+    while (level + 1 < entry.numLevels_ && levelSize * 0.5f >= screenSize)
+    {
+        levelSize *= 0.5f;
+        ++level;
+    }
+    RequestLevel(texture, level);
+}
+/// Decide the levels to keep within the memory budget from this frame's requests, and start loading the changed levels.
+/// Called by Renderer after the views have been updated.
+void TextureStreamer::Update(unsigned frameNumber)
+{
+    frameNumber_ = frameNumber;
+    FinishLevelLoads();
+    if (textures_.empty())
+        return;
+
+    URHO3D_PROFILE(UpdateTextureStreaming);
+
+    std::vector<StreamedTexture*> entries;
+    entries.reserve(textures_.size());
+    uint64_t targetMemory = 0;
+
+    for (auto i = textures_.begin(); i != textures_.end();)
+    {
+        StreamedTexture& entry = MAP_VALUE(i);
+        if (entry.texture_.Expired())
+        {
+            if (entry.loadingLevel_ != M_MAX_UNSIGNED)
+            {
+                AbandonLevelLoad(ELEMENT_KEY(i));
+                --numLoads_;
+            }
+            i = textures_.erase(i);
+            continue;
+        }
+
+        if (entry.failed_)
+            entry.targetLevel_ = entry.residentLevel_;
+        else if (entry.requestedLevel_ != M_MAX_UNSIGNED)
+        {
+            // More detailed levels already resident are only dropped if the budget needs the memory
+            entry.targetLevel_ = Min(entry.requestedLevel_, entry.residentLevel_);
+            entry.lastRequestFrame_ = frameNumber_;
+        }
+        else if (frameNumber_ - entry.lastRequestFrame_ > keepFrames_)
+            entry.targetLevel_ = Max(entry.residentLevel_, entry.initialLevel_);
+        else
+            entry.targetLevel_ = entry.residentLevel_;
+
+        targetMemory += GetLevelsMemory(entry.level0Size_, entry.numLevels_, entry.targetLevel_);
+        entries.push_back(&entry);
+        ++i;
+    }
+
+    if (memoryBudget_ && targetMemory > memoryBudget_)
+    {
+        // Take memory from the least recently requested, and then the largest textures first
+        std::sort(entries.begin(), entries.end(), [](const StreamedTexture* lhs, const StreamedTexture* rhs) {
+            if (lhs->lastRequestFrame_ != rhs->lastRequestFrame_)
+                return lhs->lastRequestFrame_ < rhs->lastRequestFrame_;
+            return lhs->level0Size_ > rhs->level0Size_;
+        });
+
+        // First drop the levels more detailed than requested, then if still needed also requested levels
+        for (unsigned pass = 0; pass < 2 && targetMemory > memoryBudget_; ++pass)
+        {
+            for (StreamedTexture* entry : entries)
+            {
+                if (entry->failed_)
+                    continue;
+                unsigned limit = entry->numLevels_ - 1;
+                if (pass == 0 && entry->requestedLevel_ != M_MAX_UNSIGNED)
+                    limit = entry->requestedLevel_;
+                while (targetMemory > memoryBudget_ && entry->targetLevel_ < limit)
+                {
+                    targetMemory -= GetLevelsMemory(entry->level0Size_, entry->numLevels_, entry->targetLevel_) -
+                            GetLevelsMemory(entry->level0Size_, entry->numLevels_, entry->targetLevel_ + 1);
+                    ++entry->targetLevel_;
+                }
+                if (targetMemory <= memoryBudget_)
+                    break;
+            }
+        }
+    }
+
+    // Dropping levels frees memory, so do those first, then load the textures missing the most detail
+    std::sort(entries.begin(), entries.end(), [](const StreamedTexture* lhs, const StreamedTexture* rhs) {
+        bool lhsDrop = lhs->targetLevel_ > lhs->residentLevel_;
+        bool rhsDrop = rhs->targetLevel_ > rhs->residentLevel_;
+        if (lhsDrop != rhsDrop)
+            return lhsDrop;
+        return (int)lhs->residentLevel_ - (int)lhs->targetLevel_ > (int)rhs->residentLevel_ - (int)rhs->targetLevel_;
+    });
+
+    for (StreamedTexture* entry : entries)
+    {
+        if (numLoads_ >= maxLoads_)
+            break;
+        if (entry->failed_ || entry->loadingLevel_ != M_MAX_UNSIGNED || entry->targetLevel_ == entry->residentLevel_)
+            continue;
+        entry->loadingLevel_ = entry->targetLevel_;
+        ++numLoads_;
+        LoadLevels(*entry, entry->targetLevel_);
+    }
+
+    for (StreamedTexture* entry : entries)
+        entry->requestedLevel_ = M_MAX_UNSIGNED;
+}
+/// Return streaming state of a texture, or null if not streamed.
+const StreamedTexture* TextureStreamer::GetTextureState(Texture2D* texture) const
+{
+    auto i = textures_.find(texture);
+    return i != textures_.end() ? &MAP_VALUE(i) : nullptr;
+}
+/// Return most detailed resident level of a texture, or 0 if not streamed.
+unsigned TextureStreamer::GetResidentLevel(Texture2D* texture) const
+{
+    const StreamedTexture* entry = GetTextureState(texture);
+    return entry ? entry->residentLevel_ : 0;
+}
+/// Return most detailed level of a texture wanted within the memory budget, or 0 if not streamed.
+unsigned TextureStreamer::GetTargetLevel(Texture2D* texture) const
+{
+    const StreamedTexture* entry = GetTextureState(texture);
+    return entry ? entry->targetLevel_ : 0;
+}
+/// Return memory use of the resident levels of all streamed textures.
+uint64_t TextureStreamer::GetResidentMemory() const
+{
+    uint64_t total = 0;
+    for (const auto& elem : textures_)
+        total += GetLevelsMemory(ELEMENT_VALUE(elem).level0Size_, ELEMENT_VALUE(elem).numLevels_, ELEMENT_VALUE(elem).residentLevel_);
+    return total;
+}
+/// Return memory use of a mip chain starting from a level.
+uint64_t TextureStreamer::GetLevelsMemory(uint64_t level0Size, unsigned numLevels, unsigned level)
+{
+    uint64_t total = 0;
+    for (unsigned i = level; i < numLevels && i < 32; ++i)
+        total += Max(level0Size >> (2 * i), (uint64_t)1);
+    return total;
+}
+/// Change the most detailed level of a texture. Dropping levels keeps the less detailed ones already on the GPU where they
+/// can be read back. Otherwise, and when adding levels, the image is loaded on the work queue and the texture is recreated
+/// from it once loaded.
+void TextureStreamer::LoadLevels(StreamedTexture& entry, unsigned level)
+{
+    Texture2D* texture = entry.texture_.Get();
+    if (level > entry.residentLevel_ && texture->DropLevels(level - entry.residentLevel_))
+    {
+        LevelsLoaded(texture, true);
+        return;
+    }
+
+    // The image may be in the cache already, for example when it is also used as a heightmap
+    ResourceCache* cache = m_context->resourceCache();
+    Image* image = cache->GetExistingResource<Image>(entry.name_);
+    if (image)
+    {
+        ApplyLevels(entry, image);
+        return;
+    }
+
+    std::shared_ptr<TextureLevelLoad> load = std::make_shared<TextureLevelLoad>();
+    load->texture_ = texture;
+    load->name_ = entry.name_;
+    load->image_ = new Image(m_context);
+    levelLoads_.push_back(load);
+
+    auto work = [cache, load]() {
+        std::unique_ptr<File> file = cache->GetFile(load->name_, false);
+        load->success_ = file && load->image_->Load(*file);
+        load->finished_ = true;
+    };
+    // Low priority work, the more levels missing the sooner
+    WorkQueue* queue = m_context->m_WorkQueueSystem.get();
+    if (queue)
+        queue->AddWorkItem(work, entry.residentLevel_ > level ? entry.residentLevel_ - level : 0);
+    else
+        work();
+}
+/// Finish a level load started by LoadLevels().
+void TextureStreamer::LevelsLoaded(Texture2D* texture, bool success)
+{
+    auto i = textures_.find(texture);
+    if (i == textures_.end())
+        return;
+
+    StreamedTexture& entry = MAP_VALUE(i);
+    if (entry.loadingLevel_ == M_MAX_UNSIGNED)
+        return;
+
+    if (success)
+        entry.residentLevel_ = entry.loadingLevel_;
+    else
+    {
+        URHO3D_LOGWARNING("Could not load levels of texture " + entry.name_ + ", stopped streaming it");
+        entry.failed_ = true;
+    }
+    entry.loadingLevel_ = M_MAX_UNSIGNED;
+    --numLoads_;
+}
+/// Recreate a texture from an image with the level being loaded as the most detailed.
+void TextureStreamer::ApplyLevels(StreamedTexture& entry, Image* image)
+{
+    Texture2D* texture = entry.texture_.Get();
+    texture->SetStreamingLevel(entry.loadingLevel_);
+    LevelsLoaded(texture, texture->SetData(image));
+}
+/// Upload the images of the finished level loads.
+void TextureStreamer::FinishLevelLoads()
+{
+    for (auto i = levelLoads_.begin(); i != levelLoads_.end();)
+    {
+        TextureLevelLoad& load = **i;
+        if (!load.finished_)
+        {
+            ++i;
+            continue;
+        }
+
+        auto j = load.texture_ ? textures_.find(load.texture_) : textures_.end();
+        if (j != textures_.end() && !MAP_VALUE(j).texture_.Expired())
+        {
+            if (load.success_)
+                ApplyLevels(MAP_VALUE(j), load.image_);
+            else
+                LevelsLoaded(load.texture_, false);
+        }
+        // The image was only needed for the upload. Loads still running keep theirs until finished
+        i = levelLoads_.erase(i);
+    }
+}
+/// Discard the result of the level load of a texture that stopped streaming.
+void TextureStreamer::AbandonLevelLoad(Texture2D* texture)
+{
+    for (const std::shared_ptr<TextureLevelLoad>& load : levelLoads_)
+    {
+        if (load->texture_ == texture)
+            load->texture_ = nullptr;
+    }
+}
+
+}
@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "Lutefisk3D/Core/Lutefisk3D.h"
+#include "Lutefisk3D/Container/HashMap.h"
+#include "Lutefisk3D/Container/Ptr.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <QtCore/QString>
+#include <memory>
+
+namespace Urho3D
+{
+class Context;
+class Image;
+class Texture2D;
+struct TextureLevelLoad;
+
+/// Streaming state of a texture. Mip levels are counted in the full resolution image, level 0 being the most detailed.
+struct StreamedTexture
+{
+    WeakPtr<Texture2D> texture_;               ///< Texture.
+    QString name_;                              ///< Resource name the levels are loaded from.
+    int size_ = 0;                              ///< Larger dimension of the full resolution image.
+    unsigned numLevels_ = 1;                    ///< Number of levels in the full mip chain.
+    uint64_t level0Size_ = 0;                   ///< Memory use of the full resolution level.
+    unsigned minLevel_ = 0;                     ///< Most detailed level allowed by the texture quality setting.
+    unsigned initialLevel_ = 0;                 ///< Level the texture falls back to when no longer requested.
+    unsigned residentLevel_ = 0;                ///< Most detailed level resident.
+    unsigned requestedLevel_ = M_MAX_UNSIGNED;  ///< Most detailed level requested by the views this frame, M_MAX_UNSIGNED if none.
+    unsigned targetLevel_ = 0;                  ///< Most detailed level wanted within the memory budget.
+    unsigned loadingLevel_ = M_MAX_UNSIGNED;    ///< Level being loaded, M_MAX_UNSIGNED if none.
+    unsigned lastRequestFrame_ = 0;             ///< Frame the texture was last requested on.
+    bool failed_ = false;                       ///< Loading the levels failed; streaming is stopped for the texture.
+};
+
+/// Streams the mip levels of 2D textures. Textures are created with their low resolution levels only, and the views
+/// request more detailed levels according to the screen size of the objects using them. The levels are loaded on the work
+/// queue into images owned by the streamer, and the levels of textures no longer in view are dropped from the GPU
+/// textures to stay within a memory budget.
+class LUTEFISK3D_EXPORT TextureStreamer
+{
+public:
+    /// Construct.
+    TextureStreamer(Context* context);
+    /// Destruct.
+    virtual ~TextureStreamer();
+
+    /// Enable or disable streaming. Only affects textures loaded afterwards. Default disabled.
+    void SetEnabled(bool enable) { enabled_ = enable; }
+    /// Set memory budget of the streamed textures, 0 if unlimited.
+    void SetMemoryBudget(uint64_t budget) { memoryBudget_ = budget; }
+    /// Set the maximum size of the levels textures are initially loaded with.
+    void SetInitialSize(int size) { initialSize_ = Max(size, 1); }
+    /// Set maximum number of level loads in progress at the same time.
+    void SetMaxLoads(unsigned num) { maxLoads_ = Max(num, 1U); }
+    /// Set number of frames levels stay resident after the texture was last requested.
+    void SetKeepFrames(unsigned frames) { keepFrames_ = frames; }
+
+    unsigned AddTexture(Texture2D* texture, Image* image);
+    unsigned AddTexture(Texture2D* texture, int width, int height, unsigned numLevels, uint64_t level0Size, unsigned minLevel = 0);
+    void RemoveTexture(Texture2D* texture);
+    void RequestLevel(Texture2D* texture, unsigned level);
+    void RequestScreenSize(Texture2D* texture, float screenSize);
+    void Update(unsigned frameNumber);
+
+    /// Return whether streaming is enabled.
+    bool IsEnabled() const { return enabled_; }
+    /// Return memory budget of the streamed textures, 0 if unlimited.
+    uint64_t GetMemoryBudget() const { return memoryBudget_; }
+    /// Return the maximum size of the levels textures are initially loaded with.
+    int GetInitialSize() const { return initialSize_; }
+    /// Return maximum number of level loads in progress at the same time.
+    unsigned GetMaxLoads() const { return maxLoads_; }
+    /// Return number of frames levels stay resident after the texture was last requested.
+    unsigned GetKeepFrames() const { return keepFrames_; }
+    /// Return number of streamed textures.
+    unsigned GetNumTextures() const { return textures_.size(); }
+    /// Return number of level loads in progress.
+    unsigned GetNumLoads() const { return numLoads_; }
+    const StreamedTexture* GetTextureState(Texture2D* texture) const;
+    unsigned GetResidentLevel(Texture2D* texture) const;
+    unsigned GetTargetLevel(Texture2D* texture) const;
+    uint64_t GetResidentMemory() const;
+
+    static uint64_t GetLevelsMemory(uint64_t level0Size, unsigned numLevels, unsigned level);
+
+protected:
+    /// Start loading a texture with the given most detailed level. LevelsLoaded() must be called once finished.
+    virtual void LoadLevels(StreamedTexture& entry, unsigned level);
+    void LevelsLoaded(Texture2D* texture, bool success);
+
+private:
+    void ApplyLevels(StreamedTexture& entry, Image* image);
+    void FinishLevelLoads();
+    void AbandonLevelLoad(Texture2D* texture);
+
+    Context* m_context;
+    /// Streamed textures.
+    HashMap<Texture2D*, StreamedTexture> textures_;
+    /// Image loads in progress on the work queue, including those of removed textures that have not finished yet.
+    std::vector<std::shared_ptr<TextureLevelLoad> > levelLoads_;
+    /// Memory budget, 0 if unlimited.
+    uint64_t memoryBudget_ = 0;
+    /// Maximum size of the initially loaded levels.
+    int initialSize_ = 256;
+    /// Maximum number of level loads in progress.
+    unsigned maxLoads_ = 4;
+    /// Number of level loads in progress.
+    unsigned numLoads_ = 0;
+    /// Frames to keep levels resident after the last request.
+    unsigned keepFrames_ = 60;
+    /// Current frame number.
+    unsigned frameNumber_ = 0;
+    /// Streaming enabled flag.
+    bool enabled_ = false;
+};
+
+}
@@ -41,7 +41,8 @@ VertexBuffer::VertexBuffer(Context* context, bool forceHeadless) :
     lockScratchData_(nullptr),
     dynamic_(false),
     shadowed_(false),
-    discardLock_(false)
+    discardLock_(false),
+    dataVersion_(GetNextDataVersion())
 {
     UpdateOffsets();
 
@@ -92,6 +93,7 @@ bool VertexBuffer::SetSize(unsigned vertexCount, const std::vector<VertexElement
     else
         shadowData_.Reset();
 
+    dataVersion_ = GetNextDataVersion();
     return Create();
 }
 
@@ -56,7 +56,8 @@ public:
         lockScratchData_(std::move(rhs.lockScratchData_)),
         dynamic_(std::move(rhs.dynamic_)),
         shadowed_(std::move(rhs.shadowed_)),
-        discardLock_(std::move(rhs.discardLock_))
+        discardLock_(std::move(rhs.discardLock_)),
+        dataVersion_(rhs.dataVersion_)
     {
         rhs.vertexCount_ = 0;
         rhs.vertexSize_ = 0;
@@ -69,6 +70,7 @@ public:
         rhs.dynamic_ = 0;
         rhs.shadowed_ = 0;
         rhs.discardLock_ = 0;
+        rhs.dataVersion_ = GetNextDataVersion();
     }
     VertexBuffer& operator = (VertexBuffer&& rhs) {
         if (this != &rhs) {
@@ -85,6 +87,7 @@ public:
             dynamic_ = std::move(rhs.dynamic_);
             shadowed_ = std::move(rhs.shadowed_);
             discardLock_ = std::move(rhs.discardLock_);
+            dataVersion_ = rhs.dataVersion_;
 
             rhs.vertexCount_ = 0;
             rhs.vertexSize_ = 0;
@@ -97,6 +100,7 @@ public:
             rhs.dynamic_ = 0;
             rhs.shadowed_ = 0;
             rhs.discardLock_ = 0;
+            rhs.dataVersion_ = GetNextDataVersion();
         }
         return  *this;
     }
@@ -173,6 +177,8 @@ public:
     unsigned char* GetShadowData() const { return shadowData_.get(); }
     /// Return shared array pointer to the CPU memory shadow data.
     SharedArrayPtr<unsigned char> GetShadowDataShared() const { return shadowData_; }
+    /// Return data version, which changes whenever the buffer is resized or its data is set.
+    unsigned GetDataVersion() const { return dataVersion_; }
 
     /// Return buffer hash for building vertex declarations. Used internally.
     uint64_t GetBufferHash(unsigned streamIndex) { return elementHash_ << (streamIndex * 16); }
@@ -234,6 +240,8 @@ private:
     bool shadowed_;
     /// Discard lock flag. Used by OpenGL only.
     bool discardLock_;
+    /// Data version.
+    unsigned dataVersion_;
 };
 //struct VertexBufferManager : public HandleManager<VertexBuffer> {
 //    Handle build(Context *ctx,bool shadowed,unsigned count,unsigned elementMask,const float *data) {
@@ -39,6 +39,7 @@
 #include "Texture2DArray.h"
 #include "Texture3D.h"
 #include "TextureCube.h"
+#include "TextureStreamer.h"
 #include "VertexBuffer.h"
 #include "Core/Profiler.h"
 #include "Core/WorkQueue.h"
@@ -1016,6 +1017,10 @@ void View::GetDrawables()
     if (minZ_ == M_INFINITY)
         minZ_ = 0.0f;
 
+    TextureStreamer* streamer = renderer_->GetTextureStreamer();
+    if (streamer->IsEnabled() && streamer->GetNumTextures())
+        RequestTextureLevels(streamer);
+
     // Sort the lights to brightest/closest first, and per-vertex lights first so that per-vertex base pass can be evaluated first
     for (Light* light : lights_)
     {
@@ -1026,6 +1031,37 @@ void View::GetDrawables()
     std::sort(lights_.begin(), lights_.end(), CompareLights);
 }
 
+/// Request texture mip levels matching the screen size of the visible geometries from the texture streamer.
+void View::RequestTextureLevels(TextureStreamer* streamer)
+{
+    URHO3D_PROFILE(RequestTextureLevels);
+
+    // Approximate the screen size of a texture by the size of the geometry's bounding box, so that a texture mapped once
+    // over the geometry gets about one texel per pixel
+    float pixelsPerUnit = viewSize_.y_ * 0.5f / cullCamera_->GetHalfViewSize();
+    bool orthographic = cullCamera_->getProjectionType() != PT_PERSPECTIVE;
+    float nearClip = cullCamera_->GetNearClip();
+
+    for (Drawable* drawable : geometries_)
+    {
+        const BoundingBox& box = drawable->GetWorldBoundingBox();
+        float size = box.Size().Length();
+        float distance = orthographic ? 1.0f : Max(cullCamera_->GetDistance(box.Center()) - size * 0.5f, nearClip);
+        float screenSize = size * pixelsPerUnit / distance;
+
+        for (const SourceBatch& batch : drawable->GetBatches())
+        {
+            if (!batch.material_)
+                continue;
+            for (const SharedPtr<Texture>& texture : batch.material_->GetTextures())
+            {
+                if (texture && texture->GetType() == Texture2D::GetTypeStatic())
+                    streamer->RequestScreenSize(static_cast<Texture2D*>(texture.Get()), screenSize);
+            }
+        }
+    }
+}
+
 void View::GetBatches()
 {
     if (!octree_ || !cullCamera_)
@@ -46,6 +46,7 @@ class RenderSurface;
 class Technique;
 class Texture;
 class Texture2D;
+class TextureStreamer;
 class Viewport;
 class Zone;
 struct RenderPathCommand;
@@ -155,6 +156,8 @@ public:
 private:
     /// Query the octree for drawable objects.
     void GetDrawables();
+    /// Request texture mip levels for the visible geometries.
+    void RequestTextureLevels(TextureStreamer* streamer);
     /// Construct batches from the drawable objects.
     void GetBatches();
     /// Get lit geometries and shadowcasters for visible lights.
@@ -59,6 +59,17 @@ unsigned Deserializer::GetChecksum()
     return 0;
 }
 
+const unsigned char* Deserializer::ReadMapped(unsigned size)
+{
+    const unsigned char* data = GetMappedData();
+    if (!data || size > size_ - position_)
+        return nullptr;
+
+    data += position_;
+    Seek(position_ + size);
+    return data;
+}
+
 int64_t Deserializer::ReadInt64()
 {
     int64_t ret;
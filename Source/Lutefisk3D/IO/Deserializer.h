@@ -69,6 +69,10 @@ public:
     virtual unsigned GetChecksum();
     /// Return whether the end of stream has been reached.
     virtual bool IsEof() const { return position_ >= size_; }
+    /// Return pointer to the whole stream contents if they reside contiguously in memory, or null if they must be read.
+    virtual const unsigned char* GetMappedData() const { return nullptr; }
+    /// Return a view to the next bytes without copying and advance the position, or null if the stream is not memory-resident or the size exceeds the remaining data.
+    const unsigned char* ReadMapped(unsigned size);
     /// Set position relative to current position. Return actual new position.
     unsigned SeekRelative(int delta);
     /// Return current position.
@@ -29,11 +29,13 @@
 #include "PackageFile.h"
 #include "Lutefisk3D/Core/Profiler.h"
 #include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
 #include "Lutefisk3D/Container/Str.h"
 #include "Lutefisk3D/Container/ArrayPtr.h"
 
 #include <QFile>
 #include <QDebug>
+#include <atomic>
 #include <cstdio>
 #include <LZ4/lz4.h>
 
@@ -49,6 +51,8 @@ QFile::OpenMode openMode[] = {
 };
 
 static const unsigned SKIP_BUFFER_SIZE = 1024;
+/// Minimum number of blocks decompressed by each thread when a read is split across the work queue.
+static const unsigned MIN_PARALLEL_BLOCKS = 8;
 
 File::File(Context* context) :
     context_(context)
@@ -147,6 +151,31 @@ bool File::Open(PackageFile* package, const QString& fileName)
     if (!entry)
         return false;
 
+    fileName_ = fileName;
+    mode_ = FILE_READ;
+    offset_ = entry->offset_;
+    checksum_ = entry->checksum_;
+    position_ = 0;
+    size_ = entry->size_;
+    compressed_ = package->IsCompressed();
+    readSyncNeeded_ = false;
+    writeSyncNeeded_ = false;
+    blockSize_ = package->GetBlockSize();
+
+    // Entries of a mapped package are served from the mapping without opening a file handle
+    if (package->IsMapped())
+    {
+        mappedPackage_ = package;
+        mappedPackage_->AddMappedFile();
+        mappedData_ = package->GetMappedData() + offset_;
+        if (blockSize_ && !ReadBlockIndex())
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
     QFile *tmp = new QFile(package->GetName());
     handle_=nullptr;
     if(!tmp->open(QFile::ReadOnly)) {
@@ -157,27 +186,25 @@ bool File::Open(PackageFile* package, const QString& fileName)
     if (!handle_)
     {
         URHO3D_LOGERROR("Could not open package file " + fileName);
+        offset_ = 0;
+        checksum_ = 0;
+        size_ = 0;
         return false;
     }
 
-    fileName_ = fileName;
-    mode_ = FILE_READ;
-    offset_ = entry->offset_;
-    checksum_ = entry->checksum_;
-    position_ = 0;
-    size_ = entry->size_;
-    compressed_ = package->IsCompressed();
-    readSyncNeeded_ = false;
-    writeSyncNeeded_ = false;
-
     // Seek to beginning of package entry's file data
     ((QFile *)handle_)->seek(offset_);
+    if (blockSize_ && !ReadBlockIndex())
+    {
+        Close();
+        return false;
+    }
     return true;
 }
 
 unsigned File::Read(void* dest, unsigned size)
 {
-    if (!handle_)
+    if (!IsOpen())
     {
         // If file not open, do not log the error further here to prevent spamming the stderr stream
         return 0;
@@ -194,6 +221,16 @@ unsigned File::Read(void* dest, unsigned size)
     if (!size)
         return 0;
 
+    if (blockSize_)
+        return ReadBlocks(dest, size);
+
+    if (mappedData_)
+    {
+        memcpy(dest, mappedData_ + position_, size);
+        position_ += size;
+        return size;
+    }
+
     if (compressed_)
     {
         unsigned sizeLeft = size;
@@ -258,7 +295,7 @@ unsigned File::Read(void* dest, unsigned size)
 
 unsigned File::Seek(unsigned position)
 {
-    if (!handle_)
+    if (!IsOpen())
     {
         // If file not open, do not log the error further here to prevent spamming the stderr stream
         return 0;
@@ -268,6 +305,13 @@ unsigned File::Seek(unsigned position)
     if (mode_ == FILE_READ && position > size_)
         position = size_;
 
+    // Memory-mapped and block-compressed entries allow random access, the block is decompressed on the next read
+    if (mappedData_ || blockSize_)
+    {
+        position_ = position;
+        return position_;
+    }
+
     if (compressed_)
     {
         // Start over from the beginning
@@ -342,7 +386,7 @@ unsigned File::GetChecksum()
 {
     if (offset_ || checksum_)
         return checksum_;
-    if (!handle_ || mode_ == FILE_WRITE)
+    if (!IsOpen() || mode_ == FILE_WRITE)
         return 0;
 
     URHO3D_PROFILE(CalculateFileChecksum);
@@ -368,11 +412,24 @@ void File::Close()
     readBuffer_.reset();
     inputBuffer_.reset();
 
-    if (handle_)
+    if (handle_ || mappedData_)
     {
-        ((QFile *)handle_)->close();
-        delete ((QFile *)handle_);
-        handle_ = nullptr;
+        if (handle_)
+        {
+            ((QFile *)handle_)->close();
+            delete ((QFile *)handle_);
+            handle_ = nullptr;
+        }
+        mappedData_ = nullptr;
+        if (mappedPackage_)
+        {
+            mappedPackage_->RemoveMappedFile();
+            mappedPackage_ = nullptr;
+        }
+        preloadData_.reset();
+        blockOffsets_.clear();
+        blockSize_ = 0;
+        currentBlock_ = M_MAX_UNSIGNED;
         position_ = 0;
         size_ = 0;
         offset_ = 0;
@@ -380,6 +437,37 @@ void File::Close()
     }
 }
 
+bool File::Preload()
+{
+    if (!IsOpen() || mode_ != FILE_READ)
+        return false;
+    // Uncompressed contents of a mapped package are already in memory
+    if (mappedData_ && !compressed_)
+        return true;
+
+    std::unique_ptr<uint8_t[]> data(new uint8_t[size_]);
+    unsigned oldPos = position_;
+    Seek(0);
+    if (Read(data.get(), size_) != size_)
+        return false;
+
+    if (handle_)
+    {
+        ((QFile *)handle_)->close();
+        delete ((QFile *)handle_);
+        handle_ = nullptr;
+    }
+    readBuffer_.reset();
+    inputBuffer_.reset();
+    blockOffsets_.clear();
+    blockSize_ = 0;
+    compressed_ = false;
+    preloadData_ = std::move(data);
+    mappedData_ = preloadData_.get();
+    position_ = oldPos;
+    return true;
+}
+
 void File::Flush()
 {
     if (handle_)
@@ -393,7 +481,7 @@ void File::SetName(const QString& name)
 
 bool File::IsOpen() const
 {
-    return handle_ != nullptr;
+    return handle_ != nullptr || mappedData_ != nullptr;
 }
 void File::ReadText(QString& text)
 {
@@ -402,6 +490,13 @@ void File::ReadText(QString& text)
     if (!size_)
         return;
 
+    if (const unsigned char* mapped = GetMappedData())
+    {
+        text = QString::fromUtf8((const char*)mapped, size_);
+        position_ = size_;
+        return;
+    }
+
     QByteArray tgt;
     tgt.resize(size_);
     Read((void*)tgt.data(), size_);
@@ -417,10 +512,160 @@ bool File::Copy(File* srcFile)
         return false;
 
     unsigned fileSize = srcFile->GetSize();
+    // Write a memory-mapped source directly
+    if (const unsigned char* mapped = srcFile->GetMappedData())
+        return Write(mapped, fileSize) == fileSize;
+
     SharedArrayPtr<uint8_t> buffer(new uint8_t[fileSize]);
 
     unsigned bytesRead = srcFile->Read(buffer.get(), fileSize);
     unsigned bytesWritten = Write(buffer.get(), fileSize);
     return bytesRead == fileSize && bytesWritten == fileSize;
 }
+
+bool File::ReadBlockIndex()
+{
+    unsigned numBlocks = (unsigned)(((unsigned long long)size_ + blockSize_ - 1) / blockSize_);
+    unsigned long long indexSize = (unsigned long long)numBlocks * sizeof(unsigned);
+    unsigned long long packageSize = mappedPackage_ ? mappedPackage_->GetTotalSize() : ((QFile *)handle_)->size();
+    if (offset_ + indexSize > packageSize)
+    {
+        URHO3D_LOGERROR("Block index of package entry " + fileName_ + " extends outside package file");
+        return false;
+    }
+
+    std::vector<unsigned> packedSizes(numBlocks);
+    if (mappedData_)
+        memcpy(packedSizes.data(), mappedData_, indexSize);
+    else if (((QFile *)handle_)->read((char *)packedSizes.data(), indexSize) != (qint64)indexSize)
+    {
+        URHO3D_LOGERROR("Could not read block index of package entry " + fileName_);
+        return false;
+    }
+
+    // Blocks follow the index; a block whose packed size equals its unpacked size is stored uncompressed, so a packed
+    // block can never be larger than the block size
+    blockOffsets_.resize(numBlocks + 1);
+    unsigned long long blockOffset = indexSize;
+    for (unsigned i = 0; i < numBlocks; ++i)
+    {
+        if (packedSizes[i] > blockSize_)
+        {
+            URHO3D_LOGERROR(QString("Invalid size of block %1 in package entry %2").arg(i).arg(fileName_));
+            return false;
+        }
+        blockOffsets_[i] = (unsigned)blockOffset;
+        blockOffset += packedSizes[i];
+    }
+    if (offset_ + blockOffset > packageSize)
+    {
+        URHO3D_LOGERROR("Package entry " + fileName_ + " extends outside package file");
+        return false;
+    }
+    blockOffsets_[numBlocks] = (unsigned)blockOffset;
+
+    readBuffer_.reset(new uint8_t[blockSize_]);
+    if (!mappedData_)
+        inputBuffer_.reset(new uint8_t[blockSize_]);
+    currentBlock_ = M_MAX_UNSIGNED;
+    return true;
+}
+
+unsigned File::ReadBlocks(void* dest, unsigned size)
+{
+    uint8_t* destPtr = (uint8_t*)dest;
+    unsigned sizeLeft = size;
+    unsigned numBlocks = blockOffsets_.size() - 1;
+
+    while (sizeLeft)
+    {
+        unsigned block = position_ / blockSize_;
+        unsigned blockPosition = position_ - block * blockSize_;
+
+        // Decompress whole blocks straight to the destination. The last block counts as whole when reading up to the end
+        if (!blockPosition)
+        {
+            unsigned readEnd = position_ + sizeLeft;
+            unsigned endBlock = readEnd == size_ ? numBlocks : readEnd / blockSize_;
+            if (endBlock > block)
+            {
+                if (!DecompressBlocks(block, endBlock - block, destPtr))
+                    return size - sizeLeft;
+
+                unsigned copySize = Min(endBlock * blockSize_, size_) - position_;
+                destPtr += copySize;
+                sizeLeft -= copySize;
+                position_ += copySize;
+                continue;
+            }
+        }
+
+        if (block != currentBlock_)
+        {
+            if (!DecompressBlock(block, readBuffer_.get()))
+                return size - sizeLeft;
+            currentBlock_ = block;
+        }
+
+        unsigned copySize = Min(Min(blockSize_, size_ - block * blockSize_) - blockPosition, sizeLeft);
+        memcpy(destPtr, readBuffer_.get() + blockPosition, copySize);
+        destPtr += copySize;
+        sizeLeft -= copySize;
+        position_ += copySize;
+    }
+
+    return size;
+}
+
+bool File::DecompressBlocks(unsigned first, unsigned count, unsigned char* dest)
+{
+    std::atomic<bool> success(true);
+    const auto decompress = [this, first, dest, &success](unsigned start, unsigned end) {
+        for (unsigned i = start; i < end && success; ++i)
+        {
+            if (!DecompressBlock(first + i, dest + i * blockSize_))
+                success = false;
+        }
+    };
+
+    // Worker threads read the mapping directly. Reads through the file handle share the input buffer and stay serial
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    if (mappedData_ && queue)
+    {
+        URHO3D_PROFILE(DecompressPackageBlocks);
+        queue->ProcessRange(count, MIN_PARALLEL_BLOCKS, decompress);
+    }
+    else
+        decompress(0, count);
+    return success;
+}
+
+bool File::DecompressBlock(unsigned index, unsigned char* dest)
+{
+    unsigned packedSize = blockOffsets_[index + 1] - blockOffsets_[index];
+    unsigned unpackedSize = Min(blockSize_, size_ - index * blockSize_);
+    const uint8_t* src;
+
+    if (mappedData_)
+        src = mappedData_ + blockOffsets_[index];
+    else
+    {
+        if (packedSize > blockSize_ || !((QFile *)handle_)->seek(offset_ + blockOffsets_[index]) ||
+            ((QFile *)handle_)->read((char *)inputBuffer_.get(), packedSize) != packedSize)
+        {
+            URHO3D_LOGERROR("Error while reading from file " + fileName_);
+            return false;
+        }
+        src = inputBuffer_.get();
+    }
+
+    if (packedSize == unpackedSize)
+        memcpy(dest, src, unpackedSize);
+    else if (LZ4_decompress_safe((const char*)src, (char*)dest, packedSize, unpackedSize) != (int)unpackedSize)
+    {
+        URHO3D_LOGERROR(QString("Corrupt compressed block %1 in package entry %2").arg(index).arg(fileName_));
+        return false;
+    }
+    return true;
+}
 }
@@ -22,9 +22,12 @@
 
 #pragma once
 
+#include "Lutefisk3D/Container/Ptr.h"
 #include "Lutefisk3D/Container/RefCounted.h"
 #include "Lutefisk3D/IO/AbstractFile.h"
+#include "Lutefisk3D/Math/MathDefs.h"
 #include <QtCore/QString>
+#include <vector>
 
 namespace Urho3D
 {
@@ -67,6 +70,8 @@ public:
     bool Open(const QString& fileName, FileMode mode = FILE_READ);
     /// Open from within a package file. Return true if successful.
     bool Open(PackageFile* package, const QString& fileName);
+    /// Read the whole contents of a file opened for reading to memory, decompressing if necessary, and close the file handle. Later reads are served from memory. Return true if successful.
+    bool Preload();
     /// Close the file.
     void Close();
     /// Flush any buffered output to the file.
@@ -78,8 +83,10 @@ public:
     FileMode GetMode() const { return mode_; }
     /// Return whether is open.
     bool IsOpen() const;
-    /// Return the file handle.
+    /// Return the file handle. Null for a package entry read from the memory-mapped package.
     void* GetHandle() const { return handle_; }
+    /// Return the entry contents when read from a memory-mapped package, or null otherwise.
+    const unsigned char* GetMappedData() const override { return compressed_ ? nullptr : mappedData_; }
     /// Return whether the file originates from a package.
     bool IsPackaged() const { return offset_ != 0; }
 
@@ -99,6 +106,14 @@ private:
     bool ReadInternal(void* dest, unsigned size);
     /// Seek in file internally using either C standard IO functions or SDL RWops for Android asset files.
     void SeekInternal(unsigned newPosition);
+    /// Read the block index of a block-compressed package entry. Return true if successful.
+    bool ReadBlockIndex();
+    /// Read from a block-compressed package entry. Return number of bytes actually read.
+    unsigned ReadBlocks(void* dest, unsigned size);
+    /// Decompress consecutive blocks to the destination, using the work queue for large spans. Return true if successful.
+    bool DecompressBlocks(unsigned first, unsigned count, unsigned char* dest);
+    /// Decompress one block to the destination. Return true if successful. Thread-safe when reading from a memory-mapped package.
+    bool DecompressBlock(unsigned index, unsigned char* dest);
     Context* context_;
     /// File name.
     QString fileName_;
@@ -114,6 +129,18 @@ private:
     unsigned readBufferOffset_=0;
     /// Bytes in the current read buffer.
     unsigned readBufferSize_=0;
+    /// Package whose memory mapping is read from. Registered with the package, which must outlive the file.
+    PackageFile* mappedPackage_=nullptr;
+    /// Entry contents within the memory-mapped package, or the preloaded contents.
+    const unsigned char* mappedData_=nullptr;
+    /// Contents read to memory by Preload().
+    std::unique_ptr<uint8_t[]> preloadData_;
+    /// Block offsets from the entry start in a block-compressed package, with the end of the last block as the last element.
+    std::vector<unsigned> blockOffsets_;
+    /// Uncompressed block size in a block-compressed package, 0 otherwise.
+    unsigned blockSize_=0;
+    /// Index of the block held in the read buffer.
+    unsigned currentBlock_=M_MAX_UNSIGNED;
     /// Start position within a package file, 0 for regular files.
     unsigned offset_=0;
     /// Content checksum.
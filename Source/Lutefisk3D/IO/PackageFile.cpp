@@ -25,6 +25,7 @@
 #include "Lutefisk3D/IO/PackageFile.h"
 #include "Lutefisk3D/Core/Variant.h"
 
+#include <QFile>
 #include <QFileInfo>
 namespace Urho3D
 {
@@ -35,7 +36,10 @@ PackageFile::PackageFile(Context* context) :
     totalSize_(0),
     totalDataSize_(0),
     checksum_(0),
-    compressed_(false)
+    compressed_(false),
+    blockSize_(0),
+    mappedData_(nullptr),
+    numMappedFiles_(0)
 {
 }
 
@@ -44,17 +48,35 @@ PackageFile::PackageFile(Context* context, const QString& fileName, unsigned sta
     totalSize_(0),
     totalDataSize_(0),
     checksum_(0),
-    compressed_(false)
+    compressed_(false),
+    blockSize_(0),
+    mappedData_(nullptr),
+    numMappedFiles_(0)
 {
     Open(fileName, startOffset);
 }
 
 PackageFile::~PackageFile()
 {
+    // Files still reading from the mapping would crash once it is gone; leak it instead
+    if (numMappedFiles_)
+    {
+        URHO3D_LOGERROR(QString("Package file %1 destroyed while %2 files are read from it").arg(fileName_).arg(numMappedFiles_.load()));
+        mappedFile_.release();
+    }
 }
 
 bool PackageFile::Open(const QString& fileName, unsigned startOffset)
 {
+    if (numMappedFiles_)
+    {
+        URHO3D_LOGERROR("Can not reopen package file " + fileName_ + " while files are read from it");
+        return false;
+    }
+
+    mappedData_ = nullptr;
+    mappedFile_.reset();
+
     SharedPtr<File> file(new File(context_, fileName));
     if (!file->IsOpen())
         return false;
@@ -62,7 +84,7 @@ bool PackageFile::Open(const QString& fileName, unsigned startOffset)
     // Check ID, then read the directory
     file->Seek(startOffset);
     QString id = file->ReadFileID();
-    if (id != "UPAK" && id != "ULZ4")
+    if (id != "UPAK" && id != "ULZ4" && id != "ULZB")
     {
         // If start offset has not been explicitly specified, also try to read package size from the end of file
         // to know how much we must rewind to find the package start
@@ -79,7 +101,7 @@ bool PackageFile::Open(const QString& fileName, unsigned startOffset)
             }
         }
 
-        if (id != "UPAK" && id != "ULZ4")
+        if (id != "UPAK" && id != "ULZ4" && id != "ULZB")
         {
             URHO3D_LOGERROR(fileName + " is not a valid package file");
             return false;
@@ -89,10 +111,16 @@ bool PackageFile::Open(const QString& fileName, unsigned startOffset)
     fileName_ = fileName;
     nameHash_ = fileName_;
     totalSize_ = file->GetSize();
-    compressed_ = id == "ULZ4";
+    compressed_ = id == "ULZ4" || id == "ULZB";
 
     unsigned numFiles = file->ReadUInt();
     checksum_ = file->ReadUInt();
+    blockSize_ = id == "ULZB" ? file->ReadUInt() : 0;
+    if (id == "ULZB" && !blockSize_)
+    {
+        URHO3D_LOGERROR(fileName + " has an invalid compression block size");
+        return false;
+    }
 
     for (unsigned i = 0; i < numFiles; ++i)
     {
@@ -101,7 +129,12 @@ bool PackageFile::Open(const QString& fileName, unsigned startOffset)
         newEntry.offset_ = file->ReadUInt() + startOffset;
         totalDataSize_ += (newEntry.size_ = file->ReadUInt());
         newEntry.checksum_ = file->ReadUInt();
-        if (!compressed_ && newEntry.offset_ + newEntry.size_ > totalSize_)
+        // Stream-compressed entries have no known packed size, but must at least start inside the package. Block-compressed
+        // entries must fit their block index; the blocks themselves are checked against the package when opened
+        unsigned long long entryEnd = (unsigned long long)newEntry.offset_ + (compressed_ ? 0 : newEntry.size_);
+        if (blockSize_)
+            entryEnd += ((unsigned long long)newEntry.size_ + blockSize_ - 1) / blockSize_ * sizeof(unsigned);
+        if (entryEnd > totalSize_)
         {
             URHO3D_LOGERROR("File entry " + entryName + " outside package file");
             return false;
@@ -110,6 +143,19 @@ bool PackageFile::Open(const QString& fileName, unsigned startOffset)
             entries_[entryName] = newEntry;
     }
 
+    // Map uncompressed and block-compressed packages as a whole, so that entries can be read without going through the
+    // file handle. If mapping fails (e.g. address space exhausted), files fall back to regular reads
+    if (!compressed_ || blockSize_)
+    {
+        std::unique_ptr<QFile> mappedFile(new QFile(fileName));
+        if (mappedFile->open(QFile::ReadOnly))
+            mappedData_ = mappedFile->map(0, totalSize_);
+        if (mappedData_)
+            mappedFile_ = std::move(mappedFile);
+        else
+            URHO3D_LOGWARNING("Could not memory-map package file " + fileName);
+    }
+
     return true;
 }
 
@@ -25,6 +25,11 @@
 #include "Lutefisk3D/Core/Object.h"
 #include "Lutefisk3D/Container/Str.h"
 
+#include <atomic>
+#include <memory>
+
+class QFile;
+
 namespace Urho3D
 {
 
@@ -76,6 +81,18 @@ public:
     unsigned GetChecksum() const { return checksum_; }
     /// Return whether the files are compressed.
     bool IsCompressed() const { return compressed_; }
+    /// Return uncompressed size of the independently compressed blocks, or 0 if the package is not in the block-compressed format.
+    unsigned GetBlockSize() const { return blockSize_; }
+    /// Return the memory-mapped package file contents, or null if the package is not mapped. Uncompressed entries are read directly from the mapping.
+    const unsigned char* GetMappedData() const { return mappedData_; }
+    /// Return whether the package file is memory-mapped.
+    bool IsMapped() const { return mappedData_ != nullptr; }
+    /// Return number of open files reading from the memory mapping. The package must not be reopened or destroyed while nonzero.
+    unsigned GetNumMappedFiles() const { return numMappedFiles_; }
+    /// Register a file reading from the memory mapping. Thread-safe. Called by File.
+    void AddMappedFile() { ++numMappedFiles_; }
+    /// Unregister a file reading from the memory mapping. Thread-safe. Called by File.
+    void RemoveMappedFile() { --numMappedFiles_; }
     /// Return list of file names in the package.
     std::vector<QString> GetEntryNames() const;
     /// Return a file name in the package at the specified index
@@ -109,6 +126,14 @@ private:
     unsigned checksum_;
     /// Compressed flag.
     bool compressed_;
+    /// Block size of the block-compressed format, 0 for the uncompressed and the sequential LZ4 stream formats.
+    unsigned blockSize_;
+    /// File handle owning the memory mapping.
+    std::unique_ptr<QFile> mappedFile_;
+    /// Memory-mapped package file contents.
+    const unsigned char* mappedData_;
+    /// Number of open files reading from the memory mapping. Changed from any thread that opens or closes files.
+    std::atomic<unsigned> numMappedFiles_;
 };
 
 }
@@ -0,0 +1,219 @@
+#include <QTest>
+#include <QFile>
+#include <QTemporaryDir>
+#include "../Compression.h"
+#include "../File.h"
+#include "../PackageFile.h"
+#include "../VectorBuffer.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+
+namespace
+{
+const unsigned BLOCK_SIZE = 65536;
+const unsigned DATA_SIZE = 4 * 1024 * 1024 + 1000;
+const unsigned NUM_ENTRIES = 4000;
+const unsigned ENTRY_SIZE = 8192;
+
+/// Return data built from a small set of 8-byte words in random order, which compresses well but not trivially.
+QByteArray MakeData()
+{
+    QByteArray data(DATA_SIZE, 0);
+    unsigned seed = 1;
+    for (unsigned i = 0; i < DATA_SIZE; ++i)
+    {
+        if (!(i & 7))
+            seed = seed * 1103515245 + 12345;
+        data[i] = char(((seed >> 16) & 15) * 8 + (i & 7));
+    }
+    return data;
+}
+
+/// Build a block-compressed package holding one entry, laid out as written by PackageTool.
+QByteArray MakeBlockPackage(const QByteArray& data)
+{
+    using namespace Urho3D;
+    const unsigned numBlocks = (data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<unsigned> packedSizes;
+    VectorBuffer blocks;
+    std::vector<unsigned char> packed(EstimateCompressBound(BLOCK_SIZE));
+    for (unsigned i = 0; i < numBlocks; ++i)
+    {
+        const char* src = data.constData() + i * BLOCK_SIZE;
+        unsigned unpackedSize = std::min(BLOCK_SIZE, unsigned(data.size()) - i * BLOCK_SIZE);
+        unsigned packedSize = CompressData(packed.data(), src, unpackedSize);
+        if (packedSize && packedSize < unpackedSize)
+            blocks.Write(packed.data(), packedSize);
+        else
+            blocks.Write(src, packedSize = unpackedSize);
+        packedSizes.push_back(packedSize);
+    }
+
+    VectorBuffer header;
+    header.WriteFileID("ULZB");
+    header.WriteUInt(1);
+    header.WriteUInt(0x5eed);
+    header.WriteUInt(BLOCK_SIZE);
+    // PackageFile looks entries up by lowercase name
+    header.WriteString("data.bin");
+    const unsigned entryOffset = header.GetSize() + 3 * sizeof(unsigned);
+    header.WriteUInt(entryOffset);
+    header.WriteUInt(data.size());
+    header.WriteUInt(0);
+    for (unsigned packedSize : packedSizes)
+        header.WriteUInt(packedSize);
+    header.Write(blocks.GetData(), blocks.GetSize());
+    return QByteArray((const char*)header.GetData(), header.GetSize());
+}
+
+/// Build an uncompressed package of many small entries, like a directory of resources.
+QByteArray MakeEntriesPackage()
+{
+    using namespace Urho3D;
+    unsigned headerSize = 4 * sizeof(unsigned);
+    for (unsigned i = 0; i < NUM_ENTRIES; ++i)
+        headerSize += QString("entry%1.bin").arg(i).length() + 1 + 3 * sizeof(unsigned);
+
+    VectorBuffer package;
+    package.WriteFileID("UPAK");
+    package.WriteUInt(NUM_ENTRIES);
+    package.WriteUInt(0x5eed);
+    for (unsigned i = 0; i < NUM_ENTRIES; ++i)
+    {
+        package.WriteString(QString("entry%1.bin").arg(i));
+        package.WriteUInt(headerSize + i * ENTRY_SIZE);
+        package.WriteUInt(ENTRY_SIZE);
+        package.WriteUInt(0);
+    }
+    for (unsigned i = 0; i < NUM_ENTRIES * ENTRY_SIZE; ++i)
+        package.WriteUByte((unsigned char)(i * 31));
+    return QByteArray((const char*)package.GetData(), package.GetSize());
+}
+
+bool WriteFile(const QString& fileName, const QByteArray& contents)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && file.write(contents) == contents.size();
+}
+}
+
+class PackageFileTests : public QObject {
+    Q_OBJECT
+    QTemporaryDir dir_;
+    QByteArray data_;
+    QString packageName_;
+    QString entriesPackageName_;
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(dir_.isValid());
+        data_ = MakeData();
+        packageName_ = dir_.path() + "/Data.pak";
+        QVERIFY(WriteFile(packageName_, MakeBlockPackage(data_)));
+        entriesPackageName_ = dir_.path() + "/Entries.pak";
+        QVERIFY(WriteFile(entriesPackageName_, MakeEntriesPackage()));
+    }
+    void verifyBlockRead() {
+        Urho3D::Context context;
+        context.m_WorkQueueSystem.reset(new Urho3D::WorkQueue(&context));
+        context.m_WorkQueueSystem->CreateThreads(3);
+        Urho3D::SharedPtr<Urho3D::PackageFile> package(new Urho3D::PackageFile(&context, packageName_));
+        QVERIFY(package->IsMapped());
+        Urho3D::File file(&context, package, "Data.bin");
+        QVERIFY(file.IsOpen());
+
+        // A whole-entry read goes through the parallel path, a read from inside a block through the block cache
+        QByteArray contents(DATA_SIZE, 0);
+        QCOMPARE(file.Read(contents.data(), DATA_SIZE), DATA_SIZE);
+        QVERIFY(contents == data_);
+        file.Seek(BLOCK_SIZE * 3 + 17);
+        QByteArray part(BLOCK_SIZE, 0);
+        QCOMPARE(file.Read(part.data(), BLOCK_SIZE), BLOCK_SIZE);
+        QVERIFY(part == data_.mid(BLOCK_SIZE * 3 + 17, BLOCK_SIZE));
+    }
+    void verifyCorruptIndexRejected() {
+        Urho3D::Context context;
+        const QByteArray package = MakeBlockPackage(data_);
+        const int indexOffset = package.indexOf("data.bin") + 9 + 3 * sizeof(unsigned);
+
+        // Cut inside the block index: the entry no longer fits the package
+        const QString truncatedName = dir_.path() + "/Truncated.pak";
+        QVERIFY(WriteFile(truncatedName, package.left(indexOffset + 8)));
+        Urho3D::SharedPtr<Urho3D::PackageFile> truncated(new Urho3D::PackageFile(&context));
+        QVERIFY(!truncated->Open(truncatedName));
+
+        // A packed block size beyond the block size, which would make the offsets run past the package
+        QByteArray corrupt = package;
+        const unsigned hugeSize = 0xfffffff0;
+        memcpy(corrupt.data() + indexOffset, &hugeSize, sizeof hugeSize);
+        const QString corruptName = dir_.path() + "/Corrupt.pak";
+        QVERIFY(WriteFile(corruptName, corrupt));
+        Urho3D::SharedPtr<Urho3D::PackageFile> corruptPackage(new Urho3D::PackageFile(&context, corruptName));
+        Urho3D::File file(&context, corruptPackage, "Data.bin");
+        QVERIFY(!file.IsOpen());
+    }
+    void verifyMappedFilesKeepPackage() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::PackageFile> package(new Urho3D::PackageFile(&context, entriesPackageName_));
+        QVERIFY(package->IsMapped());
+        {
+            Urho3D::File file(&context, package, "entry1.bin");
+            QVERIFY(file.GetMappedData());
+            QCOMPARE(package->GetNumMappedFiles(), 1U);
+            // The mapping can not be replaced under an open file
+            QVERIFY(!package->Open(packageName_));
+            QCOMPARE(file.ReadUByte(), (unsigned char)(ENTRY_SIZE * 31));
+        }
+        QCOMPARE(package->GetNumMappedFiles(), 0U);
+        QVERIFY(package->Open(packageName_));
+    }
+    void benchmarkEntryReads_data() {
+        QTest::addColumn<bool>("mapped");
+        QTest::newRow("mapped") << true;
+        QTest::newRow("copied") << false;
+    }
+    void benchmarkEntryReads() {
+        // Opens the package and reads every entry, either in place from the mapping or copied to a buffer through a
+        // file handle, as without the mapping
+        QFETCH(bool, mapped);
+        Urho3D::Context context;
+        std::vector<unsigned char> buffer(ENTRY_SIZE);
+        unsigned sum = 0;
+        QBENCHMARK {
+            Urho3D::SharedPtr<Urho3D::PackageFile> package(new Urho3D::PackageFile(&context, entriesPackageName_));
+            Urho3D::File handle(&context, entriesPackageName_);
+            for (const auto& entry : package->GetEntries())
+            {
+                const unsigned char* data = buffer.data();
+                Urho3D::File file(&context);
+                if (mapped)
+                {
+                    file.Open(package, entry.first);
+                    data = file.GetMappedData();
+                }
+                else
+                {
+                    handle.Seek(entry.second.offset_);
+                    handle.Read(buffer.data(), entry.second.size_);
+                }
+                for (unsigned i = 0; i < entry.second.size_; i += 64)
+                    sum += data[i];
+            }
+        }
+        QVERIFY(sum > 0);
+    }
+    void benchmarkBlockRead() {
+        Urho3D::Context context;
+        context.m_WorkQueueSystem.reset(new Urho3D::WorkQueue(&context));
+        context.m_WorkQueueSystem->CreateThreads(3);
+        Urho3D::SharedPtr<Urho3D::PackageFile> package(new Urho3D::PackageFile(&context, packageName_));
+        QByteArray contents(DATA_SIZE, 0);
+        QBENCHMARK {
+            Urho3D::File file(&context, package, "Data.bin");
+            file.Read(contents.data(), DATA_SIZE);
+        }
+    }
+};
+
+QTEST_MAIN(PackageFileTests)
+#include "PackageFileTests.moc"
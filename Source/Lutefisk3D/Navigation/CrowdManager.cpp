@@ -23,6 +23,7 @@
 #include "Lutefisk3D/Scene/Component.h"
 #include "Lutefisk3D/Core/Context.h"
 #include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
 #include "Lutefisk3D/Graphics/DebugRenderer.h"
 #include "Lutefisk3D/IO/Log.h"
 #include "Lutefisk3D/Navigation/CrowdAgent.h"
@@ -74,6 +75,15 @@ void CrowdAgentUpdateCallback(dtCrowdAgent* ag, float dt)
     static_cast<CrowdAgent*>(ag->params.userData)->OnCrowdUpdate(ag, dt);
 }
 
+/// Run the parts of a crowd update phase on the work queue threads.
+static void CrowdParallelFor(void* userData, int count, void (*task)(void*, int), void* taskData)
+{
+    static_cast<WorkQueue*>(userData)->ProcessRange(count, 1, [task, taskData](unsigned start, unsigned end) {
+        for (unsigned i = start; i < end; ++i)
+            task(taskData, i);
+    });
+}
+
 CrowdManager::CrowdManager(Context* context) :
     Component(context),
     crowd_(nullptr),
@@ -415,6 +425,13 @@ void CrowdManager::FindPath(std::deque<Vector3>& dest, const Vector3& start, con
         navigationMesh_->FindPath(dest, start, end, Vector3(crowd_->getQueryExtents()), crowd_->getFilter(queryFilterType));
 }
 
+unsigned CrowdManager::FindPathAsync(const Vector3& start, const Vector3& end, int queryFilterType, const NavigationPathCallback& callback)
+{
+    if (crowd_ && navigationMesh_)
+        return navigationMesh_->FindPathAsync(start, end, callback, Vector3(crowd_->getQueryExtents()), crowd_->getFilter(queryFilterType));
+    return 0;
+}
+
 Vector3 CrowdManager::GetRandomPoint(int queryFilterType, dtPolyRef* randomRef)
 {
     if (randomRef)
@@ -595,6 +612,13 @@ bool CrowdManager::CreateCrowd()
         URHO3D_LOGERROR("Could not initialize DetourCrowd");
         return false;
     }
+    // Split the per-agent phases of the crowd update between the worker threads and the main thread
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    if (queue && queue->GetNumThreads())
+    {
+        if (!crowd_->setParallelFor(CrowdParallelFor, queue, queue->GetNumThreads() + 1))
+            URHO3D_LOGWARNING("Could not allocate the DetourCrowd queries for the worker threads, updating in the main thread only");
+    }
     if (recreate)
     {
         // Reconfigure the newly initialized crowd
@@ -23,6 +23,7 @@
 #pragma once
 #include "Lutefisk3D/Core/Lutefisk3D.h"
 #include "Lutefisk3D/Scene/Component.h"
+#include "Lutefisk3D/Navigation/NavigationMesh.h"
 
 #ifdef DT_POLYREF64
 typedef uint64_t dtPolyRef;
@@ -110,6 +111,8 @@ public:
     Vector3 MoveAlongSurface(const Vector3& start, const Vector3& end, int queryFilterType, int maxVisited = 3);
     /// Find a path between world space points using the crowd initialized query extent (based on maxAgentRadius) and the specified query filter type. Return non-empty list of points if successful.
     void FindPath(std::deque<Vector3> & dest, const Vector3& start, const Vector3& end, int queryFilterType);
+    /// Queue a path request between world space points using the crowd initialized query extent and the specified query filter type, searched on the work queue threads. Return the request ID, or 0 if the crowd is not initialized.
+    unsigned FindPathAsync(const Vector3& start, const Vector3& end, int queryFilterType, const NavigationPathCallback& callback);
     /// Return a random point on the navigation mesh using the crowd initialized query extent (based on maxAgentRadius) and the specified query filter type.
     Vector3 GetRandomPoint(int queryFilterType, dtPolyRef* randomRef = 0);
     /// Return a random point on the navigation mesh within a circle using the crowd initialized query extent (based on maxAgentRadius) and the specified query filter type. The circle radius is only a guideline and in practice the returned point may be further away.
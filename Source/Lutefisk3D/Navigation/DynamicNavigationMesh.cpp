@@ -211,6 +211,78 @@ struct LinearAllocator : public dtTileCacheAlloc
 };
 
 
+/// Build of the tile cache layers of one tile, applied to the tile cache on the main thread.
+struct DynamicTileBuild : public NavigationTileBuild
+{
+    /// Construct.
+    DynamicTileBuild(DynamicNavigationMesh* mesh) :
+        mesh_(mesh),
+        build_(mesh->allocator_.get())
+    {
+    }
+    /// Destruct. Free the layers that were not added to the tile cache.
+    ~DynamicTileBuild() override
+    {
+        for (int i = 0; i < numLayers_; ++i)
+            dtFree(layers_[i].data);
+    }
+
+    /// Build the compressed tile cache layers.
+    void Build() override
+    {
+        if (!empty_)
+            numLayers_ = mesh_->BuildTileLayers(build_, tile_.x_, tile_.y_, layers_);
+    }
+    /// Replace the layers of the tile in the tile cache and rebuild its navigation mesh tiles.
+    bool Apply() override
+    {
+        mesh_->WaitForPathSearches();
+        dtTileCache* tileCache = mesh_->tileCache_;
+        dtCompressedTileRef existing[TILECACHE_MAXLAYERS];
+        const int existingCt = tileCache->getTilesAt(tile_.x_, tile_.y_, existing, mesh_->maxLayers_);
+        for (int i = 0; i < existingCt; ++i)
+        {
+            unsigned char* data = 0x0;
+            if (!dtStatusFailed(tileCache->removeTile(existing[i], &data, 0)) && data != 0x0)
+                dtFree(data);
+        }
+
+        bool added = false;
+        for (int i = 0; i < numLayers_; ++i)
+        {
+            dtCompressedTileRef tileRef;
+            int status = tileCache->addTile(layers_[i].data, layers_[i].dataSize, DT_COMPRESSEDTILE_FREE_DATA, &tileRef);
+            if (dtStatusFailed((dtStatus)status))
+                dtFree(layers_[i].data);
+            else
+            {
+                tileCache->buildNavMeshTile(tileRef, mesh_->navMesh_);
+                added = true;
+            }
+            layers_[i].data = 0x0;
+        }
+        numLayers_ = 0;
+
+        if (added)
+        {
+            const BoundingBox tileBoundingBox = mesh_->GetTileBoundingBox(tile_);
+            mesh_->navigationAreaRebuilt(mesh_->node_, mesh_, tileBoundingBox.min_, tileBoundingBox.max_);
+        }
+        return empty_ || added;
+    }
+
+    /// Navigation mesh.
+    DynamicNavigationMesh* mesh_;
+    /// Build data, with the geometry collected on the main thread.
+    DynamicNavBuildData build_;
+    /// Built tile cache layers.
+    DynamicNavigationMesh::TileCacheData layers_[TILECACHE_MAXLAYERS];
+    /// Number of built layers.
+    int numLayers_ = 0;
+    /// Whether the tile has no geometry.
+    bool empty_ = false;
+};
+
 DynamicNavigationMesh::DynamicNavigationMesh(Context* context) :
     NavigationMesh(context),
     tileCache_(0),
@@ -769,6 +841,7 @@ void DynamicNavigationMesh::WriteTiles(Serializer& dest, int x, int z) const
 }
 bool DynamicNavigationMesh::ReadTiles(Deserializer& source, bool silent)
 {
+    WaitForPathSearches();
     tileQueue_.clear();
     while (!source.IsEof())
     {
@@ -816,42 +889,24 @@ int DynamicNavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geomet
 
     tileCache_->removeTile(navMesh_->getTileRefAt(x, z, 0), 0, 0);
 
+    DynamicNavBuildData build(allocator_.get());
+    if (!GetTileBuildGeometry(build, geometryList, x, z))
+        return 0; // Nothing to do
+
+    int retCt = BuildTileLayers(build, x, z, tiles);
+    if (!retCt)
+        return 0;
+
+    // Send a notification of the rebuild of this tile to anyone interested
     const BoundingBox tileBoundingBox = GetTileBoundingBox(IntVector2(x, z));
+    navigationAreaRebuilt(node_,this,tileBoundingBox.min_,tileBoundingBox.max_);
 
-    DynamicNavBuildData build(allocator_.get());
+    return retCt;
+}
 
-    rcConfig cfg;
-    memset(&cfg, 0, sizeof cfg);
-    cfg.cs = cellSize_;
-    cfg.ch = cellHeight_;
-    cfg.walkableSlopeAngle = agentMaxSlope_;
-    cfg.walkableHeight = (int)ceilf(agentHeight_ / cfg.ch);
-    cfg.walkableClimb = (int)floorf(agentMaxClimb_ / cfg.ch);
-    cfg.walkableRadius = (int)ceilf(agentRadius_ / cfg.cs);
-    cfg.maxEdgeLen = (int)(edgeMaxLength_ / cellSize_);
-    cfg.maxSimplificationError = edgeMaxError_;
-    cfg.minRegionArea = (int)sqrtf(regionMinSize_);
-    cfg.mergeRegionArea = (int)sqrtf(regionMergeSize_);
-    cfg.maxVertsPerPoly = 6;
-    cfg.tileSize = tileSize_;
-    cfg.borderSize = cfg.walkableRadius + 3; // Add padding
-    cfg.width = cfg.tileSize + cfg.borderSize * 2;
-    cfg.height = cfg.tileSize + cfg.borderSize * 2;
-    cfg.detailSampleDist = detailSampleDistance_ < 0.9f ? 0.0f : cellSize_ * detailSampleDistance_;
-    cfg.detailSampleMaxError = cellHeight_ * detailSampleMaxError_;
-
-    rcVcopy(cfg.bmin, &tileBoundingBox.min_.x_);
-    rcVcopy(cfg.bmax, &tileBoundingBox.max_.x_);
-    cfg.bmin[0] -= cfg.borderSize * cfg.cs;
-    cfg.bmin[2] -= cfg.borderSize * cfg.cs;
-    cfg.bmax[0] += cfg.borderSize * cfg.cs;
-    cfg.bmax[2] += cfg.borderSize * cfg.cs;
-
-    BoundingBox expandedBox(*reinterpret_cast<Vector3*>(cfg.bmin), *reinterpret_cast<Vector3*>(cfg.bmax));
-    GetTileGeometry(&build, geometryList, expandedBox);
-
-    if (build.vertices_.empty() || build.indices_.empty())
-        return 0; // Nothing to do
+int DynamicNavigationMesh::BuildTileLayers(DynamicNavBuildData& build, int x, int z, TileCacheData* tiles) const
+{
+    const rcConfig& cfg = *build.config_;
 
     build.heightField_ = rcAllocHeightfield();
     if (!build.heightField_)
@@ -902,7 +957,7 @@ int DynamicNavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geomet
     for (unsigned i = 0; i < build.navAreas_.size(); ++i)
         rcMarkBoxArea(build.ctx_, &build.navAreas_[i].bounds_.min_.x_, &build.navAreas_[i].bounds_.max_.x_, build.navAreas_[i].areaID_, *build.compactHeightField_);
 
-    if (this->partitionType_ == NAVMESH_PARTITION_WATERSHED)
+    if (build.watershedPartition_)
     {
         if (!rcBuildDistanceField(build.ctx_, *build.compactHeightField_))
         {
@@ -971,50 +1026,15 @@ int DynamicNavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geomet
             ++retCt;
     }
 
-    // Send a notification of the rebuild of this tile to anyone interested
-    navigationAreaRebuilt(node_,this,tileBoundingBox.min_,tileBoundingBox.max_);
-
     return retCt;
 }
 
-unsigned DynamicNavigationMesh::BuildTiles(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& from, const IntVector2& to)
+std::unique_ptr<NavigationTileBuild> DynamicNavigationMesh::CreateTileBuild(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& tile)
 {
-    unsigned numTiles = 0;
-
-    for (int z = from.y_; z <= to.y_; ++z)
-    {
-        for (int x = from.x_; x <= to.x_; ++x)
-        {
-            dtCompressedTileRef existing[TILECACHE_MAXLAYERS];
-            const int existingCt = tileCache_->getTilesAt(x, z, existing, maxLayers_);
-            for (int i = 0; i < existingCt; ++i)
-            {
-                unsigned char* data = 0x0;
-                if (!dtStatusFailed(tileCache_->removeTile(existing[i], &data, 0)) && data != 0x0)
-                    dtFree(data);
-            }
-
-            TileCacheData tiles[TILECACHE_MAXLAYERS];
-            int layerCt = BuildTile(geometryList, x, z, tiles);
-            for (int i = 0; i < layerCt; ++i)
-            {
-                dtCompressedTileRef tileRef;
-                int status = tileCache_->addTile(tiles[i].data, tiles[i].dataSize, DT_COMPRESSEDTILE_FREE_DATA, &tileRef);
-                if (dtStatusFailed((dtStatus)status))
-                {
-                    dtFree(tiles[i].data);
-                    tiles[i].data = 0x0;
-                }
-                else
-                {
-                    tileCache_->buildNavMeshTile(tileRef, navMesh_);
-                    ++numTiles;
-                }
-            }
-        }
-    }
-
-    return numTiles;
+    std::unique_ptr<DynamicTileBuild> build(new DynamicTileBuild(this));
+    build->tile_ = tile;
+    build->empty_ = !GetTileBuildGeometry(build->build_, geometryList, tile.x_, tile.y_);
+    return std::move(build);
 }
 
 std::vector<OffMeshConnection*> DynamicNavigationMesh::CollectOffMeshConnections(const BoundingBox& bounds)
@@ -1070,6 +1090,7 @@ void DynamicNavigationMesh::AddObstacle(Obstacle* obstacle, bool silent)
 
         // Because dtTileCache doesn't process obstacle requests while updating tiles
         // it's necessary update until sufficient request space is available
+        WaitForPathSearches();
         while (tileCache_->isObstacleQueueFull())
             tileCache_->update(1, navMesh_);
 
@@ -1110,6 +1131,7 @@ void DynamicNavigationMesh::RemoveObstacle(Obstacle* obstacle, bool silent)
     {
         // Because dtTileCache doesn't process obstacle requests while updating tiles
         // it's necessary update until sufficient request space is available
+        WaitForPathSearches();
         while (tileCache_->isObstacleQueueFull())
             tileCache_->update(1, navMesh_);
 
@@ -1137,7 +1159,10 @@ void DynamicNavigationMesh::RemoveObstacle(Obstacle* obstacle, bool silent)
 void DynamicNavigationMesh::HandleSceneSubsystemUpdate(Scene *,float ts)
 {
     if (tileCache_ && navMesh_ && IsEnabledEffective())
+    {
+        WaitForPathSearches();
         tileCache_->update(ts, navMesh_);
+    }
 }
 
 }
@@ -37,12 +37,14 @@ namespace Urho3D
 
 class OffMeshConnection;
 class Obstacle;
+struct DynamicNavBuildData;
 
 class LUTEFISK3D_EXPORT DynamicNavigationMesh : public NavigationMesh
 {
     URHO3D_OBJECT(DynamicNavigationMesh,NavigationMesh)
     friend class Obstacle;
     friend struct MeshProcess;
+    friend struct DynamicTileBuild;
 
 public:
     /// Constructor.
@@ -110,10 +112,12 @@ protected:
     /// Used by Obstacle class to remove itself from the tile cache, if 'silent' an event will not be raised.
     void RemoveObstacle(Obstacle*, bool silent = false);
 
-    /// Build one tile of the navigation mesh. Return true if successful.
+    /// Build one tile of the navigation mesh. Return number of built layers.
     int BuildTile(std::vector<NavigationGeometryInfo>& geometryList, int x, int z, TileCacheData*tiles);
-    /// Build tiles in the rectangular area. Return number of built tiles.
-    unsigned BuildTiles(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& from, const IntVector2& to);
+    /// Build the tile cache layers of a tile from the collected geometry. Does not modify the navigation mesh, so can be called from worker threads. Return number of built layers.
+    int BuildTileLayers(DynamicNavBuildData& build, int x, int z, TileCacheData* tiles) const;
+    /// Create the build of a tile, collecting its geometry.
+    virtual std::unique_ptr<NavigationTileBuild> CreateTileBuild(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& tile) override;
     /// Off-mesh connections to be rebuilt in the mesh processor.
     std::vector<OffMeshConnection*> CollectOffMeshConnections(const BoundingBox& bounds);
     /// Release the navigation mesh, query, and tile cache.
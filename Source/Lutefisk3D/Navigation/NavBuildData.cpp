@@ -31,6 +31,11 @@ namespace Urho3D
 {
 
 NavBuildData::NavBuildData() :
+    config_(new rcConfig()),
+    walkableHeight_(0.0f),
+    walkableRadius_(0.0f),
+    walkableClimb_(0.0f),
+    watershedPartition_(true),
     ctx_(new rcContext(true)),
     heightField_(0),
     compactHeightField_(0)
@@ -42,6 +47,8 @@ NavBuildData::~NavBuildData()
         delete(ctx_);
 
     ctx_ = 0;
+    delete config_;
+    config_ = 0;
     rcFreeHeightField(heightField_);
     heightField_ = 0;
     rcFreeCompactHeightfield(compactHeightField_);
@@ -31,6 +31,7 @@ struct dtTileCacheContourSet;
 struct dtTileCachePolyMesh;
 struct dtTileCacheAlloc;
 struct rcCompactHeightfield;
+struct rcConfig;
 struct rcContourSet;
 struct rcHeightfield;
 struct rcHeightfieldLayerSet;
@@ -74,6 +75,16 @@ struct LUTEFISK3D_EXPORT NavBuildData
     std::vector<unsigned char> offMeshAreas_;
     /// Offmesh connection direction.
     std::vector<unsigned char> offMeshDir_;
+    /// Recast configuration of the tile, copied from the navigation mesh when the geometry is collected.
+    rcConfig* config_;
+    /// Agent height of the Detour tile data.
+    float walkableHeight_;
+    /// Agent radius of the Detour tile data.
+    float walkableRadius_;
+    /// Agent max vertical climb of the Detour tile data.
+    float walkableClimb_;
+    /// Whether regions are partitioned with watershed instead of monotone partitioning.
+    bool watershedPartition_;
     /// Recast context.
     rcContext* ctx_;
     /// Recast heightfield.
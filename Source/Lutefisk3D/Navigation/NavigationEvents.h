@@ -41,6 +41,8 @@ struct NavigationMeshSignals {
     jl::Signal<Node *,NavigationMesh *,IntVector2> navigationTileRemoved; // Node,Mesh,Tile
     /// All mesh tiles are removed from navigation mesh.
     jl::Signal<Node *,NavigationMesh *> navigationAllTilesRemoved; // Node,Mesh
+    /// All tiles of the asynchronous builds have been swapped into the navigation mesh.
+    jl::Signal<Node *,NavigationMesh *,unsigned> navigationAsyncBuildFinished; // Node,Mesh,NumTiles
 };
 struct NavigationSignals {
     jl::Signal<Node *,NavigationMesh *,IntVector2> navigationTileAdded; // Node,Mesh,Tile
@@ -26,6 +26,7 @@
 #include "Lutefisk3D/Physics/CollisionShape.h"
 #endif
 #include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
 #include "Lutefisk3D/Graphics/DebugRenderer.h"
 #include "Lutefisk3D/Graphics/Drawable.h"
 #include "DynamicNavigationMesh.h"
@@ -37,9 +38,14 @@
 #include "NavBuildData.h"
 #include "Navigable.h"
 #include "NavigationEvents.h"
+#include "NavigationPathQueue.h"
+#include "NavigationTileGraph.h"
 #include "Obstacle.h"
 #include "OffMeshConnection.h"
 #include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/Thread.h"
+#include "Lutefisk3D/Core/Timer.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
 #include "Lutefisk3D/Scene/Scene.h"
 #include "Lutefisk3D/Graphics/StaticModel.h"
 #include "Lutefisk3D/Graphics/TerrainPatch.h"
@@ -82,6 +88,9 @@ static const float DEFAULT_DETAIL_SAMPLE_DISTANCE = 6.0f;
 static const float DEFAULT_DETAIL_SAMPLE_MAX_ERROR = 1.0f;
 
 static const int MAX_POLYS = 2048;
+/// Number of tiles per worker thread collected and built at a time.
+static const unsigned TILE_BUILD_BATCH_SIZE = 4;
+static const unsigned DEFAULT_MAX_TILE_SWAPS_PER_FRAME = 8;
 
 
 /// Temporary data for finding a path.
@@ -97,12 +106,117 @@ struct FindPathData
     unsigned char pathFlags_[MAX_POLYS];
 };
 
+/// Triangles of a geometry component within one tile.
+struct NavigationTileTriangles
+{
+    /// Vertices.
+    std::vector<Vector3> vertices_;
+    /// Triangle indices.
+    std::vector<int> indices_;
+};
+
+/// Triangles of a geometry component kept between builds, relative to the navigation mesh root node.
+struct NavigationGeometryCacheEntry
+{
+    /// Component, to detect a destroyed component whose address has been reused.
+    WeakPtr<Component> component_;
+    /// Transform the triangles were extracted with.
+    Matrix3x4 transform_;
+    /// LOD level the triangles were extracted from.
+    unsigned lodLevel_ = 0;
+    /// Hash of the model or shape data the triangles were extracted from.
+    unsigned sourceHash_ = 0;
+    /// Geometry collection the component was last seen in.
+    unsigned collectStamp_ = 0;
+    /// Whether the triangles have been extracted.
+    bool extracted_ = false;
+    /// Whether the triangles have been sorted into tiles.
+    bool bucketed_ = false;
+    /// Vertices.
+    std::vector<Vector3> vertices_;
+    /// Triangle indices.
+    std::vector<int> indices_;
+    /// Triangles by tile index.
+    HashMap<unsigned, NavigationTileTriangles> tiles_;
+};
+
+/// Cached triangles of the geometry components of a navigation mesh.
+struct NavigationGeometryCache
+{
+    /// Cached triangles by component.
+    HashMap<Component*, NavigationGeometryCacheEntry> entries_;
+    /// Number of geometry collections.
+    unsigned collectStamp_ = 0;
+    /// Origin of the tile grid the triangles are sorted with.
+    Vector3 gridOrigin_;
+    /// Tile edge length of the tile grid.
+    float tileEdgeLength_ = 0.0f;
+    /// Border around the tiles within which the triangles are included.
+    float borderSize_ = 0.0f;
+    /// Number of tiles on the X axis.
+    int numTilesX_ = 0;
+    /// Number of tiles on the Z axis.
+    int numTilesZ_ = 0;
+    /// Number of times geometry has been extracted into the cache.
+    unsigned numExtractions_ = 0;
+};
+
+/// Tile of a navigation mesh being rebuilt.
+struct SimpleTileBuild : public NavigationTileBuild
+{
+    /// Construct.
+    SimpleTileBuild(NavigationMesh* mesh) :
+        mesh_(mesh)
+    {
+    }
+    /// Destruct. Free the tile data if it was not swapped in.
+    ~SimpleTileBuild() override
+    {
+        dtFree(navData_);
+    }
+
+    /// Build the Detour tile data.
+    void Build() override
+    {
+        if (!empty_)
+            success_ = mesh_->BuildTileData(build_, tile_.x_, tile_.y_, navData_, navDataSize_);
+    }
+    /// Replace the tile in the navigation mesh.
+    bool Apply() override
+    {
+        mesh_->WaitForPathSearches();
+        mesh_->navMesh_->removeTile(mesh_->navMesh_->getTileRefAt(tile_.x_, tile_.y_, 0), 0, 0);
+        if (empty_)
+            return true;
+        if (!success_)
+            return false;
+
+        unsigned char* navData = navData_;
+        navData_ = nullptr;
+        return mesh_->AddTileData(navData, navDataSize_, tile_.x_, tile_.y_);
+    }
+
+    /// Navigation mesh.
+    NavigationMesh* mesh_;
+    /// Build data, with the geometry collected on the main thread.
+    SimpleNavBuildData build_;
+    /// Built Detour tile data.
+    unsigned char* navData_ = nullptr;
+    /// Built Detour tile data size.
+    int navDataSize_ = 0;
+    /// Whether the tile has no geometry.
+    bool empty_ = false;
+    /// Whether the tile was built successfully.
+    bool success_ = false;
+};
+
 NavigationMesh::NavigationMesh(Context* context) :
     Component(context),
     navMesh_(nullptr),
     navMeshQuery_(nullptr),
     queryFilter_(new dtQueryFilter()),
     pathData_(new FindPathData()),
+    geometryCache_(new NavigationGeometryCache()),
     tileSize_(DEFAULT_TILE_SIZE),
     cellSize_(DEFAULT_CELL_SIZE),
     cellHeight_(DEFAULT_CELL_HEIGHT),
@@ -122,7 +236,9 @@ NavigationMesh::NavigationMesh(Context* context) :
     partitionType_(NAVMESH_PARTITION_WATERSHED),
     keepInterResults_(false),
     drawOffMeshConnections_(false),
-    drawNavAreas_(false)
+    drawNavAreas_(false),
+    numAsyncTiles_(0),
+    maxTileSwapsPerFrame_(DEFAULT_MAX_TILE_SWAPS_PER_FRAME)
 {
 }
 
@@ -153,6 +269,7 @@ void NavigationMesh::RegisterObject(Context* context)
     URHO3D_ENUM_ACCESSOR_ATTRIBUTE("Partition Type", GetPartitionType, SetPartitionType, NavmeshPartitionType, navmeshPartitionTypeNames, NAVMESH_PARTITION_WATERSHED, AM_DEFAULT);
     URHO3D_ACCESSOR_ATTRIBUTE("Draw OffMeshConnections", GetDrawOffMeshConnections, SetDrawOffMeshConnections, bool, false, AM_DEFAULT);
     URHO3D_ACCESSOR_ATTRIBUTE("Draw NavAreas", GetDrawNavAreas, SetDrawNavAreas, bool, false, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Hierarchical Pathfinding", GetHierarchicalPathfinding, SetHierarchicalPathfinding, bool, false, AM_DEFAULT);
 }
 
 void NavigationMesh::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
@@ -506,6 +623,89 @@ bool NavigationMesh::Build(const IntVector2& from, const IntVector2& to)
     return true;
 }
 
+bool NavigationMesh::BuildAsync(const BoundingBox& boundingBox)
+{
+    if (!node_ || !navMesh_)
+        return BuildAsync(IntVector2::ZERO, IntVector2::ZERO);
+
+    BoundingBox localSpaceBox = boundingBox.Transformed(node_->GetWorldTransform().Inverse());
+
+    float tileEdgeLength = (float)tileSize_ * cellSize_;
+
+    int sx = Clamp((int)((localSpaceBox.min_.x_ - boundingBox_.min_.x_) / tileEdgeLength), 0, numTilesX_ - 1);
+    int sz = Clamp((int)((localSpaceBox.min_.z_ - boundingBox_.min_.z_) / tileEdgeLength), 0, numTilesZ_ - 1);
+    int ex = Clamp((int)((localSpaceBox.max_.x_ - boundingBox_.min_.x_) / tileEdgeLength), 0, numTilesX_ - 1);
+    int ez = Clamp((int)((localSpaceBox.max_.z_ - boundingBox_.min_.z_) / tileEdgeLength), 0, numTilesZ_ - 1);
+
+    return BuildAsync(IntVector2(sx, sz), IntVector2(ex, ez));
+}
+
+bool NavigationMesh::BuildAsync(const IntVector2& from, const IntVector2& to)
+{
+    URHO3D_PROFILE(BuildNavigationMeshAsync);
+
+    if (!node_)
+        return false;
+
+    if (!navMesh_)
+    {
+        URHO3D_LOGERROR("Navigation mesh must first be built fully before it can be partially rebuilt");
+        return false;
+    }
+
+    std::vector<NavigationGeometryInfo> geometryList;
+    CollectGeometries(geometryList);
+
+    if (pendingTiles_.empty())
+    {
+        numAsyncTiles_ = 0;
+        g_coreSignals.beginFrame.Connect(this, &NavigationMesh::HandleBeginFrame);
+    }
+
+    // Without a work queue the tiles are built when swapped in
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    for (int z = from.y_; z <= to.y_; ++z)
+    {
+        for (int x = from.x_; x <= to.x_; ++x)
+        {
+            std::unique_ptr<NavigationTileBuild> tile = CreateTileBuild(geometryList, IntVector2(x, z));
+            if (queue)
+            {
+                NavigationTileBuild* build = tile.get();
+                tile->workItem_ = queue->AddWorkItem([build]() {
+                    build->Build();
+                    build->built_ = true;
+                });
+            }
+            pendingTiles_.push_back(std::move(tile));
+        }
+    }
+
+    return true;
+}
+
+void NavigationMesh::CancelAsyncBuild()
+{
+    if (pendingTiles_.empty())
+        return;
+
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    for (std::unique_ptr<NavigationTileBuild>& tile : pendingTiles_)
+    {
+        if (!queue || !tile->workItem_ || tile->built_)
+            continue;
+        SharedPtr<WorkItem> item(tile->workItem_);
+        if (queue->RemoveWorkItem(item))
+            continue;
+        // Already taken by a worker thread
+        while (!tile->built_)
+            Time::Sleep(0);
+    }
+
+    pendingTiles_.clear();
+    g_coreSignals.beginFrame.Disconnect(this);
+}
+
 std::vector<unsigned char> NavigationMesh::GetTileData(const IntVector2& tile) const
 {
     VectorBuffer ret;
@@ -559,6 +759,7 @@ void NavigationMesh::RemoveTile(const IntVector2& tile)
     if (!tileRef)
         return;
 
+    WaitForPathSearches();
     navMesh_->removeTile(tileRef, nullptr, nullptr);
 
     // Send event
@@ -567,6 +768,8 @@ void NavigationMesh::RemoveTile(const IntVector2& tile)
 
 void NavigationMesh::RemoveAllTiles()
 {
+    WaitForPathSearches();
+
     const dtNavMesh* navMesh = navMesh_;
     for (int i = 0; i < navMesh_->getMaxTiles(); ++i)
     {
@@ -665,8 +868,16 @@ void NavigationMesh::FindPath(std::deque<NavigationPathPoint>& dest, const Vecto
     int numPolys = 0;
     int numPathPoints = 0;
 
-    navMeshQuery_->findPath(startRef, endRef, &localStart.x_, &localEnd.x_, queryFilter, pathData_->polys_, &numPolys,
-        MAX_POLYS);
+    if (tileGraph_)
+    {
+        numPolys = tileGraph_->FindCorridor(navMeshQuery_, startRef, endRef, localStart, localEnd, queryFilter,
+            pathData_->polys_, MAX_POLYS);
+    }
+    if (!numPolys)
+    {
+        navMeshQuery_->findPath(startRef, endRef, &localStart.x_, &localEnd.x_, queryFilter, pathData_->polys_, &numPolys,
+            MAX_POLYS);
+    }
     if (!numPolys)
         return;
 
@@ -685,32 +896,66 @@ void NavigationMesh::FindPath(std::deque<NavigationPathPoint>& dest, const Vecto
         NavigationPathPoint pt;
         pt.position_ = transform * pathData_->pathPoints_[i];
         pt.flag_ = (NavigationPathPointFlag)pathData_->pathFlags_[i];
+        pt.areaID_ = GetNavAreaID(pt.position_);
+        dest.push_back(pt);
+    }
+}
+
+unsigned NavigationMesh::FindPathAsync(const Vector3& start, const Vector3& end, const NavigationPathCallback& callback,
+    const Vector3& extents, const dtQueryFilter* filter)
+{
+    return GetPathQueue()->AddRequest(start, end, extents, filter, callback);
+}
+
+bool NavigationMesh::CancelPathRequest(unsigned id)
+{
+    return pathQueue_ ? pathQueue_->CancelRequest(id) : false;
+}
+
+NavigationPathQueue* NavigationMesh::GetPathQueue()
+{
+    if (!pathQueue_)
+        pathQueue_.reset(new NavigationPathQueue(this));
+    return pathQueue_.get();
+}
 
-        // Walk through all NavAreas and find nearest
-        unsigned nearestNavAreaID = 0;   // 0 is the default nav area ID
-        float nearestDistance = std::numeric_limits<float>::max();
-        for (unsigned j = 0; j < areas_.size(); j++)
+void NavigationMesh::SetHierarchicalPathfinding(bool enable)
+{
+    if (enable == GetHierarchicalPathfinding())
+        return;
+
+    // The graph is built on the first long path search
+    if (enable)
+        tileGraph_.reset(new NavigationTileGraph());
+    else
+        tileGraph_.reset();
+}
+
+unsigned char NavigationMesh::GetNavAreaID(const Vector3& position) const
+{
+    // Walk through all NavAreas and find nearest
+    unsigned nearestNavAreaID = 0;   // 0 is the default nav area ID
+    float nearestDistance = std::numeric_limits<float>::max();
+    for (unsigned j = 0; j < areas_.size(); j++)
+    {
+        NavArea* area = areas_[j].Get();
+        if (area && area->IsEnabledEffective())
         {
-            NavArea* area = areas_[j].Get();
-            if (area && area->IsEnabledEffective())
+            BoundingBox bb = area->GetWorldBoundingBox();
+            if (bb.IsInside(position) == INSIDE)
             {
-                BoundingBox bb = area->GetWorldBoundingBox();
-                if (bb.IsInside(pt.position_) == INSIDE)
+                Vector3 areaWorldCenter = area->GetNode()->GetWorldPosition();
+                float distance = (areaWorldCenter - position).LengthSquared();
+
+                if (distance < nearestDistance)
                 {
-                    Vector3 areaWorldCenter = area->GetNode()->GetWorldPosition();
-                    float distance = (areaWorldCenter - pt.position_).LengthSquared();
-
-                    if (distance < nearestDistance)
-                    {
-                        nearestDistance = distance;
-                        nearestNavAreaID = area->GetAreaID();
-                    }
+                    nearestDistance = distance;
+                    nearestNavAreaID = area->GetAreaID();
                 }
             }
         }
-        pt.areaID_ = (unsigned char)nearestNavAreaID;
-        dest.push_back(pt);
     }
+    return (unsigned char)nearestNavAreaID;
 }
 
 Vector3 NavigationMesh::GetRandomPoint(const dtQueryFilter* filter, dtPolyRef* randomRef)
@@ -835,6 +1080,9 @@ void NavigationMesh::SetAreaCost(unsigned areaID, float cost)
 {
     if (queryFilter_)
         queryFilter_->setAreaCost((int)areaID, cost);
+    // Paths cached with the default filter may no longer be the cheapest
+    if (pathQueue_)
+        pathQueue_->Reset();
 }
 BoundingBox NavigationMesh::GetWorldBoundingBox() const
 {
@@ -973,6 +1221,36 @@ void NavigationMesh::CollectGeometries(std::vector<NavigationGeometryInfo>& geom
             areas_.emplace_back(WeakPtr<NavArea>(area));
          }
     }
+
+    // Discard the cached triangles of components that have moved or changed their model, or are no longer collected
+    NavigationGeometryCache& cache = *geometryCache_;
+    ++cache.collectStamp_;
+    for (const NavigationGeometryInfo& info : geometryList)
+    {
+        StringHash type = info.component_->GetType();
+        if (type == OffMeshConnection::GetTypeStatic() || type == NavArea::GetTypeStatic())
+            continue;
+
+        NavigationGeometryCacheEntry& entry = cache.entries_[info.component_];
+        unsigned sourceHash = GetGeometrySourceHash(info);
+        if (entry.component_.Get() != info.component_ || entry.transform_ != info.transform_ ||
+                entry.lodLevel_ != info.lodLevel_ || entry.sourceHash_ != sourceHash)
+        {
+            entry = NavigationGeometryCacheEntry();
+            entry.component_ = WeakPtr<Component>(info.component_);
+            entry.transform_ = info.transform_;
+            entry.lodLevel_ = info.lodLevel_;
+            entry.sourceHash_ = sourceHash;
+        }
+        entry.collectStamp_ = cache.collectStamp_;
+    }
+    for (auto i = cache.entries_.begin(); i != cache.entries_.end();)
+    {
+        if (i->second.collectStamp_ != cache.collectStamp_)
+            i = cache.entries_.erase(i);
+        else
+            ++i;
+    }
 }
 
 void NavigationMesh::CollectGeometries(std::vector<NavigationGeometryInfo>& geometryList, Node* node, QSet<Node*>& processedNodes, bool recursive)
@@ -1051,16 +1329,35 @@ void NavigationMesh::CollectGeometries(std::vector<NavigationGeometryInfo>& geom
     }
 }
 
-void NavigationMesh::GetTileGeometry(NavBuildData* build, std::vector<NavigationGeometryInfo>& geometryList, BoundingBox& box)
+void NavigationMesh::GetTileGeometry(NavBuildData* build, std::vector<NavigationGeometryInfo>& geometryList, BoundingBox& box, const IntVector2& tile)
 {
     Matrix3x4 inverse = node_->GetWorldTransform().Inverse();
 
+    // Sort the cached triangles again if the tile grid has changed
+    NavigationGeometryCache& cache = *geometryCache_;
+    rcConfig cfg;
+    GetTileConfig(cfg, 0, 0);
+    const float tileEdgeLength = (float)tileSize_ * cellSize_;
+    const float borderSize = cfg.borderSize * cfg.cs;
+    if (cache.gridOrigin_ != boundingBox_.min_ || cache.tileEdgeLength_ != tileEdgeLength || cache.borderSize_ != borderSize ||
+            cache.numTilesX_ != numTilesX_ || cache.numTilesZ_ != numTilesZ_)
+    {
+        cache.gridOrigin_ = boundingBox_.min_;
+        cache.tileEdgeLength_ = tileEdgeLength;
+        cache.borderSize_ = borderSize;
+        cache.numTilesX_ = numTilesX_;
+        cache.numTilesZ_ = numTilesZ_;
+        for (auto& i : cache.entries_)
+        {
+            i.second.tiles_.clear();
+            i.second.bucketed_ = false;
+        }
+    }
+
     for (unsigned i = 0; i < geometryList.size(); ++i)
     {
         if (box.IsInsideFast(geometryList[i].boundingBox_) != OUTSIDE)
         {
-            const Matrix3x4& transform = geometryList[i].transform_;
-
             if (geometryList[i].component_->GetType() == OffMeshConnection::GetTypeStatic())
             {
                 OffMeshConnection* connection = static_cast<OffMeshConnection*>(geometryList[i].component_);
@@ -1085,85 +1382,240 @@ void NavigationMesh::GetTileGeometry(NavBuildData* build, std::vector<Navigation
                 continue;
             }
 
-#ifdef LUTEFISK3D_PHYSICS
-            CollisionShape* shape = dynamic_cast<CollisionShape*>(geometryList[i].component_);
-            if (shape)
+            NavigationGeometryCacheEntry& entry = cache.entries_[geometryList[i].component_];
+            if (!entry.extracted_)
             {
-                switch (shape->GetShapeType())
-                {
-                case SHAPE_TRIANGLEMESH:
-                    {
-                        Model* model = shape->GetModel();
-                        if (!model)
-                            continue;
-
-                        unsigned lodLevel = shape->GetLodLevel();
-                        for (unsigned j = 0; j < model->GetNumGeometries(); ++j)
-                            AddTriMeshGeometry(build, model->GetGeometry(j, lodLevel), transform);
-                    }
-                    break;
+                entry.component_ = WeakPtr<Component>(geometryList[i].component_);
+                entry.transform_ = geometryList[i].transform_;
+                entry.lodLevel_ = geometryList[i].lodLevel_;
+                ExtractGeometry(geometryList[i], entry.vertices_, entry.indices_);
+                ++cache.numExtractions_;
+                entry.extracted_ = true;
+                entry.bucketed_ = false;
+            }
+            if (!entry.bucketed_)
+                BucketCachedGeometry(entry);
 
-                case SHAPE_CONVEXHULL:
-                    {
-                        ConvexData* data = static_cast<ConvexData*>(shape->GetGeometryData());
-                        if (!data)
-                            continue;
+            auto triangles = entry.tiles_.find((unsigned)(tile.y_ * numTilesX_ + tile.x_));
+            if (triangles == entry.tiles_.end())
+                continue;
 
-                        unsigned numVertices = data->vertexCount_;
-                        unsigned numIndices = data->indexCount_;
-                        unsigned destVertexStart = build->vertices_.size();
+            int destVertexStart = (int)build->vertices_.size();
+            build->vertices_.insert(build->vertices_.end(), triangles->second.vertices_.begin(), triangles->second.vertices_.end());
+            for (int index : triangles->second.indices_)
+                build->indices_.push_back(index + destVertexStart);
+        }
+    }
+}
 
-                        for (unsigned j = 0; j < numVertices; ++j)
-                            build->vertices_.push_back(transform * data->vertexData_[j]);
+unsigned NavigationMesh::GetGeometrySourceHash(const NavigationGeometryInfo& info) const
+{
+    unsigned hash = 0;
+    auto addToHash = [&hash](unsigned value) {
+        hash = value + (hash << 6) + (hash << 16) - hash;
+    };
+    // Data versions are never reused, so a reloaded model or a regenerated terrain patch always changes the hash
+    auto addGeometryToHash = [&addToHash](Geometry* geometry) {
+        addToHash(geometry ? geometry->GetDataVersion() : 0);
+    };
 
-                        for (unsigned j = 0; j < numIndices; ++j)
-                            build->indices_.push_back(data->indexData_[j] + destVertexStart);
-                    }
-                    break;
+#ifdef LUTEFISK3D_PHYSICS
+    CollisionShape* shape = dynamic_cast<CollisionShape*>(info.component_);
+    if (shape)
+    {
+        addToHash(shape->GetShapeType());
+        Model* model = shape->GetModel();
+        if (model && shape->GetShapeType() == SHAPE_TRIANGLEMESH)
+        {
+            addToHash(model->GetDataVersion());
+            addToHash(shape->GetLodLevel());
+            for (unsigned j = 0; j < model->GetNumGeometries(); ++j)
+                addGeometryToHash(model->GetGeometry(j, shape->GetLodLevel()));
+        }
+        else if (shape->GetShapeType() == SHAPE_CONVEXHULL)
+        {
+            // The hull is a copy made when the shape was created, and small enough to hash the contents
+            ConvexData* data = static_cast<ConvexData*>(shape->GetGeometryData());
+            if (data)
+            {
+                const unsigned char* vertexBytes = reinterpret_cast<const unsigned char*>(data->vertexData_.get());
+                for (unsigned j = 0; j < data->vertexCount_ * sizeof(Vector3); ++j)
+                    hash = SDBMHash(hash, vertexBytes[j]);
+                for (unsigned j = 0; j < data->indexCount_; ++j)
+                    addToHash(data->indexData_[j]);
+            }
+        }
+        return hash;
+    }
+#endif
+    Drawable* drawable = dynamic_cast<Drawable*>(info.component_);
+    if (drawable)
+    {
+        const std::vector<SourceBatch>& batches = drawable->GetBatches();
+        for (unsigned j = 0; j < batches.size(); ++j)
+            addGeometryToHash(drawable->GetLodGeometry(j, info.lodLevel_));
+    }
+    return hash;
+}
 
-                case SHAPE_BOX:
-                    {
-                        unsigned destVertexStart = build->vertices_.size();
-
-                        build->vertices_.push_back(transform * Vector3(-0.5f, 0.5f, -0.5f));
-                        build->vertices_.push_back(transform * Vector3(0.5f, 0.5f, -0.5f));
-                        build->vertices_.push_back(transform * Vector3(0.5f, -0.5f, -0.5f));
-                        build->vertices_.push_back(transform * Vector3(-0.5f, -0.5f, -0.5f));
-                        build->vertices_.push_back(transform * Vector3(-0.5f, 0.5f, 0.5f));
-                        build->vertices_.push_back(transform * Vector3(0.5f, 0.5f, 0.5f));
-                        build->vertices_.push_back(transform * Vector3(0.5f, -0.5f, 0.5f));
-                        build->vertices_.push_back(transform * Vector3(-0.5f, -0.5f, 0.5f));
-
-                        const unsigned indices[] = {
-                            0, 1, 2, 0, 2, 3, 1, 5, 6, 1, 6, 2, 4, 5, 1, 4, 1, 0, 5, 4, 7, 5, 7, 6,
-                            4, 0, 3, 4, 3, 7, 1, 0, 4, 1, 4, 5
-                        };
-
-                        for (unsigned indice : indices)
-                            build->indices_.push_back(indice + destVertexStart);
-                    }
+void NavigationMesh::ExtractGeometry(const NavigationGeometryInfo& info, std::vector<Vector3>& vertices, std::vector<int>& indices)
+{
+    const Matrix3x4& transform = info.transform_;
+
+#ifdef LUTEFISK3D_PHYSICS
+    CollisionShape* shape = dynamic_cast<CollisionShape*>(info.component_);
+    if (shape)
+    {
+        switch (shape->GetShapeType())
+        {
+        case SHAPE_TRIANGLEMESH:
+            {
+                Model* model = shape->GetModel();
+                if (!model)
                     break;
 
-                default:
+                unsigned lodLevel = shape->GetLodLevel();
+                for (unsigned j = 0; j < model->GetNumGeometries(); ++j)
+                    AddTriMeshGeometry(vertices, indices, model->GetGeometry(j, lodLevel), transform);
+            }
+            break;
+
+        case SHAPE_CONVEXHULL:
+            {
+                ConvexData* data = static_cast<ConvexData*>(shape->GetGeometryData());
+                if (!data)
                     break;
-                }
 
-                continue;
+                unsigned numVertices = data->vertexCount_;
+                unsigned numIndices = data->indexCount_;
+                unsigned destVertexStart = vertices.size();
+
+                for (unsigned j = 0; j < numVertices; ++j)
+                    vertices.push_back(transform * data->vertexData_[j]);
+
+                for (unsigned j = 0; j < numIndices; ++j)
+                    indices.push_back(data->indexData_[j] + destVertexStart);
             }
-#endif
-            Drawable* drawable = dynamic_cast<Drawable*>(geometryList[i].component_);
-            if (drawable)
+            break;
+
+        case SHAPE_BOX:
             {
-                const std::vector<SourceBatch>& batches = drawable->GetBatches();
+                unsigned destVertexStart = vertices.size();
+
+                vertices.push_back(transform * Vector3(-0.5f, 0.5f, -0.5f));
+                vertices.push_back(transform * Vector3(0.5f, 0.5f, -0.5f));
+                vertices.push_back(transform * Vector3(0.5f, -0.5f, -0.5f));
+                vertices.push_back(transform * Vector3(-0.5f, -0.5f, -0.5f));
+                vertices.push_back(transform * Vector3(-0.5f, 0.5f, 0.5f));
+                vertices.push_back(transform * Vector3(0.5f, 0.5f, 0.5f));
+                vertices.push_back(transform * Vector3(0.5f, -0.5f, 0.5f));
+                vertices.push_back(transform * Vector3(-0.5f, -0.5f, 0.5f));
+
+                const unsigned boxIndices[] = {
+                    0, 1, 2, 0, 2, 3, 1, 5, 6, 1, 6, 2, 4, 5, 1, 4, 1, 0, 5, 4, 7, 5, 7, 6,
+                    4, 0, 3, 4, 3, 7, 1, 0, 4, 1, 4, 5
+                };
+
+                for (unsigned indice : boxIndices)
+                    indices.push_back(indice + destVertexStart);
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        return;
+    }
+#endif
+    Drawable* drawable = dynamic_cast<Drawable*>(info.component_);
+    if (drawable)
+    {
+        const std::vector<SourceBatch>& batches = drawable->GetBatches();
+
+        for (unsigned j = 0; j < batches.size(); ++j)
+            AddTriMeshGeometry(vertices, indices, drawable->GetLodGeometry(j, info.lodLevel_), transform);
+    }
+}
 
-                for (unsigned j = 0; j < batches.size(); ++j)
-                    AddTriMeshGeometry(build, drawable->GetLodGeometry(j, geometryList[i].lodLevel_), transform);
+void NavigationMesh::BucketCachedGeometry(NavigationGeometryCacheEntry& entry)
+{
+    const NavigationGeometryCache& cache = *geometryCache_;
+    entry.tiles_.clear();
+    entry.bucketed_ = true;
+    if (!cache.numTilesX_ || !cache.numTilesZ_)
+        return;
+
+    // A triangle belongs to every tile whose bounding box, expanded by the border, it overlaps on the XZ plane
+    HashMap<unsigned, std::vector<unsigned> > tileTriangles;
+    const unsigned numTriangles = entry.indices_.size() / 3;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        const Vector3& v0 = entry.vertices_[entry.indices_[i * 3]];
+        const Vector3& v1 = entry.vertices_[entry.indices_[i * 3 + 1]];
+        const Vector3& v2 = entry.vertices_[entry.indices_[i * 3 + 2]];
+        const float minX = Min(Min(v0.x_, v1.x_), v2.x_) - cache.borderSize_ - cache.gridOrigin_.x_;
+        const float maxX = Max(Max(v0.x_, v1.x_), v2.x_) + cache.borderSize_ - cache.gridOrigin_.x_;
+        const float minZ = Min(Min(v0.z_, v1.z_), v2.z_) - cache.borderSize_ - cache.gridOrigin_.z_;
+        const float maxZ = Max(Max(v0.z_, v1.z_), v2.z_) + cache.borderSize_ - cache.gridOrigin_.z_;
+
+        const int sx = Max(CeilToInt(minX / cache.tileEdgeLength_) - 1, 0);
+        const int ex = Min(FloorToInt(maxX / cache.tileEdgeLength_), cache.numTilesX_ - 1);
+        const int sz = Max(CeilToInt(minZ / cache.tileEdgeLength_) - 1, 0);
+        const int ez = Min(FloorToInt(maxZ / cache.tileEdgeLength_), cache.numTilesZ_ - 1);
+        for (int z = sz; z <= ez; ++z)
+        {
+            for (int x = sx; x <= ex; ++x)
+                tileTriangles[(unsigned)(z * cache.numTilesX_ + x)].push_back(i);
+        }
+    }
+
+    // Copy the triangles of each tile with only the vertices they use
+    std::vector<int> remap(entry.vertices_.size(), -1);
+    for (auto& bucket : tileTriangles)
+    {
+        NavigationTileTriangles& triangles = entry.tiles_[bucket.first];
+        triangles.indices_.reserve(bucket.second.size() * 3);
+        for (unsigned triangle : bucket.second)
+        {
+            for (unsigned j = 0; j < 3; ++j)
+            {
+                int index = entry.indices_[triangle * 3 + j];
+                if (remap[index] < 0)
+                {
+                    remap[index] = (int)triangles.vertices_.size();
+                    triangles.vertices_.push_back(entry.vertices_[index]);
+                }
+                triangles.indices_.push_back(remap[index]);
             }
         }
+        for (unsigned triangle : bucket.second)
+        {
+            for (unsigned j = 0; j < 3; ++j)
+                remap[entry.indices_[triangle * 3 + j]] = -1;
+        }
     }
 }
 
-void NavigationMesh::AddTriMeshGeometry(NavBuildData* build, Geometry* geometry, const Matrix3x4& transform)
+void NavigationMesh::InvalidateGeometryCache(Component* component)
+{
+    if (component)
+        geometryCache_->entries_.erase(component);
+    else
+        geometryCache_->entries_.clear();
+}
+
+unsigned NavigationMesh::GetNumCachedGeometries() const
+{
+    return geometryCache_->entries_.size();
+}
+
+unsigned NavigationMesh::GetNumGeometryExtractions() const
+{
+    return geometryCache_->numExtractions_;
+}
+
+void NavigationMesh::AddTriMeshGeometry(std::vector<Vector3>& vertices, std::vector<int>& indices, Geometry* geometry, const Matrix3x4& transform)
 {
     if (!geometry)
         return;
@@ -1186,35 +1638,35 @@ void NavigationMesh::AddTriMeshGeometry(NavBuildData* build, Geometry* geometry,
     if (!srcIndexCount)
         return;
 
-    unsigned destVertexStart = build->vertices_.size();
+    unsigned destVertexStart = vertices.size();
 
     for (unsigned k = srcVertexStart; k < srcVertexStart + srcVertexCount; ++k)
     {
         Vector3 vertex = transform * *((const Vector3*)(&vertexData[k * vertexSize]));
-        build->vertices_.push_back(vertex);
+        vertices.push_back(vertex);
     }
 
     // Copy remapped indices
     if (indexSize == sizeof(unsigned short))
     {
-        const unsigned short* indices = ((const unsigned short*)indexData) + srcIndexStart;
-        const unsigned short* indicesEnd = indices + srcIndexCount;
+        const unsigned short* srcIndices = ((const unsigned short*)indexData) + srcIndexStart;
+        const unsigned short* indicesEnd = srcIndices + srcIndexCount;
 
-        while (indices < indicesEnd)
+        while (srcIndices < indicesEnd)
         {
-            build->indices_.push_back(*indices - srcVertexStart + destVertexStart);
-            ++indices;
+            indices.push_back(*srcIndices - srcVertexStart + destVertexStart);
+            ++srcIndices;
         }
     }
     else
     {
-        const unsigned* indices = ((const unsigned*)indexData) + srcIndexStart;
-        const unsigned* indicesEnd = indices + srcIndexCount;
+        const unsigned* srcIndices = ((const unsigned*)indexData) + srcIndexStart;
+        const unsigned* indicesEnd = srcIndices + srcIndexCount;
 
-        while (indices < indicesEnd)
+        while (srcIndices < indicesEnd)
         {
-            build->indices_.push_back(*indices - srcVertexStart + destVertexStart);
-            ++indices;
+            indices.push_back(*srcIndices - srcVertexStart + destVertexStart);
+            ++srcIndices;
         }
     }
 }
@@ -1248,6 +1700,7 @@ bool NavigationMesh::ReadTile(Deserializer& source, bool silent)
     }
 
     source.Read(navData, navDataSize);
+    WaitForPathSearches();
     if (dtStatusFailed(navMesh_->addTile(navData, navDataSize, DT_TILE_FREE_DATA, 0, 0)))
     {
         URHO3D_LOGERROR("Failed to add navigation mesh tile");
@@ -1265,14 +1718,74 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
 {
     URHO3D_PROFILE(BuildNavigationMeshTile);
 
-    // Remove previous tile (if any)
-    navMesh_->removeTile(navMesh_->getTileRefAt(x, z, 0), 0, 0);
+    std::unique_ptr<NavigationTileBuild> tile = CreateTileBuild(geometryList, IntVector2(x, z));
+    tile->Build();
+    return tile->Apply();
+}
 
-    const BoundingBox tileBoundingBox = GetTileBoundingBox(IntVector2(x, z));
+std::unique_ptr<NavigationTileBuild> NavigationMesh::CreateTileBuild(std::vector<NavigationGeometryInfo>& geometryList,
+                                                                     const IntVector2& tile)
+{
+    std::unique_ptr<SimpleTileBuild> build(new SimpleTileBuild(this));
+    build->tile_ = tile;
+    build->empty_ = !GetTileBuildGeometry(build->build_, geometryList, tile.x_, tile.y_);
+    return std::move(build);
+}
 
-    SimpleNavBuildData build;
+unsigned NavigationMesh::BuildTiles(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& from, const IntVector2& to)
+{
+    unsigned numTiles = 0;
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    const unsigned numTilesX = (unsigned)(to.x_ - from.x_ + 1);
+    const unsigned numTilesToBuild = numTilesX * (unsigned)(to.y_ - from.y_ + 1);
 
-    rcConfig cfg;
+    if (!queue || !queue->GetNumThreads() || numTilesToBuild < 2 || !Thread::IsMainThread())
+    {
+        for (int z = from.y_; z <= to.y_; ++z)
+        {
+            for (int x = from.x_; x <= to.x_; ++x)
+            {
+                std::unique_ptr<NavigationTileBuild> tile = CreateTileBuild(geometryList, IntVector2(x, z));
+                tile->Build();
+                if (tile->Apply())
+                    ++numTiles;
+            }
+        }
+        return numTiles;
+    }
+
+    URHO3D_PROFILE(BuildNavigationMeshTiles);
+
+    // Build the tiles in batches to bound the memory held by the collected geometry. The scene is only accessed while
+    // collecting on the main thread, and the tiles are replaced in the navigation mesh in the same order as a serial
+    // build, so that the tile references do not depend on the number of threads.
+    const unsigned batchSize = TILE_BUILD_BATCH_SIZE * ((unsigned)queue->GetNumThreads() + 1);
+    std::vector<std::unique_ptr<NavigationTileBuild> > batch;
+    batch.reserve(batchSize);
+    for (unsigned first = 0; first < numTilesToBuild; first += batchSize)
+    {
+        batch.clear();
+        for (unsigned i = first; i < Min(first + batchSize, numTilesToBuild); ++i)
+            batch.push_back(CreateTileBuild(geometryList, IntVector2(from.x_ + (int)(i % numTilesX), from.y_ + (int)(i / numTilesX))));
+
+        queue->ProcessRange(batch.size(), 1, [&batch](unsigned start, unsigned end) {
+            for (unsigned i = start; i < end; ++i)
+                batch[i]->Build();
+        });
+
+        // Detour tile addition is not thread-safe
+        for (std::unique_ptr<NavigationTileBuild>& tile : batch)
+        {
+            if (tile->Apply())
+                ++numTiles;
+        }
+    }
+
+    return numTiles;
+}
+
+void NavigationMesh::GetTileConfig(rcConfig& cfg, int x, int z) const
+{
     memset(&cfg, 0, sizeof cfg);
     cfg.cs = cellSize_;
     cfg.ch = cellHeight_;
@@ -1292,18 +1805,33 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
     cfg.detailSampleDist = detailSampleDistance_ < 0.9f ? 0.0f : cellSize_ * detailSampleDistance_;
     cfg.detailSampleMaxError = cellHeight_ * detailSampleMaxError_;
 
+    const BoundingBox tileBoundingBox = GetTileBoundingBox(IntVector2(x, z));
     rcVcopy(cfg.bmin, &tileBoundingBox.min_.x_);
     rcVcopy(cfg.bmax, &tileBoundingBox.max_.x_);
     cfg.bmin[0] -= cfg.borderSize * cfg.cs;
     cfg.bmin[2] -= cfg.borderSize * cfg.cs;
     cfg.bmax[0] += cfg.borderSize * cfg.cs;
     cfg.bmax[2] += cfg.borderSize * cfg.cs;
+}
+
+bool NavigationMesh::GetTileBuildGeometry(NavBuildData& build, std::vector<NavigationGeometryInfo>& geometryList, int x, int z)
+{
+    // The tile may be built on a worker thread while the attributes are changed, so it only reads this copy
+    rcConfig& cfg = *build.config_;
+    GetTileConfig(cfg, x, z);
+    build.walkableHeight_ = agentHeight_;
+    build.walkableRadius_ = agentRadius_;
+    build.walkableClimb_ = agentMaxClimb_;
+    build.watershedPartition_ = partitionType_ == NAVMESH_PARTITION_WATERSHED;
 
     BoundingBox expandedBox(*reinterpret_cast<Vector3*>(cfg.bmin), *reinterpret_cast<Vector3*>(cfg.bmax));
-    GetTileGeometry(&build, geometryList, expandedBox);
+    GetTileGeometry(&build, geometryList, expandedBox, IntVector2(x, z));
+    return !build.vertices_.empty() && !build.indices_.empty();
+}
 
-    if (build.vertices_.empty() || build.indices_.empty())
-        return true; // Nothing to do
+bool NavigationMesh::BuildTileData(SimpleNavBuildData& build, int x, int z, unsigned char*& navData, int& navDataSize) const
+{
+    const rcConfig& cfg = *build.config_;
 
     build.heightField_ = rcAllocHeightfield();
     if (!build.heightField_)
@@ -1353,7 +1881,7 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
         rcMarkBoxArea(build.ctx_, &build.navAreas_[i].bounds_.min_.x_, &build.navAreas_[i].bounds_.max_.x_,
             build.navAreas_[i].areaID_, *build.compactHeightField_);
 
-    if (this->partitionType_ == NAVMESH_PARTITION_WATERSHED)
+    if (build.watershedPartition_)
     {
     if (!rcBuildDistanceField(build.ctx_, *build.compactHeightField_))
     {
@@ -1422,9 +1950,6 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
             build.polyMesh_->flags[i] = 0x1;
     }
 
-    unsigned char* navData = nullptr;
-    int navDataSize = 0;
-
     dtNavMeshCreateParams params;
     memset(&params, 0, sizeof params);
     params.verts = build.polyMesh_->verts;
@@ -1439,9 +1964,9 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
     params.detailVertsCount = build.polyMeshDetail_->nverts;
     params.detailTris = build.polyMeshDetail_->tris;
     params.detailTriCount = build.polyMeshDetail_->ntris;
-    params.walkableHeight = agentHeight_;
-    params.walkableRadius = agentRadius_;
-    params.walkableClimb = agentMaxClimb_;
+    params.walkableHeight = build.walkableHeight_;
+    params.walkableRadius = build.walkableRadius_;
+    params.walkableClimb = build.walkableClimb_;
     params.tileX = x;
     params.tileY = z;
     rcVcopy(params.bmin, build.polyMesh_->bmin);
@@ -1467,6 +1992,11 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
         return false;
     }
 
+    return true;
+}
+
+bool NavigationMesh::AddTileData(unsigned char* navData, int navDataSize, int x, int z)
+{
     if (dtStatusFailed(navMesh_->addTile(navData, navDataSize, DT_TILE_FREE_DATA, 0, nullptr)))
     {
         URHO3D_LOGERROR("Failed to add navigation mesh tile");
@@ -1475,24 +2005,41 @@ bool NavigationMesh::BuildTile(std::vector<NavigationGeometryInfo>& geometryList
     }
 
     // Send a notification of the rebuild of this tile to anyone interested
+    const BoundingBox tileBoundingBox = GetTileBoundingBox(IntVector2(x, z));
     navigationAreaRebuilt(node_,this,tileBoundingBox.min_,tileBoundingBox.max_);
     return true;
 }
 
-unsigned NavigationMesh::BuildTiles(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& from, const IntVector2& to)
+void NavigationMesh::HandleBeginFrame(unsigned, float)
 {
-    unsigned numTiles = 0;
+    URHO3D_PROFILE(SwapNavigationMeshTiles);
 
-    for (int z = from.y_; z <= to.y_; ++z)
+    unsigned numSwaps = 0;
+    while (!pendingTiles_.empty() && (!maxTileSwapsPerFrame_ || numSwaps < maxTileSwapsPerFrame_))
     {
-        for (int x = from.x_; x <= to.x_; ++x)
+        NavigationTileBuild* tile = pendingTiles_.front().get();
+        if (!tile->workItem_ && !tile->built_)
         {
-            if (BuildTile(geometryList, x, z))
-                ++numTiles;
+            tile->Build();
+            tile->built_ = true;
         }
+        // Swap in build order, so that a tile rebuilt twice ends up with the later geometry
+        if (!tile->built_)
+            break;
+
+        if (tile->Apply())
+            ++numAsyncTiles_;
+        pendingTiles_.pop_front();
+        ++numSwaps;
+    }
+
+    if (pendingTiles_.empty())
+    {
+        g_coreSignals.beginFrame.Disconnect(this);
+        navigationAsyncBuildFinished(node_, this, numAsyncTiles_);
     }
-    return numTiles;
 }
+
 bool NavigationMesh::InitializeQuery()
 {
     if (!navMesh_ || !node_)
@@ -1517,8 +2064,20 @@ bool NavigationMesh::InitializeQuery()
     return true;
 }
 
+void NavigationMesh::WaitForPathSearches()
+{
+    if (pathQueue_)
+        pathQueue_->WaitForSearches();
+}
+
 void NavigationMesh::ReleaseNavigationMesh()
 {
+    CancelAsyncBuild();
+    if (pathQueue_)
+        pathQueue_->Reset();
+    if (tileGraph_)
+        tileGraph_->Clear();
+
     dtFreeNavMesh(navMesh_);
     navMesh_ = nullptr;
 
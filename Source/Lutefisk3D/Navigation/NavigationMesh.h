@@ -29,6 +29,11 @@
 #include "Lutefisk3D/Navigation/NavigationEvents.h"
 #include <QtCore/QSet>
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
 #ifdef DT_POLYREF64
 typedef uint64_t dtPolyRef;
 #else
@@ -38,6 +43,7 @@ typedef unsigned int dtPolyRef;
 class dtNavMesh;
 class dtNavMeshQuery;
 class dtQueryFilter;
+struct rcConfig;
 
 namespace Urho3D
 {
@@ -49,9 +55,15 @@ enum NavmeshPartitionType
 };
 class Geometry;
 class NavArea;
+class NavigationPathQueue;
+class NavigationTileGraph;
+struct WorkItem;
 
 struct FindPathData;
+struct NavigationGeometryCache;
+struct NavigationGeometryCacheEntry;
 struct NavBuildData;
+struct SimpleNavBuildData;
 
 /// Description of a navigation mesh geometry component, with transform and bounds information.
 struct NavigationGeometryInfo
@@ -85,11 +97,35 @@ struct LUTEFISK3D_EXPORT NavigationPathPoint
     unsigned char areaID_;
 };
 
+/// Callback receiving the result of an asynchronous path request: the request ID and the path, empty if none was found.
+using NavigationPathCallback = std::function<void(unsigned, const std::deque<NavigationPathPoint>&)>;
+
+/// Tile of a navigation mesh being rebuilt. The geometry is collected on the main thread when created, the tile data is
+/// built on a worker thread, and the result is swapped into the navigation mesh on the main thread.
+struct LUTEFISK3D_EXPORT NavigationTileBuild
+{
+    /// Destruct.
+    virtual ~NavigationTileBuild() = default;
+    /// Build the tile data. Must not access the scene or the navigation mesh.
+    virtual void Build() = 0;
+    /// Replace the tile in the navigation mesh with the built data. Return true if successful.
+    virtual bool Apply() = 0;
+
+    /// Tile index.
+    IntVector2 tile_;
+    /// Work item building the tile in the background, null if built synchronously.
+    WorkItem* workItem_ = nullptr;
+    /// Set once the tile data has been built.
+    std::atomic<bool> built_{false};
+};
+
 /// Navigation mesh component. Collects the navigation geometry from child nodes with the Navigable component and responds to path queries.
 class LUTEFISK3D_EXPORT NavigationMesh : public Component, public NavigationMeshSignals
 {
     URHO3D_OBJECT(NavigationMesh,Component);
     friend class CrowdManager;
+    friend struct SimpleTileBuild;
+    friend class NavigationPathQueue;
 
 public:
     /// Construct.
@@ -140,6 +176,25 @@ public:
     virtual bool Build(const BoundingBox& boundingBox);
     /// Rebuild part of the navigation mesh in the rectangular area. Return true if successful.
     virtual bool Build(const IntVector2& from, const IntVector2& to);
+    /// Rebuild part of the navigation mesh contained by the world-space bounding box in the background. The geometry is
+    /// collected immediately, and the rebuilt tiles replace the old ones at the start of the following frames. Return true if successful.
+    bool BuildAsync(const BoundingBox& boundingBox);
+    /// Rebuild part of the navigation mesh in the rectangular area in the background. Return true if successful.
+    bool BuildAsync(const IntVector2& from, const IntVector2& to);
+    /// Discard the tiles of the asynchronous builds not yet swapped in. Waits for the tiles being built.
+    void CancelAsyncBuild();
+    /// Set maximum number of rebuilt tiles swapped into the navigation mesh per frame, 0 for unlimited.
+    void SetMaxTileSwapsPerFrame(unsigned num) { maxTileSwapsPerFrame_ = num; }
+    /// Return maximum number of rebuilt tiles swapped into the navigation mesh per frame.
+    unsigned GetMaxTileSwapsPerFrame() const { return maxTileSwapsPerFrame_; }
+    /// Return number of tiles of the asynchronous builds not yet swapped in.
+    unsigned GetNumPendingTiles() const { return pendingTiles_.size(); }
+    /// Discard the cached geometry of a component, or of all components if null. Needed only when buffer shadow data is written to directly, without SetData or Lock.
+    void InvalidateGeometryCache(Component* component = nullptr);
+    /// Return number of components with cached geometry.
+    unsigned GetNumCachedGeometries() const;
+    /// Return number of times component geometry has been extracted into the cache, which happens for new or changed components only.
+    unsigned GetNumGeometryExtractions() const;
     /// Return tile data.
     virtual std::vector<unsigned char> GetTileData(const IntVector2& tile) const;
     /// Add tile to navigation mesh.
@@ -166,6 +221,19 @@ public:
     /// Find a path between world space points. Return non-empty list of navigation path points if successful. Extents specifies how far off the navigation mesh the points can be.
     void FindPath (std::deque<NavigationPathPoint>& dest, const Vector3& start, const Vector3& end, const Vector3& extents = Vector3::ONE,
         const dtQueryFilter* filter = 0);
+    /// Queue a path request between world space points, searched on the work queue threads. The callback is called at the start of a later frame. Return the request ID.
+    unsigned FindPathAsync(const Vector3& start, const Vector3& end, const NavigationPathCallback& callback,
+        const Vector3& extents = Vector3::ONE, const dtQueryFilter* filter = 0);
+    /// Cancel an asynchronous path request. Return true if the request was found.
+    bool CancelPathRequest(unsigned id);
+    /// Return the queue servicing the asynchronous path requests, to configure it.
+    NavigationPathQueue* GetPathQueue();
+    /// Enable or disable searching long paths first on a graph of the tile regions. Default disabled.
+    void SetHierarchicalPathfinding(bool enable);
+    /// Return whether long paths are searched first on a graph of the tile regions.
+    bool GetHierarchicalPathfinding() const { return tileGraph_ != nullptr; }
+    /// Return the graph of the tile regions, or null if hierarchical pathfinding is disabled.
+    NavigationTileGraph* GetTileGraph() const { return tileGraph_.get(); }
     /// Return a random point on the navigation mesh.
     Vector3 GetRandomPoint(const dtQueryFilter* filter = 0, dtPolyRef* randomRef = 0);
     /// Return a random point on the navigation mesh within a circle. The circle radius is only a guideline and in practice the returned point may be further away.
@@ -250,21 +318,43 @@ private:
     void WriteTile(Serializer& dest, int x, int z) const;
     /// Read tile data to the navigation mesh.
     bool ReadTile(Deserializer& source, bool silent);
+    /// Swap the rebuilt tiles of the asynchronous builds into the navigation mesh.
+    void HandleBeginFrame(unsigned frameNumber, float timeStep);
+    /// Return the ID of the nearest enabled navigation area containing a world space point, or 0 if none.
+    unsigned char GetNavAreaID(const Vector3& position) const;
 protected:
     /// Collect geometry from under Navigable components.
     void CollectGeometries(std::vector<NavigationGeometryInfo>& geometryList);
     /// Visit nodes and collect navigable geometry.
     void CollectGeometries(std::vector<NavigationGeometryInfo>& geometryList, Node* node, QSet<Node *> &processedNodes, bool recursive);
-    /// Get geometry data within a bounding box.
-    void GetTileGeometry(NavBuildData* build, std::vector<NavigationGeometryInfo>& geometryList, BoundingBox& box);
+    /// Get geometry data of a tile within its bounding box.
+    void GetTileGeometry(NavBuildData* build, std::vector<NavigationGeometryInfo>& geometryList, BoundingBox& box, const IntVector2& tile);
+    /// Return a hash of the source data of a geometry component, which changes when its model or shape changes.
+    unsigned GetGeometrySourceHash(const NavigationGeometryInfo& info) const;
+    /// Extract the triangles of a geometry component, relative to the navigation mesh root node.
+    void ExtractGeometry(const NavigationGeometryInfo& info, std::vector<Vector3>& vertices, std::vector<int>& indices);
+    /// Sort the cached triangles of a component into the tiles they overlap.
+    void BucketCachedGeometry(NavigationGeometryCacheEntry& entry);
     /// Add a triangle mesh to the geometry data.
-    void AddTriMeshGeometry(NavBuildData* build, Geometry* geometry, const Matrix3x4& transform);
+    void AddTriMeshGeometry(std::vector<Vector3>& vertices, std::vector<int>& indices, Geometry* geometry, const Matrix3x4& transform);
     /// Build one tile of the navigation mesh. Return true if successful.
     virtual bool BuildTile(std::vector<NavigationGeometryInfo>& geometryList, int x, int z);
-    /// Build tiles in the rectangular area. Return number of built tiles.
+    /// Collect the geometry of a tile and return the object to rebuild it with.
+    virtual std::unique_ptr<NavigationTileBuild> CreateTileBuild(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& tile);
+    /// Build tiles in the rectangular area, concurrently on the work queue threads if available. Return number of built tiles.
     unsigned BuildTiles(std::vector<NavigationGeometryInfo>& geometryList, const IntVector2& from, const IntVector2& to);
+    /// Return the Recast configuration of a tile.
+    void GetTileConfig(rcConfig& cfg, int x, int z) const;
+    /// Copy the build parameters of a tile and collect its geometry for building. Return false if the tile has no geometry.
+    bool GetTileBuildGeometry(NavBuildData& build, std::vector<NavigationGeometryInfo>& geometryList, int x, int z);
+    /// Build Detour tile data from the collected geometry and build parameters. Does not access the scene or the navigation mesh, so may be called from worker threads. Return true if successful.
+    bool BuildTileData(SimpleNavBuildData& build, int x, int z, unsigned char*& navData, int& navDataSize) const;
+    /// Add built tile data to the navigation mesh, which takes ownership of the data, and send the notification. Return true if successful.
+    bool AddTileData(unsigned char* navData, int navDataSize, int x, int z);
     /// Ensure that the navigation mesh query is initialized. Return true if successful.
     bool InitializeQuery();
+    /// Wait for the asynchronous path searches running on the work queue threads. Must be called before modifying the navigation mesh.
+    void WaitForPathSearches();
     /// Release the navigation mesh and the query.
     virtual void ReleaseNavigationMesh();
 
@@ -278,6 +368,12 @@ protected:
     std::unique_ptr<dtQueryFilter> queryFilter_;
     /// Temporary data for finding a path.
     std::unique_ptr<FindPathData> pathData_;
+    /// Triangles of the geometry components, kept between builds.
+    std::unique_ptr<NavigationGeometryCache> geometryCache_;
+    /// Queue of the asynchronous path requests, created on first use.
+    std::unique_ptr<NavigationPathQueue> pathQueue_;
+    /// Graph of the tile regions for hierarchical pathfinding, null if disabled.
+    std::unique_ptr<NavigationTileGraph> tileGraph_;
     /// Tile size.
     int tileSize_;
     /// Cell size.
@@ -324,6 +420,12 @@ protected:
 
     /// NavAreas for this NavMesh
     std::vector<WeakPtr<NavArea> > areas_;
+    /// Tiles of the asynchronous builds, in the order they are swapped in.
+    std::deque<std::unique_ptr<NavigationTileBuild> > pendingTiles_;
+    /// Number of tiles swapped in since the asynchronous builds started.
+    unsigned numAsyncTiles_;
+    /// Maximum number of tiles swapped in per frame, 0 for unlimited.
+    unsigned maxTileSwapsPerFrame_;
 };
 
 /// Register Navigation library objects.
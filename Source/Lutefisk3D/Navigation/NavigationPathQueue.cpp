@@ -0,0 +1,512 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "NavigationPathQueue.h"
+
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
+#include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/IO/Log.h"
+#include "Lutefisk3D/Scene/Node.h"
+
+#include <Detour/DetourNavMesh.h>
+#include <Detour/DetourNavMeshQuery.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace Urho3D
+{
+
+static const int MAX_POLYS = 2048;
+/// Priority of the search tasks: above the background navigation mesh tile builds, below the work the frame waits for.
+static const unsigned SEARCH_TASK_PRIORITY = 1;
+static const unsigned DEFAULT_MAX_ITERATIONS = 1000;
+static const unsigned DEFAULT_MAX_SEARCHES = 16;
+static const unsigned DEFAULT_CACHE_SIZE = 256;
+
+/// Asynchronous path request.
+struct NavigationPathRequest
+{
+    /// Request ID.
+    unsigned id_ = 0;
+    /// Start point relative to the navigation mesh root node.
+    Vector3 start_;
+    /// End point relative to the navigation mesh root node.
+    Vector3 end_;
+    /// Search extents for the start and end polygons.
+    Vector3 extents_;
+    /// Copy of the query filter, so that the caller's filter can change while searching.
+    dtQueryFilter filter_;
+    /// Caller's query filter, identifying the filter in the path cache.
+    const dtQueryFilter* filterKey_ = nullptr;
+    /// Callback receiving the path.
+    NavigationPathCallback callback_;
+    /// Query the request is searched with.
+    dtNavMeshQuery* query_ = nullptr;
+    /// Start polygon.
+    dtPolyRef startRef_ = 0;
+    /// End polygon.
+    dtPolyRef endRef_ = 0;
+    /// Polygon corridor of the path.
+    std::vector<dtPolyRef> polys_;
+    /// Path points relative to the navigation mesh root node.
+    std::vector<Vector3> points_;
+    /// Detour flags of the path points.
+    std::vector<unsigned char> flags_;
+    /// Whether the sliced search has been initialized.
+    bool searching_ = false;
+    /// Whether the corridor was taken from the path cache.
+    bool cached_ = false;
+    /// Whether the search has been restarted after the navigation mesh changed under it.
+    bool retried_ = false;
+    /// Whether the path is ready to be delivered.
+    bool finished_ = false;
+    /// Whether the request has been cancelled.
+    bool cancelled_ = false;
+};
+
+/// Requests advanced by one work item. Shared with the work item, which may run after the task was taken back.
+struct NavigationPathTask
+{
+    /// Requests to advance.
+    std::vector<NavigationPathRequest*> requests_;
+    /// Search iterations per request.
+    unsigned maxIterations_ = 0;
+    /// Whether a thread has started the task.
+    std::atomic<bool> started_{false};
+};
+
+/// Find the path points along the corridor of a request.
+static void FindStraightPath(dtNavMeshQuery* query, NavigationPathRequest& request)
+{
+    // If full path was not found, clamp end point to the end polygon
+    Vector3 actualEnd = request.end_;
+    if (request.polys_.back() != request.endRef_)
+        query->closestPointOnPoly(request.polys_.back(), &request.end_.x_, &actualEnd.x_, nullptr);
+
+    int numPoints = 0;
+    request.points_.resize(MAX_POLYS);
+    request.flags_.resize(MAX_POLYS);
+    query->findStraightPath(&request.start_.x_, &actualEnd.x_, request.polys_.data(), (int)request.polys_.size(),
+        &request.points_[0].x_, request.flags_.data(), nullptr, &numPoints, MAX_POLYS);
+    request.points_.resize(numPoints);
+    request.flags_.resize(numPoints);
+    request.finished_ = true;
+}
+
+/// Advance the search of a request by a number of iterations. Called from the work queue threads.
+static void AdvanceSearch(NavigationPathRequest& request, unsigned maxIterations)
+{
+    dtNavMeshQuery* query = request.query_;
+    if (!request.searching_)
+    {
+        if (dtStatusFailed(query->initSlicedFindPath(request.startRef_, request.endRef_, &request.start_.x_, &request.end_.x_,
+                &request.filter_)))
+        {
+            request.finished_ = true;
+            return;
+        }
+        request.searching_ = true;
+    }
+
+    dtStatus status = query->updateSlicedFindPath((int)maxIterations, nullptr);
+    if (dtStatusInProgress(status))
+        return;
+    request.searching_ = false;
+
+    int numPolys = 0;
+    request.polys_.resize(MAX_POLYS);
+    if (dtStatusSucceed(status))
+        query->finalizeSlicedFindPath(request.polys_.data(), &numPolys, MAX_POLYS);
+    request.polys_.resize(numPolys);
+
+    if (!numPolys)
+    {
+        // Polygons removed from the navigation mesh during the search fail it; search once more from the current polygons
+        if (dtStatusFailed(status) && !request.retried_)
+        {
+            request.retried_ = true;
+            query->findNearestPoly(&request.start_.x_, &request.extents_.x_, &request.filter_, &request.startRef_, nullptr);
+            query->findNearestPoly(&request.end_.x_, &request.extents_.x_, &request.filter_, &request.endRef_, nullptr);
+            if (request.startRef_ && request.endRef_)
+                return;
+        }
+        request.finished_ = true;
+        return;
+    }
+
+    FindStraightPath(query, request);
+}
+
+NavigationPathQueue::NavigationPathQueue(NavigationMesh* navMesh) :
+    navMesh_(navMesh),
+    numQueries_(0),
+    queryNavMesh_(nullptr),
+    numRunningTasks_(0),
+    nextId_(1),
+    maxIterations_(DEFAULT_MAX_ITERATIONS),
+    maxSearches_(DEFAULT_MAX_SEARCHES),
+    cacheSize_(DEFAULT_CACHE_SIZE),
+    numCacheHits_(0)
+{
+    g_coreSignals.postUpdate.Connect(this, &NavigationPathQueue::HandlePostUpdate);
+    g_coreSignals.beginFrame.Connect(this, &NavigationPathQueue::HandleBeginFrame);
+}
+
+NavigationPathQueue::~NavigationPathQueue()
+{
+    CancelAllRequests();
+    for (dtNavMeshQuery* query : freeQueries_)
+        dtFreeNavMeshQuery(query);
+}
+
+unsigned NavigationPathQueue::AddRequest(const Vector3& start, const Vector3& end, const Vector3& extents,
+    const dtQueryFilter* filter, const NavigationPathCallback& callback)
+{
+    std::unique_ptr<NavigationPathRequest> request(new NavigationPathRequest());
+    request->id_ = nextId_++;
+    if (!nextId_)
+        nextId_ = 1;
+
+    // Navigation data is in local space. Transform path points from world to local
+    Node* node = navMesh_->GetNode();
+    Matrix3x4 inverse = node ? node->GetWorldTransform().Inverse() : Matrix3x4::IDENTITY;
+    request->start_ = inverse * start;
+    request->end_ = inverse * end;
+    request->extents_ = extents;
+    request->filter_ = filter ? *filter : *navMesh_->queryFilter_;
+    request->filterKey_ = filter;
+    request->callback_ = callback;
+
+    unsigned id = request->id_;
+    pending_.push_back(std::move(request));
+    return id;
+}
+
+bool NavigationPathQueue::CancelRequest(unsigned id)
+{
+    for (auto i = pending_.begin(); i != pending_.end(); ++i)
+    {
+        if ((*i)->id_ == id)
+        {
+            pending_.erase(i);
+            return true;
+        }
+    }
+    // Requests being searched are only marked, as the work queue threads may be using them
+    for (std::unique_ptr<NavigationPathRequest>& request : active_)
+    {
+        if (request->id_ == id && !request->cancelled_)
+        {
+            request->cancelled_ = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void NavigationPathQueue::CancelAllRequests()
+{
+    WaitForSearches();
+
+    for (std::unique_ptr<NavigationPathRequest>& request : active_)
+    {
+        if (request->query_)
+            freeQueries_.push_back(request->query_);
+    }
+    active_.clear();
+    pending_.clear();
+}
+
+void NavigationPathQueue::WaitForSearches()
+{
+    if (tasks_.empty())
+        return;
+
+    URHO3D_PROFILE(WaitForNavigationPaths);
+
+    // Tasks not started by the worker threads, which may be busy with longer work, are run here instead of waited for
+    for (const std::shared_ptr<NavigationPathTask>& task : tasks_)
+    {
+        if (task->started_.exchange(true))
+            continue;
+        for (NavigationPathRequest* request : task->requests_)
+            AdvanceSearch(*request, task->maxIterations_);
+        MutexLock lock(taskMutex_);
+        --numRunningTasks_;
+    }
+    for (;;)
+    {
+        {
+            MutexLock lock(taskMutex_);
+            if (!numRunningTasks_)
+                break;
+        }
+        tasksDone_.Wait();
+    }
+    tasks_.clear();
+}
+
+void NavigationPathQueue::Reset()
+{
+    WaitForSearches();
+
+    // Search the unfinished requests again, ahead of the ones still waiting
+    for (auto i = active_.rbegin(); i != active_.rend(); ++i)
+    {
+        NavigationPathRequest& request = **i;
+        if (request.query_)
+        {
+            freeQueries_.push_back(request.query_);
+            request.query_ = nullptr;
+        }
+        if (!request.finished_ && !request.cancelled_)
+        {
+            request.searching_ = false;
+            request.retried_ = false;
+            pending_.push_front(std::move(*i));
+        }
+    }
+    active_.erase(std::remove(active_.begin(), active_.end(), nullptr), active_.end());
+
+    cache_.clear();
+    cacheOrder_.clear();
+}
+
+void NavigationPathQueue::SetCacheSize(unsigned size)
+{
+    cacheSize_ = size;
+    while (cache_.size() > cacheSize_)
+    {
+        cache_.erase(cacheOrder_.front());
+        cacheOrder_.pop_front();
+    }
+}
+
+void NavigationPathQueue::HandlePostUpdate(float)
+{
+    if (pending_.empty() && active_.empty())
+        return;
+
+    URHO3D_PROFILE(UpdateNavigationPaths);
+
+    WaitForSearches();
+
+    if (!navMesh_->InitializeQuery())
+    {
+        // No navigation mesh to search: the requests get an empty path
+        while (!pending_.empty())
+        {
+            pending_.front()->finished_ = true;
+            active_.push_back(std::move(pending_.front()));
+            pending_.pop_front();
+        }
+        return;
+    }
+
+    if (queryNavMesh_ != navMesh_->navMesh_)
+    {
+        // The queries of a released navigation mesh were returned by Reset()
+        for (dtNavMeshQuery* query : freeQueries_)
+            dtFreeNavMeshQuery(query);
+        numQueries_ -= freeQueries_.size();
+        freeQueries_.clear();
+        queryNavMesh_ = navMesh_->navMesh_;
+    }
+
+    while (!pending_.empty() && StartRequest(*pending_.front()))
+    {
+        active_.push_back(std::move(pending_.front()));
+        pending_.pop_front();
+    }
+
+    std::vector<NavigationPathRequest*> searches;
+    for (std::unique_ptr<NavigationPathRequest>& request : active_)
+    {
+        if (!request->finished_ && !request->cancelled_)
+            searches.push_back(request.get());
+    }
+    if (searches.empty())
+        return;
+
+    const unsigned maxIterations = maxIterations_;
+    WorkQueue* queue = navMesh_->GetContext()->m_WorkQueueSystem.get();
+    if (!queue || !queue->GetNumThreads())
+    {
+        for (NavigationPathRequest* request : searches)
+            AdvanceSearch(*request, maxIterations);
+        return;
+    }
+
+    // The searches run while the frame renders, and are waited for at the start of the next frame or before the
+    // navigation mesh is modified
+    const unsigned numTasks = Min((unsigned)queue->GetNumThreads(), (unsigned)searches.size());
+    {
+        MutexLock lock(taskMutex_);
+        numRunningTasks_ += numTasks;
+    }
+    for (unsigned i = 0; i < numTasks; ++i)
+    {
+        std::shared_ptr<NavigationPathTask> task(new NavigationPathTask());
+        task->requests_.assign(searches.begin() + searches.size() * i / numTasks, searches.begin() + searches.size() * (i + 1) / numTasks);
+        task->maxIterations_ = maxIterations;
+        tasks_.push_back(task);
+        queue->AddWorkItem([this, task]() {
+            if (task->started_.exchange(true))
+                return;
+            for (NavigationPathRequest* request : task->requests_)
+                AdvanceSearch(*request, task->maxIterations_);
+            // The queue may be destroyed as soon as the waiting thread sees the count reach zero, so signal under the lock
+            MutexLock lock(taskMutex_);
+            if (!--numRunningTasks_)
+                tasksDone_.Set();
+        }, SEARCH_TASK_PRIORITY);
+    }
+}
+
+void NavigationPathQueue::HandleBeginFrame(unsigned, float)
+{
+    if (active_.empty())
+        return;
+
+    WaitForSearches();
+
+    std::vector<std::unique_ptr<NavigationPathRequest> > finished;
+    for (auto i = active_.begin(); i != active_.end();)
+    {
+        NavigationPathRequest& request = **i;
+        if (request.finished_ || request.cancelled_)
+        {
+            if (request.query_)
+                freeQueries_.push_back(request.query_);
+            request.query_ = nullptr;
+            if (!request.cancelled_)
+            {
+                CachePath(request);
+                finished.push_back(std::move(*i));
+            }
+            i = active_.erase(i);
+        }
+        else
+            ++i;
+    }
+
+    // The callbacks may add and cancel requests, so are called only after the finished requests have been removed
+    Node* node = navMesh_->GetNode();
+    const Matrix3x4& transform = node ? node->GetWorldTransform() : Matrix3x4::IDENTITY;
+    for (std::unique_ptr<NavigationPathRequest>& request : finished)
+    {
+        std::deque<NavigationPathPoint> path;
+        for (unsigned i = 0; i < request->points_.size(); ++i)
+        {
+            NavigationPathPoint pt;
+            pt.position_ = transform * request->points_[i];
+            pt.flag_ = (NavigationPathPointFlag)request->flags_[i];
+            pt.areaID_ = navMesh_->GetNavAreaID(pt.position_);
+            path.push_back(pt);
+        }
+        if (request->callback_)
+            request->callback_(request->id_, path);
+    }
+}
+
+bool NavigationPathQueue::StartRequest(NavigationPathRequest& request)
+{
+    dtNavMeshQuery* navMeshQuery = navMesh_->navMeshQuery_;
+    navMeshQuery->findNearestPoly(&request.start_.x_, &request.extents_.x_, &request.filter_, &request.startRef_, nullptr);
+    navMeshQuery->findNearestPoly(&request.end_.x_, &request.extents_.x_, &request.filter_, &request.endRef_, nullptr);
+    if (!request.startRef_ || !request.endRef_)
+    {
+        request.finished_ = true;
+        return true;
+    }
+
+    // A cached corridor is used only if all its polygons still exist
+    auto cached = cache_.find(std::make_pair(std::make_pair(request.startRef_, request.endRef_), request.filterKey_));
+    if (cached != cache_.end())
+    {
+        bool valid = true;
+        for (dtPolyRef ref : cached->second)
+        {
+            if (!queryNavMesh_->isValidPolyRef(ref))
+            {
+                valid = false;
+                break;
+            }
+        }
+        if (valid)
+        {
+            request.polys_ = cached->second;
+            request.cached_ = true;
+            FindStraightPath(navMeshQuery, request);
+            ++numCacheHits_;
+            return true;
+        }
+    }
+
+    if (freeQueries_.empty())
+    {
+        if (numQueries_ >= maxSearches_)
+            return false;
+
+        dtNavMeshQuery* query = dtAllocNavMeshQuery();
+        if (!query || dtStatusFailed(query->init(queryNavMesh_, MAX_POLYS)))
+        {
+            URHO3D_LOGERROR("Could not create navigation path query");
+            dtFreeNavMeshQuery(query);
+            request.finished_ = true;
+            return true;
+        }
+        freeQueries_.push_back(query);
+        ++numQueries_;
+    }
+
+    request.query_ = freeQueries_.back();
+    freeQueries_.pop_back();
+    return true;
+}
+
+void NavigationPathQueue::CachePath(const NavigationPathRequest& request)
+{
+    if (!cacheSize_ || request.cached_ || request.polys_.empty())
+        return;
+
+    auto key = std::make_pair(std::make_pair(request.startRef_, request.endRef_), request.filterKey_);
+    auto existing = cache_.find(key);
+    if (existing != cache_.end())
+    {
+        existing->second = request.polys_;
+        return;
+    }
+
+    cache_[key] = request.polys_;
+    cacheOrder_.push_back(key);
+    while (cache_.size() > cacheSize_)
+    {
+        cache_.erase(cacheOrder_.front());
+        cacheOrder_.pop_front();
+    }
+}
+
+}
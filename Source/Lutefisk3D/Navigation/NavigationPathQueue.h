@@ -0,0 +1,128 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "Lutefisk3D/Container/HashMap.h"
+#include "Lutefisk3D/Core/Condition.h"
+#include "Lutefisk3D/Core/Mutex.h"
+#include "Lutefisk3D/Navigation/NavigationMesh.h"
+
+#include <memory>
+
+class dtNavMesh;
+class dtNavMeshQuery;
+
+namespace Urho3D
+{
+
+struct NavigationPathRequest;
+struct NavigationPathTask;
+
+/// Services the asynchronous path requests of a navigation mesh on the work queue threads. Each request being searched
+/// has its own Detour query and node pool, and advances a limited number of search iterations per frame. The searches
+/// are run from the end of the frame's update until the start of the next frame, when the finished paths are delivered.
+class LUTEFISK3D_EXPORT NavigationPathQueue : public jl::SignalObserver
+{
+public:
+    /// Construct.
+    NavigationPathQueue(NavigationMesh* navMesh);
+    /// Destruct. Discard the unfinished requests without calling their callbacks.
+    ~NavigationPathQueue();
+
+    /// Queue a path request between world space points. Return the request ID.
+    unsigned AddRequest(const Vector3& start, const Vector3& end, const Vector3& extents, const dtQueryFilter* filter,
+        const NavigationPathCallback& callback);
+    /// Cancel a request. Its callback will not be called. Return true if the request was found.
+    bool CancelRequest(unsigned id);
+    /// Cancel all requests.
+    void CancelAllRequests();
+    /// Wait for the searches running on the work queue threads. Must be called before the navigation mesh is modified.
+    void WaitForSearches();
+    /// Wait for the searches, restart the requests being searched and discard the cached paths. Called when the navigation mesh is released.
+    void Reset();
+
+    /// Set maximum number of search iterations per request per frame.
+    void SetMaxIterations(unsigned iterations) { maxIterations_ = Max(iterations, 1U); }
+    /// Set maximum number of requests searched at the same time, each with its own Detour query.
+    void SetMaxSearches(unsigned num) { maxSearches_ = Max(num, 1U); }
+    /// Set number of paths kept for reuse by requests between the same start and end polygons, 0 to disable.
+    void SetCacheSize(unsigned size);
+
+    /// Return maximum number of search iterations per request per frame.
+    unsigned GetMaxIterations() const { return maxIterations_; }
+    /// Return maximum number of requests searched at the same time.
+    unsigned GetMaxSearches() const { return maxSearches_; }
+    /// Return number of paths kept for reuse.
+    unsigned GetCacheSize() const { return cacheSize_; }
+    /// Return number of unfinished requests.
+    unsigned GetNumRequests() const { return pending_.size() + active_.size(); }
+    /// Return number of requests served from the path cache.
+    unsigned GetNumCacheHits() const { return numCacheHits_; }
+
+private:
+    /// Start and advance the searches after the frame's update.
+    void HandlePostUpdate(float timeStep);
+    /// Deliver the finished paths at the start of the frame.
+    void HandleBeginFrame(unsigned frameNumber, float timeStep);
+    /// Find the start and end polygons of a request and either take its path from the cache, or give it a query to search with. Return false if no query is free.
+    bool StartRequest(NavigationPathRequest& request);
+    /// Store the path of a finished request in the cache.
+    void CachePath(const NavigationPathRequest& request);
+
+    /// Navigation mesh.
+    NavigationMesh* navMesh_;
+    /// Requests waiting for a query.
+    std::deque<std::unique_ptr<NavigationPathRequest> > pending_;
+    /// Requests being searched, or finished and waiting to be delivered.
+    std::vector<std::unique_ptr<NavigationPathRequest> > active_;
+    /// Queries not used by a request.
+    std::vector<dtNavMeshQuery*> freeQueries_;
+    /// Number of queries allocated.
+    unsigned numQueries_;
+    /// Detour navigation mesh the queries were initialized with.
+    dtNavMesh* queryNavMesh_;
+    /// Cached polygon corridors by start polygon, end polygon and query filter.
+    HashMap<std::pair<std::pair<dtPolyRef, dtPolyRef>, const dtQueryFilter*>, std::vector<dtPolyRef> > cache_;
+    /// Cache keys in the order they were added.
+    std::deque<std::pair<std::pair<dtPolyRef, dtPolyRef>, const dtQueryFilter*> > cacheOrder_;
+    /// Search tasks added to the work queue since the last wait.
+    std::vector<std::shared_ptr<NavigationPathTask> > tasks_;
+    /// Number of search tasks not finished. Guarded by taskMutex_.
+    unsigned numRunningTasks_;
+    /// Mutex for the number of running tasks.
+    Mutex taskMutex_;
+    /// Set when the last running search task finishes.
+    Condition tasksDone_;
+    /// Next request ID.
+    unsigned nextId_;
+    /// Maximum search iterations per request per frame.
+    unsigned maxIterations_;
+    /// Maximum number of requests searched at the same time.
+    unsigned maxSearches_;
+    /// Maximum number of cached paths.
+    unsigned cacheSize_;
+    /// Number of requests served from the cache.
+    unsigned numCacheHits_;
+};
+
+}
@@ -0,0 +1,392 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "NavigationTileGraph.h"
+
+#include "Lutefisk3D/Container/HashMap.h"
+#include "Lutefisk3D/Core/Profiler.h"
+
+#include <Detour/DetourNavMesh.h>
+#include <Detour/DetourNavMeshQuery.h>
+
+#include <algorithm>
+#include <queue>
+
+namespace Urho3D
+{
+
+static const unsigned DEFAULT_REFINE_PORTALS = 4;
+static const int MAX_NEIGHBOUR_TILES = 32;
+
+/// Return the center of a polygon in navigation mesh space.
+static Vector3 GetPolyCenter(const dtMeshTile* tile, const dtPoly& poly)
+{
+    Vector3 center;
+    for (unsigned i = 0; i < poly.vertCount; ++i)
+        center += Vector3(&tile->verts[poly.verts[i] * 3]);
+    return center / (float)poly.vertCount;
+}
+
+/// Return the midpoint of the part of a polygon edge shared with a link.
+static Vector3 GetPortalMidpoint(const dtMeshTile* tile, const dtPoly& poly, const dtLink& link)
+{
+    // Off-mesh connections link through their end points, and the polygons they land on have no edge for them
+    if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+        return Vector3(&tile->verts[poly.verts[link.edge] * 3]);
+    if (link.edge == 0xff)
+        return GetPolyCenter(tile, poly);
+
+    const Vector3 v0(&tile->verts[poly.verts[link.edge] * 3]);
+    const Vector3 v1(&tile->verts[poly.verts[(link.edge + 1) % poly.vertCount] * 3]);
+    if (link.side == 0xff)
+        return (v0 + v1) * 0.5f;
+    // Links across the tile border may cover only a part of the edge
+    return v0.Lerp(v1, (link.bmin + link.bmax) / 510.0f);
+}
+
+/// Add the indices of the tiles around and at a tile coordinate.
+static void GetNeighbourTiles(const dtNavMesh* navMesh, int x, int z, std::vector<unsigned>& dest)
+{
+    const dtMeshTile* tiles[MAX_NEIGHBOUR_TILES];
+    for (int dz = -1; dz <= 1; ++dz)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            const int numTiles = navMesh->getTilesAt(x + dx, z + dz, tiles, MAX_NEIGHBOUR_TILES);
+            for (int i = 0; i < numTiles; ++i)
+                dest.push_back(navMesh->decodePolyIdTile(navMesh->getTileRef(tiles[i])));
+        }
+    }
+}
+
+NavigationTileGraph::NavigationTileGraph() :
+    navMesh_(nullptr),
+    refinePortals_(DEFAULT_REFINE_PORTALS)
+{
+}
+
+NavigationTileGraph::~NavigationTileGraph() = default;
+
+void NavigationTileGraph::Update(const dtNavMesh* navMesh)
+{
+    if (navMesh != navMesh_ || tiles_.size() != (unsigned)navMesh->getMaxTiles())
+    {
+        Clear();
+        navMesh_ = navMesh;
+        tiles_.resize(navMesh->getMaxTiles());
+    }
+
+    // Detour changes the salt of a tile whenever it is removed, so a tile replaced since the last update is detected too
+    std::vector<unsigned> changed;
+    for (unsigned i = 0; i < tiles_.size(); ++i)
+    {
+        const dtMeshTile* tile = navMesh_->getTile(i);
+        const TileEntry& entry = tiles_[i];
+        const bool present = tile->header != nullptr;
+        if (present != entry.present_ || (present && tile->salt != entry.salt_))
+            changed.push_back(i);
+    }
+    if (changed.empty())
+        return;
+
+    URHO3D_PROFILE(UpdateNavigationTileGraph);
+
+    // Split the changed tiles into regions first, as the links refer to the regions of the neighbouring tiles
+    std::vector<unsigned> relink;
+    for (unsigned index : changed)
+    {
+        const dtMeshTile* tile = navMesh_->getTile(index);
+        TileEntry& entry = tiles_[index];
+        if (entry.present_)
+            GetNeighbourTiles(navMesh_, entry.x_, entry.z_, relink);
+
+        entry.present_ = tile->header != nullptr;
+        entry.salt_ = tile->salt;
+        entry.regions_.clear();
+        entry.polyRegions_.clear();
+        if (entry.present_)
+        {
+            entry.x_ = tile->header->x;
+            entry.z_ = tile->header->y;
+            BuildRegions(tile, entry);
+            GetNeighbourTiles(navMesh_, entry.x_, entry.z_, relink);
+        }
+    }
+
+    std::sort(relink.begin(), relink.end());
+    relink.erase(std::unique(relink.begin(), relink.end()), relink.end());
+    for (unsigned index : relink)
+    {
+        if (tiles_[index].present_)
+            BuildLinks(navMesh_->getTile(index), tiles_[index]);
+    }
+}
+
+void NavigationTileGraph::Clear()
+{
+    tiles_.clear();
+    navMesh_ = nullptr;
+}
+
+int NavigationTileGraph::FindCorridor(dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef, const Vector3& start,
+    const Vector3& end, const dtQueryFilter* filter, dtPolyRef* path, int maxPath)
+{
+    Update(query->getAttachedNavMesh());
+
+    const RegionKey startRegion = GetRegion(startRef);
+    const RegionKey endRegion = GetRegion(endRef);
+    if (startRegion.second == M_MAX_UNSIGNED || endRegion.second == M_MAX_UNSIGNED)
+        return 0;
+    // Within neighbouring tiles a regular search is as cheap
+    const TileEntry& startTile = tiles_[startRegion.first];
+    const TileEntry& endTile = tiles_[endRegion.first];
+    if (Abs(startTile.x_ - endTile.x_) <= 1 && Abs(startTile.z_ - endTile.z_) <= 1)
+        return 0;
+
+    URHO3D_PROFILE(FindHierarchicalPath);
+
+    std::vector<const NavigationRegionLink*> route;
+    if (!FindRoute(startRegion, endRegion, end, route))
+        return 0;
+
+    // Search the polygons from portal to portal. Consecutive searches share the polygon at the portal
+    int numPolys = 0;
+    dtPolyRef fromRef = startRef;
+    Vector3 fromPos = start;
+    unsigned nextPortal = 0;
+    for (;;)
+    {
+        const bool last = nextPortal + refinePortals_ > route.size();
+        dtPolyRef toRef = endRef;
+        Vector3 toPos = end;
+        if (!last)
+        {
+            nextPortal += refinePortals_;
+            toRef = route[nextPortal - 1]->portalPoly_;
+            toPos = route[nextPortal - 1]->portal_;
+        }
+
+        const int offset = numPolys ? numPolys - 1 : 0;
+        int numSegmentPolys = 0;
+        query->findPath(fromRef, toRef, &fromPos.x_, &toPos.x_, filter, path + offset, &numSegmentPolys, maxPath - offset);
+        // The filter may block a route the graph allows, or the path may not fit
+        if (!numSegmentPolys || path[offset + numSegmentPolys - 1] != toRef)
+            return 0;
+        numPolys = offset + numSegmentPolys;
+        if (last)
+            break;
+
+        fromRef = toRef;
+        fromPos = toPos;
+    }
+
+    // Cut the loops where a search went back through polygons of the previous one
+    HashMap<dtPolyRef, int> positions;
+    int numUnique = 0;
+    for (int i = 0; i < numPolys; ++i)
+    {
+        auto it = positions.find(path[i]);
+        if (it != positions.end())
+        {
+            const int cut = it->second + 1;
+            for (int j = cut; j < numUnique; ++j)
+                positions.erase(path[j]);
+            numUnique = cut;
+            continue;
+        }
+        positions[path[i]] = numUnique;
+        path[numUnique++] = path[i];
+    }
+    return numUnique;
+}
+
+unsigned NavigationTileGraph::GetNumRegions() const
+{
+    unsigned num = 0;
+    for (const TileEntry& entry : tiles_)
+        num += entry.regions_.size();
+    return num;
+}
+
+unsigned NavigationTileGraph::GetNumLinks() const
+{
+    unsigned num = 0;
+    for (const TileEntry& entry : tiles_)
+    {
+        for (const NavigationTileRegion& region : entry.regions_)
+            num += region.links_.size();
+    }
+    return num;
+}
+
+void NavigationTileGraph::BuildRegions(const dtMeshTile* tile, TileEntry& entry)
+{
+    const unsigned tileIndex = navMesh_->decodePolyIdTile(navMesh_->getTileRef(tile));
+    const int numPolys = tile->header->polyCount;
+    entry.polyRegions_.resize(numPolys, M_MAX_UNSIGNED);
+
+    std::vector<unsigned> stack;
+    for (int i = 0; i < numPolys; ++i)
+    {
+        if (entry.polyRegions_[i] != M_MAX_UNSIGNED)
+            continue;
+
+        // Flood fill through the links staying within the tile
+        const unsigned region = entry.regions_.size();
+        Vector3 centerSum;
+        unsigned numRegionPolys = 0;
+        entry.polyRegions_[i] = region;
+        stack.push_back(i);
+        while (!stack.empty())
+        {
+            const dtPoly& poly = tile->polys[stack.back()];
+            stack.pop_back();
+            centerSum += GetPolyCenter(tile, poly);
+            ++numRegionPolys;
+
+            for (unsigned j = poly.firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+            {
+                const dtPolyRef ref = tile->links[j].ref;
+                if (navMesh_->decodePolyIdTile(ref) != tileIndex)
+                    continue;
+                const unsigned linkPoly = navMesh_->decodePolyIdPoly(ref);
+                if (entry.polyRegions_[linkPoly] == M_MAX_UNSIGNED)
+                {
+                    entry.polyRegions_[linkPoly] = region;
+                    stack.push_back(linkPoly);
+                }
+            }
+        }
+
+        entry.regions_.emplace_back();
+        entry.regions_.back().center_ = centerSum / (float)numRegionPolys;
+    }
+}
+
+void NavigationTileGraph::BuildLinks(const dtMeshTile* tile, TileEntry& entry)
+{
+    const unsigned tileIndex = navMesh_->decodePolyIdTile(navMesh_->getTileRef(tile));
+    for (NavigationTileRegion& region : entry.regions_)
+        region.links_.clear();
+
+    for (int i = 0; i < tile->header->polyCount; ++i)
+    {
+        const dtPoly& poly = tile->polys[i];
+        NavigationTileRegion& region = entry.regions_[entry.polyRegions_[i]];
+
+        for (unsigned j = poly.firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+        {
+            const dtLink& link = tile->links[j];
+            const unsigned linkTile = navMesh_->decodePolyIdTile(link.ref);
+            if (linkTile == tileIndex)
+                continue;
+            const TileEntry& linkEntry = tiles_[linkTile];
+            const unsigned linkPoly = navMesh_->decodePolyIdPoly(link.ref);
+            if (!linkEntry.present_ || linkPoly >= linkEntry.polyRegions_.size())
+                continue;
+            const unsigned linkRegion = linkEntry.polyRegions_[linkPoly];
+
+            const Vector3 portal = GetPortalMidpoint(tile, poly, link);
+            const float cost = (portal - region.center_).Length() + (linkEntry.regions_[linkRegion].center_ - portal).Length();
+
+            // Keep the cheapest portal between two regions
+            auto existing = std::find_if(region.links_.begin(), region.links_.end(), [linkTile, linkRegion](const NavigationRegionLink& l) {
+                return l.tile_ == linkTile && l.region_ == linkRegion;
+            });
+            if (existing == region.links_.end())
+                existing = region.links_.insert(region.links_.end(), NavigationRegionLink{linkTile, linkRegion, 0, portal, M_INFINITY});
+            if (cost < existing->cost_)
+            {
+                existing->portalPoly_ = link.ref;
+                existing->portal_ = portal;
+                existing->cost_ = cost;
+            }
+        }
+    }
+}
+
+NavigationTileGraph::RegionKey NavigationTileGraph::GetRegion(dtPolyRef ref) const
+{
+    unsigned salt, tileIndex, polyIndex;
+    navMesh_->decodePolyId(ref, salt, tileIndex, polyIndex);
+    if (tileIndex >= tiles_.size() || !tiles_[tileIndex].present_ || tiles_[tileIndex].salt_ != salt ||
+        polyIndex >= tiles_[tileIndex].polyRegions_.size())
+        return RegionKey(tileIndex, M_MAX_UNSIGNED);
+    return RegionKey(tileIndex, tiles_[tileIndex].polyRegions_[polyIndex]);
+}
+
+bool NavigationTileGraph::FindRoute(const RegionKey& start, const RegionKey& end, const Vector3& endPos,
+    std::vector<const NavigationRegionLink*>& route) const
+{
+    /// Search state of a region.
+    struct VisitedRegion
+    {
+        float cost_;                        ///< Cost from the start region.
+        RegionKey parent_;                  ///< Region the search came from.
+        const NavigationRegionLink* link_;  ///< Link the search came through.
+        bool closed_;                       ///< Region has been expanded.
+    };
+    typedef std::pair<float, RegionKey> OpenRegion;
+
+    HashMap<RegionKey, VisitedRegion> visited;
+    std::priority_queue<OpenRegion, std::vector<OpenRegion>, std::greater<OpenRegion> > open;
+    visited[start] = VisitedRegion{0.0f, start, nullptr, false};
+    open.push(OpenRegion(0.0f, start));
+
+    while (!open.empty())
+    {
+        const RegionKey key = open.top().second;
+        open.pop();
+        VisitedRegion& current = visited[key];
+        if (current.closed_)
+            continue;
+        current.closed_ = true;
+
+        if (key == end)
+        {
+            route.clear();
+            for (RegionKey k = end; k != start; k = visited[k].parent_)
+                route.push_back(visited[k].link_);
+            std::reverse(route.begin(), route.end());
+            return true;
+        }
+
+        const float cost = current.cost_;
+        for (const NavigationRegionLink& link : tiles_[key.first].regions_[key.second].links_)
+        {
+            const RegionKey linkKey(link.tile_, link.region_);
+            const float linkCost = cost + link.cost_;
+            auto it = visited.find(linkKey);
+            if (it != visited.end() && (it->second.closed_ || it->second.cost_ <= linkCost))
+                continue;
+
+            visited[linkKey] = VisitedRegion{linkCost, key, &link, false};
+            const float heuristic = (tiles_[link.tile_].regions_[link.region_].center_ - endPos).Length();
+            open.push(OpenRegion(linkCost + heuristic, linkKey));
+        }
+    }
+
+    return false;
+}
+
+}
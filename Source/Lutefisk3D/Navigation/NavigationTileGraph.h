@@ -0,0 +1,122 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "Lutefisk3D/Core/Lutefisk3D.h"
+#include "Lutefisk3D/Math/Vector3.h"
+
+#include <vector>
+
+#ifdef DT_POLYREF64
+typedef uint64_t dtPolyRef;
+#else
+typedef unsigned int dtPolyRef;
+#endif
+
+class dtNavMesh;
+class dtNavMeshQuery;
+class dtQueryFilter;
+struct dtMeshTile;
+
+namespace Urho3D
+{
+
+/// Link from a tile region to a region of a neighbouring tile.
+struct NavigationRegionLink
+{
+    unsigned tile_;             ///< Tile index of the linked region.
+    unsigned region_;           ///< Index of the linked region in its tile.
+    dtPolyRef portalPoly_;      ///< Polygon of the linked region at the portal.
+    Vector3 portal_;            ///< Midpoint of the portal edge, in navigation mesh space.
+    float cost_;                ///< Distance from the region center to the linked region center through the portal.
+};
+
+/// Polygons of a tile connected to each other without leaving the tile.
+struct NavigationTileRegion
+{
+    Vector3 center_;                                ///< Average of the polygon centers, in navigation mesh space.
+    std::vector<NavigationRegionLink> links_;       ///< Links to the regions of the neighbouring tiles.
+};
+
+/// Abstract graph over the tiles of a navigation mesh, for finding long paths. Every tile is split into regions of
+/// connected polygons, and the regions are linked through the portals on the tile borders. A path is first searched on
+/// the graph, and then refined with short polygon searches between the portals along the route, so that the polygon
+/// searches stay within the node pool of the query however long the path is.
+class LUTEFISK3D_EXPORT NavigationTileGraph
+{
+public:
+    /// Construct.
+    NavigationTileGraph();
+    /// Destruct.
+    ~NavigationTileGraph();
+
+    /// Bring the graph up to date with the tiles added to and removed from the navigation mesh since the last update.
+    void Update(const dtNavMesh* navMesh);
+    /// Discard the graph.
+    void Clear();
+    /// Find the polygon corridor between two points on the navigation mesh. Return the number of polygons, or 0 if no
+    /// route was found on the graph or refining it failed, in which case a regular search should be made.
+    int FindCorridor(dtNavMeshQuery* query, dtPolyRef startRef, dtPolyRef endRef, const Vector3& start, const Vector3& end,
+        const dtQueryFilter* filter, dtPolyRef* path, int maxPath);
+
+    /// Set the maximum number of portals a refining polygon search spans.
+    void SetRefinePortals(unsigned num) { refinePortals_ = Max(num, 1U); }
+    /// Return the maximum number of portals a refining polygon search spans.
+    unsigned GetRefinePortals() const { return refinePortals_; }
+    /// Return number of regions in the graph.
+    unsigned GetNumRegions() const;
+    /// Return number of links between the regions.
+    unsigned GetNumLinks() const;
+
+private:
+    /// Regions of a tile.
+    struct TileEntry
+    {
+        bool present_ = false;                      ///< Tile was present on the last update.
+        unsigned salt_ = 0;                         ///< Salt of the tile on the last update.
+        int x_ = 0;                                 ///< Tile X coordinate.
+        int z_ = 0;                                 ///< Tile Z coordinate.
+        std::vector<NavigationTileRegion> regions_; ///< Regions.
+        std::vector<unsigned> polyRegions_;         ///< Region of every polygon.
+    };
+    /// Node of the graph, by tile index and region index.
+    typedef std::pair<unsigned, unsigned> RegionKey;
+
+    /// Split a tile into regions.
+    void BuildRegions(const dtMeshTile* tile, TileEntry& entry);
+    /// Link the regions of a tile to the regions of the neighbouring tiles.
+    void BuildLinks(const dtMeshTile* tile, TileEntry& entry);
+    /// Return the region of a polygon. The region index is M_MAX_UNSIGNED if the polygon is not in the graph.
+    RegionKey GetRegion(dtPolyRef ref) const;
+    /// Search the region route between two regions. Return true if found.
+    bool FindRoute(const RegionKey& start, const RegionKey& end, const Vector3& endPos, std::vector<const NavigationRegionLink*>& route) const;
+
+    /// Navigation mesh the graph was built from.
+    const dtNavMesh* navMesh_;
+    /// Regions of every tile, by tile index.
+    std::vector<TileEntry> tiles_;
+    /// Maximum number of portals spanned by a refining search.
+    unsigned refinePortals_;
+};
+
+}
@@ -0,0 +1,109 @@
+#include <QTest>
+#include "NavigationTestScene.h"
+#include "../CrowdAgent.h"
+#include "../CrowdManager.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+/// Build the navigation mesh of a scene and add a crowd of agents on a grid, each heading to the opposite side.
+std::vector<Urho3D::CrowdAgent*> CreateCrowd(Urho3D::Scene* scene, unsigned numAgents)
+{
+    using namespace Urho3D;
+    NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+    navMesh->Build();
+    CrowdManager* crowdManager = scene->CreateComponent<CrowdManager>();
+    crowdManager->SetMaxAgents(numAgents);
+
+    const unsigned side = (unsigned)std::ceil(std::sqrt((float)numAgents));
+    const float spacing = 1.5f;
+    const float offset = (float)(side - 1) * spacing * 0.5f;
+    std::vector<CrowdAgent*> agents;
+    for (unsigned i = 0; i < numAgents; ++i)
+    {
+        const Vector3 position((float)(i % side) * spacing - offset, 0.0f, (float)(i / side) * spacing - offset);
+        Node* node = scene->CreateChild("Agent");
+        node->SetPosition(position);
+        CrowdAgent* agent = node->CreateComponent<CrowdAgent>();
+        agent->SetTargetPosition(Vector3(-position.x_, 0.0f, -position.z_));
+        agents.push_back(agent);
+    }
+    return agents;
+}
+}
+
+class CrowdManagerTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreateNavigationTestContext(ctx, 3);
+    }
+    void verifyParallelUpdateMatchesSerial() {
+        using namespace Urho3D;
+        // Without worker threads the crowd has no parallel for callback
+        Context serialContext;
+        CreateNavigationTestContext(&serialContext, 0);
+        SharedPtr<Scene> serialScene = CreateObstacleScene(&serialContext, 6);
+        std::vector<CrowdAgent*> serialAgents = CreateCrowd(serialScene, 400);
+
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, 6);
+        std::vector<CrowdAgent*> agents = CreateCrowd(scene, 400);
+        QCOMPARE(agents.size(), serialAgents.size());
+        std::vector<Vector3> startPositions;
+        for (CrowdAgent* agent : agents)
+            startPositions.push_back(agent->GetPosition());
+
+        // Agents crossing the middle of the crowd steer around each other and the obstacles
+        for (unsigned frame = 0; frame < 120; ++frame)
+        {
+            serialScene->Update(1.0f / 30.0f);
+            scene->Update(1.0f / 30.0f);
+        }
+        unsigned numMoved = 0;
+        for (unsigned i = 0; i < agents.size(); ++i)
+        {
+            QVERIFY(agents[i]->IsInCrowd());
+            const Vector3 position = agents[i]->GetPosition();
+            const Vector3 serialPosition = serialAgents[i]->GetPosition();
+            QVERIFY(memcmp(&position, &serialPosition, sizeof(Vector3)) == 0);
+            const Vector3 velocity = agents[i]->GetActualVelocity();
+            const Vector3 serialVelocity = serialAgents[i]->GetActualVelocity();
+            QVERIFY(memcmp(&velocity, &serialVelocity, sizeof(Vector3)) == 0);
+            numMoved += (position - startPositions[i]).Length() > 1.0f ? 1 : 0;
+        }
+        QVERIFY(numMoved > agents.size() / 2);
+    }
+    void benchmarkCrowdUpdate_data() {
+        QTest::addColumn<unsigned>("numAgents");
+        QTest::newRow("5000") << 5000U;
+        QTest::newRow("10000") << 10000U;
+        QTest::newRow("20000") << 20000U;
+    }
+    void benchmarkCrowdUpdate() {
+        using namespace Urho3D;
+        QFETCH(unsigned, numAgents);
+        // Room for the agents 1.5 units apart, plus obstacles between them
+        const int numTiles = (int)std::ceil(std::sqrt((float)numAgents) * 1.5f / (TEST_TILE_SIZE * 0.3f)) + 2;
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, numTiles);
+        std::vector<CrowdAgent*> agents = CreateCrowd(scene, numAgents);
+        QCOMPARE((unsigned)agents.size(), numAgents);
+        // Past the first frames, when the agents request their paths
+        for (unsigned frame = 0; frame < 10; ++frame)
+            scene->Update(1.0f / 30.0f);
+        QBENCHMARK {
+            scene->Update(1.0f / 30.0f);
+        }
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(CrowdManagerTests)
+#include "CrowdManagerTests.moc"
@@ -0,0 +1,110 @@
+#include <QTest>
+#include "NavigationTestScene.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
+
+#include <vector>
+
+namespace
+{
+unsigned numFinished = 0;
+unsigned numFinishedTiles = 0;
+
+void CountFinished(Urho3D::Node*, Urho3D::NavigationMesh*, unsigned numTiles)
+{
+    ++numFinished;
+    numFinishedTiles = numTiles;
+}
+
+std::vector<std::vector<unsigned char>> GetAllTileData(Urho3D::NavigationMesh* navMesh)
+{
+    std::vector<std::vector<unsigned char>> data;
+    for (int z = 0; z < navMesh->GetNumTiles().y_; ++z)
+        for (int x = 0; x < navMesh->GetNumTiles().x_; ++x)
+            data.push_back(navMesh->GetTileData(Urho3D::IntVector2(x, z)));
+    return data;
+}
+
+void RemoveObstacles(Urho3D::Scene* scene)
+{
+    while (Urho3D::Node* obstacle = scene->GetChild("Obstacle"))
+        obstacle->Remove();
+}
+}
+
+class NavigationAsyncBuildTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreateNavigationTestContext(ctx, 3);
+    }
+    void init()
+    {
+        numFinished = 0;
+        numFinishedTiles = 0;
+    }
+    void verifySwapsAtFrameStart() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, 6);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        navMesh->navigationAsyncBuildFinished.Connect(&CountFinished);
+        const std::vector<std::vector<unsigned char>> original = GetAllTileData(navMesh);
+        const unsigned numTiles = original.size();
+
+        RemoveObstacles(scene);
+        navMesh->SetMaxTileSwapsPerFrame(4);
+        QVERIFY(navMesh->BuildAsync(IntVector2::ZERO, navMesh->GetNumTiles() - IntVector2(1, 1)));
+        QCOMPARE(navMesh->GetNumPendingTiles(), numTiles);
+        // Built on the worker threads, but not swapped in before the frame starts
+        QTRY_VERIFY(ctx->m_WorkQueueSystem->IsCompleted(0));
+        QCOMPARE(navMesh->GetNumPendingTiles(), numTiles);
+        QVERIFY(GetAllTileData(navMesh) == original);
+
+        unsigned frame = 1;
+        for (unsigned remaining = numTiles; remaining; ++frame)
+        {
+            QCOMPARE(numFinished, 0U);
+            g_coreSignals.beginFrame(frame, 1.0f / 60.0f);
+            remaining -= Min(remaining, 4U);
+            QCOMPARE(navMesh->GetNumPendingTiles(), remaining);
+        }
+        QCOMPARE(numFinished, 1U);
+        QCOMPARE(numFinishedTiles, numTiles);
+        QVERIFY(GetAllTileData(navMesh) != original);
+
+        // Finished builds do not swap again
+        g_coreSignals.beginFrame(frame, 1.0f / 60.0f);
+        QCOMPARE(numFinished, 1U);
+    }
+    void verifyCancelWithTilesInFlight() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, 16);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        navMesh->navigationAsyncBuildFinished.Connect(&CountFinished);
+        const std::vector<std::vector<unsigned char>> original = GetAllTileData(navMesh);
+
+        RemoveObstacles(scene);
+        QVERIFY(navMesh->BuildAsync(IntVector2::ZERO, navMesh->GetNumTiles() - IntVector2(1, 1)));
+        QVERIFY(navMesh->GetNumPendingTiles() > 0);
+        // Some tiles are being built by the worker threads, the rest are still queued
+        navMesh->CancelAsyncBuild();
+        QCOMPARE(navMesh->GetNumPendingTiles(), 0U);
+        QTRY_VERIFY(ctx->m_WorkQueueSystem->IsCompleted(0));
+
+        for (unsigned frame = 1; frame < 10; ++frame)
+            g_coreSignals.beginFrame(frame, 1.0f / 60.0f);
+        QCOMPARE(numFinished, 0U);
+        QVERIFY(GetAllTileData(navMesh) == original);
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(NavigationAsyncBuildTests)
+#include "NavigationAsyncBuildTests.moc"
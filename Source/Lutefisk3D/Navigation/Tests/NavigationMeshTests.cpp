@@ -0,0 +1,147 @@
+#include <QTest>
+#include "NavigationTestScene.h"
+#include "Lutefisk3D/Graphics/Geometry.h"
+#include "Lutefisk3D/Graphics/IndexBuffer.h"
+#include "Lutefisk3D/Graphics/Model.h"
+#include "Lutefisk3D/Graphics/VertexBuffer.h"
+
+namespace
+{
+/// Create a model of one quad on the XZ plane, with shadowed buffers.
+Urho3D::SharedPtr<Urho3D::Model> CreateQuadModel(Urho3D::Context* context, float size)
+{
+    using namespace Urho3D;
+    const float vertices[] = { -size, 0.0f, -size, size, 0.0f, -size, size, 0.0f, size, -size, 0.0f, size };
+    const unsigned short indices[] = { 0, 2, 1, 0, 3, 2 };
+    SharedPtr<VertexBuffer> vertexBuffer(new VertexBuffer(context, true));
+    vertexBuffer->SetShadowed(true);
+    vertexBuffer->SetSize(4, MASK_POSITION);
+    vertexBuffer->SetData(vertices);
+    SharedPtr<IndexBuffer> indexBuffer(new IndexBuffer(context, true));
+    indexBuffer->SetShadowed(true);
+    indexBuffer->SetSize(6, false);
+    indexBuffer->SetData(indices);
+    SharedPtr<Geometry> geometry(new Geometry(context));
+    geometry->SetVertexBuffer(0, vertexBuffer);
+    geometry->SetIndexBuffer(indexBuffer);
+    geometry->SetDrawRange(TRIANGLE_LIST, 0, 6);
+
+    SharedPtr<Model> model(new Model(context));
+    model->SetNumGeometries(1);
+    model->SetGeometry(0, 0, geometry);
+    model->SetBoundingBox(BoundingBox(Vector3(-size, 0.0f, -size), Vector3(size, 0.0f, size)));
+    return model;
+}
+}
+
+class NavigationMeshTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreateNavigationTestContext(ctx, 3);
+    }
+    void verifyPathQueries() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateFloorScene(ctx);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        QVERIFY(navMesh->GetNumTiles().x_ > 2);
+        QVERIFY(navMesh->HasTile(navMesh->GetTileIndex(PATH_START)));
+
+        std::deque<NavigationPathPoint> path;
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.size() > 2);
+        QVERIFY((path.back().position_ - PATH_END).Length() < 0.5f);
+        // The wall is walked around through the gap at its positive X end
+        bool throughGap = false;
+        for (const NavigationPathPoint& point : path)
+            throughGap |= point.position_.x_ > 20.0f;
+        QVERIFY(throughGap);
+    }
+    void verifyBuildIndependentOfThreads() {
+        using namespace Urho3D;
+        // The same scene built serially, and in batches on the worker threads
+        Context serialContext;
+        CreateNavigationTestContext(&serialContext, 0);
+        SharedPtr<Scene> serialScene = CreateObstacleScene(&serialContext, 8);
+        NavigationMesh* serialMesh = serialScene->GetComponent<NavigationMesh>();
+        QVERIFY(serialMesh->Build());
+
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, 8);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+
+        QCOMPARE(navMesh->GetNumTiles(), serialMesh->GetNumTiles());
+        QVERIFY(navMesh->GetNumTiles().x_ >= 8);
+        unsigned numTiles = 0;
+        for (int z = 0; z < navMesh->GetNumTiles().y_; ++z)
+        {
+            for (int x = 0; x < navMesh->GetNumTiles().x_; ++x)
+            {
+                const IntVector2 tile(x, z);
+                QCOMPARE(navMesh->HasTile(tile), serialMesh->HasTile(tile));
+                // Also covers the tile references, which depend on the order the tiles were added in
+                QVERIFY(navMesh->GetTileData(tile) == serialMesh->GetTileData(tile));
+                numTiles += navMesh->HasTile(tile) ? 1 : 0;
+            }
+        }
+        QVERIFY(numTiles > 32);
+    }
+    void verifyGeometryCache() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateObstacleScene(ctx, 4);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        // The floor and one obstacle per tile
+        QCOMPARE(navMesh->GetNumCachedGeometries(), 17U);
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 17U);
+
+        // Only the moved obstacle is extracted again
+        scene->GetChild("Obstacle")->Translate(Vector3(1.0f, 0.0f, 0.5f));
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumCachedGeometries(), 17U);
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 18U);
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 18U);
+
+        // A triangle mesh is extracted again when its vertex data is set, although the buffers stay the same
+        SharedPtr<Model> model = CreateQuadModel(ctx, 2.0f);
+        Node* meshNode = scene->CreateChild("Mesh");
+        meshNode->SetPosition(Vector3(0.0f, 0.5f, 0.0f));
+        meshNode->CreateComponent<CollisionShape>()->SetTriangleMesh(model);
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumCachedGeometries(), 18U);
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 19U);
+        const float raised[] = { -2.0f, 0.2f, -2.0f, 2.0f, 0.2f, -2.0f, 2.0f, 0.2f, 2.0f, -2.0f, 0.2f, 2.0f };
+        model->GetGeometry(0, 0)->GetVertexBuffer(0)->SetData(raised);
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 20U);
+        // Replacing the geometry with an equal one is a change too
+        model->SetGeometry(0, 0, CreateQuadModel(ctx, 2.0f)->GetGeometry(0, 0));
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 21U);
+
+        // A removed component leaves the cache
+        meshNode->Remove();
+        QVERIFY(navMesh->Build());
+        QCOMPARE(navMesh->GetNumCachedGeometries(), 17U);
+        QCOMPARE(navMesh->GetNumGeometryExtractions(), 21U);
+    }
+    void benchmarkTileBuild() {
+        Urho3D::SharedPtr<Urho3D::Scene> scene = CreateObstacleScene(ctx, 64);
+        Urho3D::NavigationMesh* navMesh = scene->GetComponent<Urho3D::NavigationMesh>();
+        QBENCHMARK {
+            QVERIFY(navMesh->Build());
+        }
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(NavigationMeshTests)
+#include "NavigationMeshTests.moc"
@@ -0,0 +1,89 @@
+#include <QTest>
+#include "NavigationTestScene.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
+#include "Lutefisk3D/Core/Timer.h"
+
+#include <atomic>
+
+class NavigationPathQueueTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+
+    /// Run frames until the request is delivered. Return whether it was.
+    bool RunFrames(const bool& called)
+    {
+        for (unsigned frame = 1; frame < 100 && !called; ++frame)
+        {
+            Urho3D::g_coreSignals.postUpdate(1.0f / 60.0f);
+            Urho3D::g_coreSignals.beginFrame(frame, 1.0f / 60.0f);
+        }
+        return called;
+    }
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreateNavigationTestContext(ctx, 3);
+    }
+    void verifyAsyncPathMatchesSync() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateFloorScene(ctx);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        std::deque<NavigationPathPoint> path;
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.size() > 2);
+
+        bool called = false;
+        std::deque<NavigationPathPoint> asyncPath;
+        navMesh->FindPathAsync(PATH_START, PATH_END, [&](unsigned, const std::deque<NavigationPathPoint>& result) {
+            asyncPath = result;
+            called = true;
+        });
+        QVERIFY(RunFrames(called));
+        QCOMPARE(asyncPath.size(), path.size());
+        for (unsigned i = 0; i < path.size(); ++i)
+            QVERIFY(asyncPath[i].position_.Equals(path[i].position_));
+    }
+    void verifyNotWaitingForOtherWork() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateFloorScene(ctx);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+
+        // Keep every worker thread busy with higher priority work that outlives the frames
+        WorkQueue* queue = ctx->m_WorkQueueSystem.get();
+        std::atomic<unsigned> numStarted{0};
+        std::atomic<bool> release{false};
+        for (size_t i = 0; i < queue->GetNumThreads(); ++i)
+        {
+            queue->AddWorkItem([&numStarted, &release]() {
+                ++numStarted;
+                while (!release)
+                    Time::Sleep(1);
+            }, 100);
+        }
+        QTRY_COMPARE(numStarted.load(), (unsigned)queue->GetNumThreads());
+
+        // The searches no thread could start are run when waited for
+        bool called = false;
+        std::deque<NavigationPathPoint> asyncPath;
+        navMesh->FindPathAsync(PATH_START, PATH_END, [&](unsigned, const std::deque<NavigationPathPoint>& result) {
+            asyncPath = result;
+            called = true;
+        });
+        const bool delivered = RunFrames(called);
+        release = true;
+        QTRY_VERIFY(queue->IsCompleted(0));
+        QVERIFY(delivered);
+        QVERIFY(asyncPath.size() > 2);
+        QVERIFY((asyncPath.back().position_ - PATH_END).Length() < 0.5f);
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(NavigationPathQueueTests)
+#include "NavigationPathQueueTests.moc"
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../Navigable.h"
+#include "../NavigationMesh.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/Physics/CollisionShape.h"
+#include "Lutefisk3D/Physics/PhysicsWorld.h"
+#include "Lutefisk3D/Scene/Scene.h"
+
+#include <deque>
+
+// Scenes shared by the navigation tests. They are built from collision shapes so that no graphics are needed.
+
+static const Urho3D::Vector3 PATH_START(-35.0f, 0.0f, -35.0f);
+static const Urho3D::Vector3 PATH_END(-35.0f, 0.0f, 35.0f);
+/// Tile size in cells used by the test scenes, 9.6 world units with the default cell size.
+static const int TEST_TILE_SIZE = 32;
+
+/// Register the libraries the test scenes use, and give the context a work queue with the given number of threads.
+inline void CreateNavigationTestContext(Urho3D::Context* context, unsigned numThreads)
+{
+    Urho3D::RegisterSceneLibrary(context);
+    Urho3D::RegisterPhysicsLibrary(context);
+    Urho3D::RegisterNavigationLibrary(context);
+    context->m_WorkQueueSystem.reset(new Urho3D::WorkQueue(context));
+    if (numThreads)
+        context->m_WorkQueueSystem->CreateThreads(numThreads);
+}
+
+/// Create a box floor split by a wall with a gap at one end. Paths from PATH_START to PATH_END go around the wall.
+inline Urho3D::SharedPtr<Urho3D::Scene> CreateFloorScene(Urho3D::Context* context)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    scene->CreateComponent<Navigable>();
+    NavigationMesh* navMesh = scene->CreateComponent<NavigationMesh>();
+    navMesh->SetTileSize(TEST_TILE_SIZE);
+
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->SetPosition(Vector3(0.0f, -0.5f, 0.0f));
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(80.0f, 1.0f, 80.0f));
+
+    Node* wallNode = scene->CreateChild("Wall");
+    wallNode->SetPosition(Vector3(-10.0f, 1.5f, 0.0f));
+    wallNode->CreateComponent<CollisionShape>()->SetBox(Vector3(60.0f, 3.0f, 1.0f));
+    return scene;
+}
+
+/// Create a floor of roughly numTiles x numTiles tiles, with one obstacle of generated size, height and rotation per tile.
+inline Urho3D::SharedPtr<Urho3D::Scene> CreateObstacleScene(Urho3D::Context* context, int numTiles)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+    scene->CreateComponent<Navigable>();
+    NavigationMesh* navMesh = scene->CreateComponent<NavigationMesh>();
+    navMesh->SetTileSize(TEST_TILE_SIZE);
+
+    const float tileWorldSize = TEST_TILE_SIZE * navMesh->GetCellSize();
+    const float extent = numTiles * tileWorldSize;
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->SetPosition(Vector3(0.0f, -0.5f, 0.0f));
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(extent, 1.0f, extent));
+
+    unsigned seed = 1;
+    auto next = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return (float)((seed >> 16) & 0x7fff) / 32767.0f;
+    };
+    for (int z = 0; z < numTiles; ++z)
+    {
+        for (int x = 0; x < numTiles; ++x)
+        {
+            // Low obstacles become steps the agent can climb, high ones holes in the mesh
+            Node* node = scene->CreateChild("Obstacle");
+            Vector3 size(1.0f + 4.0f * next(), 0.3f + 2.5f * next(), 1.0f + 4.0f * next());
+            node->SetPosition(Vector3(((float)x + 0.5f) * tileWorldSize - extent * 0.5f + next() * 2.0f - 1.0f, size.y_ * 0.5f,
+                                      ((float)z + 0.5f) * tileWorldSize - extent * 0.5f + next() * 2.0f - 1.0f));
+            node->SetRotation(Quaternion(next() * 90.0f, Vector3::UP));
+            node->CreateComponent<CollisionShape>()->SetBox(size);
+        }
+    }
+    return scene;
+}
+
+inline float PathLength(const std::deque<Urho3D::NavigationPathPoint>& path)
+{
+    float length = 0.0f;
+    for (unsigned i = 1; i < path.size(); ++i)
+        length += (path[i].position_ - path[i - 1].position_).Length();
+    return length;
+}
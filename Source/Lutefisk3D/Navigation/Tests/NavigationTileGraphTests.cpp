@@ -0,0 +1,63 @@
+#include <QTest>
+#include "NavigationTestScene.h"
+#include "../NavigationTileGraph.h"
+
+class NavigationTileGraphTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreateNavigationTestContext(ctx, 3);
+    }
+    void verifyGraphPath() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateFloorScene(ctx);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        std::deque<NavigationPathPoint> path;
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.size() > 2);
+
+        navMesh->SetHierarchicalPathfinding(true);
+        std::deque<NavigationPathPoint> graphPath;
+        navMesh->FindPath(graphPath, PATH_START, PATH_END);
+        QVERIFY(navMesh->GetTileGraph()->GetNumRegions() > 0);
+        QVERIFY(graphPath.size() > 2);
+        QVERIFY(graphPath.back().position_.Equals(path.back().position_));
+        // Routed through the tile regions, so not the shortest path, but close to it
+        QVERIFY(PathLength(graphPath) < PathLength(path) * 1.25f);
+    }
+    void verifyGraphFollowsRebuiltTiles() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateFloorScene(ctx);
+        NavigationMesh* navMesh = scene->GetComponent<NavigationMesh>();
+        QVERIFY(navMesh->Build());
+        navMesh->SetHierarchicalPathfinding(true);
+        std::deque<NavigationPathPoint> path;
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.size() > 2);
+
+        // Closing the gap at the end of the wall leaves no route between the two sides
+        Node* blocker = scene->CreateChild("Blocker");
+        blocker->SetPosition(Vector3(30.0f, 1.5f, 0.0f));
+        blocker->CreateComponent<CollisionShape>()->SetBox(Vector3(22.0f, 3.0f, 1.0f));
+        QVERIFY(navMesh->Build(blocker->GetComponent<CollisionShape>()->GetWorldBoundingBox()));
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.empty() || (path.back().position_ - PATH_END).Length() > 1.0f);
+
+        blocker->Remove();
+        QVERIFY(navMesh->Build(BoundingBox(Vector3(18.0f, 0.0f, -1.0f), Vector3(42.0f, 3.0f, 1.0f))));
+        navMesh->FindPath(path, PATH_START, PATH_END);
+        QVERIFY(path.size() > 2);
+        QVERIFY((path.back().position_ - PATH_END).Length() < 0.5f);
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(NavigationTileGraphTests)
+#include "NavigationTileGraphTests.moc"
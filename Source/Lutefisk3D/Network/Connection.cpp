@@ -50,17 +50,32 @@ static const int STATS_INTERVAL_MSEC = 2000;
 
 PackageDownload::PackageDownload() :
     totalFragments_(0),
+    receivedFragments_(0),
+    startFragment_(0),
+    unackedFragments_(0),
+    fileSize_(0),
     checksum_(0),
+    bytesReceived_(0),
     initiated_(false)
 {
 }
 
 PackageUpload::PackageUpload() :
     fragment_(0),
+    ackedFragments_(0),
     totalFragments_(0)
 {
 }
 
+/// Return the SDBM checksum of a package fragment.
+static unsigned GetFragmentChecksum(const unsigned char* data, unsigned size)
+{
+    unsigned checksum = 0;
+    for (unsigned i = 0; i < size; ++i)
+        checksum = SDBMHash(checksum, data[i]);
+    return checksum;
+}
+
 Connection::Connection(Context* context, bool isClient, const kNet::SharedPtr<kNet::MessageConnection>& connection) :
     Object(context),
     timeStamp_(0),
@@ -326,27 +341,31 @@ void Connection::SendRemoteEvents()
 
 void Connection::SendPackages()
 {
-    while (!uploads_.empty() && connection_->NumOutboundMessagesPending() < 1000)
-    {
-        unsigned char buffer[PACKAGE_FRAGMENT_SIZE];
+    unsigned char buffer[PACKAGE_FRAGMENT_SIZE];
 
-        for (HashMap<StringHash, PackageUpload>::iterator i = uploads_.begin(); i != uploads_.end();)
+    // Interleave the uploads one fragment at a time, so that parallel downloads progress evenly. Each upload may only
+    // run PACKAGE_WINDOW_FRAGMENTS ahead of the fragments acknowledged by the client
+    bool sent = true;
+    while (sent && connection_->NumOutboundMessagesPending() < 1000)
+    {
+        sent = false;
+        for (auto& elem : uploads_)
         {
-            PackageUpload& upload = MAP_VALUE(i);
+            PackageUpload& upload = ELEMENT_VALUE(elem);
+            if (upload.fragment_ >= upload.totalFragments_ || upload.fragment_ >= upload.ackedFragments_ + PACKAGE_WINDOW_FRAGMENTS)
+                continue;
+
             unsigned fragmentSize = Min((int)(upload.file_->GetSize() - upload.file_->GetPosition()), (int)PACKAGE_FRAGMENT_SIZE);
             upload.file_->Read(buffer, fragmentSize);
 
             msg_.clear();
-            msg_.WriteStringHash(MAP_KEY(i));
+            msg_.WriteStringHash(ELEMENT_KEY(elem));
             msg_.WriteUInt(upload.fragment_++);
+            msg_.WriteUInt(GetFragmentChecksum(buffer, fragmentSize));
             msg_.Write(buffer, fragmentSize);
-            SendMessage(MSG_PACKAGEDATA, true, false, msg_);
-
-            // Check if upload finished
-            if (upload.fragment_ == upload.totalFragments_)
-                i = uploads_.erase(i);
-            else
-                ++i;
+            // Fragments are sent in order, so that the client can append them and resume from the partial file size
+            SendMessage(MSG_PACKAGEDATA, true, true, msg_);
+            sent = true;
         }
     }
 }
@@ -410,6 +429,7 @@ bool Connection::ProcessMessage(int msgID, MemoryBuffer &msg)
 
         case MSG_REQUESTPACKAGE:
         case MSG_PACKAGEDATA:
+        case MSG_PACKAGEACK:
             ProcessPackageDownload(msgID, msg);
             break;
 
@@ -729,6 +749,7 @@ void Connection::ProcessPackageDownload(int msgID, MemoryBuffer& msg)
         else
         {
             QString name = msg.ReadString();
+            unsigned startFragment = msg.IsEof() ? 0 : msg.ReadUInt();
 
             if (!scene_)
             {
@@ -762,11 +783,28 @@ void Connection::ProcessPackageDownload(int msgID, MemoryBuffer& msg)
                         return;
                     }
 
-                    URHO3D_LOGINFO("Transmitting package file " + name + " to client " + ToString());
+                    unsigned totalFragments = (file->GetSize() + PACKAGE_FRAGMENT_SIZE - 1) / PACKAGE_FRAGMENT_SIZE;
+                    if (startFragment >= totalFragments)
+                    {
+                        URHO3D_LOGERROR("Client requested package " + name + " from an invalid fragment");
+                        SendPackageError(name);
+                        return;
+                    }
 
-                    uploads_[nameHash].file_ = file;
-                    uploads_[nameHash].fragment_ = 0;
-                    uploads_[nameHash].totalFragments_ = (file->GetSize() + PACKAGE_FRAGMENT_SIZE - 1) / PACKAGE_FRAGMENT_SIZE;
+                    if (startFragment)
+                    {
+                        URHO3D_LOGINFO(QString("Resuming transmission of package file %1 to client %2 from fragment %3")
+                                       .arg(name).arg(ToString()).arg(startFragment));
+                        file->Seek(startFragment * PACKAGE_FRAGMENT_SIZE);
+                    }
+                    else
+                        URHO3D_LOGINFO("Transmitting package file " + name + " to client " + ToString());
+
+                    PackageUpload& upload = uploads_[nameHash];
+                    upload.file_ = file;
+                    upload.fragment_ = startFragment;
+                    upload.ackedFragments_ = startFragment;
+                    upload.totalFragments_ = totalFragments;
                     return;
                 }
             }
@@ -784,75 +822,225 @@ void Connection::ProcessPackageDownload(int msgID, MemoryBuffer& msg)
             URHO3D_LOGWARNING("Received unexpected PackageData message from client");
             return;
         }
+        ProcessPackageData(msg);
+        break;
+
+    case MSG_PACKAGEACK:
+        if (!IsClient())
+        {
+            URHO3D_LOGWARNING("Received unexpected PackageAck message from server");
+            return;
+        }
         else
         {
             StringHash nameHash = msg.ReadStringHash();
+            unsigned ackedFragments = msg.ReadUInt();
 
-            HashMap<StringHash, PackageDownload>::iterator i = downloads_.find(nameHash);
-            // In case of being unable to create the package file into the cache, we will still receive all data from the server.
-            // Simply disregard it
-            if (i == downloads_.end())
+            HashMap<StringHash, PackageUpload>::iterator i = uploads_.find(nameHash);
+            if (i == uploads_.end())
                 return;
 
-            PackageDownload& download = MAP_VALUE(i);
-
-            // If no further data, this is an error reply
-            if (msg.IsEof())
+            if (ackedFragments == PACKAGE_ACK_CANCEL)
             {
-                OnPackageDownloadFailed(download.name_);
+                URHO3D_LOGINFO("Client " + ToString() + " cancelled a package transfer");
+                uploads_.erase(i);
                 return;
             }
 
-            // If file has not yet been opened, try to open now. Prepend the checksum to the filename to allow multiple versions
-            if (!download.file_)
-            {
-                download.file_ = new File(context_, context_->m_Network->GetPackageCacheDir() + ToStringHex(download.checksum_) + "_" + download.name_, FILE_WRITE);
-                if (!download.file_->IsOpen())
-                {
-                    OnPackageDownloadFailed(download.name_);
-                    return;
-                }
-            }
+            PackageUpload& upload = MAP_VALUE(i);
+            upload.ackedFragments_ = Max(upload.ackedFragments_, Min(ackedFragments, upload.fragment_));
+            // The upload is finished once the client has acknowledged every fragment
+            if (upload.ackedFragments_ == upload.totalFragments_)
+                uploads_.erase(i);
+        }
+        break;
+    default: break;
+    }
+}
 
-            // Write the fragment data to the proper index
-            unsigned char buffer[PACKAGE_FRAGMENT_SIZE];
-            unsigned index = msg.ReadUInt();
-            unsigned fragmentSize = msg.GetSize() - msg.GetPosition();
+void Connection::ProcessPackageData(MemoryBuffer& msg)
+{
+    StringHash nameHash = msg.ReadStringHash();
 
-            msg.Read(buffer, fragmentSize);
-            download.file_->Seek(index * PACKAGE_FRAGMENT_SIZE);
-            download.file_->Write(buffer, fragmentSize);
-            download.receivedFragments_.insert(index);
+    HashMap<StringHash, PackageDownload>::iterator i = downloads_.find(nameHash);
+    // Data for a download that failed or was discarded is not written anywhere. Unless this is an error reply, cancel
+    // the upload so that the server does not keep its send window open waiting for acknowledgements
+    if (i == downloads_.end())
+    {
+        if (!msg.IsEof())
+        {
+            msg_.clear();
+            msg_.WriteStringHash(nameHash);
+            msg_.WriteUInt(PACKAGE_ACK_CANCEL);
+            SendMessage(MSG_PACKAGEACK, true, false, msg_);
+        }
+        return;
+    }
 
-            // Check if all fragments received
-            if (download.receivedFragments_.size() == download.totalFragments_)
-            {
-                URHO3D_LOGINFO("Package " + download.name_ + " downloaded successfully");
+    PackageDownload& download = MAP_VALUE(i);
 
-                // Instantiate the package and add to the resource system, as we will need it to load the scene
-                download.file_->Close();
+    // If no further data, this is an error reply
+    if (msg.IsEof())
+    {
+        OnPackageDownloadFailed(download.name_);
+        return;
+    }
 
-                context_->m_ResourceCache->AddPackageFile(download.file_->GetName(), true);
+    if (!download.file_ && !OpenPackageDownloadFile(download))
+    {
+        OnPackageDownloadFailed(download.name_);
+        return;
+    }
 
-                // Then start the next download if there are more
-                downloads_.erase(i);
-                if (downloads_.empty())
-                    OnPackagesReady();
-                else
-                {
-                    PackageDownload& nextDownload = MAP_VALUE(downloads_.begin());
+    unsigned char buffer[PACKAGE_FRAGMENT_SIZE];
+    unsigned index = msg.ReadUInt();
+    unsigned fragmentChecksum = msg.ReadUInt();
+    unsigned fragmentSize = msg.GetSize() - msg.GetPosition();
+    if (fragmentSize > PACKAGE_FRAGMENT_SIZE)
+    {
+        OnPackageDownloadFailed(download.name_);
+        return;
+    }
+    msg.Read(buffer, fragmentSize);
 
-                    URHO3D_LOGINFO("Requesting package " + nextDownload.name_ + " from server");
-                    msg_.clear();
-                    msg_.WriteString(nextDownload.name_);
-                    SendMessage(MSG_REQUESTPACKAGE, true, true, msg_);
-                    nextDownload.initiated_ = true;
-                }
+    // Fragments arrive in order. Anything else, or a corrupt fragment, fails the download; the partial file keeps the
+    // fragments verified so far, so that a later request resumes from there
+    if (index != download.receivedFragments_ || GetFragmentChecksum(buffer, fragmentSize) != fragmentChecksum)
+    {
+        URHO3D_LOGERROR(QString("Received corrupt or out of order fragment %1 of package %2").arg(index).arg(download.name_));
+        OnPackageDownloadFailed(download.name_);
+        return;
+    }
+
+    download.file_->Write(buffer, fragmentSize);
+    download.checksumFile_->WriteUInt(fragmentChecksum);
+    ++download.receivedFragments_;
+    download.bytesReceived_ += fragmentSize;
+
+    if (++download.unackedFragments_ >= PACKAGE_ACK_INTERVAL || download.receivedFragments_ == download.totalFragments_)
+        SendPackageAck(nameHash, download);
+
+    // Check if all fragments received
+    if (download.receivedFragments_ == download.totalFragments_)
+    {
+        if (!FinishPackageDownload(download))
+        {
+            OnPackageDownloadFailed(download.name_);
+            return;
+        }
+
+        // Then start the next downloads if there are more
+        downloads_.erase(i);
+        if (downloads_.empty())
+            OnPackagesReady();
+        else
+            StartPackageDownloads();
+    }
+}
+
+bool Connection::OpenPackageDownloadFile(PackageDownload& download)
+{
+    FileSystem* fileSystem = context_->m_FileSystem.get();
+    // Prepend the checksum to the filename to allow multiple versions
+    QString partialName = context_->m_Network->GetPackageCacheDir() + ToStringHex(download.checksum_) + "_" + download.name_ + ".part";
+    QString checksumName = partialName + ".sums";
+
+    download.receivedFragments_ = 0;
+    if (fileSystem->FileExists(partialName) && fileSystem->FileExists(checksumName))
+    {
+        download.file_ = new File(context_, partialName, FILE_READWRITE);
+        download.checksumFile_ = new File(context_, checksumName, FILE_READWRITE);
+        if (download.file_->IsOpen() && download.checksumFile_->IsOpen() && download.file_->GetSize() <= download.fileSize_)
+        {
+            // Resume after the leading fragments that still match the checksums received with them. At least the last
+            // fragment is always requested, so that the server has something to send
+            unsigned storedFragments = Min(download.file_->GetSize() / PACKAGE_FRAGMENT_SIZE,
+                                           download.checksumFile_->GetSize() / (unsigned)sizeof(unsigned));
+            storedFragments = Min(storedFragments, download.totalFragments_ - 1);
+            unsigned char buffer[PACKAGE_FRAGMENT_SIZE];
+            while (download.receivedFragments_ < storedFragments)
+            {
+                if (download.file_->Read(buffer, PACKAGE_FRAGMENT_SIZE) != PACKAGE_FRAGMENT_SIZE ||
+                    GetFragmentChecksum(buffer, PACKAGE_FRAGMENT_SIZE) != download.checksumFile_->ReadUInt())
+                    break;
+                ++download.receivedFragments_;
+            }
+            if (download.receivedFragments_ < storedFragments)
+            {
+                URHO3D_LOGWARNING(QString("Partial download of package %1 is corrupt from fragment %2, downloading again")
+                                  .arg(download.name_).arg(download.receivedFragments_));
+            }
+
+            // Overwrite from the first fragment that did not verify. As every later fragment is received again, the
+            // files end up the right size even when they held more fragments than were kept
+            unsigned dataPosition = download.receivedFragments_ * PACKAGE_FRAGMENT_SIZE;
+            unsigned checksumPosition = download.receivedFragments_ * sizeof(unsigned);
+            if (download.receivedFragments_ && (download.file_->Seek(dataPosition) != dataPosition ||
+                download.checksumFile_->Seek(checksumPosition) != checksumPosition))
+            {
+                URHO3D_LOGWARNING("Could not resume package download " + download.name_ + ", restarting");
+                download.receivedFragments_ = 0;
             }
         }
-        break;
-    default: break;
+        if (!download.receivedFragments_)
+        {
+            download.file_.Reset();
+            download.checksumFile_.Reset();
+        }
+    }
+
+    if (!download.file_)
+    {
+        download.file_ = new File(context_, partialName, FILE_WRITE);
+        download.checksumFile_ = new File(context_, checksumName, FILE_WRITE);
+    }
+
+    download.startFragment_ = download.receivedFragments_;
+    return download.file_->IsOpen() && download.checksumFile_->IsOpen();
+}
+
+bool Connection::FinishPackageDownload(PackageDownload& download)
+{
+    FileSystem* fileSystem = context_->m_FileSystem.get();
+    QString partialName = download.file_->GetName();
+    QString fileName = partialName.left(partialName.length() - 5);
+    QString checksumName = download.checksumFile_->GetName();
+    download.file_->Close();
+    download.file_.Reset();
+    download.checksumFile_->Close();
+    download.checksumFile_.Reset();
+    // Every fragment has been checked against its checksum, either on arrival or when the download was resumed
+    fileSystem->Delete(checksumName);
+
+    float seconds = Max(download.timer_.GetMSecS(), 1U) / 1000.0f;
+    URHO3D_LOGINFO(QString("Package %1 downloaded successfully (%2 MB/s)").arg(download.name_)
+                   .arg(download.bytesReceived_ / (1024.0 * 1024.0) / seconds, 0, 'f', 2));
+
+    if (fileSystem->FileExists(fileName))
+        fileSystem->Delete(fileName);
+    if (!fileSystem->Rename(partialName, fileName))
+        return false;
+
+    // Verify the whole package before it is added to the resource system, as we will need it to load the scene
+    SharedPtr<PackageFile> package(new PackageFile(context_, fileName));
+    if (package->GetTotalSize() != download.fileSize_ || package->GetChecksum() != download.checksum_)
+    {
+        URHO3D_LOGERROR("Package " + download.name_ + " failed checksum verification");
+        fileSystem->Delete(fileName);
+        return false;
     }
+
+    context_->m_ResourceCache->AddPackageFile(package, 0);
+    return true;
+}
+
+void Connection::SendPackageAck(StringHash nameHash, PackageDownload& download)
+{
+    msg_.clear();
+    msg_.WriteStringHash(nameHash);
+    msg_.WriteUInt(download.receivedFragments_);
+    SendMessage(MSG_PACKAGEACK, true, false, msg_);
+    download.unackedFragments_ = 0;
 }
 
 void Connection::ProcessIdentity(int msgID, MemoryBuffer& msg)
@@ -1047,12 +1235,29 @@ const QString &Connection::GetDownloadName() const
 
 float Connection::GetDownloadProgress() const
 {
+    unsigned received = 0;
+    unsigned total = 0;
     for (const auto & elem : downloads_)
     {
         if (ELEMENT_VALUE(elem).initiated_)
-            return (float)ELEMENT_VALUE(elem).receivedFragments_.size() / (float)ELEMENT_VALUE(elem).totalFragments_;
+        {
+            received += ELEMENT_VALUE(elem).receivedFragments_;
+            total += ELEMENT_VALUE(elem).totalFragments_;
+        }
     }
-    return 1.0f;
+    return total ? (float)received / (float)total : 1.0f;
+}
+
+float Connection::GetDownloadBytesPerSec() const
+{
+    float bytesPerSec = 0.0f;
+    for (const auto & elem : downloads_)
+    {
+        const PackageDownload& download = ELEMENT_VALUE(elem);
+        if (download.initiated_)
+            bytesPerSec += download.bytesReceived_ * 1000.0f / Max(download.timer_.GetMSecS(), 1U);
+    }
+    return bytesPerSec;
 }
 
 void Connection::SendPackageToClient(PackageFile* package)
@@ -1452,16 +1657,45 @@ void Connection::RequestPackage(const QString& name, unsigned fileSize, unsigned
     PackageDownload& download = downloads_[nameHash];
     download.name_ = name;
     download.totalFragments_ = (fileSize + PACKAGE_FRAGMENT_SIZE - 1) / PACKAGE_FRAGMENT_SIZE;
+    download.fileSize_ = fileSize;
     download.checksum_ = checksum;
 
-    // Start download now only if no existing downloads, else wait for the existing ones to finish
-    if (downloads_.size() == 1)
+    // Start download now if below the parallel download limit, else wait for the existing ones to finish
+    StartPackageDownloads();
+}
+
+void Connection::StartPackageDownloads()
+{
+    unsigned numActive = 0;
+    for (const auto& elem : downloads_)
+    {
+        if (ELEMENT_VALUE(elem).initiated_)
+            ++numActive;
+    }
+
+    for (auto& elem : downloads_)
     {
-        URHO3D_LOGINFO("Requesting package " + name + " from server");
+        if (numActive >= MAX_PARALLEL_PACKAGE_DOWNLOADS)
+            break;
+        PackageDownload& download = ELEMENT_VALUE(elem);
+        if (download.initiated_)
+            continue;
+
+        // Open the cache file up front, so that the request can tell the server where to resume from
+        if (!OpenPackageDownloadFile(download))
+        {
+            OnPackageDownloadFailed(download.name_);
+            return;
+        }
+
+        URHO3D_LOGINFO("Requesting package " + download.name_ + " from server");
         msg_.clear();
-        msg_.WriteString(name);
+        msg_.WriteString(download.name_);
+        msg_.WriteUInt(download.startFragment_);
         SendMessage(MSG_REQUESTPACKAGE, true, true, msg_);
+        download.timer_.Reset();
         download.initiated_ = true;
+        ++numActive;
     }
 }
 
@@ -66,16 +66,28 @@ struct PackageDownload
     /// Construct with defaults.
     PackageDownload();
 
-    /// Destination file.
+    /// Destination file. Data is written to a partial file in the package cache dir until all fragments are received.
     SharedPtr<File> file_;
-    /// Already received fragments.
-    QSet<unsigned> receivedFragments_;
+    /// Checksums of the fragments in the partial file, kept alongside it so that a resumed download can verify them.
+    SharedPtr<File> checksumFile_;
     /// Package name.
     QString name_;
     /// Total number of fragments.
     unsigned totalFragments_;
+    /// Number of fragments received so far, counting fragments resumed from a previous partial download.
+    unsigned receivedFragments_;
+    /// Fragment index the download was resumed from.
+    unsigned startFragment_;
+    /// Number of received fragments not yet acknowledged to the server.
+    unsigned unackedFragments_;
+    /// Package file size.
+    unsigned fileSize_;
     /// Checksum.
     unsigned checksum_;
+    /// Bytes received during this transfer.
+    unsigned long long bytesReceived_;
+    /// Transfer timer, reset when the download is initiated.
+    Timer timer_;
     /// Download initiated flag.
     bool initiated_;
 };
@@ -88,8 +100,10 @@ struct PackageUpload
 
     /// Source file.
     SharedPtr<File> file_;
-    /// Current fragment index.
+    /// Next fragment index to send.
     unsigned fragment_;
+    /// Number of fragments acknowledged by the client.
+    unsigned ackedFragments_;
     /// Total number of fragments
     unsigned totalFragments_;
 };
@@ -197,8 +211,10 @@ public:
     unsigned GetNumDownloads() const;
     /// Return name of current package download, or empty if no downloads.
     const QString& GetDownloadName() const;
-    /// Return progress of current package download, or 1.0 if no downloads.
+    /// Return progress of current package downloads, or 1.0 if no downloads.
     float GetDownloadProgress() const;
+    /// Return package download throughput in bytes per second, averaged over the active downloads.
+    float GetDownloadBytesPerSec() const;
     /// Trigger client connection to download a package file from the server. Can be used to download additional resource packages when client is already joined in a scene. The package must have been added as a requirement to the scene the client is joined in, or else the eventual download will fail.
     void SendPackageToClient(PackageFile* package);
 
@@ -240,8 +256,18 @@ private:
     void ProcessPackageInfo(int msgID, MemoryBuffer& msg);
     /// Check a package list received from server and initiate package downloads as necessary. Return true on success, or false if failed to initialze downloads (cache dir not set)
     bool RequestNeededPackages(unsigned numPackages, MemoryBuffer& msg);
-    /// Initiate a package download.
+    /// Queue a package download.
     void RequestPackage(const QString& name, unsigned fileSize, unsigned checksum);
+    /// Initiate queued package downloads up to the parallel download limit.
+    void StartPackageDownloads();
+    /// Open the partial download file, resuming from a previous attempt if possible. Return true on success.
+    bool OpenPackageDownloadFile(PackageDownload& download);
+    /// Process a package data fragment from the server.
+    void ProcessPackageData(MemoryBuffer& msg);
+    /// Finish a package download whose fragments have all been received. Return true if the package verified ok.
+    bool FinishPackageDownload(PackageDownload& download);
+    /// Acknowledge received package fragments to the server.
+    void SendPackageAck(StringHash nameHash, PackageDownload& download);
     /// Send an error reply for a package download.
     void SendPackageError(const QString& name);
     /// Handle scene load failure on the server or client.
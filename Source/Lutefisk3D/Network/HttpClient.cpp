@@ -0,0 +1,755 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Lutefisk3D/Network/HttpClient.h"
+#include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/Timer.h"
+#include "Lutefisk3D/IO/Log.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using SocketHandle = SOCKET;
+static const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#define CloseSocket closesocket
+#define PollSockets WSAPoll
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using SocketHandle = int;
+static const SocketHandle INVALID_SOCKET_HANDLE = -1;
+#define CloseSocket close
+#define PollSockets poll
+#endif
+
+namespace Urho3D
+{
+
+/// Socket receive chunk size.
+static const unsigned RECV_CHUNK_SIZE = 16384;
+/// Poll timeout, which bounds the latency of starting newly queued requests.
+static const int POLL_TIMEOUT_MSEC = 5;
+/// Time after which idle pooled connections are closed.
+static const unsigned IDLE_CONNECTION_TIMEOUT_MSEC = 30000;
+/// Maximum size of the response status line and headers.
+static const unsigned MAX_HEADER_SIZE = 65536;
+
+/// HTTP connection phase.
+enum HttpConnectionPhase
+{
+    HCP_CONNECTING = 0,
+    HCP_SENDING,
+    HCP_RECEIVING_HEADERS,
+    HCP_RECEIVING_BODY,
+    HCP_IDLE
+};
+
+/// How the end of the response body is determined.
+enum HttpBodyMode
+{
+    HBM_NONE = 0,
+    HBM_CONTENT_LENGTH,
+    HBM_CHUNKED,
+    HBM_UNTIL_CLOSE
+};
+
+/// Chunked transfer encoding decoder state.
+enum HttpChunkState
+{
+    HCS_SIZE = 0,
+    HCS_DATA,
+    HCS_DATA_END,
+    HCS_TRAILER
+};
+
+/// Connection to a host, with the request currently in flight on it.
+struct HttpConnection
+{
+    /// Socket.
+    SocketHandle socket_ = INVALID_SOCKET_HANDLE;
+    /// Host name.
+    std::string host_;
+    /// Port.
+    unsigned short port_ = 0;
+    /// Request in flight.
+    HttpRequest* request_ = nullptr;
+    /// Phase.
+    HttpConnectionPhase phase_ = HCP_CONNECTING;
+    /// Bytes of the request text already sent.
+    size_t sent_ = 0;
+    /// Status line and headers received so far.
+    std::string header_;
+    /// Body mode.
+    HttpBodyMode bodyMode_ = HBM_NONE;
+    /// Chunked decoder state.
+    HttpChunkState chunkState_ = HCS_SIZE;
+    /// Chunk size or trailer line being parsed.
+    std::string chunkLine_;
+    /// Remaining bytes of the body or of the current chunk.
+    unsigned long long remaining_ = 0;
+    /// Whether the server allows reusing the connection after the response.
+    bool keepAlive_ = true;
+    /// Whether the connection came from the pool. A pooled connection may have been closed by the server meanwhile.
+    bool reused_ = false;
+    /// Whether any response bytes were received.
+    bool responseStarted_ = false;
+    /// Idle timer for pooled connections.
+    Timer idleTimer_;
+
+    /// Destruct. Close the socket.
+    ~HttpConnection()
+    {
+        if (socket_ != INVALID_SOCKET_HANDLE)
+            CloseSocket(socket_);
+    }
+};
+
+/// Return whether the last socket error means the operation would block.
+static bool WouldBlock()
+{
+#ifdef _WIN32
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+    return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+#endif
+}
+
+/// Switch a socket to non-blocking mode.
+static bool SetNonBlocking(SocketHandle socket)
+{
+#ifdef _WIN32
+    u_long enable = 1;
+    return ioctlsocket(socket, FIONBIO, &enable) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+/// Open a non-blocking socket and start connecting. Name resolution blocks the I/O thread. Return invalid handle on failure.
+static SocketHandle OpenSocket(const std::string& host, unsigned short port)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result)
+        return INVALID_SOCKET_HANDLE;
+
+    SocketHandle socket = INVALID_SOCKET_HANDLE;
+    for (addrinfo* addr = result; addr; addr = addr->ai_next)
+    {
+        socket = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (socket == INVALID_SOCKET_HANDLE)
+            continue;
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof noDelay);
+        if (SetNonBlocking(socket) && (connect(socket, addr->ai_addr, (int)addr->ai_addrlen) == 0 || WouldBlock()))
+            break;
+        CloseSocket(socket);
+        socket = INVALID_SOCKET_HANDLE;
+    }
+
+    freeaddrinfo(result);
+    return socket;
+}
+
+/// Return string with leading and trailing whitespace removed.
+static std::string Trimmed(const std::string& str)
+{
+    size_t start = str.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+        return std::string();
+    return str.substr(start, str.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+/// Decode response body data according to the body mode, and pass it to the request. Return true when the body is complete.
+static bool ProcessBody(HttpConnection* connection, const char* data, unsigned size)
+{
+    HttpRequest* request = connection->request_;
+
+    switch (connection->bodyMode_)
+    {
+    case HBM_NONE:
+        return true;
+
+    case HBM_UNTIL_CLOSE:
+        request->AppendData(data, size);
+        return false;
+
+    case HBM_CONTENT_LENGTH:
+    {
+        unsigned copy = (unsigned)Min((unsigned long long)size, connection->remaining_);
+        request->AppendData(data, copy);
+        connection->remaining_ -= copy;
+        return connection->remaining_ == 0;
+    }
+
+    case HBM_CHUNKED:
+        while (size)
+        {
+            switch (connection->chunkState_)
+            {
+            case HCS_SIZE:
+            case HCS_TRAILER:
+            {
+                const char* lineEnd = (const char*)memchr(data, '\n', size);
+                unsigned consumed = lineEnd ? (unsigned)(lineEnd - data) + 1 : size;
+                connection->chunkLine_.append(data, consumed);
+                data += consumed;
+                size -= consumed;
+                if (!lineEnd)
+                    break;
+
+                std::string line = Trimmed(connection->chunkLine_);
+                connection->chunkLine_.clear();
+                if (connection->chunkState_ == HCS_TRAILER)
+                {
+                    // Empty line ends the trailer and the body
+                    if (line.empty())
+                        return true;
+                }
+                else
+                {
+                    connection->remaining_ = strtoull(line.c_str(), nullptr, 16);
+                    connection->chunkState_ = connection->remaining_ ? HCS_DATA : HCS_TRAILER;
+                }
+                break;
+            }
+
+            case HCS_DATA:
+            {
+                unsigned copy = (unsigned)Min((unsigned long long)size, connection->remaining_);
+                request->AppendData(data, copy);
+                data += copy;
+                size -= copy;
+                connection->remaining_ -= copy;
+                if (!connection->remaining_)
+                {
+                    connection->chunkState_ = HCS_DATA_END;
+                    connection->remaining_ = 2;
+                }
+                break;
+            }
+
+            case HCS_DATA_END:
+            {
+                // Skip the CRLF after the chunk data
+                unsigned skip = (unsigned)Min((unsigned long long)size, connection->remaining_);
+                data += skip;
+                size -= skip;
+                connection->remaining_ -= skip;
+                if (!connection->remaining_)
+                    connection->chunkState_ = HCS_SIZE;
+                break;
+            }
+            }
+        }
+        return false;
+    }
+
+    return false;
+}
+
+/// Parse the status line and headers, and set up body decoding. Return false if the response is malformed.
+static bool ParseHeaders(HttpConnection* connection, const std::string& headerText)
+{
+    HttpRequest* request = connection->request_;
+    std::vector<std::pair<std::string, std::string> > headers;
+
+    size_t lineEnd = headerText.find("\r\n");
+    std::string statusLine = headerText.substr(0, lineEnd);
+    if (statusLine.compare(0, 5, "HTTP/") || statusLine.size() < 12)
+        return false;
+    int statusCode = atoi(statusLine.c_str() + 9);
+    // HTTP/1.0 closes the connection unless keep-alive is explicitly confirmed
+    connection->keepAlive_ = statusLine.compare(0, 8, "HTTP/1.0") != 0;
+
+    bool hasLength = false;
+    bool chunked = false;
+    while (lineEnd != std::string::npos)
+    {
+        size_t start = lineEnd + 2;
+        lineEnd = headerText.find("\r\n", start);
+        std::string line = headerText.substr(start, lineEnd == std::string::npos ? std::string::npos : lineEnd - start);
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = Trimmed(line.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::string value = Trimmed(line.substr(colon + 1));
+        std::string lowerValue = value;
+        std::transform(lowerValue.begin(), lowerValue.end(), lowerValue.begin(), ::tolower);
+
+        if (name == "content-length")
+        {
+            hasLength = true;
+            connection->remaining_ = strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (name == "transfer-encoding" && lowerValue.find("chunked") != std::string::npos)
+            chunked = true;
+        else if (name == "connection")
+        {
+            if (lowerValue.find("close") != std::string::npos)
+                connection->keepAlive_ = false;
+            else if (lowerValue.find("keep-alive") != std::string::npos)
+                connection->keepAlive_ = true;
+        }
+        headers.emplace_back(name, value);
+    }
+
+    request->SetResponse(statusCode, headers);
+
+    // Responses to HEAD and some status codes never have a body
+    if (request->GetVerb() == "HEAD" || statusCode / 100 == 1 || statusCode == 204 || statusCode == 304)
+        connection->bodyMode_ = HBM_NONE;
+    else if (chunked)
+    {
+        connection->bodyMode_ = HBM_CHUNKED;
+        connection->chunkState_ = HCS_SIZE;
+    }
+    else if (hasLength)
+        connection->bodyMode_ = connection->remaining_ ? HBM_CONTENT_LENGTH : HBM_NONE;
+    else
+    {
+        connection->bodyMode_ = HBM_UNTIL_CLOSE;
+        connection->keepAlive_ = false;
+    }
+    return true;
+}
+
+HttpClient::HttpClient() :
+    numActiveRequests_(0),
+    numPooledConnections_(0),
+    numConnectionsOpened_(0),
+    maxConnectionsPerHost_(6)
+{
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+HttpClient::~HttpClient()
+{
+    Stop();
+
+    // Fail whatever did not finish, so that readers blocked in HttpRequest::Read() wake up
+    for (auto& connection : active_)
+    {
+        if (connection)
+            waiting_.push_back(connection->request_);
+    }
+    waiting_.insert(waiting_.end(), queued_.begin(), queued_.end());
+    for (HttpRequest* request : waiting_)
+    {
+        request->SetState(HTTP_ERROR, "HTTP client destroyed");
+        request->ReleaseRef();
+    }
+    for (HttpRequest* request : finished_)
+        request->ReleaseRef();
+    active_.clear();
+    pool_.clear();
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void HttpClient::Enqueue(HttpRequest* request)
+{
+    if (!request)
+        return;
+
+    request->AddRef();
+    {
+        MutexLock lock(mutex_);
+        queued_.push_back(request);
+        ++numActiveRequests_;
+    }
+
+    if (!IsStarted())
+        Run();
+}
+
+void HttpClient::DispatchFinished()
+{
+    std::vector<HttpRequest*> finished;
+    {
+        MutexLock lock(mutex_);
+        finished.swap(finished_);
+    }
+
+    for (HttpRequest* request : finished)
+    {
+        request->requestFinished(request);
+        request->ReleaseRef();
+    }
+}
+
+void HttpClient::SetMaxConnectionsPerHost(unsigned num)
+{
+    maxConnectionsPerHost_ = Max(num, 1U);
+}
+
+unsigned HttpClient::GetNumActiveRequests() const
+{
+    MutexLock lock(mutex_);
+    return numActiveRequests_;
+}
+
+unsigned HttpClient::GetNumPooledConnections() const
+{
+    MutexLock lock(mutex_);
+    return numPooledConnections_;
+}
+
+unsigned HttpClient::GetNumConnectionsOpened() const
+{
+    MutexLock lock(mutex_);
+    return numConnectionsOpened_;
+}
+
+void HttpClient::ThreadFunction()
+{
+    URHO3D_PROFILE_THREAD(HttpClient);
+
+    std::vector<pollfd> fds;
+    std::vector<HttpConnection*> polled;
+
+    while (shouldRun_)
+    {
+        {
+            MutexLock lock(mutex_);
+            waiting_.insert(waiting_.end(), queued_.begin(), queued_.end());
+            queued_.clear();
+        }
+
+        StartWaitingRequests();
+
+        // Poll active connections for the direction they are waiting on, and idle ones to notice the server closing them
+        fds.clear();
+        polled.clear();
+        for (auto& connection : active_)
+        {
+            bool sending = connection->phase_ == HCP_CONNECTING || connection->phase_ == HCP_SENDING;
+            // Leave the socket out while the reader is behind, so that the kernel socket buffer throttles the server.
+            // Polling it for nothing would still report a hangup, and spin on it until the reader catches up
+            if (!sending && !connection->request_->GetFreeSpace())
+                continue;
+            pollfd fd;
+            fd.fd = connection->socket_;
+            fd.events = sending ? POLLOUT : POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+            polled.push_back(connection.get());
+        }
+        for (auto& connection : pool_)
+        {
+            pollfd fd;
+            fd.fd = connection->socket_;
+            fd.events = POLLIN;
+            fd.revents = 0;
+            fds.push_back(fd);
+            polled.push_back(connection.get());
+        }
+
+        if (fds.empty())
+        {
+            Time::Sleep(POLL_TIMEOUT_MSEC);
+            continue;
+        }
+
+        if (PollSockets(fds.data(), (unsigned)fds.size(), POLL_TIMEOUT_MSEC) < 0)
+            continue;
+
+        for (unsigned i = 0; i < fds.size(); ++i)
+        {
+            HttpConnection* connection = polled[i];
+            short revents = fds[i].revents;
+
+            if (connection->phase_ == HCP_IDLE)
+            {
+                // Any activity on an idle connection is the server closing it, or unexpected data; drop it either way
+                if (revents || connection->idleTimer_.GetMSecS() > IDLE_CONNECTION_TIMEOUT_MSEC)
+                {
+                    for (auto it = pool_.begin(); it != pool_.end(); ++it)
+                    {
+                        if (it->get() == connection)
+                        {
+                            pool_.erase(it);
+                            break;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            bool error = (revents & (POLLERR | POLLNVAL)) != 0;
+            bool readable = (revents & (POLLIN | POLLHUP)) != 0;
+            bool writable = (revents & POLLOUT) != 0;
+            if (error && connection->phase_ != HCP_RECEIVING_HEADERS && connection->phase_ != HCP_RECEIVING_BODY)
+                writable = true; // Let the send path report the failure
+            if (readable || writable || error)
+                ProcessConnection(connection, readable || error, writable);
+        }
+
+        // Drop finished connections from the active list; those to be reused have been moved to the pool
+        active_.erase(std::remove_if(active_.begin(), active_.end(),
+                                     [](const std::unique_ptr<HttpConnection>& connection) { return !connection; }),
+                      active_.end());
+
+        MutexLock lock(mutex_);
+        numPooledConnections_ = pool_.size();
+    }
+}
+
+void HttpClient::StartWaitingRequests()
+{
+    for (auto it = waiting_.begin(); it != waiting_.end();)
+    {
+        HttpRequest* request = *it;
+        if (request->GetState() == HTTP_ERROR)
+        {
+            // Failed already on construction, e.g. unsupported protocol
+            {
+                MutexLock lock(mutex_);
+                finished_.push_back(request);
+                --numActiveRequests_;
+            }
+            it = waiting_.erase(it);
+            continue;
+        }
+
+        unsigned numHostConnections = 0;
+        for (auto& connection : active_)
+        {
+            if (connection->host_ == request->host_ && connection->port_ == request->port_)
+                ++numHostConnections;
+        }
+        if (numHostConnections >= maxConnectionsPerHost_)
+        {
+            ++it;
+            continue;
+        }
+
+        if (!AcquireConnection(request))
+        {
+            request->SetState(HTTP_ERROR, QString("Could not connect to %1:%2").arg(QString::fromStdString(request->host_)).arg(request->port_));
+            MutexLock lock(mutex_);
+            finished_.push_back(request);
+            --numActiveRequests_;
+        }
+        it = waiting_.erase(it);
+    }
+}
+
+HttpConnection* HttpClient::AcquireConnection(HttpRequest* request)
+{
+    std::unique_ptr<HttpConnection> connection;
+
+    // Prefer an idle keep-alive connection to the same host
+    for (auto it = pool_.begin(); it != pool_.end(); ++it)
+    {
+        if ((*it)->host_ == request->host_ && (*it)->port_ == request->port_)
+        {
+            connection = std::move(*it);
+            pool_.erase(it);
+            connection->reused_ = true;
+            connection->phase_ = HCP_SENDING;
+            break;
+        }
+    }
+
+    if (!connection)
+    {
+        SocketHandle socket = OpenSocket(request->host_, request->port_);
+        if (socket == INVALID_SOCKET_HANDLE)
+            return nullptr;
+
+        connection.reset(new HttpConnection());
+        connection->socket_ = socket;
+        connection->host_ = request->host_;
+        connection->port_ = request->port_;
+        connection->phase_ = HCP_CONNECTING;
+
+        MutexLock lock(mutex_);
+        ++numConnectionsOpened_;
+    }
+
+    connection->request_ = request;
+    connection->sent_ = 0;
+    connection->header_.clear();
+    connection->chunkLine_.clear();
+    connection->bodyMode_ = HBM_NONE;
+    connection->remaining_ = 0;
+    connection->keepAlive_ = true;
+    connection->responseStarted_ = false;
+    request->SetState(HTTP_OPEN);
+
+    active_.push_back(std::move(connection));
+    return active_.back().get();
+}
+
+void HttpClient::ProcessConnection(HttpConnection* connection, bool readable, bool writable)
+{
+    if (connection->phase_ == HCP_CONNECTING && writable)
+    {
+        int socketError = 0;
+        socklen_t length = sizeof socketError;
+        getsockopt(connection->socket_, SOL_SOCKET, SO_ERROR, (char*)&socketError, &length);
+        if (socketError)
+        {
+            FinishRequest(connection, HTTP_ERROR, "Could not connect to " + QString::fromStdString(connection->host_));
+            return;
+        }
+        connection->phase_ = HCP_SENDING;
+    }
+
+    if (connection->phase_ == HCP_SENDING && writable)
+    {
+        const std::string& data = connection->request_->requestData_;
+        int sent = send(connection->socket_, data.data() + connection->sent_, (int)(data.size() - connection->sent_), 0);
+        if (sent < 0 && !WouldBlock())
+        {
+            FinishRequest(connection, HTTP_ERROR, "Failed to send request to " + QString::fromStdString(connection->host_));
+            return;
+        }
+        if (sent > 0)
+            connection->sent_ += sent;
+        if (connection->sent_ == data.size())
+            connection->phase_ = HCP_RECEIVING_HEADERS;
+        return;
+    }
+
+    if (!readable || (connection->phase_ != HCP_RECEIVING_HEADERS && connection->phase_ != HCP_RECEIVING_BODY))
+        return;
+
+    // Never receive more than the request can buffer, as decoded body data is never larger than the raw data
+    unsigned space = Min(connection->request_->GetFreeSpace(), RECV_CHUNK_SIZE);
+    if (!space)
+        return;
+
+    char buffer[RECV_CHUNK_SIZE];
+    int received = recv(connection->socket_, buffer, (int)space, 0);
+    if (received < 0)
+    {
+        if (!WouldBlock())
+            FinishRequest(connection, HTTP_ERROR, "Connection to " + QString::fromStdString(connection->host_) + " failed");
+        return;
+    }
+    if (received == 0)
+    {
+        // Closed by the server. This completes a read-until-close body, anything else is an error
+        if (connection->phase_ == HCP_RECEIVING_BODY && connection->bodyMode_ == HBM_UNTIL_CLOSE)
+            FinishRequest(connection, HTTP_CLOSED);
+        else
+            FinishRequest(connection, HTTP_ERROR, "Connection closed by " + QString::fromStdString(connection->host_));
+        return;
+    }
+    connection->responseStarted_ = true;
+
+    const char* body = buffer;
+    unsigned bodySize = (unsigned)received;
+    if (connection->phase_ == HCP_RECEIVING_HEADERS)
+    {
+        size_t previous = connection->header_.size();
+        connection->header_.append(buffer, received);
+        size_t headerEnd = connection->header_.find("\r\n\r\n", previous > 3 ? previous - 3 : 0);
+        if (headerEnd == std::string::npos)
+        {
+            if (connection->header_.size() > MAX_HEADER_SIZE)
+                FinishRequest(connection, HTTP_ERROR, "Response headers too large");
+            return;
+        }
+
+        if (!ParseHeaders(connection, connection->header_.substr(0, headerEnd)))
+        {
+            FinishRequest(connection, HTTP_ERROR, "Malformed HTTP response");
+            return;
+        }
+        connection->phase_ = HCP_RECEIVING_BODY;
+
+        // The rest of the received data belongs to the body
+        unsigned headerBytes = (unsigned)(headerEnd + 4 - previous);
+        body = buffer + headerBytes;
+        bodySize = (unsigned)received - headerBytes;
+        connection->header_.clear();
+        if (connection->bodyMode_ == HBM_NONE)
+        {
+            FinishRequest(connection, HTTP_CLOSED);
+            return;
+        }
+    }
+
+    if (ProcessBody(connection, body, bodySize))
+        FinishRequest(connection, HTTP_CLOSED);
+}
+
+void HttpClient::FinishRequest(HttpConnection* connection, HttpRequestState state, const QString& error)
+{
+    HttpRequest* request = connection->request_;
+    connection->request_ = nullptr;
+
+    auto it = std::find_if(active_.begin(), active_.end(),
+                           [connection](const std::unique_ptr<HttpConnection>& c) { return c.get() == connection; });
+
+    // A pooled connection may have been closed by the server while idle. Retry once on a fresh connection if nothing
+    // of the response was received yet
+    bool retry = state == HTTP_ERROR && connection->reused_ && !connection->responseStarted_;
+
+    if (state == HTTP_CLOSED && connection->keepAlive_)
+    {
+        connection->phase_ = HCP_IDLE;
+        connection->idleTimer_.Reset();
+        pool_.push_back(std::move(*it));
+    }
+    else
+        it->reset();
+
+    if (retry && AcquireConnection(request))
+        return;
+
+    if (state == HTTP_ERROR)
+        URHO3D_LOGWARNING("HTTP request to " + request->GetURL() + " failed: " + error);
+    request->SetState(state, error);
+
+    MutexLock lock(mutex_);
+    finished_.push_back(request);
+    --numActiveRequests_;
+}
+
+}
@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "Lutefisk3D/Core/Mutex.h"
+#include "Lutefisk3D/Core/Thread.h"
+#include "Lutefisk3D/Network/HttpRequest.h"
+
+#include <memory>
+#include <vector>
+
+namespace Urho3D
+{
+
+struct HttpConnection;
+
+/// Services HTTP requests on a single I/O thread, multiplexing non-blocking sockets and reusing keep-alive connections.
+class LUTEFISK3D_EXPORT HttpClient : public Thread
+{
+public:
+    /// Construct. The I/O thread is started when the first request is queued.
+    HttpClient();
+    /// Destruct. Stop the I/O thread and fail the unfinished requests.
+    ~HttpClient() override;
+
+    /// Multiplex the queued requests until stopped.
+    void ThreadFunction() override;
+
+    /// Queue a request for the I/O thread.
+    void Enqueue(HttpRequest* request);
+    /// Send the requestFinished signal of the requests finished since the last call. Call from the main thread.
+    void DispatchFinished();
+    /// Set maximum number of simultaneous connections per host. Further requests to the host wait for a free connection.
+    void SetMaxConnectionsPerHost(unsigned num);
+    /// Return maximum number of simultaneous connections per host.
+    unsigned GetMaxConnectionsPerHost() const { return maxConnectionsPerHost_; }
+    /// Return number of requests queued or in flight.
+    unsigned GetNumActiveRequests() const;
+    /// Return number of idle keep-alive connections kept for reuse.
+    unsigned GetNumPooledConnections() const;
+    /// Return total number of connections opened. Together with the request count, tells how well connections are reused.
+    unsigned GetNumConnectionsOpened() const;
+
+private:
+    /// Start requests waiting for a connection. Called by the I/O thread.
+    void StartWaitingRequests();
+    /// Open a new connection or take one from the pool for a request. Return null on failure.
+    HttpConnection* AcquireConnection(HttpRequest* request);
+    /// Advance a connection after its socket became ready. Called by the I/O thread.
+    void ProcessConnection(HttpConnection* connection, bool readable, bool writable);
+    /// Finish the connection's request, and either pool or close the connection. Called by the I/O thread.
+    void FinishRequest(HttpConnection* connection, HttpRequestState state, const QString& error = QString());
+
+    /// Mutex for the queues shared with the main thread.
+    mutable Mutex mutex_;
+    /// Requests queued by the main thread. The client holds a reference to each request until its signal has been sent;
+    /// references are only added and released on the main thread, as reference counts are not thread-safe.
+    std::vector<HttpRequest*> queued_;
+    /// Requests finished by the I/O thread, waiting for their signal.
+    std::vector<HttpRequest*> finished_;
+    /// Requests waiting for a connection. Used by the I/O thread only.
+    std::vector<HttpRequest*> waiting_;
+    /// Connections with a request in flight. Used by the I/O thread only.
+    std::vector<std::unique_ptr<HttpConnection> > active_;
+    /// Idle keep-alive connections. Used by the I/O thread only.
+    std::vector<std::unique_ptr<HttpConnection> > pool_;
+    /// Number of requests queued or in flight.
+    unsigned numActiveRequests_;
+    /// Number of idle pooled connections, readable from the main thread.
+    unsigned numPooledConnections_;
+    /// Number of connections opened.
+    unsigned numConnectionsOpened_;
+    /// Maximum simultaneous connections per host.
+    unsigned maxConnectionsPerHost_;
+};
+
+}
@@ -20,53 +20,33 @@
 // THE SOFTWARE.
 //
 
-#include "../Network/HttpRequest.h"
-#include "../IO/Log.h"
-#include "../Core/Profiler.h"
-#include "../Core/Timer.h"
+#include "Lutefisk3D/Network/HttpRequest.h"
+#include "Lutefisk3D/IO/Log.h"
+#include "Lutefisk3D/Math/MathDefs.h"
 
-#include <Civetweb/civetweb.h>
-
-#include "../DebugNew.h"
+#include <cstring>
 
 namespace Urho3D
 {
 
-static const unsigned ERROR_BUFFER_SIZE = 256;
-static const unsigned READ_BUFFER_SIZE = 65536; // Must be a power of two
+/// Maximum amount of unread response data buffered per request before the I/O thread stops reading its socket.
+static const unsigned READ_BUFFER_SIZE = 65536;
 
-HttpRequest::HttpRequest(const QString& url, const QString& verb, const std::vector<QString> & headers, const QString& postData) :
+HttpRequest::HttpRequest(const QString& url, const QString& verb, const std::vector<QString>& headers, const QString& postData) :
     url_(url.trimmed()),
     verb_(!verb.isEmpty() ? verb : "GET"),
-    headers_(headers),
-    postData_(postData),
+    port_(80),
+    statusCode_(0),
     state_(HTTP_INITIALIZING),
-    httpReadBuffer_(new unsigned char[READ_BUFFER_SIZE]),
-    readBuffer_(new unsigned char[READ_BUFFER_SIZE]),
-    readPosition_(0),
-    writePosition_(0)
+    readPosition_(0)
 {
     // Size of response is unknown, so just set maximum value. The position will also be changed
     // to maximum value once the request is done, signaling end for Deserializer::IsEof().
     size_ = M_MAX_UNSIGNED;
 
-    URHO3D_LOGDEBUG("HTTP " + verb_ + " request to URL " + url_);
-
-    // Start the worker thread to actually create the connection and read the response data.
-    Run();
-}
-
-HttpRequest::~HttpRequest()
-{
-    Stop();
-}
-
-void HttpRequest::ThreadFunction()
-{
     QString protocol = "http";
     QString host;
     QString path = "/";
-    int port = 80;
 
     int protocolEnd = url_.indexOf("://");
     if (protocolEnd != -1)
@@ -87,162 +67,80 @@ void HttpRequest::ThreadFunction()
     int portStart = host.indexOf(':');
     if (portStart != -1)
     {
-        port = ToInt(host.mid(portStart + 1));
+        port_ = (unsigned short)host.mid(portStart + 1).toUInt();
         host = host.mid(0, portStart);
     }
+    host_ = host.toStdString();
 
-    char errorBuffer[ERROR_BUFFER_SIZE];
-    memset(errorBuffer, 0, sizeof(errorBuffer));
-
-    QString headersStr;
-    for (unsigned i = 0; i < headers_.size(); ++i)
-    {
-        // Trim and only add non-empty header strings
-        QString header = headers_[i].trimmed();
-        if (header.length())
-            headersStr += header + "\r\n";
-    }
-
-    // Initiate the connection. This may block due to DNS query
-    /// \todo SSL mode will not actually work unless Civetweb's SSL mode is initialized with an external SSL DLL
-    mg_connection* connection = nullptr;
-    if (postData_.isEmpty())
-    {
-        connection = mg_download(qPrintable(host), port, protocol.compare("https", Qt::CaseInsensitive) ? 0 : 1, errorBuffer, sizeof(errorBuffer),
-            "%s %s HTTP/1.0\r\n"
-            "Host: %s\r\n"
-            "%s"
-            "\r\n", qPrintable(verb_), qPrintable(path), qPrintable(host), qPrintable(headersStr));
-    }
-    else
+    if (protocol.compare("http", Qt::CaseInsensitive))
     {
-        connection = mg_download(qPrintable(host), port, protocol.compare("https", Qt::CaseInsensitive) ? 0 : 1, errorBuffer, sizeof(errorBuffer),
-            "%s %s HTTP/1.0\r\n"
-            "Host: %s\r\n"
-            "%s"
-            "Content-Length: %d\r\n"
-            "\r\n"
-            "%s", qPrintable(verb_),qPrintable(path), qPrintable(host), qPrintable(headersStr), postData_.length(), qPrintable(postData_));
+        state_ = HTTP_ERROR;
+        error_ = "Unsupported protocol " + protocol;
+        return;
     }
 
+    // HTTP/1.1 with keep-alive, so that the connection can be reused by the following requests to the same host
+    QString request = QString("%1 %2 HTTP/1.1\r\nHost: %3\r\nConnection: keep-alive\r\n").arg(verb_, path, host);
+    for (const QString& header : headers)
     {
-        MutexLock lock(mutex_);
-        state_ = connection ? HTTP_OPEN : HTTP_ERROR;
-
-        // If no connection could be made, store the error and exit
-        if (state_ == HTTP_ERROR)
-        {
-            error_ = QString(&errorBuffer[0]);
-            return;
-        }
-    }
-
-    // Loop while should run, read data from the connection, copy to the main thread buffer if there is space
-    while (shouldRun_)
-    {
-        // Read less than full buffer to be able to distinguish between full and empty ring buffer. Reading may block
-        int bytesRead = mg_read(connection, httpReadBuffer_.Get(), READ_BUFFER_SIZE / 4);
-        if (bytesRead <= 0)
-            break;
-
-        mutex_.Acquire();
-
-        // Wait until enough space in the main thread's ring buffer
-        for (;;)
-        {
-            unsigned spaceInBuffer = READ_BUFFER_SIZE - ((writePosition_ - readPosition_) & (READ_BUFFER_SIZE - 1));
-            if ((int)spaceInBuffer > bytesRead || !shouldRun_)
-                break;
-
-            mutex_.Release();
-            Time::Sleep(5);
-            mutex_.Acquire();
-        }
-
-        if (!shouldRun_)
-        {
-            mutex_.Release();
-            break;
-        }
-
-        if (writePosition_ + bytesRead <= READ_BUFFER_SIZE)
-            memcpy(readBuffer_.Get() + writePosition_, httpReadBuffer_.Get(), bytesRead);
-        else
-        {
-            // Handle ring buffer wrap
-            unsigned part1 = READ_BUFFER_SIZE - writePosition_;
-            unsigned part2 = bytesRead - part1;
-            memcpy(readBuffer_.Get() + writePosition_, httpReadBuffer_.Get(), part1);
-            memcpy(readBuffer_.Get(), httpReadBuffer_.Get() + part1, part2);
-        }
-
-        writePosition_ += bytesRead;
-        writePosition_ &= READ_BUFFER_SIZE - 1;
-
-        mutex_.Release();
+        // Trim and only add non-empty header strings
+        QString trimmed = header.trimmed();
+        if (trimmed.length())
+            request += trimmed + "\r\n";
     }
+    QByteArray body = postData.toUtf8();
+    if (!body.isEmpty())
+        request += QString("Content-Length: %1\r\n").arg(body.size());
+    request += "\r\n";
+    requestData_ = request.toStdString();
+    requestData_.append(body.constData(), body.size());
 
-    // Close the connection
-    mg_close_connection(connection);
+    URHO3D_LOGDEBUG("HTTP " + verb_ + " request to URL " + url_);
+}
 
-    {
-        MutexLock lock(mutex_);
-        state_ = HTTP_CLOSED;
-    }
+HttpRequest::~HttpRequest()
+{
 }
 
 unsigned HttpRequest::Read(void* dest, unsigned size)
 {
-    mutex_.Acquire();
-
     unsigned char* destPtr = (unsigned char*)dest;
-    unsigned sizeLeft = size;
     unsigned totalRead = 0;
 
-    for (;;)
+    while (totalRead < size)
     {
-        std::pair<unsigned, bool> status;
-
-        for (;;)
-        {
-            status = CheckAvailableSizeAndEof();
-            if (status.first || status.second)
-                break;
-            // While no bytes and connection is still open, block until has some data
-            mutex_.Release();
-            Time::Sleep(5);
-            mutex_.Acquire();
-        }
-        unsigned bytesAvailable = status.first;
-
+        mutex_.Acquire();
+        unsigned bytesAvailable = readBuffer_.size() - readPosition_;
+        bool finished = state_ == HTTP_ERROR || state_ == HTTP_CLOSED;
         if (bytesAvailable)
         {
-            if (bytesAvailable > sizeLeft)
-                bytesAvailable = sizeLeft;
-
-            if (readPosition_ + bytesAvailable <= READ_BUFFER_SIZE)
-                memcpy(destPtr, readBuffer_.Get() + readPosition_, bytesAvailable);
-            else
-            {
-                // Handle ring buffer wrap
-                unsigned part1 = READ_BUFFER_SIZE - readPosition_;
-                unsigned part2 = bytesAvailable - part1;
-                memcpy(destPtr, readBuffer_.Get() + readPosition_, part1);
-                memcpy(destPtr + part1, readBuffer_.Get(), part2);
-            }
-
+            bytesAvailable = Min(bytesAvailable, size - totalRead);
+            memcpy(destPtr + totalRead, readBuffer_.data() + readPosition_, bytesAvailable);
             readPosition_ += bytesAvailable;
-            readPosition_ &= READ_BUFFER_SIZE - 1;
-            sizeLeft -= bytesAvailable;
             totalRead += bytesAvailable;
-            destPtr += bytesAvailable;
+            // Compact the buffer once everything or a large prefix has been consumed. A reader that keeps up with the
+            // I/O thread may never drain the buffer completely, which would otherwise let it grow without bound
+            if (readPosition_ == readBuffer_.size())
+            {
+                readBuffer_.clear();
+                readPosition_ = 0;
+            }
+            else if (readPosition_ >= READ_BUFFER_SIZE / 2)
+            {
+                readBuffer_.erase(readBuffer_.begin(), readBuffer_.begin() + readPosition_);
+                readPosition_ = 0;
+            }
         }
+        mutex_.Release();
 
-        if (!sizeLeft || !bytesAvailable)
+        if (bytesAvailable)
+            continue;
+        if (finished)
             break;
+        // While no bytes and the request is still open, block until the I/O thread has some data
+        dataAvailable_.Wait();
     }
 
-    mutex_.Release();
     return totalRead;
 }
 
@@ -254,7 +152,7 @@ unsigned HttpRequest::Seek(unsigned position)
 bool HttpRequest::IsEof() const
 {
     MutexLock lock(mutex_);
-    return CheckAvailableSizeAndEof().second;
+    return state_ == HTTP_ERROR || (state_ == HTTP_CLOSED && readPosition_ == readBuffer_.size());
 }
 
 QString HttpRequest::GetError() const
@@ -269,18 +167,65 @@ HttpRequestState HttpRequest::GetState() const
     return state_;
 }
 
+int HttpRequest::GetStatusCode() const
+{
+    MutexLock lock(mutex_);
+    return statusCode_;
+}
+
+QString HttpRequest::GetResponseHeader(const QString& name) const
+{
+    std::string key = name.toLower().toStdString();
+    MutexLock lock(mutex_);
+    for (const auto& header : responseHeaders_)
+    {
+        if (header.first == key)
+            return QString::fromStdString(header.second);
+    }
+    return QString();
+}
+
 unsigned HttpRequest::GetAvailableSize() const
 {
     MutexLock lock(mutex_);
-    return CheckAvailableSizeAndEof().first;
+    return readBuffer_.size() - readPosition_;
+}
+
+unsigned HttpRequest::GetFreeSpace() const
+{
+    MutexLock lock(mutex_);
+    unsigned buffered = readBuffer_.size() - readPosition_;
+    return buffered < READ_BUFFER_SIZE ? READ_BUFFER_SIZE - buffered : 0;
 }
 
-std::pair<unsigned, bool> HttpRequest::CheckAvailableSizeAndEof() const
+void HttpRequest::AppendData(const char* data, unsigned size)
 {
-    std::pair<unsigned, bool> ret;
-    ret.first = (writePosition_ - readPosition_) & (READ_BUFFER_SIZE - 1);
-    ret.second = (state_ == HTTP_ERROR || (state_ == HTTP_CLOSED && !ret.first));
-    return ret;
+    if (!size)
+        return;
+
+    {
+        MutexLock lock(mutex_);
+        readBuffer_.insert(readBuffer_.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+    }
+    dataAvailable_.Set();
+}
+
+void HttpRequest::SetResponse(int statusCode, const std::vector<std::pair<std::string, std::string> >& headers)
+{
+    MutexLock lock(mutex_);
+    statusCode_ = statusCode;
+    responseHeaders_ = headers;
+}
+
+void HttpRequest::SetState(HttpRequestState state, const QString& error)
+{
+    {
+        MutexLock lock(mutex_);
+        state_ = state;
+        if (!error.isEmpty())
+            error_ = error;
+    }
+    dataAvailable_.Set();
 }
 
 }
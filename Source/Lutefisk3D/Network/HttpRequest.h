@@ -22,15 +22,21 @@
 
 #pragma once
 
-#include "../Container/ArrayPtr.h"
-#include "../IO/Deserializer.h"
-#include "../Core/Mutex.h"
-#include "../Container/RefCounted.h"
-#include "../Core/Thread.h"
+#include "Lutefisk3D/Container/RefCounted.h"
+#include "Lutefisk3D/Core/Condition.h"
+#include "Lutefisk3D/Core/Mutex.h"
+#include "Lutefisk3D/Engine/jlsignal/Signal.h"
+#include "Lutefisk3D/IO/Deserializer.h"
+
+#include <QtCore/QString>
+#include <string>
+#include <vector>
 
 namespace Urho3D
 {
 
+class HttpRequest;
+
 /// HTTP connection state
 enum HttpRequestState
 {
@@ -40,25 +46,30 @@ enum HttpRequestState
     HTTP_CLOSED
 };
 
-/// An HTTP connection with response data stream.
-class LUTEFISK3D_EXPORT HttpRequest : public RefCounted, public Deserializer, public Thread
+struct HttpRequestSignals
+{
+    /// Request finished, either successfully or with an error. Sent on the main thread.
+    jl::Signal<HttpRequest *> requestFinished;
+};
+
+/// An HTTP request with response data stream. Serviced by the HttpClient I/O thread.
+class LUTEFISK3D_EXPORT HttpRequest : public RefCounted, public Deserializer, public HttpRequestSignals
 {
+    friend class HttpClient;
+
 public:
-    /// Construct with parameters.
+    /// Construct with parameters. The request is started once queued to an HttpClient.
     HttpRequest(const QString& url, const QString& verb, const std::vector<QString>& headers, const QString& postData);
-    /// Destruct. Release the connection object.
-    ~HttpRequest();
-    
-    /// Process the connection in the worker thread until closed.
-    virtual void ThreadFunction();
-    
-    /// Read response data from the HTTP connection and return number of bytes actually read. While the connection is open, will block while trying to read the specified size. To avoid blocking, only read up to as many bytes as GetAvailableSize() returns.
-    virtual unsigned Read(void* dest, unsigned size);
+    /// Destruct.
+    ~HttpRequest() override;
+
+    /// Read response data and return number of bytes actually read. While the request is open, will block while trying to read the specified size. To avoid blocking, only read up to as many bytes as GetAvailableSize() returns.
+    unsigned Read(void* dest, unsigned size) override;
     /// Set position from the beginning of the stream. Not supported.
-    virtual unsigned Seek(unsigned position);
+    unsigned Seek(unsigned position) override;
     /// Return whether all response data has been read.
-    virtual bool IsEof() const;
-    
+    bool IsEof() const override;
+
     /// Return URL used in the request.
     const QString& GetURL() const { return url_; }
     /// Return verb used in the request. Default GET if empty verb specified on construction.
@@ -67,37 +78,51 @@ public:
     QString GetError() const;
     /// Return connection state.
     HttpRequestState GetState() const;
+    /// Return HTTP status code of the response, or 0 if not yet received.
+    int GetStatusCode() const;
+    /// Return a response header value by lowercase name, or empty if not present.
+    QString GetResponseHeader(const QString& name) const;
     /// Return amount of bytes in the read buffer.
     unsigned GetAvailableSize() const;
     /// Return whether connection is in the open state.
     bool IsOpen() const { return GetState() == HTTP_OPEN; }
-    
+
 private:
-    /// Check for available read data in buffer and whether end has been reached. Must only be called when the mutex is held by the main thread.
-    std::pair<unsigned, bool> CheckAvailableSizeAndEof() const;
-    
+    /// Return free space in the read buffer. Called by the I/O thread to apply backpressure.
+    unsigned GetFreeSpace() const;
+    /// Append response body data. Called by the I/O thread.
+    void AppendData(const char* data, unsigned size);
+    /// Store the parsed response status and headers. Called by the I/O thread.
+    void SetResponse(int statusCode, const std::vector<std::pair<std::string, std::string> >& headers);
+    /// Change state and optionally store an error. Called by the I/O thread.
+    void SetState(HttpRequestState state, const QString& error = QString());
+
     /// URL.
     QString url_;
     /// Verb.
     QString verb_;
     /// Error string. Empty if no error.
     QString error_;
-    /// Headers.
-    std::vector<QString> headers_;
-    /// POST data.
-    QString postData_;
+    /// Host name parsed from the URL.
+    std::string host_;
+    /// Port parsed from the URL.
+    unsigned short port_;
+    /// Full request text, sent by the I/O thread.
+    std::string requestData_;
+    /// Response headers as lowercase name and value pairs.
+    std::vector<std::pair<std::string, std::string> > responseHeaders_;
+    /// Response status code.
+    int statusCode_;
     /// Connection state.
     HttpRequestState state_;
-    /// Mutex for synchronizing the worker and the main thread.
+    /// Mutex for synchronizing the I/O and the main thread.
     mutable Mutex mutex_;
-    /// Read buffer for the worker thread.
-    SharedArrayPtr<unsigned char> httpReadBuffer_;
-    /// Read buffer for the main thread.
-    SharedArrayPtr<unsigned char> readBuffer_;
-    /// Read buffer read cursor.
+    /// Signaled when data is appended or the request finishes.
+    Condition dataAvailable_;
+    /// Received response body data not yet read.
+    std::vector<unsigned char> readBuffer_;
+    /// Read cursor in the read buffer.
     unsigned readPosition_;
-    /// Read buffer write cursor.
-    unsigned writePosition_;
 };
 
 }
@@ -31,6 +31,7 @@
 #include "../IO/IOEvents.h"
 #include "../IO/Log.h"
 #include "../IO/MemoryBuffer.h"
+#include "HttpClient.h"
 #include "NetworkEvents.h"
 #include "NetworkPriority.h"
 #include "../Core/Profiler.h"
@@ -113,6 +114,7 @@ Network::~Network()
 
     delete network_;
     network_ = nullptr;
+    httpClient_.reset();
 }
 
 void Network::HandleMessage(kNet::MessageConnection *source, kNet::packet_id_t packetId, kNet::message_id_t msgId, const char *data, size_t numBytes)
@@ -370,6 +372,18 @@ void Network::SetPackageCacheDir(const QString& path)
     packageCacheDir_ = AddTrailingSlash(path);
 }
 
+SharedPtr<HttpRequest> Network::MakeHttpRequest(const QString& url, const QString& verb, const std::vector<QString>& headers, const QString& postData)
+{
+    URHO3D_PROFILE(MakeHttpRequest);
+
+    if (!httpClient_)
+        httpClient_.reset(new HttpClient());
+
+    SharedPtr<HttpRequest> request(new HttpRequest(url, verb, headers, postData));
+    httpClient_->Enqueue(request);
+    return request;
+}
+
 void Network::SendPackageToClients(Scene* scene, PackageFile* package)
 {
     if (!scene)
@@ -431,6 +445,10 @@ void Network::Update(float timeStep)
 {
     URHO3D_PROFILE(UpdateNetwork);
 
+    // Signal finished HTTP requests
+    if (httpClient_)
+        httpClient_->DispatchFinished();
+
     // Process server connection if it exists
     if (serverConnection_)
     {
@@ -31,10 +31,12 @@
 #include <kNet/IMessageHandler.h>
 #include <kNet/INetworkServerListener.h>
 #include <QtCore/QSet>
+#include <memory>
 
 namespace Urho3D
 {
 
+class HttpClient;
 class HttpRequest;
 class MemoryBuffer;
 class Scene;
@@ -97,6 +99,8 @@ public:
     void UnregisterAllRemoteEvents();
     /// Set the package download cache directory.
     void SetPackageCacheDir(const QString& path);
+    /// Perform an HTTP request to the specified URL. The request is serviced by a shared I/O thread and signals requestFinished on the main thread when done. Empty verb defaults to a GET request.
+    SharedPtr<HttpRequest> MakeHttpRequest(const QString& url, const QString& verb = QString(), const std::vector<QString>& headers = std::vector<QString>(), const QString& postData = QString());
     /// Trigger all client connections in the specified scene to download a package file from the server. Can be used to download additional resource packages when clients are already joined in the scene. The package must have been added as a requirement to the scene, or else the eventual download will fail.
     void SendPackageToClients(Scene* scene, PackageFile* package);
     /// Return network update FPS.
@@ -117,6 +121,8 @@ public:
     bool CheckRemoteEvent(StringHash eventType) const;
     /// Return the package download cache directory.
     const QString& GetPackageCacheDir() const { return packageCacheDir_; }
+    /// Return the HTTP client servicing MakeHttpRequest, or null if no requests have been made.
+    HttpClient* GetHttpClient() const { return httpClient_.get(); }
 
     /// Process incoming messages from connections. Called by HandleBeginFrame.
     void Update(float timeStep);
@@ -159,6 +165,8 @@ private:
     float updateAcc_;
     /// Package cache directory.
     QString packageCacheDir_;
+    /// HTTP client, created on the first HTTP request.
+    std::unique_ptr<HttpClient> httpClient_;
 };
 
 /// Register Network library objects.
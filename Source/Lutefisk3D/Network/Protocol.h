@@ -63,10 +63,20 @@ static const int MSG_REMOTEEVENT = 0x14;
 static const int MSG_REMOTENODEEVENT = 0x15;
 /// Server->client: info about package.
 static const int MSG_PACKAGEINFO = 0x16;
+/// Client->server: acknowledge received package fragments, opening the server's send window.
+static const int MSG_PACKAGEACK = 0x17;
 
 /// Fixed content ID for client controls update.
 static const unsigned CONTROLS_CONTENT_ID = 1;
 /// Package file fragment size.
-static const unsigned PACKAGE_FRAGMENT_SIZE = 1024;
+static const unsigned PACKAGE_FRAGMENT_SIZE = 4096;
+/// Maximum number of unacknowledged package fragments in flight per upload.
+static const unsigned PACKAGE_WINDOW_FRAGMENTS = 256;
+/// Number of received fragments after which the client acknowledges a package download.
+static const unsigned PACKAGE_ACK_INTERVAL = PACKAGE_WINDOW_FRAGMENTS / 4;
+/// Fragment count sent in a package acknowledgement to cancel an upload the client no longer wants.
+static const unsigned PACKAGE_ACK_CANCEL = 0xffffffff;
+/// Maximum number of package downloads the client runs in parallel.
+static const unsigned MAX_PARALLEL_PACKAGE_DOWNLOADS = 4;
 
 }
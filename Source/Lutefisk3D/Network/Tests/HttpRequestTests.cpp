@@ -0,0 +1,208 @@
+#include <QTest>
+#include <QThread>
+#include "../HttpClient.h"
+#include "../HttpRequest.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#include <atomic>
+#include <ctime>
+#include <string>
+#include <thread>
+
+namespace
+{
+#ifndef _WIN32
+/// Size of the body sent before the server closes the connection, several times the request's read buffer.
+const int CLOSE_BODY_SIZE = 192 * 1024;
+
+/// Minimal keep-alive HTTP/1.1 stand-in server on the loopback interface.
+class StandInServer
+{
+public:
+    StandInServer()
+    {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        bind(listener_, (sockaddr*)&addr, sizeof addr);
+        listen(listener_, 8);
+        socklen_t length = sizeof addr;
+        getsockname(listener_, (sockaddr*)&addr, &length);
+        port_ = ntohs(addr.sin_port);
+        thread_ = std::thread([this]() { Serve(); });
+    }
+    ~StandInServer()
+    {
+        shutdown(listener_, SHUT_RDWR);
+        close(listener_);
+        thread_.join();
+    }
+    unsigned short port_;
+    std::atomic<int> numAccepted_{0};
+
+private:
+    void Serve()
+    {
+        for (;;)
+        {
+            int client = accept(listener_, nullptr, nullptr);
+            if (client < 0)
+                return;
+            ++numAccepted_;
+            std::thread([client]() { ServeConnection(client); }).detach();
+        }
+    }
+    static void ServeConnection(int client)
+    {
+        std::string pending;
+        char buffer[4096];
+        for (;;)
+        {
+            size_t headerEnd;
+            while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos)
+            {
+                ssize_t received = recv(client, buffer, sizeof buffer, 0);
+                if (received <= 0)
+                {
+                    close(client);
+                    return;
+                }
+                pending.append(buffer, received);
+            }
+            std::string request = pending.substr(0, headerEnd);
+            pending.erase(0, headerEnd + 4);
+
+            std::string response;
+            if (request.find("GET /close ") == 0)
+            {
+                // A body delimited by the server closing the connection. The send buffer is made large enough to hold
+                // it, so that the server closes without waiting for the client to read
+                int sendBufferSize = CLOSE_BODY_SIZE * 2;
+                setsockopt(client, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof sendBufferSize);
+                response = "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n" + std::string(CLOSE_BODY_SIZE, 'y');
+                send(client, response.data(), response.size(), 0);
+                close(client);
+                return;
+            }
+            if (request.find("GET /chunked ") == 0)
+                response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nfoo\r\n6\r\nbarbaz\r\n0\r\n\r\n";
+            else if (request.find("GET /large ") == 0)
+                response = "HTTP/1.1 200 OK\r\nContent-Length: 1000000\r\n\r\n" + std::string(1000000, 'x');
+            else
+                response = "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nX-Test: yes\r\n\r\nhello world";
+            send(client, response.data(), response.size(), 0);
+        }
+    }
+
+    int listener_;
+    std::thread thread_;
+};
+#endif
+
+QByteArray ReadAll(Urho3D::HttpRequest* request)
+{
+    QByteArray result;
+    char buffer[8192];
+    while (!request->IsEof())
+    {
+        unsigned read = request->Read(buffer, sizeof buffer);
+        result.append(buffer, read);
+    }
+    return result;
+}
+}
+
+class HttpRequestTests : public QObject {
+    Q_OBJECT
+private slots:
+#ifndef _WIN32
+    void verifyKeepAliveReuse() {
+        StandInServer server;
+        Urho3D::HttpClient client;
+        QString url = QString("http://127.0.0.1:%1/fixed").arg(server.port_);
+        for (int i = 0; i < 3; ++i)
+        {
+            Urho3D::SharedPtr<Urho3D::HttpRequest> request(new Urho3D::HttpRequest(url, "", {}, ""));
+            client.Enqueue(request);
+            QCOMPARE(ReadAll(request), QByteArray("hello world"));
+            QCOMPARE(request->GetStatusCode(), 200);
+            QCOMPARE(request->GetResponseHeader("X-Test"), QString("yes"));
+            // Give the I/O thread a moment to return the connection to the pool
+            while (client.GetNumActiveRequests())
+                QThread::msleep(1);
+        }
+        QCOMPARE(client.GetNumConnectionsOpened(), 1U);
+        QCOMPARE(server.numAccepted_.load(), 1);
+    }
+    void verifyChunkedBody() {
+        StandInServer server;
+        Urho3D::HttpClient client;
+        Urho3D::SharedPtr<Urho3D::HttpRequest> request(
+                    new Urho3D::HttpRequest(QString("http://127.0.0.1:%1/chunked").arg(server.port_), "", {}, ""));
+        client.Enqueue(request);
+        QCOMPARE(ReadAll(request), QByteArray("foobarbaz"));
+        QCOMPARE(request->GetState(), Urho3D::HTTP_CLOSED);
+    }
+    void verifySmallReads() {
+        StandInServer server;
+        Urho3D::HttpClient client;
+        Urho3D::SharedPtr<Urho3D::HttpRequest> request(
+                    new Urho3D::HttpRequest(QString("http://127.0.0.1:%1/large").arg(server.port_), "", {}, ""));
+        client.Enqueue(request);
+        // Reads much smaller than the buffer seldom drain it, and go through the partial compaction
+        QByteArray result;
+        char buffer[1000];
+        while (!request->IsEof())
+            result.append(buffer, request->Read(buffer, sizeof buffer));
+        QCOMPARE(result, QByteArray(1000000, 'x'));
+        QVERIFY(request->GetAvailableSize() == 0);
+    }
+    void verifySlowReaderAfterClose() {
+        StandInServer server;
+        Urho3D::HttpClient client;
+        Urho3D::SharedPtr<Urho3D::HttpRequest> request(
+                    new Urho3D::HttpRequest(QString("http://127.0.0.1:%1/close").arg(server.port_), "", {}, ""));
+        client.Enqueue(request);
+
+        // While the reader is behind, the I/O thread waits instead of spinning on the closed connection
+        std::clock_t startCpu = std::clock();
+        QThread::msleep(500);
+        double cpuSeconds = double(std::clock() - startCpu) / CLOCKS_PER_SEC;
+        QVERIFY(cpuSeconds < 0.1);
+
+        QCOMPARE(ReadAll(request), QByteArray(CLOSE_BODY_SIZE, 'y'));
+        QCOMPARE(request->GetState(), Urho3D::HTTP_CLOSED);
+    }
+    void verifyManyConcurrentRequests() {
+        StandInServer server;
+        Urho3D::HttpClient client;
+        std::vector<Urho3D::SharedPtr<Urho3D::HttpRequest> > requests;
+        for (int i = 0; i < 100; ++i)
+        {
+            requests.emplace_back(new Urho3D::HttpRequest(QString("http://127.0.0.1:%1/large").arg(server.port_), "", {}, ""));
+            client.Enqueue(requests.back());
+        }
+        for (auto& request : requests)
+            QCOMPARE(ReadAll(request).size(), 1000000);
+        // Requests beyond the per-host limit wait for, and then reuse, pooled connections
+        QVERIFY(client.GetNumConnectionsOpened() <= client.GetMaxConnectionsPerHost());
+    }
+#endif
+    void verifyUnsupportedProtocol() {
+        Urho3D::HttpClient client;
+        Urho3D::SharedPtr<Urho3D::HttpRequest> request(new Urho3D::HttpRequest("https://localhost/", "", {}, ""));
+        client.Enqueue(request);
+        QVERIFY(request->IsEof());
+        QCOMPARE(request->GetState(), Urho3D::HTTP_ERROR);
+    }
+};
+
+QTEST_MAIN(HttpRequestTests)
+#include "HttpRequestTests.moc"
@@ -0,0 +1,151 @@
+#include <QTest>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
+#include "../Connection.h"
+#include "../Network.h"
+#include "../Protocol.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/StringUtils.h"
+#include "Lutefisk3D/IO/FileSystem.h"
+#include "Lutefisk3D/IO/PackageFile.h"
+#include "Lutefisk3D/IO/VectorBuffer.h"
+#include "Lutefisk3D/Resource/ResourceCache.h"
+#include "Lutefisk3D/Scene/Scene.h"
+
+namespace
+{
+const unsigned short TEST_PORT = 27615;
+const unsigned PACKAGE_CHECKSUM = 0x1234abcd;
+/// Number of package fragments, about 16 MB of data.
+const unsigned PACKAGE_FRAGMENTS = 4096;
+const unsigned RESUMED_FRAGMENTS = 1024;
+/// Offset of a byte corrupted in the partial file, inside the fragments left from the interrupted download.
+const unsigned CORRUPT_OFFSET = 700 * Urho3D::PACKAGE_FRAGMENT_SIZE + 100;
+
+/// Build an uncompressed package holding one entry that spans many fragments.
+QByteArray MakePackage()
+{
+    using namespace Urho3D;
+    QByteArray data(PACKAGE_FRAGMENTS * PACKAGE_FRAGMENT_SIZE, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = char(i * 7);
+
+    VectorBuffer buffer;
+    buffer.WriteFileID("UPAK");
+    buffer.WriteUInt(1);
+    buffer.WriteUInt(PACKAGE_CHECKSUM);
+    buffer.WriteString("Data.bin");
+    unsigned headerSize = buffer.GetSize() + 3 * sizeof(unsigned);
+    buffer.WriteUInt(headerSize);
+    buffer.WriteUInt(data.size());
+    buffer.WriteUInt(0);
+    buffer.Write(data.constData(), data.size());
+    return QByteArray((const char*)buffer.GetData(), buffer.GetSize());
+}
+
+bool WriteFile(const QString& fileName, const QByteArray& contents)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && file.write(contents) == contents.size();
+}
+
+/// Return the checksums the server sends with each fragment of the data.
+QByteArray GetFragmentChecksums(const QByteArray& data)
+{
+    using namespace Urho3D;
+    VectorBuffer buffer;
+    for (int start = 0; start < data.size(); start += PACKAGE_FRAGMENT_SIZE)
+    {
+        unsigned checksum = 0;
+        for (int i = start; i < Min(start + (int)PACKAGE_FRAGMENT_SIZE, data.size()); ++i)
+            checksum = SDBMHash(checksum, (unsigned char)data[i]);
+        buffer.WriteUInt(checksum);
+    }
+    return QByteArray((const char*)buffer.GetData(), buffer.GetSize());
+}
+
+void CreateSubsystems(Urho3D::Context* context)
+{
+    using namespace Urho3D;
+    RegisterSceneLibrary(context);
+    context->m_FileSystem.reset(new FileSystem(context));
+    context->m_ResourceCache.reset(new ResourceCache(context));
+    context->m_Network.reset(new Network(context));
+}
+}
+
+class PackageDownloadTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyResumedDownload() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString packageName = dir.path() + "/Data.pak";
+        const QString cacheDir = dir.path() + "/Cache/";
+        const QByteArray package = MakePackage();
+        QVERIFY(package.size() > int((RESUMED_FRAGMENTS + 1) * PACKAGE_FRAGMENT_SIZE));
+        QVERIFY(WriteFile(packageName, package));
+
+        // Leave the first fragments of an interrupted download in the client's cache, along with their checksums. One
+        // byte of the stored data no longer matches its checksum
+        QVERIFY(QDir().mkpath(cacheDir));
+        const QString downloadedName = cacheDir + ToStringHex(PACKAGE_CHECKSUM) + "_Data.pak";
+        const QByteArray resumed = package.left(RESUMED_FRAGMENTS * PACKAGE_FRAGMENT_SIZE);
+        QByteArray partial = resumed;
+        partial[CORRUPT_OFFSET] = char(~partial[CORRUPT_OFFSET]);
+        QVERIFY(WriteFile(downloadedName + ".part", partial));
+        QVERIFY(WriteFile(downloadedName + ".part.sums", GetFragmentChecksums(resumed)));
+
+        Context serverContext;
+        CreateSubsystems(&serverContext);
+        SharedPtr<Scene> serverScene(new Scene(&serverContext));
+        SharedPtr<PackageFile> serverPackage(new PackageFile(&serverContext, packageName));
+        QCOMPARE(serverPackage->GetChecksum(), PACKAGE_CHECKSUM);
+        serverScene->AddRequiredPackageFile(serverPackage);
+        Network* server = serverContext.m_Network.get();
+        QVERIFY(server->StartServer(TEST_PORT));
+
+        Context clientContext;
+        CreateSubsystems(&clientContext);
+        SharedPtr<Scene> clientScene(new Scene(&clientContext));
+        Network* client = clientContext.m_Network.get();
+        client->SetPackageCacheDir(cacheDir);
+        QVERIFY(client->Connect("127.0.0.1", TEST_PORT, clientScene));
+
+        const float timeStep = 1.0f / 30.0f;
+        for (int i = 0; i < 10000; ++i)
+        {
+            server->Update(timeStep);
+            client->Update(timeStep);
+            for (const SharedPtr<Connection>& connection : server->GetClientConnections())
+            {
+                if (!connection->GetScene())
+                    connection->SetScene(serverScene);
+            }
+            server->PostUpdate(timeStep);
+            client->PostUpdate(timeStep);
+            Connection* serverConnection = client->GetServerConnection();
+            if (serverConnection && serverConnection->IsSceneLoaded())
+                break;
+            QThread::msleep(1);
+        }
+        QVERIFY(client->GetServerConnection());
+        QVERIFY(client->GetServerConnection()->IsSceneLoaded());
+
+        // The corrupt fragment and those after it came from the server again
+        QFile downloaded(downloadedName);
+        QVERIFY(downloaded.open(QFile::ReadOnly));
+        QVERIFY(downloaded.readAll() == package);
+        QVERIFY(!QFile::exists(downloadedName + ".part"));
+        QVERIFY(!QFile::exists(downloadedName + ".part.sums"));
+
+        client->Disconnect();
+        server->StopServer();
+    }
+};
+
+QTEST_MAIN(PackageDownloadTests)
+#include "PackageDownloadTests.moc"
@@ -25,12 +25,14 @@
 #include "CollisionShape.h"
 #include "Constraint.h"
 #include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
 #include "Lutefisk3D/Graphics/DebugRenderer.h"
 #include "Lutefisk3D/IO/Log.h"
 #include "Lutefisk3D/Graphics/Model.h"
 #include "Lutefisk3D/Core/Mutex.h"
 #include "PhysicsEvents.h"
 #include "PhysicsUtils.h"
+#include "RaycastVehicle.h"
 #include "Lutefisk3D/Core/Profiler.h"
 #include "Lutefisk3D/Math/Ray.h"
 #include "RigidBody.h"
@@ -44,9 +46,19 @@
 #include <Bullet/BulletCollision/CollisionShapes/btBoxShape.h>
 #include <Bullet/BulletCollision/CollisionShapes/btSphereShape.h>
 #include <Bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
+#include <Bullet/BulletDynamics/ConstraintSolver/btTypedConstraint.h>
 #include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
 #include <Bullet/LinearMath/btIDebugDraw.h>
+#include <Bullet/LinearMath/btTransformUtil.h>
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <Bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <Bullet/LinearMath/btThreads.h>
+#endif
 
+#include <algorithm>
+#include <atomic>
 #include <unordered_set>
 
 extern ContactAddedCallback gContactAddedCallback;
@@ -74,6 +86,12 @@ struct PhysicsWorldPrivate final : public btIDebugDraw
     int getDebugMode() const override { return debugMode_; }
     void PreStep(float ts) { owner->PreStep(ts); }
     void PostStep(float ts) { owner->PostStep(ts); }
+    /// Create the Bullet world, multithreaded on the work queue if given.
+    void CreateWorld(WorkQueue* workQueue);
+    /// Destroy the Bullet world.
+    void ReleaseWorld();
+    /// Replace the multithreaded world with the single-threaded one, moving the collision objects and constraints to it.
+    void SwitchToSingleThreadedWorld();
 
     PhysicsWorld *owner;
     /// Debug draw flags.
@@ -86,8 +104,12 @@ struct PhysicsWorldPrivate final : public btIDebugDraw
     std::unique_ptr<btBroadphaseInterface> broadphase_;
     /// Bullet constraint solver.
     std::unique_ptr<btConstraintSolver> solver_;
+    /// Bullet constraint solver pool of the multithreaded world.
+    std::unique_ptr<btConstraintSolver> solverPool_;
     /// Bullet physics world.
     std::unique_ptr<btDiscreteDynamicsWorld> world_;
+    /// Multithreaded world flag.
+    bool multiThreaded_ = false;
     /// Debug renderer.
     DebugRenderer* debugRenderer_ = nullptr;
     /// Debug draw depth test mode.
@@ -101,12 +123,62 @@ namespace {
 const int MAX_SOLVER_ITERATIONS = 256;
 const int DEFAULT_FPS = 60;
 const Vector3 DEFAULT_GRAVITY = Vector3(0.0f, -9.81f, 0.0f);
+/// Minimum number of batched queries per work item.
+const unsigned MIN_QUERIES_PER_PART = 16;
 
 bool CompareRaycastResults(const PhysicsRaycastResult& lhs, const PhysicsRaycastResult& rhs)
 {
     return lhs.distance_ < rhs.distance_;
 }
 
+bool CompareContactPairs(const PhysicsContactPair& lhs, const PhysicsContactPair& rhs)
+{
+    if (lhs.bodyA_->GetID() != rhs.bodyA_->GetID())
+        return lhs.bodyA_->GetID() < rhs.bodyA_->GetID();
+    return lhs.bodyB_->GetID() < rhs.bodyB_->GetID();
+}
+
+using CollisionPairMap = HashMap<std::pair<WeakPtr<RigidBody>, WeakPtr<RigidBody> >, ManifoldPair>;
+
+/// Return the rigid body IDs of a collision pair. The bodies of a previous step's pair may have been removed since.
+std::pair<unsigned, unsigned> CollisionPairIDs(const std::pair<WeakPtr<RigidBody>, WeakPtr<RigidBody> >& bodies)
+{
+    return std::make_pair(bodies.first ? bodies.first->GetID() : 0, bodies.second ? bodies.second->GetID() : 0);
+}
+
+/// Return the entries of a collision pair map in the order to send their events. The map is ordered by pointer hashes,
+/// which differ between runs, so the entries are sorted by the rigid body IDs when deterministic.
+std::vector<CollisionPairMap::iterator> GetCollisionOrder(CollisionPairMap& collisions, bool deterministic)
+{
+    std::vector<CollisionPairMap::iterator> order;
+    order.reserve(collisions.size());
+    for (auto i = collisions.begin(); i != collisions.end(); ++i)
+        order.push_back(i);
+    if (deterministic)
+    {
+        std::sort(order.begin(), order.end(), [](CollisionPairMap::iterator lhs, CollisionPairMap::iterator rhs) {
+            return CollisionPairIDs(MAP_KEY(lhs)) < CollisionPairIDs(MAP_KEY(rhs));
+        });
+    }
+    return order;
+}
+
+unsigned HashScalar(unsigned hash, btScalar value)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for (unsigned i = 0; i < sizeof(btScalar); ++i)
+        hash = SDBMHash(hash, bytes[i]);
+    return hash;
+}
+
+unsigned HashVector(unsigned hash, const btVector3& value)
+{
+    // The fourth component is padding and may hold anything
+    hash = HashScalar(hash, value.x());
+    hash = HashScalar(hash, value.y());
+    return HashScalar(hash, value.z());
+}
+
 void InternalPreTickCallback(btDynamicsWorld *world, btScalar timeStep)
 {
     static_cast<PhysicsWorldPrivate*>(world->getWorldUserInfo())->PreStep(timeStep);
@@ -127,6 +199,219 @@ bool CustomMaterialCombinerCallback(btManifoldPoint& cp, const btCollisionObject
     return true;
 }
 
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+/// Runs the parallel loops of the multithreaded Bullet world on the work queue threads.
+class WorkQueueTaskScheduler : public btITaskScheduler
+{
+public:
+    WorkQueueTaskScheduler(WorkQueue* workQueue) :
+        btITaskScheduler("WorkQueue"),
+        workQueue_(workQueue)
+    {
+    }
+
+    int getMaxNumThreads() const override { return (int)workQueue_->GetNumThreads() + 1; }
+    int getNumThreads() const override { return getMaxNumThreads(); }
+    /// The worker threads are owned by the work queue.
+    void setNumThreads(int) override {}
+
+    void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) override
+    {
+        workQueue_->ProcessRange(iEnd - iBegin, Max(grainSize, 1), [iBegin, &body](unsigned start, unsigned end) {
+            body.forLoop(iBegin + start, iBegin + end);
+        });
+    }
+
+    btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody& body) override
+    {
+        btScalar sum = 0;
+        Mutex sumMutex;
+        workQueue_->ProcessRange(iEnd - iBegin, Max(grainSize, 1), [iBegin, &body, &sum, &sumMutex](unsigned start, unsigned end) {
+            const btScalar partSum = body.sumLoop(iBegin + start, iBegin + end);
+            MutexLock lock(sumMutex);
+            sum += partSum;
+        });
+        return sum;
+    }
+
+    /// Return the work queue.
+    WorkQueue* GetWorkQueue() const { return workQueue_; }
+
+private:
+    /// Work queue.
+    WorkQueue* workQueue_;
+};
+
+/// Bullet's task scheduler is global, so one is shared by all the multithreaded worlds and released with the last of them.
+static std::unique_ptr<WorkQueueTaskScheduler> taskScheduler;
+/// Number of multithreaded worlds using the task scheduler.
+static unsigned numTaskSchedulerUsers = 0;
+
+/// Return the task scheduler running on the work queue, creating it if no world uses one yet. Return null if the worlds
+/// already using it run on another work queue.
+WorkQueueTaskScheduler* AcquireTaskScheduler(WorkQueue* workQueue)
+{
+    if (!numTaskSchedulerUsers)
+    {
+        taskScheduler.reset(new WorkQueueTaskScheduler(workQueue));
+        btSetTaskScheduler(taskScheduler.get());
+    }
+    else if (taskScheduler->GetWorkQueue() != workQueue)
+        return nullptr;
+
+    ++numTaskSchedulerUsers;
+    return taskScheduler.get();
+}
+
+/// Release the task scheduler of a multithreaded world.
+void ReleaseTaskScheduler()
+{
+    if (--numTaskSchedulerUsers)
+        return;
+
+    btSetTaskScheduler(btGetSequentialTaskScheduler());
+    taskScheduler.reset();
+}
+#endif
+
+/// Broadphase callback of a batched raycast or sweep. Bullet's own callbacks traverse the broadphase with a single shared
+/// stack, so the batched queries traverse it themselves with a stack per work item.
+struct BatchRayCallback : public btBroadphaseRayCallback
+{
+    /// Construct for a raycast.
+    BatchRayCallback(const btVector3& from, const btVector3& to, btCollisionWorld::RayResultCallback* rayResult) :
+        rayResult_(rayResult),
+        convexResult_(nullptr),
+        castShape_(nullptr),
+        allowedPenetration_(0.0f)
+    {
+        fromTrans_.setIdentity();
+        fromTrans_.setOrigin(from);
+        toTrans_.setIdentity();
+        toTrans_.setOrigin(to);
+        SetDirection();
+    }
+
+    /// Construct for a convex sweep.
+    BatchRayCallback(const btConvexShape* castShape, const btTransform& from, const btTransform& to,
+        btCollisionWorld::ConvexResultCallback* convexResult, btScalar allowedPenetration) :
+        fromTrans_(from),
+        toTrans_(to),
+        rayResult_(nullptr),
+        convexResult_(convexResult),
+        castShape_(castShape),
+        allowedPenetration_(allowedPenetration)
+    {
+        SetDirection();
+    }
+
+    /// Test the ray or the sweep against an object whose bounding box it overlaps.
+    bool process(const btBroadphaseProxy* proxy) override
+    {
+        btCollisionWorld::RayResultCallback* rayResult = rayResult_;
+        btCollisionWorld::ConvexResultCallback* convexResult = convexResult_;
+        // Stop once a hit at the very start has been found
+        if ((rayResult ? rayResult->m_closestHitFraction : convexResult->m_closestHitFraction) == btScalar(0.f))
+            return false;
+
+        btCollisionObject* object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+        if (rayResult && rayResult->needsCollision(object->getBroadphaseHandle()))
+            btCollisionWorld::rayTestSingle(fromTrans_, toTrans_, object, object->getCollisionShape(), object->getWorldTransform(), *rayResult);
+        else if (convexResult && convexResult->needsCollision(object->getBroadphaseHandle()))
+            btCollisionWorld::objectQuerySingle(castShape_, fromTrans_, toTrans_, object, object->getCollisionShape(),
+                object->getWorldTransform(), *convexResult, allowedPenetration_);
+        return true;
+    }
+
+    /// Traverse both broadphase trees using the given stack.
+    void Test(const btDbvtBroadphase* broadphase, const btVector3& aabbMin, const btVector3& aabbMax, btAlignedObjectArray<const btDbvtNode*>& stack)
+    {
+        Tester tester(*this);
+        for (const btDbvt& set : broadphase->m_sets)
+            set.rayTestInternal(set.m_root, fromTrans_.getOrigin(), toTrans_.getOrigin(), m_rayDirectionInverse, m_signs, m_lambda_max,
+                aabbMin, aabbMax, stack, tester);
+    }
+
+private:
+    /// Broadphase tree leaf visitor.
+    struct Tester : btDbvt::ICollide
+    {
+        Tester(BatchRayCallback& callback) : callback_(callback) {}
+        void Process(const btDbvtNode* leaf) { callback_.process(static_cast<const btBroadphaseProxy*>(leaf->data)); }
+        BatchRayCallback& callback_;
+    };
+
+    /// Set up the cached ray data used by the bounding box tests.
+    void SetDirection()
+    {
+        const btVector3 delta = toTrans_.getOrigin() - fromTrans_.getOrigin();
+        const btVector3 dir = delta.fuzzyZero() ? btVector3(0.0f, 0.0f, 0.0f) : delta.normalized();
+        for (int i = 0; i < 3; ++i)
+        {
+            m_rayDirectionInverse[i] = dir[i] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / dir[i];
+            m_signs[i] = m_rayDirectionInverse[i] < 0.0;
+        }
+        m_lambda_max = dir.dot(delta);
+    }
+
+    /// Start transform.
+    btTransform fromTrans_;
+    /// End transform.
+    btTransform toTrans_;
+    /// Raycast result, or null for a sweep.
+    btCollisionWorld::RayResultCallback* rayResult_;
+    /// Sweep result, or null for a raycast.
+    btCollisionWorld::ConvexResultCallback* convexResult_;
+    /// Swept shape.
+    const btConvexShape* castShape_;
+    /// Penetration allowed at the start of a sweep.
+    btScalar allowedPenetration_;
+};
+
+/// Run batched queries on the work queue threads, or in the calling thread if there is no work queue.
+void ProcessQueries(Context* context, unsigned count, const std::function<void(unsigned, unsigned)>& function)
+{
+    if (WorkQueue* queue = context->m_WorkQueueSystem.get())
+        queue->ProcessRange(count, MIN_QUERIES_PER_PART, function);
+    else if (count)
+        function(0, count);
+}
+
+/// Find the closest hit of a convex sweep without the broadphase's shared traversal stack.
+void BatchConvexCast(PhysicsRaycastResult& result, const btDbvtBroadphase* broadphase, const btConvexShape* shape,
+    const btTransform& from, const btTransform& to, unsigned collisionMask, btScalar allowedPenetration,
+    btAlignedObjectArray<const btDbvtNode*>& stack)
+{
+    // Expand the shape bounds by the rotation during the sweep, like btCollisionWorld::convexSweepTest
+    btVector3 linVel, angVel, aabbMin, aabbMax;
+    btTransformUtil::calculateVelocity(from, to, 1.0f, linVel, angVel);
+    btTransform rotation(from.getRotation());
+    shape->calculateTemporalAabb(rotation, btVector3(0.0f, 0.0f, 0.0f), angVel, 1.0f, aabbMin, aabbMax);
+
+    btCollisionWorld::ClosestConvexResultCallback convexResult(from.getOrigin(), to.getOrigin());
+    convexResult.m_collisionFilterGroup = (short)0xffff;
+    convexResult.m_collisionFilterMask = (short)collisionMask;
+    BatchRayCallback callback(shape, from, to, &convexResult, allowedPenetration);
+    callback.Test(broadphase, aabbMin, aabbMax, stack);
+
+    if (convexResult.hasHit())
+    {
+        result.body_ = static_cast<RigidBody*>(convexResult.m_hitCollisionObject->getUserPointer());
+        result.position_ = ToVector3(convexResult.m_hitPointWorld);
+        result.normal_ = ToVector3(convexResult.m_hitNormalWorld);
+        result.distance_ = convexResult.m_closestHitFraction * (to.getOrigin() - from.getOrigin()).length();
+        result.hitFraction_ = convexResult.m_closestHitFraction;
+    }
+    else
+    {
+        result.body_ = nullptr;
+        result.position_ = Vector3::ZERO;
+        result.normal_ = Vector3::ZERO;
+        result.distance_ = M_INFINITY;
+        result.hitFraction_ = 0.0f;
+    }
+}
+
 /// Callback for physics world queries.
 struct PhysicsQueryCallback : public btCollisionWorld::ContactResultCallback
 {
@@ -166,6 +451,10 @@ PhysicsWorld::PhysicsWorld(Context* context) :
     internalEdge_(true),
     applyingTransforms_(false),
     simulating_(false),
+    deterministic_(false),
+    stateHash_(0),
+    nextContactListenerId_(1),
+    deliveringContacts_(false),
     private_data(new PhysicsWorldPrivate(this))
 {
     gContactAddedCallback = CustomMaterialCombinerCallback;
@@ -202,6 +491,7 @@ void PhysicsWorld::RegisterObject(Context* context)
     URHO3D_ATTRIBUTE("Interpolation", bool, interpolation_, true, AM_FILE);
     URHO3D_ATTRIBUTE("Internal Edge Utility", bool, internalEdge_, true, AM_DEFAULT);
     URHO3D_ACCESSOR_ATTRIBUTE("Split Impulse", GetSplitImpulse, SetSplitImpulse, bool, false, AM_DEFAULT);
+    URHO3D_ACCESSOR_ATTRIBUTE("Deterministic", IsDeterministic, SetDeterministic, bool, false, AM_DEFAULT);
 }
 
 PhysicsWorldPrivate::PhysicsWorldPrivate(PhysicsWorld * o) : owner(o) {
@@ -209,31 +499,137 @@ PhysicsWorldPrivate::PhysicsWorldPrivate(PhysicsWorld * o) : owner(o) {
         collisionConfiguration_ = PhysicsWorld::config.collisionConfig_;
     else
         collisionConfiguration_ = new btDefaultCollisionConfiguration();
-    collisionDispatcher_.reset(new btCollisionDispatcher(collisionConfiguration_));
-    broadphase_.reset(new btDbvtBroadphase());
-    solver_.reset(new btSequentialImpulseConstraintSolver);
-    world_.reset(new btDiscreteDynamicsWorld(collisionDispatcher_.get(), broadphase_.get(), solver_.get(), collisionConfiguration_));
+
+    WorkQueue* workQueue = o->GetContext()->m_WorkQueueSystem.get();
+    if (PhysicsWorld::config.multiThreaded_ && workQueue && workQueue->GetNumThreads())
+        CreateWorld(workQueue);
+    else
+        CreateWorld(nullptr);
 
     world_->setGravity(ToBtVector3(DEFAULT_GRAVITY));
     world_->getDispatchInfo().m_useContinuous = true;
     world_->getSolverInfo().m_splitImpulse = false; // Disable by default for performance
+}
+
+PhysicsWorldPrivate::~PhysicsWorldPrivate()
+{
+    ReleaseWorld();
+
+    // Delete configuration only if it was the default created by PhysicsWorld
+    if (!PhysicsWorld::config.collisionConfig_)
+        delete collisionConfiguration_;
+    collisionConfiguration_ = nullptr;
+}
+
+void PhysicsWorldPrivate::CreateWorld(WorkQueue* workQueue)
+{
+    broadphase_.reset(new btDbvtBroadphase());
+
+    if (workQueue)
+    {
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+        if (WorkQueueTaskScheduler* scheduler = AcquireTaskScheduler(workQueue))
+        {
+            const int numThreads = scheduler->getNumThreads();
+            collisionDispatcher_.reset(new btCollisionDispatcherMt(collisionConfiguration_));
+            // Small islands are solved in parallel by the pool, large ones by the multithreaded solver
+            btConstraintSolverPoolMt* solverPool = new btConstraintSolverPoolMt(numThreads);
+            solverPool_.reset(solverPool);
+            solver_.reset(new btSequentialImpulseConstraintSolverMt);
+            world_.reset(new btDiscreteDynamicsWorldMt(collisionDispatcher_.get(), broadphase_.get(), solverPool, solver_.get(),
+                collisionConfiguration_));
+            multiThreaded_ = true;
+        }
+        else
+            URHO3D_LOGWARNING("Multithreaded physics worlds must share one work queue, creating a single-threaded world");
+#else
+        URHO3D_LOGWARNING("Multithreaded physics world requested, but Bullet was not built thread-safe (LUTEFISK3D_PHYSICS_THREADED)");
+#endif
+    }
+    if (!world_)
+    {
+        collisionDispatcher_.reset(new btCollisionDispatcher(collisionConfiguration_));
+        solver_.reset(new btSequentialImpulseConstraintSolver);
+        world_.reset(new btDiscreteDynamicsWorld(collisionDispatcher_.get(), broadphase_.get(), solver_.get(), collisionConfiguration_));
+    }
+
     world_->setDebugDrawer(this);
     world_->setInternalTickCallback((btInternalTickCallback)InternalPreTickCallback, static_cast<void*>(this), true);
     world_->setInternalTickCallback((btInternalTickCallback)InternalTickCallback, static_cast<void*>(this), false);
     world_->setSynchronizeAllMotionStates(true);
 }
 
-PhysicsWorldPrivate::~PhysicsWorldPrivate()
+void PhysicsWorldPrivate::ReleaseWorld()
 {
     world_.reset();
     solver_.reset();
+    solverPool_.reset();
     broadphase_.reset();
     collisionDispatcher_.reset();
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+    if (multiThreaded_)
+        ReleaseTaskScheduler();
+#endif
+    multiThreaded_ = false;
+}
 
-    // Delete configuration only if it was the default created by PhysicsWorld
-    if (!PhysicsWorld::config.collisionConfig_)
-        delete collisionConfiguration_;
-    collisionConfiguration_ = nullptr;
+void PhysicsWorldPrivate::SwitchToSingleThreadedWorld()
+{
+    struct WorldObject
+    {
+        btCollisionObject* object_;
+        int group_;
+        int mask_;
+    };
+    // Take out the constraints first, remembering whether they disable the collisions between their bodies
+    std::vector<std::pair<btTypedConstraint*, bool> > constraints;
+    for (int i = 0; i < world_->getNumConstraints(); ++i)
+    {
+        btTypedConstraint* constraint = world_->getConstraint(i);
+        btRigidBody& body = constraint->getRigidBodyA();
+        bool disableCollision = false;
+        for (int j = 0; j < body.getNumConstraintRefs() && !disableCollision; ++j)
+            disableCollision = body.getConstraintRef(j) == constraint;
+        constraints.emplace_back(constraint, disableCollision);
+    }
+    for (const auto& constraint : constraints)
+        world_->removeConstraint(constraint.first);
+
+    // Keep the order of the collision objects, so that the new broadphase proxies are created in the same order
+    const btCollisionObjectArray& objectArray = world_->getCollisionObjectArray();
+    std::vector<WorldObject> objects;
+    objects.reserve(objectArray.size());
+    for (int i = 0; i < objectArray.size(); ++i)
+    {
+        btBroadphaseProxy* proxy = objectArray[i]->getBroadphaseHandle();
+        objects.push_back({ objectArray[i], proxy->m_collisionFilterGroup, proxy->m_collisionFilterMask });
+    }
+    for (const WorldObject& elem : objects)
+    {
+        if (btRigidBody* body = btRigidBody::upcast(elem.object_))
+            world_->removeRigidBody(body);
+        else
+            world_->removeCollisionObject(elem.object_);
+    }
+
+    const btVector3 gravity = world_->getGravity();
+    const btContactSolverInfo solverInfo = world_->getSolverInfo();
+    const btDispatcherInfo dispatchInfo = world_->getDispatchInfo();
+    ReleaseWorld();
+    CreateWorld(nullptr);
+    world_->setGravity(gravity);
+    world_->getSolverInfo() = solverInfo;
+    world_->getDispatchInfo() = dispatchInfo;
+
+    for (const WorldObject& elem : objects)
+    {
+        if (btRigidBody* body = btRigidBody::upcast(elem.object_))
+            world_->addRigidBody(body, elem.group_, elem.mask_);
+        else
+            world_->addCollisionObject(elem.object_, elem.group_, elem.mask_);
+    }
+    for (const auto& constraint : constraints)
+        world_->addConstraint(constraint.first, constraint.second);
 }
 
 void PhysicsWorldPrivate::drawLine(const btVector3& from, const btVector3& to, const btVector3& color)
@@ -275,7 +671,8 @@ void PhysicsWorld::Update(float timeStep)
 
     float internalTimeStep = 1.0f / fps_;
     int maxSubSteps = (int)(timeStep * fps_) + 1;
-    if (maxSubSteps_ < 0)
+    // The adaptive timestep would make the steps depend on the frame times
+    if (maxSubSteps_ < 0 && !deterministic_)
     {
         internalTimeStep = timeStep;
         maxSubSteps = 1;
@@ -287,7 +684,7 @@ void PhysicsWorld::Update(float timeStep)
     simulating_ = true;
 
     L_D(PhysicsWorld);
-    if (interpolation_)
+    if (interpolation_ && !deterministic_)
         d->world_->stepSimulation(timeStep, maxSubSteps, internalTimeStep);
     else
     {
@@ -380,6 +777,31 @@ void PhysicsWorld::SetSplitImpulse(bool enable)
     MarkNetworkUpdate();
 }
 
+void PhysicsWorld::SetDeterministic(bool enable)
+{
+    L_D(PhysicsWorld);
+    if (enable && d->multiThreaded_)
+    {
+        // The results of the multithreaded world depend on the number of threads
+        std::vector<RaycastVehicle*> vehicles;
+        if (scene_)
+            scene_->GetComponents<RaycastVehicle>(vehicles, true);
+        if (simulating_)
+            URHO3D_LOGWARNING("Can not switch to the single-threaded physics world during the simulation step");
+        else if (!vehicles.empty())
+            URHO3D_LOGWARNING("Can not switch to the single-threaded physics world with raycast vehicles in the scene");
+        else
+            d->SwitchToSingleThreadedWorld();
+    }
+
+    deterministic_ = enable;
+    // Process the overlapping pairs and the islands in the order of the broadphase proxy IDs
+    d->world_->getDispatchInfo().m_deterministicOverlappingPairs = enable;
+    stateHash_ = 0;
+
+    MarkNetworkUpdate();
+}
+
 void PhysicsWorld::SetMaxNetworkAngularVelocity(float velocity)
 {
     maxNetworkAngularVelocity_ = Clamp(velocity, 1.0f, 32767.0f);
@@ -621,6 +1043,119 @@ void PhysicsWorld::ConvexCast(PhysicsRaycastResult& result, btCollisionShape* sh
     }
 }
 
+void PhysicsWorld::RaycastSingleBatch(PhysicsRaycastResult* results, const PhysicsRaycastQuery* queries, unsigned count)
+{
+    URHO3D_PROFILE(PhysicsRaycastSingleBatch);
+    if (simulating_)
+    {
+        URHO3D_LOGERROR("Can not perform batched physics raycasts during the simulation step");
+        return;
+    }
+    L_D(PhysicsWorld);
+
+    const btDbvtBroadphase* broadphase = static_cast<const btDbvtBroadphase*>(d->broadphase_.get());
+    ProcessQueries(context_, count, [results, queries, broadphase](unsigned start, unsigned end) {
+        btAlignedObjectArray<const btDbvtNode*> stack;
+        for (unsigned i = start; i < end; ++i)
+        {
+            const PhysicsRaycastQuery& query = queries[i];
+            PhysicsRaycastResult& result = results[i];
+            const btVector3 from = ToBtVector3(query.ray_.origin_);
+            const btVector3 to = ToBtVector3(query.ray_.origin_ + query.maxDistance_ * query.ray_.direction_);
+
+            btCollisionWorld::ClosestRayResultCallback rayResult(from, to);
+            rayResult.m_collisionFilterGroup = (short)0xffff;
+            rayResult.m_collisionFilterMask = (short)query.collisionMask_;
+            BatchRayCallback callback(from, to, &rayResult);
+            callback.Test(broadphase, btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), stack);
+
+            if (rayResult.hasHit())
+            {
+                result.position_ = ToVector3(rayResult.m_hitPointWorld);
+                result.normal_ = ToVector3(rayResult.m_hitNormalWorld);
+                result.distance_ = (result.position_ - query.ray_.origin_).Length();
+                result.hitFraction_ = rayResult.m_closestHitFraction;
+                result.body_ = static_cast<RigidBody*>(rayResult.m_collisionObject->getUserPointer());
+            }
+            else
+            {
+                result.position_ = Vector3::ZERO;
+                result.normal_ = Vector3::ZERO;
+                result.distance_ = M_INFINITY;
+                result.hitFraction_ = 0.0f;
+                result.body_ = nullptr;
+            }
+        }
+    });
+}
+
+void PhysicsWorld::SphereCastBatch(PhysicsRaycastResult* results, const PhysicsRaycastQuery* queries, unsigned count, float radius)
+{
+    URHO3D_PROFILE(PhysicsSphereCastBatch);
+    if (simulating_)
+    {
+        URHO3D_LOGERROR("Can not perform batched physics sphere casts during the simulation step");
+        return;
+    }
+    L_D(PhysicsWorld);
+
+    const btDbvtBroadphase* broadphase = static_cast<const btDbvtBroadphase*>(d->broadphase_.get());
+    // The shape is only read by the queries, so all of them share it
+    btSphereShape shape(radius);
+    const btScalar allowedPenetration = d->world_->getDispatchInfo().m_allowedCcdPenetration;
+    ProcessQueries(context_, count, [results, queries, broadphase, &shape, allowedPenetration](unsigned start, unsigned end) {
+        btAlignedObjectArray<const btDbvtNode*> stack;
+        for (unsigned i = start; i < end; ++i)
+        {
+            const PhysicsRaycastQuery& query = queries[i];
+            const btTransform from(btQuaternion::getIdentity(), ToBtVector3(query.ray_.origin_));
+            const btTransform to(btQuaternion::getIdentity(), ToBtVector3(query.ray_.origin_ + query.maxDistance_ * query.ray_.direction_));
+            BatchConvexCast(results[i], broadphase, &shape, from, to, query.collisionMask_, allowedPenetration, stack);
+        }
+    });
+}
+
+void PhysicsWorld::ConvexCastBatch(PhysicsRaycastResult* results, const PhysicsConvexCastQuery* queries, unsigned count)
+{
+    URHO3D_PROFILE(PhysicsConvexCastBatch);
+    if (simulating_)
+    {
+        URHO3D_LOGERROR("Can not perform batched physics convex casts during the simulation step");
+        return;
+    }
+    L_D(PhysicsWorld);
+
+    const btDbvtBroadphase* broadphase = static_cast<const btDbvtBroadphase*>(d->broadphase_.get());
+    const btScalar allowedPenetration = d->world_->getDispatchInfo().m_allowedCcdPenetration;
+    std::atomic<bool> invalidShape(false);
+    ProcessQueries(context_, count, [results, queries, broadphase, allowedPenetration, &invalidShape](unsigned start, unsigned end) {
+        btAlignedObjectArray<const btDbvtNode*> stack;
+        for (unsigned i = start; i < end; ++i)
+        {
+            const PhysicsConvexCastQuery& query = queries[i];
+            PhysicsRaycastResult& result = results[i];
+            if (!query.shape_ || !query.shape_->isConvex())
+            {
+                invalidShape = true;
+                result.body_ = nullptr;
+                result.position_ = Vector3::ZERO;
+                result.normal_ = Vector3::ZERO;
+                result.distance_ = M_INFINITY;
+                result.hitFraction_ = 0.0f;
+                continue;
+            }
+
+            const btTransform from(ToBtQuaternion(query.startRot_), ToBtVector3(query.startPos_));
+            const btTransform to(ToBtQuaternion(query.endRot_), ToBtVector3(query.endPos_));
+            BatchConvexCast(result, broadphase, static_cast<const btConvexShape*>(query.shape_), from, to, query.collisionMask_,
+                allowedPenetration, stack);
+        }
+    });
+
+    if (invalidShape)
+        URHO3D_LOGERROR("Null or non-convex collision shape in batched convex cast");
+}
+
 void PhysicsWorld::RemoveCachedGeometry(Model* model)
 {
     for (auto i = triMeshCache_.begin(), fin = triMeshCache_.end(); i!=fin; )
@@ -715,6 +1250,39 @@ void PhysicsWorld::GetCollidingBodies(std::unordered_set<RigidBody*>& result, co
     }
 }
 
+unsigned PhysicsWorld::AddContactListener(unsigned collisionMask, const PhysicsContactCallback& callback)
+{
+    if (!callback)
+    {
+        URHO3D_LOGERROR("Null contact listener callback");
+        return 0;
+    }
+
+    PhysicsContactListener listener;
+    listener.id_ = nextContactListenerId_++;
+    listener.collisionMask_ = collisionMask;
+    listener.callback_ = callback;
+    listener.removed_ = false;
+    contactListeners_.push_back(listener);
+    return listener.id_;
+}
+
+bool PhysicsWorld::RemoveContactListener(unsigned id)
+{
+    for (auto i = contactListeners_.begin(); i != contactListeners_.end(); ++i)
+    {
+        if (i->id_ != id || i->removed_)
+            continue;
+        // Do not move the listeners while one of them is being called, they are compacted after the delivery
+        if (deliveringContacts_)
+            i->removed_ = true;
+        else
+            contactListeners_.erase(i);
+        return true;
+    }
+    return false;
+}
+
 Vector3 PhysicsWorld::GetGravity() const
 {
     L_D(PhysicsWorld);
@@ -733,6 +1301,12 @@ bool PhysicsWorld::GetSplitImpulse() const
     return d->world_->getSolverInfo().m_splitImpulse != 0;
 }
 
+bool PhysicsWorld::IsMultiThreaded() const
+{
+    L_D(PhysicsWorld);
+    return d->multiThreaded_;
+}
+
 void PhysicsWorld::AddRigidBody(RigidBody* body)
 {
     rigidBodies_.insert(body);
@@ -845,6 +1419,9 @@ void PhysicsWorld::PostStep(float timeStep)
 {
     URHO3D_PROFILE_END();
 
+    if (deterministic_)
+        UpdateStateHash();
+
     SendCollisionEvents();
 
     // Send post-step event
@@ -855,7 +1432,11 @@ void PhysicsWorld::SendCollisionEvents()
 {
     URHO3D_PROFILE(SendCollisionEvents);
 
+    // Reuse the previous step's pair map instead of copying the current one into it at the end
+    previousCollisions_.swap(currentCollisions_);
     currentCollisions_.clear();
+    contactPairs_.clear();
+    contactPoints_.clear();
     L_D(PhysicsWorld);
 
     int numManifolds = d->collisionDispatcher_->getNumManifolds();
@@ -893,7 +1474,7 @@ void PhysicsWorld::SendCollisionEvents()
             // First only store the collision pair as weak pointers and the manifold pointer, so user code can safely destroy
             // objects during collision event handling
             std::pair<WeakPtr<RigidBody>, WeakPtr<RigidBody> > bodyPair;
-            if (bodyA < bodyB)
+            if (deterministic_ ? bodyA->GetID() < bodyB->GetID() : bodyA < bodyB)
             {
                 bodyPair = std::make_pair(bodyWeakA, bodyWeakB);
                 currentCollisions_[bodyPair].manifold_ = contactManifold;
@@ -905,127 +1486,135 @@ void PhysicsWorld::SendCollisionEvents()
             }
         }
 
-        for (auto elem = currentCollisions_.begin(),fin=currentCollisions_.end(); elem!=fin; ++elem)
+        SendContactStream();
+
+        // The serialized per-pair events are only kept for compatibility, skip them when nobody listens
+        const bool legacyEvents = collisionStart.CountConnections() || collision.CountConnections() ||
+                !nodeCollisionStart.empty() || !nodeCollision.empty();
+        if (legacyEvents)
         {
-            RigidBody* bodyA = MAP_KEY(elem).first;
-            RigidBody* bodyB = MAP_KEY(elem).second;
-            if (!bodyA || !bodyB)
-                continue;
+            for (CollisionPairMap::iterator elem : GetCollisionOrder(currentCollisions_, deterministic_))
+            {
+                RigidBody* bodyA = MAP_KEY(elem).first;
+                RigidBody* bodyB = MAP_KEY(elem).second;
+                if (!bodyA || !bodyB)
+                    continue;
 
-            btPersistentManifold* contactManifold = MAP_VALUE(elem).manifold_;
+                btPersistentManifold* contactManifold = MAP_VALUE(elem).manifold_;
 
-            Node* nodeA = bodyA->GetNode();
-            Node* nodeB = bodyB->GetNode();
-            WeakPtr<Node> nodeWeakA(nodeA);
-            WeakPtr<Node> nodeWeakB(nodeB);
+                Node* nodeA = bodyA->GetNode();
+                Node* nodeB = bodyB->GetNode();
+                WeakPtr<Node> nodeWeakA(nodeA);
+                WeakPtr<Node> nodeWeakB(nodeB);
 
-            bool trigger = bodyA->IsTrigger() || bodyB->IsTrigger();
-            bool newCollision = !hashContains(previousCollisions_,MAP_KEY(elem));
+                bool trigger = bodyA->IsTrigger() || bodyB->IsTrigger();
+                bool newCollision = !hashContains(previousCollisions_,MAP_KEY(elem));
 
-            contacts_.clear();
+                contacts_.clear();
 
-            // "Pointers not flipped"-manifold, send unmodified normals
-            if (contactManifold)
-            {
-                for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                // "Pointers not flipped"-manifold, send unmodified normals
+                if (contactManifold)
                 {
-                    btManifoldPoint& point = contactManifold->getContactPoint(j);
-                    contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
-                    contacts_.WriteVector3(ToVector3(point.m_normalWorldOnB));
-                    contacts_.WriteFloat(point.m_distance1);
-                    contacts_.WriteFloat(point.m_appliedImpulse);
+                    for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                    {
+                        btManifoldPoint& point = contactManifold->getContactPoint(j);
+                        contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
+                        contacts_.WriteVector3(ToVector3(point.m_normalWorldOnB));
+                        contacts_.WriteFloat(point.m_distance1);
+                        contacts_.WriteFloat(point.m_appliedImpulse);
+                    }
                 }
-            }
-            // "Pointers flipped"-manifold, flip normals also
-            contactManifold = MAP_VALUE(elem).flippedManifold_;
-            if (contactManifold)
-            {
-                for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                // "Pointers flipped"-manifold, flip normals also
+                contactManifold = MAP_VALUE(elem).flippedManifold_;
+                if (contactManifold)
                 {
-                    btManifoldPoint& point = contactManifold->getContactPoint(j);
-                    contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
-                    contacts_.WriteVector3(-ToVector3(point.m_normalWorldOnB));
-                    contacts_.WriteFloat(point.m_distance1);
-                    contacts_.WriteFloat(point.m_appliedImpulse);
+                    for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                    {
+                        btManifoldPoint& point = contactManifold->getContactPoint(j);
+                        contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
+                        contacts_.WriteVector3(-ToVector3(point.m_normalWorldOnB));
+                        contacts_.WriteFloat(point.m_distance1);
+                        contacts_.WriteFloat(point.m_appliedImpulse);
+                    }
                 }
-            }
 
-            // Send separate collision start event if collision is new
-            if (newCollision)
-            {
-                collisionStart(this,nodeA,nodeB,bodyA,bodyB,trigger,contacts_.GetBuffer());
-                // Skip rest of processing if either of the nodes or bodies is removed as a response to the event
+                // Send separate collision start event if collision is new
+                if (newCollision)
+                {
+                    collisionStart(this,nodeA,nodeB,bodyA,bodyB,trigger,contacts_.GetBuffer());
+                    // Skip rest of processing if either of the nodes or bodies is removed as a response to the event
+                    if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
+                        continue;
+                }
+                collision(this,nodeA,nodeB,bodyA,bodyB,trigger,contacts_.GetBuffer());
                 if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
                     continue;
-            }
-            collision(this,nodeA,nodeB,bodyA,bodyB,trigger,contacts_.GetBuffer());
-            if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
-                continue;
 
-            if (newCollision)
-            {
-                auto iter = nodeCollisionStart.find(nodeA);
-                if(iter!=nodeCollisionStart.end()) {
+                if (newCollision)
+                {
+                    auto iter = nodeCollisionStart.find(nodeA);
+                    if(iter!=nodeCollisionStart.end()) {
+                        iter->second(bodyA,nodeB,bodyB,trigger,contacts_.GetBuffer());
+                        if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
+                            continue;
+                    }
+                }
+                auto iter = nodeCollision.find(nodeA);
+                if(iter!=nodeCollision.end()) {
                     iter->second(bodyA,nodeB,bodyB,trigger,contacts_.GetBuffer());
                     if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
                         continue;
                 }
-            }
-            auto iter = nodeCollision.find(nodeA);
-            if(iter!=nodeCollision.end()) {
-                iter->second(bodyA,nodeB,bodyB,trigger,contacts_.GetBuffer());
-                if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
-                    continue;
-            }
 
-            // Flip perspective to body B
-            contacts_.clear();
-            contactManifold = MAP_VALUE(elem).manifold_;
-            if (contactManifold)
-            {
-                for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                // Flip perspective to body B
+                contacts_.clear();
+                contactManifold = MAP_VALUE(elem).manifold_;
+                if (contactManifold)
                 {
-                    btManifoldPoint& point = contactManifold->getContactPoint(j);
-                    contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
-                    contacts_.WriteVector3(-ToVector3(point.m_normalWorldOnB));
-                    contacts_.WriteFloat(point.m_distance1);
-                    contacts_.WriteFloat(point.m_appliedImpulse);
+                    for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                    {
+                        btManifoldPoint& point = contactManifold->getContactPoint(j);
+                        contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
+                        contacts_.WriteVector3(-ToVector3(point.m_normalWorldOnB));
+                        contacts_.WriteFloat(point.m_distance1);
+                        contacts_.WriteFloat(point.m_appliedImpulse);
+                    }
                 }
-            }
-            contactManifold = MAP_VALUE(elem).flippedManifold_;
-            if (contactManifold)
-            {
-                for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                contactManifold = MAP_VALUE(elem).flippedManifold_;
+                if (contactManifold)
                 {
-                    btManifoldPoint& point = contactManifold->getContactPoint(j);
-                    contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
-                    contacts_.WriteVector3(ToVector3(point.m_normalWorldOnB));
-                    contacts_.WriteFloat(point.m_distance1);
-                    contacts_.WriteFloat(point.m_appliedImpulse);
+                    for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+                    {
+                        btManifoldPoint& point = contactManifold->getContactPoint(j);
+                        contacts_.WriteVector3(ToVector3(point.m_positionWorldOnB));
+                        contacts_.WriteVector3(ToVector3(point.m_normalWorldOnB));
+                        contacts_.WriteFloat(point.m_distance1);
+                        contacts_.WriteFloat(point.m_appliedImpulse);
+                    }
                 }
-            }
 
-            if (newCollision)
-            {
-                auto iter = nodeCollisionStart.find(nodeB);
-                if(iter!=nodeCollisionStart.end()) {
+                if (newCollision)
+                {
+                    auto iter = nodeCollisionStart.find(nodeB);
+                    if(iter!=nodeCollisionStart.end()) {
+                        iter->second(bodyB,nodeA,bodyA,trigger,contacts_.GetBuffer());
+                        if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
+                            continue;
+                    }
+                }
+                iter = nodeCollision.find(nodeB);
+                if(iter!=nodeCollision.end()) {
                     iter->second(bodyB,nodeA,bodyA,trigger,contacts_.GetBuffer());
-                    if (!nodeWeakA || !nodeWeakB || !MAP_KEY(elem).first || !MAP_KEY(elem).second)
-                        continue;
                 }
             }
-            iter = nodeCollision.find(nodeB);
-            if(iter!=nodeCollision.end()) {
-                iter->second(bodyB,nodeA,bodyA,trigger,contacts_.GetBuffer());
-            }
         }
     }
 
     // Send collision end events as applicable
     {
-        for (auto & elem_pair : previousCollisions_)
+        for (CollisionPairMap::iterator elem_pair : GetCollisionOrder(previousCollisions_, deterministic_))
         {
-            const std::pair<WeakPtr<RigidBody>, WeakPtr<RigidBody> > &elem(elem_pair.first);
+            const std::pair<WeakPtr<RigidBody>, WeakPtr<RigidBody> > &elem(MAP_KEY(elem_pair));
 
             if (!hashContains(currentCollisions_,elem))
             {
@@ -1068,8 +1657,97 @@ void PhysicsWorld::SendCollisionEvents()
             }
         }
     }
+}
+
+void PhysicsWorld::UpdateStateHash()
+{
+    L_D(PhysicsWorld);
+    const btCollisionObjectArray& objects = d->world_->getCollisionObjectArray();
+
+    unsigned hash = 0;
+    for (int i = 0; i < objects.size(); ++i)
+    {
+        const btRigidBody* body = btRigidBody::upcast(objects[i]);
+        if (!body)
+            continue;
+        const btTransform& transform = body->getWorldTransform();
+        hash = HashVector(hash, transform.getOrigin());
+        for (int j = 0; j < 3; ++j)
+            hash = HashVector(hash, transform.getBasis()[j]);
+        hash = HashVector(hash, body->getLinearVelocity());
+        hash = HashVector(hash, body->getAngularVelocity());
+    }
+    stateHash_ = hash;
+}
+
+void PhysicsWorld::SendContactStream()
+{
+    for (auto & elem_pair : currentCollisions_)
+    {
+        RigidBody* bodyA = elem_pair.first.first;
+        RigidBody* bodyB = elem_pair.first.second;
+        if (!bodyA || !bodyB)
+            continue;
+
+        PhysicsContactPair pair;
+        pair.bodyA_ = bodyA;
+        pair.bodyB_ = bodyB;
+        pair.nodeA_ = bodyA->GetNode();
+        pair.nodeB_ = bodyB->GetNode();
+        pair.firstContact_ = contactPoints_.size();
+        pair.collisionLayers_ = bodyA->GetCollisionLayer() | bodyB->GetCollisionLayer();
+        pair.trigger_ = bodyA->IsTrigger() || bodyB->IsTrigger();
+        pair.newCollision_ = !hashContains(previousCollisions_, elem_pair.first);
+
+        // The flipped manifold has the bodies the other way around, so flip its normals to match
+        for (int flipped = 0; flipped < 2; ++flipped)
+        {
+            btPersistentManifold* contactManifold = flipped ? elem_pair.second.flippedManifold_ : elem_pair.second.manifold_;
+            if (!contactManifold)
+                continue;
+            for (int j = 0; j < contactManifold->getNumContacts(); ++j)
+            {
+                const btManifoldPoint& point = contactManifold->getContactPoint(j);
+                PhysicsContact contact;
+                contact.position_ = ToVector3(point.m_positionWorldOnB);
+                contact.normal_ = flipped ? -ToVector3(point.m_normalWorldOnB) : ToVector3(point.m_normalWorldOnB);
+                contact.distance_ = point.m_distance1;
+                contact.impulse_ = point.m_appliedImpulse;
+                contactPoints_.push_back(contact);
+            }
+        }
+        pair.numContacts_ = contactPoints_.size() - pair.firstContact_;
+        contactPairs_.push_back(pair);
+    }
+
+    // The pair map is ordered by pointer hashes, which differ between runs
+    if (deterministic_)
+        std::sort(contactPairs_.begin(), contactPairs_.end(), CompareContactPairs);
+
+    if (contactListeners_.empty())
+        return;
+
+    URHO3D_PROFILE(SendContactStream);
+
+    deliveringContacts_ = true;
+    // Listeners added during delivery get the stream from the next step on
+    const unsigned numListeners = contactListeners_.size();
+    for (unsigned i = 0; i < numListeners; ++i)
+    {
+        const PhysicsContactListener& listener = contactListeners_[i];
+        for (const PhysicsContactPair& pair : contactPairs_)
+        {
+            if (listener.removed_)
+                break;
+            if (pair.collisionLayers_ & listener.collisionMask_)
+                listener.callback_(pair, contactPoints_.data() + pair.firstContact_);
+        }
+    }
+    deliveringContacts_ = false;
 
-    previousCollisions_ = currentCollisions_;
+    // Remove the listeners removed during delivery
+    contactListeners_.erase(std::remove_if(contactListeners_.begin(), contactListeners_.end(),
+        [](const PhysicsContactListener& listener) { return listener.removed_; }), contactListeners_.end());
 }
 
 void RegisterPhysicsLibrary(Context* context)
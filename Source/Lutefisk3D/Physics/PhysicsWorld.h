@@ -25,12 +25,16 @@
 #include "Lutefisk3D/Physics/PhysicsEvents.h"
 #include "Lutefisk3D/Scene/Component.h"
 #include "Lutefisk3D/Math/BoundingBox.h"
+#include "Lutefisk3D/Math/Quaternion.h"
+#include "Lutefisk3D/Math/Ray.h"
 #include "Lutefisk3D/Math/Sphere.h"
 #include "Lutefisk3D/Math/Vector3.h"
 #include "Lutefisk3D/IO/VectorBuffer.h"
 #include "Lutefisk3D/Container/HashMap.h"
 
 #include <QtCore/QSet>
+#include <deque>
+#include <functional>
 
 class btCollisionConfiguration;
 class btCollisionShape;
@@ -49,7 +53,6 @@ class Deserializer;
 class Constraint;
 class Model;
 class Node;
-class Ray;
 class RigidBody;
 class Scene;
 class Serializer;
@@ -78,6 +81,86 @@ struct LUTEFISK3D_EXPORT PhysicsRaycastResult
     RigidBody* body_ = nullptr;
 };
 
+/// Ray of a batched physics raycast or sphere cast.
+struct LUTEFISK3D_EXPORT PhysicsRaycastQuery
+{
+    /// Worldspace ray.
+    Ray ray_;
+    /// Maximum distance along the ray.
+    float maxDistance_ = 0.0f;
+    /// Collision mask.
+    unsigned collisionMask_ = M_MAX_UNSIGNED;
+};
+
+/// Sweep of a batched physics convex cast.
+struct LUTEFISK3D_EXPORT PhysicsConvexCastQuery
+{
+    /// Convex Bullet collision shape to sweep. Shapes may be shared by several queries.
+    btCollisionShape* shape_ = nullptr;
+    /// Worldspace start position.
+    Vector3 startPos_;
+    /// Worldspace start rotation.
+    Quaternion startRot_;
+    /// Worldspace end position.
+    Vector3 endPos_;
+    /// Worldspace end rotation.
+    Quaternion endRot_;
+    /// Collision mask.
+    unsigned collisionMask_ = M_MAX_UNSIGNED;
+};
+
+/// Contact point of the physics contact stream.
+struct LUTEFISK3D_EXPORT PhysicsContact
+{
+    /// Worldspace position on the second body.
+    Vector3 position_;
+    /// Worldspace normal on the second body, pointing towards the first body.
+    Vector3 normal_;
+    /// Distance between the bodies, negative when penetrating.
+    float distance_;
+    /// Impulse applied by the solver.
+    float impulse_;
+};
+
+/// Colliding rigid body pair of the physics contact stream. The contact points are seen from the first body.
+struct LUTEFISK3D_EXPORT PhysicsContactPair
+{
+    /// First rigid body.
+    RigidBody* bodyA_;
+    /// Second rigid body.
+    RigidBody* bodyB_;
+    /// Node of the first rigid body.
+    Node* nodeA_;
+    /// Node of the second rigid body.
+    Node* nodeB_;
+    /// Index of the first contact point in the contact stream.
+    unsigned firstContact_;
+    /// Number of contact points.
+    unsigned numContacts_;
+    /// Combined collision layers of both bodies.
+    unsigned collisionLayers_;
+    /// Either body is a trigger.
+    bool trigger_;
+    /// The bodies were not colliding on the previous step.
+    bool newCollision_;
+};
+
+/// Contact stream listener callback, called for every matching pair with its contact points.
+using PhysicsContactCallback = std::function<void(const PhysicsContactPair&, const PhysicsContact*)>;
+
+/// Contact stream listener.
+struct PhysicsContactListener
+{
+    /// Listener ID.
+    unsigned id_;
+    /// Collision layers of which either body must have one.
+    unsigned collisionMask_;
+    /// Callback.
+    PhysicsContactCallback callback_;
+    /// Removed during delivery, waiting to be erased.
+    bool removed_;
+};
+
 /// Delayed world transform assignment for parented rigidbodies.
 struct DelayedWorldTransform
 {
@@ -105,6 +188,8 @@ struct PhysicsWorldConfig
 {
     /// Override for the collision configuration (default btDefaultCollisionConfiguration).
     btCollisionConfiguration* collisionConfig_=nullptr;
+    /// Create Bullet's multithreaded world, which runs on the work queue threads. Needs a build with LUTEFISK3D_PHYSICS_THREADED and worker threads, otherwise the regular world is created. Deterministic mode switches back to the regular world.
+    bool multiThreaded_=false;
 };
 
 static const float DEFAULT_MAX_NETWORK_ANGULAR_VELOCITY = 100.0f;
@@ -148,6 +233,8 @@ public:
     void SetSplitImpulse(bool enable);
     /// Set maximum angular velocity for network replication.
     void SetMaxNetworkAngularVelocity(float velocity);
+    /// Set deterministic mode for replays and lockstep. Steps only whole fixed substeps without interpolation, processes the collision pairs in a stable order and hashes the simulation state after each step. Results are reproducible given the same scene and inputs. A multithreaded world is replaced by the single-threaded one, as its results depend on the number of threads. Disabled by default.
+    void SetDeterministic(bool enable);
     /// Perform a physics world raycast and return all hits.
     void Raycast(std::vector<PhysicsRaycastResult>& result, const Ray& ray, float maxDistance, unsigned collisionMask = M_MAX_UNSIGNED);
     /// Perform a physics world raycast and return the closest hit.
@@ -160,6 +247,12 @@ public:
     void ConvexCast(PhysicsRaycastResult& result, CollisionShape* shape, const Vector3& startPos, const Quaternion& startRot, const Vector3& endPos, const Quaternion& endRot, unsigned collisionMask = M_MAX_UNSIGNED);
     /// Perform a physics world swept convex test using a user-supplied Bullet collision shape and return the first hit.
     void ConvexCast(PhysicsRaycastResult& result, btCollisionShape* shape, const Vector3& startPos, const Quaternion& startRot, const Vector3& endPos, const Quaternion& endRot, unsigned collisionMask = M_MAX_UNSIGNED);
+    /// Perform a batch of physics world raycasts on the work queue threads and write the closest hit of each to the results array, which must hold count elements. Must not be called during the simulation step.
+    void RaycastSingleBatch(PhysicsRaycastResult* results, const PhysicsRaycastQuery* queries, unsigned count);
+    /// Perform a batch of physics world swept sphere tests on the work queue threads and write the closest hit of each to the results array. Must not be called during the simulation step.
+    void SphereCastBatch(PhysicsRaycastResult* results, const PhysicsRaycastQuery* queries, unsigned count, float radius);
+    /// Perform a batch of physics world swept convex tests on the work queue threads and write the first hit of each to the results array. Must not be called during the simulation step.
+    void ConvexCastBatch(PhysicsRaycastResult* results, const PhysicsConvexCastQuery* queries, unsigned count);
     /// Invalidate cached collision geometry for a model.
     void RemoveCachedGeometry(Model* model);
     /// Return rigid bodies by a sphere query.
@@ -171,6 +264,15 @@ public:
     /// Return rigid bodies that have been in collision with the specified body on the last simulation step. Only returns collisions that were sent as events (depends on collision event mode) and excludes e.g. static-static collisions.
     void GetCollidingBodies(std::unordered_set<RigidBody*>& result, const RigidBody* body);
 
+    /// Add a contact stream listener, called after each simulation step for the colliding pairs where either body has a collision layer in the mask. Rigid bodies and nodes must not be removed from within the callback. Return the listener ID.
+    unsigned AddContactListener(unsigned collisionMask, const PhysicsContactCallback& callback);
+    /// Remove a contact stream listener. Return true if it was found.
+    bool RemoveContactListener(unsigned id);
+    /// Return the colliding pairs of the last simulation step. The body and node pointers are not guaranteed to be valid after the collision events.
+    const std::vector<PhysicsContactPair>& GetContactPairs() const { return contactPairs_; }
+    /// Return the contact points of the last simulation step, indexed by the contact pairs.
+    const std::vector<PhysicsContact>& GetContacts() const { return contactPoints_; }
+
     /// Return gravity.
     Vector3 GetGravity() const;
     /// Return maximum number of physics substeps per frame.
@@ -185,6 +287,12 @@ public:
     bool GetInternalEdge() const { return internalEdge_; }
     /// Return whether split impulse collision mode is enabled.
     bool GetSplitImpulse() const;
+    /// Return whether the multithreaded Bullet world is used.
+    bool IsMultiThreaded() const;
+    /// Return whether deterministic mode is enabled.
+    bool IsDeterministic() const { return deterministic_; }
+    /// Return the hash of the rigid body transforms and velocities after the last simulation step. Only calculated in deterministic mode.
+    unsigned GetStateHash() const { return stateHash_; }
     /// Return simulation steps per second.
     int GetFps() const { return fps_; }
     /// Return maximum angular velocity for network replication.
@@ -241,6 +349,10 @@ private:
     void PostStep(float timeStep);
     /// Send accumulated collision events.
     void SendCollisionEvents();
+    /// Fill the contact stream from the current collisions and deliver it to the listeners.
+    void SendContactStream();
+    /// Calculate the state hash from the rigid bodies in the Bullet world's order.
+    void UpdateStateHash();
 
     /// Extra weak pointer to scene to allow for cleanup in case the world is destroyed before other components.
     WeakPtr<Scene> scene_;
@@ -280,6 +392,20 @@ private:
     bool applyingTransforms_;
     /// Simulating flag.
     bool simulating_;
+    /// Deterministic mode flag.
+    bool deterministic_;
+    /// Simulation state hash after the last step in deterministic mode.
+    unsigned stateHash_;
+    /// Colliding pairs of the contact stream.
+    std::vector<PhysicsContactPair> contactPairs_;
+    /// Contact points of the contact stream.
+    std::vector<PhysicsContact> contactPoints_;
+    /// Contact stream listeners. A deque, so that listeners added during delivery do not move the one being called.
+    std::deque<PhysicsContactListener> contactListeners_;
+    /// Next contact stream listener ID.
+    unsigned nextContactListenerId_;
+    /// Delivering the contact stream flag.
+    bool deliveringContacts_;
     struct PhysicsWorldPrivate *private_data = nullptr;
 };
 
@@ -0,0 +1,104 @@
+#include <QTest>
+#include "PhysicsTestScene.h"
+
+class PhysicsContactTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreatePhysicsTestContext(ctx, 0);
+    }
+    void verifyContactStream() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateBoxes(ctx, 1);
+        PhysicsWorld* world = scene->GetComponent<PhysicsWorld>();
+
+        unsigned numCalls = 0;
+        unsigned numNewCollisions = 0;
+        world->AddContactListener(M_MAX_UNSIGNED, [&](const PhysicsContactPair& pair, const PhysicsContact* contacts) {
+            ++numCalls;
+            if (pair.newCollision_)
+                ++numNewCollisions;
+            QVERIFY(pair.numContacts_ > 0);
+            QCOMPARE(pair.collisionLayers_, FLOOR_LAYER | BOX_LAYER);
+            QVERIFY(!pair.trigger_);
+            // The normals point towards the first body
+            const Vector3 towardsA = pair.nodeA_->GetWorldPosition() - pair.nodeB_->GetWorldPosition();
+            for (unsigned i = 0; i < pair.numContacts_; ++i)
+                QVERIFY(contacts[i].normal_.DotProduct(towardsA) > 0.0f);
+        });
+
+        for (int i = 0; i < 60 && !numCalls; ++i)
+            Step(world);
+        QCOMPARE(numCalls, 1U);
+        QCOMPARE(numNewCollisions, 1U);
+        QCOMPARE(world->GetContactPairs().size(), size_t(1));
+        const PhysicsContactPair& pair = world->GetContactPairs().front();
+        QCOMPARE(pair.firstContact_, 0U);
+        QCOMPARE((size_t)pair.numContacts_, world->GetContacts().size());
+
+        // A resting contact is only new on its first step
+        Step(world);
+        QCOMPARE(numCalls, 2U);
+        QCOMPARE(numNewCollisions, 1U);
+        QVERIFY(!world->GetContactPairs().front().newCollision_);
+    }
+    void verifyMaskFiltering() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateBoxes(ctx, 2);
+        PhysicsWorld* world = scene->GetComponent<PhysicsWorld>();
+
+        unsigned numBoxCalls = 0;
+        unsigned numOtherCalls = 0;
+        world->AddContactListener(BOX_LAYER, [&](const PhysicsContactPair&, const PhysicsContact*) { ++numBoxCalls; });
+        world->AddContactListener(4, [&](const PhysicsContactPair&, const PhysicsContact*) { ++numOtherCalls; });
+        for (int i = 0; i < 60 && world->GetContactPairs().size() < 2; ++i)
+            Step(world);
+        QCOMPARE(world->GetContactPairs().size(), size_t(2));
+        QVERIFY(numBoxCalls >= 2);
+        QCOMPARE(numOtherCalls, 0U);
+    }
+    void verifyRemovalDuringDelivery() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateBoxes(ctx, 2);
+        PhysicsWorld* world = scene->GetComponent<PhysicsWorld>();
+
+        unsigned numFirstCalls = 0;
+        unsigned numSecondCalls = 0;
+        unsigned numAddedCalls = 0;
+        unsigned secondId = 0;
+        unsigned firstId = 0;
+        firstId = world->AddContactListener(M_MAX_UNSIGNED, [&](const PhysicsContactPair&, const PhysicsContact*) {
+            ++numFirstCalls;
+            // Removing itself and a listener not yet called stops both, and a listener added now waits for the next step
+            QVERIFY(world->RemoveContactListener(firstId));
+            QVERIFY(world->RemoveContactListener(secondId));
+            QVERIFY(!world->RemoveContactListener(secondId));
+            world->AddContactListener(M_MAX_UNSIGNED, [&](const PhysicsContactPair&, const PhysicsContact*) { ++numAddedCalls; });
+        });
+        secondId = world->AddContactListener(M_MAX_UNSIGNED, [&](const PhysicsContactPair&, const PhysicsContact*) {
+            ++numSecondCalls;
+        });
+
+        for (int i = 0; i < 60 && world->GetContactPairs().size() < 2; ++i)
+            Step(world);
+        QCOMPARE(world->GetContactPairs().size(), size_t(2));
+        QCOMPARE(numFirstCalls, 1U);
+        QCOMPARE(numSecondCalls, 0U);
+        QCOMPARE(numAddedCalls, 0U);
+        QVERIFY(!world->RemoveContactListener(firstId));
+
+        Step(world);
+        QCOMPARE(numFirstCalls, 1U);
+        QCOMPARE(numAddedCalls, 2U);
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(PhysicsContactTests)
+#include "PhysicsContactTests.moc"
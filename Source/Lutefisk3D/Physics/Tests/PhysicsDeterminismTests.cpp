@@ -0,0 +1,115 @@
+#include <QTest>
+#include "PhysicsTestScene.h"
+
+namespace
+{
+const int NUM_STEPS = 300;
+
+/// Kick the dynamic bodies of a new collision. The impulse depends on the current velocity, so the result depends on the
+/// order the collisions are handled in.
+void ApplyCollisionImpulse(Urho3D::PhysicsWorld*, Urho3D::Node*, Urho3D::Node*, Urho3D::RigidBody* bodyA, Urho3D::RigidBody* bodyB,
+    bool, const std::vector<uint8_t>&)
+{
+    for (Urho3D::RigidBody* body : { bodyA, bodyB })
+    {
+        if (body->GetMass() > 0.0f)
+            body->ApplyImpulse(Urho3D::Vector3(0.0f, 0.5f, 0.0f) + 0.1f * body->GetLinearVelocity());
+    }
+}
+
+/// Drop a pile of boxes and spheres on a static floor and return the state hash after every step. Deterministic mode is
+/// enabled before or after the bodies are added.
+std::vector<unsigned> SimulatePile(Urho3D::Context* context, bool collisionImpulses = false, bool deterministicLast = false)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    PhysicsWorld* world = scene->CreateComponent<PhysicsWorld>();
+    if (!deterministicLast)
+        world->SetDeterministic(true);
+    if (collisionImpulses)
+        world->collisionStart.Connect(&ApplyCollisionImpulse);
+
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->CreateComponent<RigidBody>();
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(50.0f, 1.0f, 50.0f));
+
+    for (int i = 0; i < 40; ++i)
+    {
+        Node* node = scene->CreateChild("Body");
+        node->SetPosition(Vector3((i % 4) * 0.6f, 2.0f + i * 0.9f, (i % 3) * 0.4f));
+        node->SetRotation(Quaternion(i * 17.0f, i * 5.0f, 0.0f));
+        RigidBody* body = node->CreateComponent<RigidBody>();
+        body->SetMass(1.0f + (i % 5));
+        body->SetAngularVelocity(Vector3(0.1f * i, 0.0f, -0.05f * i));
+        CollisionShape* shape = node->CreateComponent<CollisionShape>();
+        if (i % 2)
+            shape->SetBox(Vector3::ONE);
+        else
+            shape->SetSphere(1.0f);
+    }
+
+    if (deterministicLast)
+        world->SetDeterministic(true);
+    std::vector<unsigned> hashes;
+    for (int i = 0; i < NUM_STEPS; ++i)
+    {
+        Step(world);
+        hashes.push_back(world->GetStateHash());
+    }
+    return hashes;
+}
+}
+
+class PhysicsDeterminismTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreatePhysicsTestContext(ctx, 0);
+    }
+    void verifyRepeatedRunsMatch() {
+        const std::vector<unsigned> first = SimulatePile(ctx);
+        const std::vector<unsigned> second = SimulatePile(ctx);
+        QCOMPARE(first.size(), size_t(NUM_STEPS));
+        for (int i = 0; i < NUM_STEPS; ++i)
+            QCOMPARE(second[i], first[i]);
+        // The bodies move, so the state must not hash the same on every step
+        QVERIFY(first.front() != first.back());
+    }
+    void verifyCollisionHandlersMatch() {
+        const std::vector<unsigned> first = SimulatePile(ctx, true);
+        const std::vector<unsigned> second = SimulatePile(ctx, true);
+        for (int i = 0; i < NUM_STEPS; ++i)
+            QCOMPARE(second[i], first[i]);
+        // The handler changes the simulation
+        QVERIFY(first != SimulatePile(ctx));
+    }
+    void verifyThreadCountsMatch() {
+        using namespace Urho3D;
+        // Deterministic mode replaces the multithreaded world, so the results do not depend on the work queue threads
+        PhysicsWorld::config.multiThreaded_ = true;
+        Context threadedContext;
+        CreatePhysicsTestContext(&threadedContext, 3);
+        const std::vector<unsigned> serial = SimulatePile(ctx, true);
+        const std::vector<unsigned> threaded = SimulatePile(&threadedContext, true);
+        // The bodies are moved to the single-threaded world in the order they were added
+        const std::vector<unsigned> switched = SimulatePile(&threadedContext, true, true);
+        PhysicsWorld::config.multiThreaded_ = false;
+        QCOMPARE(threaded.size(), serial.size());
+        QCOMPARE(switched.size(), serial.size());
+        for (int i = 0; i < NUM_STEPS; ++i)
+        {
+            QCOMPARE(threaded[i], serial[i]);
+            QCOMPARE(switched[i], serial[i]);
+        }
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(PhysicsDeterminismTests)
+#include "PhysicsDeterminismTests.moc"
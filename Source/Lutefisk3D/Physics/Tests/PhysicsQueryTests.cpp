@@ -0,0 +1,125 @@
+#include <QTest>
+#include "PhysicsTestScene.h"
+
+#include <vector>
+
+namespace
+{
+const unsigned GRID_SIZE = 16;
+
+/// Create tilted rays over the floor, some of them pointing away from it.
+std::vector<Urho3D::PhysicsRaycastQuery> CreateRays()
+{
+    using namespace Urho3D;
+    std::vector<PhysicsRaycastQuery> queries;
+    for (unsigned z = 0; z < GRID_SIZE; ++z)
+    {
+        for (unsigned x = 0; x < GRID_SIZE; ++x)
+        {
+            PhysicsRaycastQuery query;
+            const Vector3 origin(x * 2.0f - 16.0f, 8.0f, z * 2.0f - 16.0f);
+            const Vector3 direction((x % 5) * 0.2f - 0.4f, (x + z) % 7 ? -1.0f : 0.3f, (z % 3) * 0.3f - 0.3f);
+            query.ray_.Define(origin, direction);
+            query.maxDistance_ = 20.0f;
+            query.collisionMask_ = (x + z) % 4 ? M_MAX_UNSIGNED : 2;
+            queries.push_back(query);
+        }
+    }
+    return queries;
+}
+
+void CompareResults(const Urho3D::PhysicsRaycastResult& batched, const Urho3D::PhysicsRaycastResult& single)
+{
+    QCOMPARE(batched.body_, single.body_);
+    if (!single.body_)
+        return;
+    QVERIFY(Urho3D::Abs(batched.distance_ - single.distance_) < 1e-3f);
+    QVERIFY((batched.position_ - single.position_).Length() < 1e-3f);
+}
+}
+
+class PhysicsQueryTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreatePhysicsTestContext(ctx, 3);
+    }
+    void verifyBatchesMatchSingleQueries() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateObstacles(ctx);
+        PhysicsWorld* world = scene->GetComponent<PhysicsWorld>();
+        const std::vector<PhysicsRaycastQuery> rays = CreateRays();
+        std::vector<PhysicsRaycastResult> results(rays.size());
+        unsigned numHits = 0;
+
+        world->RaycastSingleBatch(results.data(), rays.data(), rays.size());
+        for (unsigned i = 0; i < rays.size(); ++i)
+        {
+            PhysicsRaycastResult single;
+            world->RaycastSingle(single, rays[i].ray_, rays[i].maxDistance_, rays[i].collisionMask_);
+            CompareResults(results[i], single);
+            if (single.body_)
+                ++numHits;
+        }
+        QVERIFY(numHits > rays.size() / 2 && numHits < rays.size());
+
+        world->SphereCastBatch(results.data(), rays.data(), rays.size(), 0.4f);
+        for (unsigned i = 0; i < rays.size(); ++i)
+        {
+            PhysicsRaycastResult single;
+            world->SphereCast(single, rays[i].ray_, 0.4f, rays[i].maxDistance_, rays[i].collisionMask_);
+            CompareResults(results[i], single);
+        }
+
+        // The swept shape is not part of the world, as it has no rigid body
+        Node* shapeNode = scene->CreateChild("Shape");
+        CollisionShape* shape = shapeNode->CreateComponent<CollisionShape>();
+        shape->SetBox(Vector3(0.5f, 0.8f, 0.3f));
+        QVERIFY(shape->GetCollisionShape());
+        std::vector<PhysicsConvexCastQuery> sweeps;
+        for (const PhysicsRaycastQuery& ray : rays)
+        {
+            PhysicsConvexCastQuery sweep;
+            sweep.shape_ = shape->GetCollisionShape();
+            sweep.startPos_ = ray.ray_.origin_;
+            sweep.startRot_ = Quaternion(sweeps.size() * 13.0f, Vector3::UP);
+            sweep.endPos_ = ray.ray_.origin_ + ray.maxDistance_ * ray.ray_.direction_;
+            sweep.endRot_ = Quaternion(sweeps.size() * 13.0f + 30.0f, Vector3::UP);
+            sweep.collisionMask_ = ray.collisionMask_;
+            sweeps.push_back(sweep);
+        }
+        world->ConvexCastBatch(results.data(), sweeps.data(), sweeps.size());
+        for (unsigned i = 0; i < sweeps.size(); ++i)
+        {
+            PhysicsRaycastResult single;
+            world->ConvexCast(single, sweeps[i].shape_, sweeps[i].startPos_, sweeps[i].startRot_, sweeps[i].endPos_,
+                sweeps[i].endRot_, sweeps[i].collisionMask_);
+            CompareResults(results[i], single);
+        }
+    }
+    void benchmarkRaycastBatch() {
+        using namespace Urho3D;
+        SharedPtr<Scene> scene = CreateObstacles(ctx);
+        PhysicsWorld* world = scene->GetComponent<PhysicsWorld>();
+        std::vector<PhysicsRaycastQuery> rays;
+        for (unsigned i = 0; i < 40; ++i)
+        {
+            const std::vector<PhysicsRaycastQuery> grid = CreateRays();
+            rays.insert(rays.end(), grid.begin(), grid.end());
+        }
+        std::vector<PhysicsRaycastResult> results(rays.size());
+        QBENCHMARK {
+            world->RaycastSingleBatch(results.data(), rays.data(), rays.size());
+        }
+    }
+    void cleanupTestCase()
+    {
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(PhysicsQueryTests)
+#include "PhysicsQueryTests.moc"
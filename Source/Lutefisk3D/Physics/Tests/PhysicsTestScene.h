@@ -0,0 +1,104 @@
+#pragma once
+
+#include "../CollisionShape.h"
+#include "../PhysicsWorld.h"
+#include "../RigidBody.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/Scene/Scene.h"
+
+// Scenes shared by the physics tests.
+
+static const unsigned FLOOR_LAYER = 1;
+static const unsigned BOX_LAYER = 2;
+
+/// Register the libraries the test scenes use, and give the context a work queue with the given number of threads.
+inline void CreatePhysicsTestContext(Urho3D::Context* context, unsigned numThreads)
+{
+    Urho3D::RegisterSceneLibrary(context);
+    Urho3D::RegisterPhysicsLibrary(context);
+    context->m_WorkQueueSystem.reset(new Urho3D::WorkQueue(context));
+    if (numThreads)
+        context->m_WorkQueueSystem->CreateThreads(numThreads);
+}
+
+/// Create a scene with a stack of boxes standing on a static floor.
+inline Urho3D::SharedPtr<Urho3D::Scene> CreateStack(Urho3D::Context* context, int numBodies)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->CreateComponent<RigidBody>();
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(200.0f, 1.0f, 200.0f));
+
+    for (int i = 0; i < numBodies; ++i)
+    {
+        Node* node = scene->CreateChild("Box");
+        node->SetPosition(Vector3((i % 10) * 1.5f - 7.5f, 1.0f + (i / 100) * 1.1f, ((i / 10) % 10) * 1.5f - 7.5f));
+        node->CreateComponent<RigidBody>()->SetMass(1.0f);
+        node->CreateComponent<CollisionShape>()->SetBox(Vector3::ONE);
+    }
+    return scene;
+}
+
+/// Create a static floor with boxes resting just above it.
+inline Urho3D::SharedPtr<Urho3D::Scene> CreateBoxes(Urho3D::Context* context, int numBoxes)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->SetPosition(Vector3(0.0f, -0.5f, 0.0f));
+    floorNode->CreateComponent<RigidBody>()->SetCollisionLayer(FLOOR_LAYER);
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(20.0f, 1.0f, 20.0f));
+
+    for (int i = 0; i < numBoxes; ++i)
+    {
+        Node* node = scene->CreateChild("Box");
+        node->SetPosition(Vector3(i * 3.0f, 0.55f, 0.0f));
+        RigidBody* body = node->CreateComponent<RigidBody>();
+        body->SetMass(1.0f);
+        body->SetCollisionLayer(BOX_LAYER);
+        node->CreateComponent<CollisionShape>()->SetBox(Vector3::ONE);
+    }
+    return scene;
+}
+
+/// Create a floor with boxes and spheres of different sizes standing on it.
+inline Urho3D::SharedPtr<Urho3D::Scene> CreateObstacles(Urho3D::Context* context)
+{
+    using namespace Urho3D;
+    SharedPtr<Scene> scene(new Scene(context));
+    scene->CreateComponent<PhysicsWorld>();
+
+    Node* floorNode = scene->CreateChild("Floor");
+    floorNode->SetPosition(Vector3(0.0f, -0.5f, 0.0f));
+    floorNode->CreateComponent<RigidBody>();
+    floorNode->CreateComponent<CollisionShape>()->SetBox(Vector3(40.0f, 1.0f, 40.0f));
+
+    for (int i = 0; i < 30; ++i)
+    {
+        Node* node = scene->CreateChild("Obstacle");
+        node->SetPosition(Vector3((i * 7) % 30 - 15.0f, 1.0f, (i * 11) % 30 - 15.0f));
+        node->SetRotation(Quaternion(i * 23.0f, Vector3::UP));
+        node->CreateComponent<RigidBody>()->SetCollisionLayer(i % 3 ? 1 : 2);
+        CollisionShape* shape = node->CreateComponent<CollisionShape>();
+        if (i % 2)
+            shape->SetBox(Vector3(1.0f + (i % 4), 2.0f, 1.5f));
+        else
+            shape->SetSphere(1.0f + (i % 3) * 0.5f);
+    }
+
+    scene->GetComponent<PhysicsWorld>()->UpdateCollisions();
+    return scene;
+}
+
+/// Run fixed physics steps.
+inline void Step(Urho3D::PhysicsWorld* world, int numSteps = 1)
+{
+    for (int i = 0; i < numSteps; ++i)
+        world->Update(1.0f / world->GetFps());
+}
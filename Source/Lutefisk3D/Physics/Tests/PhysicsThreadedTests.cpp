@@ -0,0 +1,88 @@
+#include <QTest>
+#include "PhysicsTestScene.h"
+
+namespace
+{
+bool IsMultiThreaded(Urho3D::Scene* scene)
+{
+    return scene->GetComponent<Urho3D::PhysicsWorld>()->IsMultiThreaded();
+}
+}
+
+class PhysicsThreadedTests : public QObject {
+    Q_OBJECT
+    Urho3D::Context *ctx;
+private slots:
+    void initTestCase()
+    {
+        ctx = new Urho3D::Context;
+        CreatePhysicsTestContext(ctx, 3);
+        Urho3D::PhysicsWorld::config.multiThreaded_ = true;
+    }
+    void verifySchedulerLifetime() {
+        using namespace Urho3D;
+        SharedPtr<Scene> first = CreateStack(ctx, 100);
+        SharedPtr<Scene> second = CreateStack(ctx, 100);
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+        QVERIFY(IsMultiThreaded(first));
+        QVERIFY(IsMultiThreaded(second));
+#else
+        QVERIFY(!IsMultiThreaded(first));
+        QVERIFY(!IsMultiThreaded(second));
+#endif
+
+        // The remaining world keeps the shared scheduler
+        first.Reset();
+        Step(second->GetComponent<PhysicsWorld>(), 30);
+        second.Reset();
+
+        // With no worlds left the scheduler follows a new work queue
+        ctx->m_WorkQueueSystem.reset(new WorkQueue(ctx));
+        ctx->m_WorkQueueSystem->CreateThreads(3);
+        SharedPtr<Scene> third = CreateStack(ctx, 100);
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+        QVERIFY(IsMultiThreaded(third));
+#else
+        QVERIFY(!IsMultiThreaded(third));
+#endif
+        Step(third->GetComponent<PhysicsWorld>(), 30);
+    }
+    void verifySecondWorkQueueFallback() {
+        using namespace Urho3D;
+        Context otherContext;
+        CreatePhysicsTestContext(&otherContext, 3);
+        SharedPtr<Scene> scene = CreateStack(ctx, 100);
+        // The scheduler is in use on the first work queue, so the world on the second one is single-threaded
+        SharedPtr<Scene> otherScene = CreateStack(&otherContext, 100);
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+        QVERIFY(IsMultiThreaded(scene));
+#endif
+        QVERIFY(!IsMultiThreaded(otherScene));
+        Step(scene->GetComponent<PhysicsWorld>(), 30);
+        Step(otherScene->GetComponent<PhysicsWorld>(), 30);
+
+        // Once the first work queue's worlds are gone, the second one gets the scheduler
+        scene.Reset();
+        SharedPtr<Scene> nextScene = CreateStack(&otherContext, 100);
+#ifdef LUTEFISK3D_PHYSICS_THREADED
+        QVERIFY(IsMultiThreaded(nextScene));
+#endif
+        Step(nextScene->GetComponent<PhysicsWorld>(), 30);
+        nextScene.Reset();
+        otherScene.Reset();
+    }
+    void benchmarkStack() {
+        Urho3D::SharedPtr<Urho3D::Scene> scene = CreateStack(ctx, 1000);
+        QBENCHMARK {
+            Step(scene->GetComponent<Urho3D::PhysicsWorld>(), 10);
+        }
+    }
+    void cleanupTestCase()
+    {
+        Urho3D::PhysicsWorld::config.multiThreaded_ = false;
+        delete ctx;
+    }
+};
+
+QTEST_MAIN(PhysicsThreadedTests)
+#include "PhysicsThreadedTests.moc"
@@ -25,98 +25,281 @@
 #include "ResourceCache.h"
 #include "ResourceEvents.h"
 #include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/ProcessUtils.h"
 #include "Lutefisk3D/Core/Profiler.h"
 #include "Lutefisk3D/Core/Timer.h"
 #include "Lutefisk3D/IO/Log.h"
 #include "Lutefisk3D/IO/File.h"
+#include "Lutefisk3D/Math/MathDefs.h"
 #include "Lutefisk3D/Resource/Resource.h"
 namespace Urho3D
 {
 
+/// Resource read or decode thread managed by the background loader.
+class BackgroundLoaderThread : public Thread, public RefCounted
+{
+public:
+    /// Construct.
+    BackgroundLoaderThread(BackgroundLoader* owner, bool decode) :
+        owner_(owner),
+        decode_(decode)
+    {
+    }
+
+    /// Read or decode resources until stopped.
+    void ThreadFunction() override
+    {
+        if (decode_)
+            URHO3D_PROFILE_THREAD(ResourceDecodeThread);
+        else
+            URHO3D_PROFILE_THREAD(ResourceReadThread);
+        owner_->ProcessItems(decode_);
+    }
+
+private:
+    /// Background loader.
+    BackgroundLoader* owner_;
+    /// Decode stage flag, false for the read stage.
+    bool decode_;
+};
+
 BackgroundLoader::BackgroundLoader(ResourceCache* owner) :
-    owner_(owner)
+    owner_(owner),
+    sequence_(0),
+    numThreads_(Clamp(GetNumPhysicalCPUs(), 2U, 5U) - 1),
+    numReadThreads_(2),
+    shutDown_(false)
 {
 }
 
 BackgroundLoader::~BackgroundLoader()
 {
+    // Wake up the loader threads; each one passes the wakeup on to the next before exiting
+    shutDown_ = true;
+    readCondition_.Set();
+    decodeCondition_.Set();
+    for (const SharedPtr<BackgroundLoaderThread>& thread : threads_)
+        thread->Stop();
+    threads_.clear();
+
     MutexLock lock(backgroundLoadMutex_);
 
     backgroundLoadQueue_.clear();
 }
-void BackgroundLoader::ThreadFunction()
+
+void BackgroundLoader::SetNumThreads(unsigned num)
+{
+    MutexLock lock(backgroundLoadMutex_);
+
+    if (threads_.size())
+    {
+        URHO3D_LOGWARNING("Can not change number of background loader threads after they have been started");
+        return;
+    }
+
+    numThreads_ = Max(num, 1U);
+}
+
+void BackgroundLoader::SetNumReadThreads(unsigned num)
+{
+    MutexLock lock(backgroundLoadMutex_);
+
+    if (threads_.size())
+    {
+        URHO3D_LOGWARNING("Can not change number of background loader threads after they have been started");
+        return;
+    }
+
+    numReadThreads_ = Max(num, 1U);
+}
+
+void BackgroundLoader::ProcessItems(bool decode)
 {
-    while (shouldRun_)
+    Condition& condition = decode ? decodeCondition_ : readCondition_;
+    std::priority_queue<BackgroundLoadOrder>& order = decode ? decodeOrder_ : readOrder_;
+
+    for (;;)
     {
         backgroundLoadMutex_.Acquire();
+        BackgroundLoadItem* item = shutDown_ ? nullptr : (decode ? TakeDecodeItem() : TakeReadItem());
+        bool moreQueued = !order.empty();
+        backgroundLoadMutex_.Release();
 
-        // Search for a queued resource that has not been loaded yet
-        auto i = backgroundLoadQueue_.begin();
-        while (i != backgroundLoadQueue_.end())
+        if (shutDown_)
         {
-            if (MAP_VALUE(i).resource_->GetAsyncLoadState() == ASYNC_QUEUED)
-                break;
-            else
-                ++i;
+            condition.Set();
+            return;
         }
 
-        if (i == backgroundLoadQueue_.end())
+        if (!item)
         {
-            // No resources to load found
-            backgroundLoadMutex_.Release();
-            Time::Sleep(5);
+            // Sleep until there is work for this stage
+            condition.Wait();
+            continue;
         }
+
+        // The wakeup only woke this thread; pass it on if there is more work for the others
+        if (moreQueued)
+            condition.Set();
+
+        if (decode)
+            FinishLoadingPhase(*item, DecodeItem(*item));
+        else if (!ReadItem(*item))
+            FinishLoadingPhase(*item, false);
         else
         {
-            BackgroundLoadItem& item = MAP_VALUE(i);
-            Resource* resource = item.resource_;
-            // We can be sure that the item is not removed from the queue as long as it is in the
-            // "queued" or "loading" state
+            // Hand the resource over to the decode stage
+            backgroundLoadMutex_.Acquire();
+            item->decodeQueued_ = true;
+            decodeOrder_.push(BackgroundLoadOrder{item->priority_, sequence_++, std::make_pair(item->resource_->GetType(),
+                item->resource_->GetNameHash())});
             backgroundLoadMutex_.Release();
+            decodeCondition_.Set();
+        }
+    }
+}
 
-            bool success = false;
-            std::unique_ptr<File> file = owner_->GetFile(resource->GetName(), item.sendEventOnFailure_);
-            if (file)
-            {
-                resource->SetAsyncLoadState(ASYNC_LOADING);
-                success = resource->BeginLoad(*file);
-            }
+BackgroundLoadItem* BackgroundLoader::TakeReadItem()
+{
+    while (!readOrder_.empty())
+    {
+        BackgroundLoadOrder order = readOrder_.top();
+        readOrder_.pop();
 
-            // Process dependencies now
-            // Need to lock the queue again when manipulating other entries
-            std::pair<StringHash, StringHash> key(resource->GetType(), resource->GetNameHash());
-            backgroundLoadMutex_.Acquire();
-            if (item.dependents_.size())
-            {
-                for (const std::pair<StringHash, StringHash> &dependent : item.dependents_)
-                {
-                    auto j = backgroundLoadQueue_.find(dependent);
-                    if (j != backgroundLoadQueue_.end())
-                        MAP_VALUE(j).dependencies_.remove(key);
-                }
+        // Skip entries made stale by a priority raise or by the main thread loading the resource itself
+        auto i = backgroundLoadQueue_.find(order.key_);
+        if (i == backgroundLoadQueue_.end())
+            continue;
+        BackgroundLoadItem& item = MAP_VALUE(i);
+        if (item.resource_->GetAsyncLoadState() != ASYNC_QUEUED)
+            continue;
+
+        // We can be sure that the item is not removed from the queue as long as it is in the "loading" state
+        item.resource_->SetAsyncLoadState(ASYNC_LOADING);
+        return &item;
+    }
 
-                item.dependents_.clear();
-            }
+    return nullptr;
+}
 
-            resource->SetAsyncLoadState(success ? ASYNC_SUCCESS : ASYNC_FAIL);
-            backgroundLoadMutex_.Release();
+BackgroundLoadItem* BackgroundLoader::TakeDecodeItem()
+{
+    while (!decodeOrder_.empty())
+    {
+        BackgroundLoadOrder order = decodeOrder_.top();
+        decodeOrder_.pop();
+
+        auto i = backgroundLoadQueue_.find(order.key_);
+        if (i == backgroundLoadQueue_.end())
+            continue;
+        BackgroundLoadItem& item = MAP_VALUE(i);
+        if (!item.decodeQueued_)
+            continue;
+
+        item.decodeQueued_ = false;
+        return &item;
+    }
+
+    return nullptr;
+}
+
+bool BackgroundLoader::ReadItem(BackgroundLoadItem& item)
+{
+    URHO3D_PROFILE(ReadResource);
+
+    // Read the whole file now so that decoding does not wait on I/O. Entries of memory-mapped packages stay where they are
+    std::unique_ptr<File> file = owner_->GetFile(item.resource_->GetName(), item.sendEventOnFailure_);
+    if (!file || !file->Preload())
+        return false;
+
+    item.file_ = file.release();
+    return true;
+}
+
+bool BackgroundLoader::DecodeItem(BackgroundLoadItem& item)
+{
+    URHO3D_PROFILE(DecodeResource);
+
+    bool success = item.resource_->BeginLoad(*item.file_);
+    item.file_.Reset();
+    return success;
+}
+
+void BackgroundLoader::FinishLoadingPhase(BackgroundLoadItem& item, bool success)
+{
+    Resource* resource = item.resource_;
+
+    // Process dependencies now
+    // Need to lock the queue again when manipulating other entries
+    std::pair<StringHash, StringHash> key(resource->GetType(), resource->GetNameHash());
+    backgroundLoadMutex_.Acquire();
+    if (item.dependents_.size())
+    {
+        for (const std::pair<StringHash, StringHash> &dependent : item.dependents_)
+        {
+            auto j = backgroundLoadQueue_.find(dependent);
+            if (j != backgroundLoadQueue_.end())
+                MAP_VALUE(j).dependencies_.remove(key);
         }
+
+        item.dependents_.clear();
     }
+
+    resource->SetAsyncLoadState(success ? ASYNC_SUCCESS : ASYNC_FAIL);
+    backgroundLoadMutex_.Release();
+
+    loadedCondition_.Set();
 }
 
-bool BackgroundLoader::QueueResource(StringHash type, const QString& name, bool sendEventOnFailure, Resource* caller)
+void BackgroundLoader::RaisePriority(const std::pair<StringHash, StringHash>& key, unsigned priority)
+{
+    auto i = backgroundLoadQueue_.find(key);
+    if (i == backgroundLoadQueue_.end() || MAP_VALUE(i).priority_ >= priority)
+        return;
+
+    // The entry with the old priority stays in the load order and is skipped once the resource has been taken
+    BackgroundLoadItem& item = MAP_VALUE(i);
+    item.priority_ = priority;
+    if (item.resource_->GetAsyncLoadState() == ASYNC_QUEUED)
+        readOrder_.push(BackgroundLoadOrder{priority, sequence_++, key});
+    else if (item.decodeQueued_)
+        decodeOrder_.push(BackgroundLoadOrder{priority, sequence_++, key});
+
+    // Whatever this resource waits for is needed as urgently
+    for (const std::pair<StringHash, StringHash>& dependency : item.dependencies_)
+        RaisePriority(dependency, priority);
+}
+
+bool BackgroundLoader::QueueResource(StringHash type, const QString& name, bool sendEventOnFailure, Resource* caller,
+                                     unsigned priority)
 {
     StringHash nameHash(name);
     std::pair<StringHash, StringHash> key(type, nameHash);
 
     MutexLock lock(backgroundLoadMutex_);
 
-    // Check if already exists in the queue
+    // A resource needed by the caller is needed at least as urgently as the caller itself
+    std::pair<StringHash, StringHash> callerKey;
+    auto callerIt = backgroundLoadQueue_.end();
+    if (caller)
+    {
+        callerKey = std::make_pair(caller->GetType(), caller->GetNameHash());
+        callerIt = backgroundLoadQueue_.find(callerKey);
+        if (callerIt != backgroundLoadQueue_.end())
+            priority = Max(priority, MAP_VALUE(callerIt).priority_);
+    }
+
+    // Check if already exists in the queue. If requested with a higher priority now, load it sooner
     if (backgroundLoadQueue_.find(key) != backgroundLoadQueue_.end())
+    {
+        RaisePriority(key, priority);
         return false;
+    }
 
     BackgroundLoadItem& item = backgroundLoadQueue_[key];
     item.sendEventOnFailure_ = sendEventOnFailure;
+    item.priority_ = priority;
+    item.decodeQueued_ = false;
 
     // Make sure the pointer is non-null and is a Resource subclass
     item.resource_ = DynamicCast<Resource>(owner_->GetContext()->CreateObject(type));
@@ -141,11 +324,9 @@ bool BackgroundLoader::QueueResource(StringHash type, const QString& name, bool
     // If this is a resource calling for the background load of more resources, mark the dependency as necessary
     if (caller)
     {
-        std::pair<StringHash, StringHash> callerKey(caller->GetType(), caller->GetNameHash());
-        auto j = backgroundLoadQueue_.find(callerKey);
-        if (j != backgroundLoadQueue_.end())
+        if (callerIt != backgroundLoadQueue_.end())
         {
-            BackgroundLoadItem& callerItem = MAP_VALUE(j);
+            BackgroundLoadItem& callerItem = MAP_VALUE(callerIt);
             item.dependents_.insert(callerKey);
             callerItem.dependencies_.insert(key);
         }
@@ -153,14 +334,24 @@ bool BackgroundLoader::QueueResource(StringHash type, const QString& name, bool
             URHO3D_LOGWARNING("Resource " + caller->GetName() + " requested for a background loaded resource but was not in the background load queue");
     }
 
-    // Start the background loader thread now
-    if (!IsStarted())
-        Run();
+    readOrder_.push(BackgroundLoadOrder{priority, sequence_++, key});
 
+    // Start the loader threads now
+    if (threads_.empty())
+    {
+        for (unsigned i = 0; i < numReadThreads_ + numThreads_; ++i)
+        {
+            SharedPtr<BackgroundLoaderThread> thread(new BackgroundLoaderThread(this, i >= numReadThreads_));
+            thread->Run();
+            threads_.push_back(thread);
+        }
+    }
+
+    readCondition_.Set();
     return true;
 }
 
-void BackgroundLoader::WaitForResource(StringHash type, StringHash nameHash)
+bool BackgroundLoader::WaitForResource(StringHash type, StringHash nameHash)
 {
     backgroundLoadMutex_.Acquire();
 
@@ -169,21 +360,39 @@ void BackgroundLoader::WaitForResource(StringHash type, StringHash nameHash)
     auto i = backgroundLoadQueue_.find(key);
     if (i != backgroundLoadQueue_.end())
     {
+        BackgroundLoadItem& item = MAP_VALUE(i);
+        Resource* resource = item.resource_;
+
+        // If no thread has taken the resource for the current stage, finish the stages right here instead of waiting
+        // behind the queues. Its queued dependencies are moved to the front of the queues
+        bool readHere = resource->GetAsyncLoadState() == ASYNC_QUEUED;
+        bool decodeHere = readHere || item.decodeQueued_;
+        if (readHere)
+            resource->SetAsyncLoadState(ASYNC_LOADING);
+        item.decodeQueued_ = false;
+        for (const std::pair<StringHash, StringHash>& dependency : item.dependencies_)
+            RaisePriority(dependency, M_MAX_UNSIGNED);
         backgroundLoadMutex_.Release();
 
+        if (readHere && !ReadItem(item))
+            FinishLoadingPhase(item, false);
+        else if (decodeHere)
+            FinishLoadingPhase(item, DecodeItem(item));
+
         {
-            Resource* resource = MAP_VALUE(i).resource_;
             HiresTimer waitTimer;
             bool didWait = false;
 
             for (;;)
             {
-                unsigned numDeps = MAP_VALUE(i).dependencies_.size();
+                backgroundLoadMutex_.Acquire();
+                unsigned numDeps = item.dependencies_.size();
                 AsyncLoadState state = resource->GetAsyncLoadState();
+                backgroundLoadMutex_.Release();
                 if (numDeps > 0 || state == ASYNC_QUEUED || state == ASYNC_LOADING)
                 {
                     didWait = true;
-                    Time::Sleep(1);
+                    loadedCondition_.Wait();
                 }
                 else
                     break;
@@ -194,19 +403,21 @@ void BackgroundLoader::WaitForResource(StringHash type, StringHash nameHash)
         }
 
         // This may take a long time and may potentially wait on other resources, so it is important we do not hold the mutex during this
-        FinishBackgroundLoading(MAP_VALUE(i));
+        FinishBackgroundLoading(item);
 
         backgroundLoadMutex_.Acquire();
-        backgroundLoadQueue_.erase(i);
+        backgroundLoadQueue_.erase(key);
         backgroundLoadMutex_.Release();
+        return true;
     }
-    else
-        backgroundLoadMutex_.Release();
+
+    backgroundLoadMutex_.Release();
+    return false;
 }
 
 void BackgroundLoader::FinishResources(int maxMs)
 {
-    if (IsStarted())
+    if (threads_.size())
     {
         HiresTimer timer;
 
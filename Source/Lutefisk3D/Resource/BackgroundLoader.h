@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "Lutefisk3D/Core/Condition.h"
 #include "Lutefisk3D/Core/Mutex.h"
 #include "Lutefisk3D/Container/Ptr.h"
 #include "Lutefisk3D/Container/RefCounted.h"
@@ -29,7 +30,10 @@
 #include "Lutefisk3D/Container/HashMap.h"
 
 #include "Lutefisk3D/Core/Thread.h"
+#include "Lutefisk3D/IO/File.h"
+#include <queue>
 #include <utility>
+#include <vector>
 #include <QtCore/QSet>
 
 namespace std {
@@ -45,6 +49,7 @@ struct hash< pair<Urho3D::StringHash,Urho3D::StringHash> > {
 namespace Urho3D
 {
 
+class BackgroundLoaderThread;
 class Resource;
 class ResourceCache;
 
@@ -63,32 +68,78 @@ struct BackgroundLoadItem
     QSet<std::pair<StringHash, StringHash> > dependents_;
     /// Whether to send failure event.
     bool sendEventOnFailure_;
+    /// Load priority. Raised when a higher priority resource depends on this one.
+    unsigned priority_;
+    /// File read to memory, waiting to be decoded.
+    SharedPtr<File> file_;
+    /// Whether the file has been read and the resource is waiting for a decode thread.
+    bool decodeQueued_;
 };
 
-/// Background loader of resources. Owned by the ResourceCache.
-class BackgroundLoader : public RefCounted, public Thread
+/// Entry in the background read or decode order. Entries of resources already taken by a thread are skipped.
+struct BackgroundLoadOrder
 {
+    /// Load priority.
+    unsigned priority_;
+    /// Queueing sequence number, to load resources of equal priority in the order they were queued.
+    unsigned sequence_;
+    /// Resource type and name hash.
+    std::pair<StringHash, StringHash> key_;
+
+    /// Test for lower load precedence.
+    bool operator <(const BackgroundLoadOrder& rhs) const
+    {
+        return priority_ != rhs.priority_ ? priority_ < rhs.priority_ : sequence_ > rhs.sequence_;
+    }
+};
+
+/// Background loader of resources. Owned by the ResourceCache. Loading is pipelined in three stages: read threads read the
+/// resource files to memory, decode threads run Resource::BeginLoad() on them, and the main thread finishes the resources
+/// with Resource::EndLoad().
+class BackgroundLoader : public RefCounted
+{
+    friend class BackgroundLoaderThread;
+
 public:
     /// Construct.
     BackgroundLoader(ResourceCache* owner);
 
-    /// Destruct. Forcibly clear the load queue.
+    /// Destruct. Stop the loader threads and forcibly clear the load queue.
     ~BackgroundLoader();
 
-    /// Resource background loading loop.
-    virtual void ThreadFunction();
-
+    /// Set number of decode threads. Only has effect before the threads are started on the first request.
+    void SetNumThreads(unsigned num);
+    /// Set number of read threads. Only has effect before the threads are started on the first request.
+    void SetNumReadThreads(unsigned num);
     /// Queue loading of a resource. The name must be sanitated to ensure consistent format. Return true if queued (not a duplicate and resource was a known type).
-    bool QueueResource(StringHash type, const QString& name, bool sendEventOnFailure, Resource* caller);
-    /// Wait and finish possible loading of a resource when being requested from the cache.
-    void WaitForResource(StringHash type, StringHash nameHash);
+    bool QueueResource(StringHash type, const QString& name, bool sendEventOnFailure, Resource* caller, unsigned priority);
+    /// Wait and finish possible loading of a resource when being requested from the cache. Return true if it was being loaded.
+    bool WaitForResource(StringHash type, StringHash nameHash);
     /// Process resources that are ready to finish.
     void FinishResources(int maxMs);
 
     /// Return amount of resources in the load queue.
     unsigned GetNumQueuedResources() const;
+    /// Return number of decode threads.
+    unsigned GetNumThreads() const { return numThreads_; }
+    /// Return number of read threads.
+    unsigned GetNumReadThreads() const { return numReadThreads_; }
 
 private:
+    /// Read or decode queued resources until shut down. Called by the loader threads.
+    void ProcessItems(bool decode);
+    /// Take the highest priority resource waiting to be read, or return null if none. Must be called with the mutex held.
+    BackgroundLoadItem* TakeReadItem();
+    /// Take the highest priority resource waiting to be decoded, or return null if none. Must be called with the mutex held.
+    BackgroundLoadItem* TakeDecodeItem();
+    /// Read the file of a resource to memory. Return true if successful.
+    bool ReadItem(BackgroundLoadItem& item);
+    /// Decode a resource from its file read to memory. Return true if successful.
+    bool DecodeItem(BackgroundLoadItem& item);
+    /// Mark the loading phase of a resource finished and resolve its dependents.
+    void FinishLoadingPhase(BackgroundLoadItem& item, bool success);
+    /// Raise the priority of a queued resource and its queued dependencies. Must be called with the mutex held.
+    void RaisePriority(const std::pair<StringHash, StringHash>& key, unsigned priority);
     /// Finish one background loaded resource.
     void FinishBackgroundLoading(BackgroundLoadItem& item);
 
@@ -98,6 +149,26 @@ private:
     mutable Mutex backgroundLoadMutex_;
     /// Resources that are queued for background loading.
     HashMap<std::pair<StringHash, StringHash>, BackgroundLoadItem> backgroundLoadQueue_;
+    /// Read order of the queued resources, highest priority first.
+    std::priority_queue<BackgroundLoadOrder> readOrder_;
+    /// Decode order of the resources read to memory, highest priority first.
+    std::priority_queue<BackgroundLoadOrder> decodeOrder_;
+    /// Read and decode threads.
+    std::vector<SharedPtr<BackgroundLoaderThread> > threads_;
+    /// Signaled when resources are queued, waking one waiting read thread.
+    Condition readCondition_;
+    /// Signaled when resources have been read, waking one waiting decode thread.
+    Condition decodeCondition_;
+    /// Signaled when a resource has finished its loading phase, waking the main thread waiting for it.
+    Condition loadedCondition_;
+    /// Next queueing sequence number.
+    unsigned sequence_;
+    /// Number of decode threads to start.
+    unsigned numThreads_;
+    /// Number of read threads to start.
+    unsigned numReadThreads_;
+    /// Shutting down flag.
+    volatile bool shutDown_;
 };
 
 }
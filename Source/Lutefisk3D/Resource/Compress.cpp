@@ -0,0 +1,454 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "Lutefisk3D/Resource/Compress.h"
+
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <cstring>
+#include <utility>
+
+namespace Urho3D
+{
+
+namespace
+{
+/// Minimum number of blocks encoded per work item when an image is split across the worker threads.
+const unsigned MIN_PARALLEL_BLOCKS = 32 * 32;
+/// Maximum number of endpoint refinements per block.
+const unsigned MAX_REFINEMENTS = 8;
+
+/// Pack a color to RGB565, rounding to the nearest value.
+unsigned PackRGB565(const float* color)
+{
+    unsigned r = (unsigned)Clamp((int)(color[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    unsigned g = (unsigned)Clamp((int)(color[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+    unsigned b = (unsigned)Clamp((int)(color[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    return (r << 11) | (g << 5) | b;
+}
+
+/// Expand a RGB565 color to 8 bits per channel the same way the decoder does.
+void UnpackRGB565(unsigned packed, int* color)
+{
+    int r = (packed >> 11) & 0x1f;
+    int g = (packed >> 5) & 0x3f;
+    int b = packed & 0x1f;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/// Colors of the opaque pixels of a block.
+struct ColorSet
+{
+    float colors_[16][3];
+    unsigned char pixels_[16];
+    unsigned numColors_ = 0;
+};
+
+/// Find the palette index of each color for the given endpoints, and return the squared error. The endpoints must already be
+/// ordered for the mode: c0 > c1 (or equal) for four colors, c0 <= c1 for three colors and transparent.
+int SelectIndices(const ColorSet& set, unsigned c0, unsigned c1, bool threeColors, unsigned char* indices)
+{
+    int palette[4][3];
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (threeColors)
+            palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+        else
+        {
+            palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+            palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+        }
+    }
+
+    unsigned numEntries = threeColors ? 3 : 4;
+    int error = 0;
+    for (unsigned i = 0; i < set.numColors_; ++i)
+    {
+        int best = M_MAX_INT;
+        for (unsigned j = 0; j < numEntries; ++j)
+        {
+            int dr = (int)set.colors_[i][0] - palette[j][0];
+            int dg = (int)set.colors_[i][1] - palette[j][1];
+            int db = (int)set.colors_[i][2] - palette[j][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = (unsigned char)j;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+/// Order the endpoints as the decoder expects for the mode.
+void OrderEndpoints(unsigned& c0, unsigned& c1, bool threeColors)
+{
+    if (threeColors ? c0 > c1 : c0 < c1)
+        std::swap(c0, c1);
+}
+
+/// Fit the initial endpoints of a set of colors, start being the brighter end.
+void FitEndpoints(const ColorSet& set, CompressionQuality quality, float* start, float* end)
+{
+    const unsigned num = set.numColors_;
+    if (quality == COMPRESS_FAST)
+    {
+        // Bounding box of the colors, inset slightly to reduce the error of the interpolated colors
+        for (int c = 0; c < 3; ++c)
+        {
+            float minValue = set.colors_[0][c];
+            float maxValue = minValue;
+            for (unsigned i = 1; i < num; ++i)
+            {
+                minValue = Min(minValue, set.colors_[i][c]);
+                maxValue = Max(maxValue, set.colors_[i][c]);
+            }
+            float inset = (maxValue - minValue) / 16.0f;
+            start[c] = maxValue - inset;
+            end[c] = minValue + inset;
+        }
+        return;
+    }
+
+    // Principal axis of the colors by power iteration on the covariance matrix
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (unsigned i = 0; i < num; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+            mean[c] += set.colors_[i][c];
+    }
+    for (int c = 0; c < 3; ++c)
+        mean[c] /= (float)num;
+
+    float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    for (unsigned i = 0; i < num; ++i)
+    {
+        float r = set.colors_[i][0] - mean[0];
+        float g = set.colors_[i][1] - mean[1];
+        float b = set.colors_[i][2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iteration = 0; iteration < 4; ++iteration)
+    {
+        float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+        float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+        float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+        float length = Max(Max(Abs(x), Abs(y)), Abs(z));
+        if (length < M_EPSILON)
+            break;
+        axis[0] = x / length;
+        axis[1] = y / length;
+        axis[2] = z / length;
+    }
+
+    // The extremes of the colors projected on the axis
+    unsigned minIndex = 0;
+    unsigned maxIndex = 0;
+    float minDot = M_INFINITY;
+    float maxDot = -M_INFINITY;
+    for (unsigned i = 0; i < num; ++i)
+    {
+        float dot = set.colors_[i][0] * axis[0] + set.colors_[i][1] * axis[1] + set.colors_[i][2] * axis[2];
+        if (dot < minDot)
+        {
+            minDot = dot;
+            minIndex = i;
+        }
+        if (dot > maxDot)
+        {
+            maxDot = dot;
+            maxIndex = i;
+        }
+    }
+    memcpy(start, set.colors_[maxIndex], sizeof(float) * 3);
+    memcpy(end, set.colors_[minIndex], sizeof(float) * 3);
+}
+
+/// Solve the endpoints that best fit the colors in the least squares sense for the given indices. Return false if the
+/// indices do not determine the endpoints.
+bool RefineEndpoints(const ColorSet& set, const unsigned char* indices, bool threeColors, float* start, float* end)
+{
+    static const float fourColorWeights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    static const float threeColorWeights[3] = {1.0f, 0.0f, 0.5f};
+    const float* weights = threeColors ? threeColorWeights : fourColorWeights;
+
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f};
+    float bx[3] = {0.0f, 0.0f, 0.0f};
+    for (unsigned i = 0; i < set.numColors_; ++i)
+    {
+        float a = weights[indices[i]];
+        float b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < 3; ++c)
+        {
+            ax[c] += a * set.colors_[i][c];
+            bx[c] += b * set.colors_[i][c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (Abs(determinant) < M_EPSILON)
+        return false;
+    for (int c = 0; c < 3; ++c)
+    {
+        start[c] = Clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+        end[c] = Clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+/// Compress the colors of a 4x4 block of RGBA pixels. With DXT1, pixels with alpha below 128 are encoded transparent.
+void CompressColorBlock(unsigned char* block, const unsigned char* rgba, bool isDxt1, CompressionQuality quality)
+{
+    ColorSet set;
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        const unsigned char* pixel = rgba + 4 * i;
+        if (isDxt1 && pixel[3] < 128)
+            continue;
+        for (int c = 0; c < 3; ++c)
+            set.colors_[set.numColors_][c] = pixel[c];
+        set.pixels_[set.numColors_++] = (unsigned char)i;
+    }
+
+    // Transparent pixels need the three color mode, with the fourth palette entry being transparent black
+    bool threeColors = set.numColors_ < 16;
+    unsigned c0 = 0;
+    unsigned c1 = 0;
+    unsigned char indices[16];
+    if (set.numColors_)
+    {
+        float start[3], end[3];
+        FitEndpoints(set, quality, start, end);
+        c0 = PackRGB565(start);
+        c1 = PackRGB565(end);
+        OrderEndpoints(c0, c1, threeColors);
+        int error = SelectIndices(set, c0, c1, threeColors, indices);
+
+        unsigned refinements = quality == COMPRESS_FAST ? 0 : (quality == COMPRESS_NORMAL ? 1 : MAX_REFINEMENTS);
+        for (unsigned i = 0; i < refinements && error > 0; ++i)
+        {
+            if (!RefineEndpoints(set, indices, threeColors, start, end))
+                break;
+            unsigned refined0 = PackRGB565(start);
+            unsigned refined1 = PackRGB565(end);
+            OrderEndpoints(refined0, refined1, threeColors);
+            if (refined0 == c0 && refined1 == c1)
+                break;
+            unsigned char refinedIndices[16];
+            int refinedError = SelectIndices(set, refined0, refined1, threeColors, refinedIndices);
+            if (refinedError >= error)
+                break;
+            c0 = refined0;
+            c1 = refined1;
+            error = refinedError;
+            memcpy(indices, refinedIndices, sizeof indices);
+        }
+    }
+
+    unsigned packedIndices = 0;
+    unsigned next = 0;
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        unsigned index = 3;
+        if (next < set.numColors_ && set.pixels_[next] == i)
+            index = indices[next++];
+        packedIndices |= index << (2 * i);
+    }
+
+    block[0] = (unsigned char)(c0 & 0xff);
+    block[1] = (unsigned char)(c0 >> 8);
+    block[2] = (unsigned char)(c1 & 0xff);
+    block[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (unsigned char)(packedIndices >> (8 * i));
+}
+
+/// Compress the alpha of a 4x4 block of RGBA pixels to the explicit 4-bit DXT3 alpha.
+void CompressAlphaDXT3(unsigned char* block, const unsigned char* rgba)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        unsigned lo = (rgba[8 * i + 3] * 15 + 127) / 255;
+        unsigned hi = (rgba[8 * i + 7] * 15 + 127) / 255;
+        block[i] = (unsigned char)(lo | (hi << 4));
+    }
+}
+
+/// Find the DXT5 alpha indices of a channel for the given endpoints, and return the squared error.
+int SelectAlphaIndices(const unsigned char* rgba, int channel, int alpha0, int alpha1, unsigned char* indices)
+{
+    int codes[8];
+    codes[0] = alpha0;
+    codes[1] = alpha1;
+    if (alpha0 <= alpha1)
+    {
+        for (int i = 1; i < 5; ++i)
+            codes[1 + i] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        codes[6] = 0;
+        codes[7] = 255;
+    }
+    else
+    {
+        for (int i = 1; i < 7; ++i)
+            codes[1 + i] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    }
+
+    int error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int alpha = rgba[4 * i + channel];
+        int best = M_MAX_INT;
+        for (int j = 0; j < 8; ++j)
+        {
+            int distance = (alpha - codes[j]) * (alpha - codes[j]);
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = (unsigned char)j;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+/// Compress one channel of a 4x4 block of RGBA pixels to the interpolated DXT5 alpha, which BC5 also uses for red and green.
+void CompressAlphaDXT5(unsigned char* block, const unsigned char* rgba, int channel, CompressionQuality quality)
+{
+    // The seven value mode spans the whole range; the five value mode spans the values other than 0 and 255, which it
+    // has explicit codes for
+    int minAlpha = 255, maxAlpha = 0;
+    int minInner = 255, maxInner = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int alpha = rgba[4 * i + channel];
+        minAlpha = Min(minAlpha, alpha);
+        maxAlpha = Max(maxAlpha, alpha);
+        if (alpha != 0 && alpha != 255)
+        {
+            minInner = Min(minInner, alpha);
+            maxInner = Max(maxInner, alpha);
+        }
+    }
+
+    int alpha0 = maxAlpha;
+    int alpha1 = minAlpha;
+    unsigned char indices[16];
+    int error = SelectAlphaIndices(rgba, channel, alpha0, alpha1, indices);
+    if (quality != COMPRESS_FAST && error > 0)
+    {
+        if (minInner > maxInner)
+            minInner = maxInner = 0;
+        unsigned char innerIndices[16];
+        int innerError = SelectAlphaIndices(rgba, channel, minInner, maxInner, innerIndices);
+        if (innerError < error)
+        {
+            alpha0 = minInner;
+            alpha1 = maxInner;
+            memcpy(indices, innerIndices, sizeof indices);
+        }
+    }
+
+    block[0] = (unsigned char)alpha0;
+    block[1] = (unsigned char)alpha1;
+    unsigned long long packedIndices = 0;
+    for (int i = 0; i < 16; ++i)
+        packedIndices |= (unsigned long long)indices[i] << (3 * i);
+    for (int i = 0; i < 6; ++i)
+        block[2 + i] = (unsigned char)(packedIndices >> (8 * i));
+}
+
+}
+
+void CompressImageDXT(unsigned char* blocks, const unsigned char* rgba, int width, int height, CompressedFormat format,
+                      CompressionQuality quality, WorkQueue* queue)
+{
+    const unsigned blocksX = (unsigned)(width + 3) / 4;
+    const unsigned blocksY = (unsigned)(height + 3) / 4;
+    const unsigned bytesPerBlock = format == CF_DXT1 ? 8 : 16;
+
+    auto compressRows = [=](unsigned start, unsigned end) {
+        unsigned char pixels[4 * 16];
+        for (unsigned row = start; row < end; ++row)
+        {
+            unsigned char* block = blocks + (size_t)row * blocksX * bytesPerBlock;
+            for (unsigned column = 0; column < blocksX; ++column, block += bytesPerBlock)
+            {
+                // Blocks on the right and bottom edges repeat the last pixels of the image
+                for (int y = 0; y < 4; ++y)
+                {
+                    int sourceY = Min((int)row * 4 + y, height - 1);
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        int sourceX = Min((int)column * 4 + x, width - 1);
+                        memcpy(pixels + 16 * y + 4 * x, rgba + 4 * ((size_t)sourceY * width + sourceX), 4);
+                    }
+                }
+
+                switch (format)
+                {
+                case CF_DXT1:
+                    CompressColorBlock(block, pixels, true, quality);
+                    break;
+                case CF_DXT3:
+                    CompressAlphaDXT3(block, pixels);
+                    CompressColorBlock(block + 8, pixels, false, quality);
+                    break;
+                case CF_BC5:
+                    CompressAlphaDXT5(block, pixels, 0, quality);
+                    CompressAlphaDXT5(block + 8, pixels, 1, quality);
+                    break;
+                default:
+                    CompressAlphaDXT5(block, pixels, 3, quality);
+                    CompressColorBlock(block + 8, pixels, false, quality);
+                    break;
+                }
+            }
+        }
+    };
+
+    if (queue)
+        queue->ProcessRange(blocksY, (MIN_PARALLEL_BLOCKS + blocksX - 1) / blocksX, compressRows);
+    else
+        compressRows(0, blocksY);
+}
+
+}
@@ -0,0 +1,39 @@
+//
+// Copyright (c) 2008-2016 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "Lutefisk3D/Resource/Image.h"
+
+namespace Urho3D
+{
+class WorkQueue;
+
+// TODO: BC7 and ETC2 encoding. Neither has a CompressedFormat, loader or decoder yet, so they need those first.
+/// Compress an RGBA image to DXT1, DXT3, DXT5 or BC5 blocks. BC5 keeps the red and green channels. The destination buffer
+/// required is ((width + 3) / 4) * ((height + 3) / 4) blocks of 8 bytes for DXT1 and 16 bytes otherwise. Large images are split
+/// across the work queue's threads if one is given.
+LUTEFISK3D_EXPORT void CompressImageDXT(unsigned char* blocks, const unsigned char* rgba, int width, int height, CompressedFormat format,
+                                        CompressionQuality quality = COMPRESS_NORMAL, WorkQueue* queue = nullptr);
+
+}
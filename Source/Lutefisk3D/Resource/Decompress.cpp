@@ -22,6 +22,13 @@
 
 #include "Lutefisk3D/Resource/Decompress.h"
 
+#include "Lutefisk3D/Core/WorkQueue.h"
+
+#include <cstring>
+#ifdef LUTEFISK3D_SSE
+#include <emmintrin.h>
+#endif
+
 // DXT decompression based on the Squish library, modified for Urho3D
 
 namespace Urho3D
@@ -72,11 +79,8 @@ static int Unpack565( unsigned char const* packed, unsigned char* colour )
     return value;
 }
 
-static void DecompressColourDXT( unsigned char* rgba, void const* block, bool isDxt1 )
+static void BuildColourPaletteDXT( unsigned* palette, unsigned char const* bytes, bool isDxt1 )
 {
-    // get the block bytes
-    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
-    
     // unpack the endpoints
     unsigned char codes[16];
     int a = Unpack565( bytes, codes );
@@ -103,30 +107,51 @@ static void DecompressColourDXT( unsigned char* rgba, void const* block, bool is
     // fill in alpha for the intermediate values
     codes[8 + 3] = 255;
     codes[12 + 3] = ( isDxt1 && a <= b ) ? 0 : 255;
-    
-    // unpack the indices
-    unsigned char indices[16];
+
+    memcpy( palette, codes, sizeof codes );
+}
+
+static void DecompressColourDXT( unsigned char* rgba, unsigned pitch, void const* block, bool isDxt1 )
+{
+    // get the block bytes
+    unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
+
+    unsigned palette[4];
+    BuildColourPaletteDXT( palette, bytes, isDxt1 );
+
+    // 2-bit indices, one byte per row with the leftmost pixel in the low bits
+    unsigned indices = ( unsigned )bytes[4] | ( ( unsigned )bytes[5] << 8 ) | ( ( unsigned )bytes[6] << 16 ) |
+            ( ( unsigned )bytes[7] << 24 );
+
+#ifdef LUTEFISK3D_SSE
+    // select the palette entries of a row of 4 pixels at once by comparing the masked index bits
+    __m128i colours[4];
     for( int i = 0; i < 4; ++i )
+        colours[i] = _mm_set1_epi32( ( int )palette[i] );
+    __m128i unit = _mm_set_epi32( 64, 16, 4, 1 );
+    __m128i mask = _mm_set_epi32( 192, 48, 12, 3 );
+    __m128i all = _mm_set1_epi32( ( int )indices );
+    for( int y = 0; y < 4; ++y )
     {
-        unsigned char* ind = indices + 4*i;
-        unsigned char packed = bytes[4 + i];
-        
-        ind[0] = packed & 0x3;
-        ind[1] = ( packed >> 2 ) & 0x3;
-        ind[2] = ( packed >> 4 ) & 0x3;
-        ind[3] = ( packed >> 6 ) & 0x3;
+        __m128i index = _mm_and_si128( all, mask );
+        __m128i result = _mm_and_si128( _mm_cmpeq_epi32( index, _mm_setzero_si128() ), colours[0] );
+        result = _mm_or_si128( result, _mm_and_si128( _mm_cmpeq_epi32( index, unit ), colours[1] ) );
+        result = _mm_or_si128( result, _mm_and_si128( _mm_cmpeq_epi32( index, _mm_add_epi32( unit, unit ) ), colours[2] ) );
+        result = _mm_or_si128( result, _mm_and_si128( _mm_cmpeq_epi32( index, mask ), colours[3] ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( rgba + y*pitch ), result );
+        all = _mm_srli_epi32( all, 8 );
     }
-    
+#else
     // store out the colours
-    for( int i = 0; i < 16; ++i )
+    for( int y = 0; y < 4; ++y )
     {
-        unsigned char offset = 4*indices[i];
-        for( int j = 0; j < 4; ++j )
-            rgba[4*i + j] = codes[offset + j];
+        for( int x = 0; x < 4; ++x )
+            memcpy( rgba + y*pitch + 4*x, &palette[( indices >> ( 8*y + 2*x ) ) & 0x3], 4 );
     }
+#endif
 }
 
-static void DecompressAlphaDXT3( unsigned char* rgba, void const* block )
+static void DecompressAlphaDXT3( unsigned char* rgba, unsigned pitch, void const* block )
 {
     unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
     
@@ -141,12 +166,13 @@ static void DecompressAlphaDXT3( unsigned char* rgba, void const* block )
         unsigned char hi = quant & 0xf0;
         
         // convert back up to bytes
-        rgba[8*i + 3] = lo | ( lo << 4 );
-        rgba[8*i + 7] = hi | ( hi >> 4 );
+        unsigned char* row = rgba + ( i >> 1 )*pitch + 8*( i & 1 );
+        row[3] = lo | ( lo << 4 );
+        row[7] = hi | ( hi >> 4 );
     }
 }
 
-static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
+static void DecompressAlphaDXT5( unsigned char* rgba, unsigned pitch, void const* block, int channel = 3 )
 {
     // get the two alpha values
     unsigned char const* bytes = reinterpret_cast< unsigned char const* >( block );
@@ -172,35 +198,39 @@ static void DecompressAlphaDXT5( unsigned char* rgba, void const* block )
             codes[1 + i] = ( unsigned char )( ( ( 7 - i )*alpha0 + i*alpha1 )/7 );
     }
     
-    // decode the indices
-    unsigned char indices[16];
-    unsigned char const* src = bytes + 2;
-    unsigned char* dest = indices;
-    for( int i = 0; i < 2; ++i )
-    {
-        // grab 3 bytes
-        int value = 0;
-        for( int j = 0; j < 3; ++j )
-        {
-            int byte = *src++;
-            value |= ( byte << 8*j );
-        }
-        
-        // unpack 8 3-bit values from it
-        for( int j = 0; j < 8; ++j )
-        {
-            int index = ( value >> 3*j ) & 0x7;
-            *dest++ = ( unsigned char )index;
-        }
-    }
+    // the 16 3-bit indices are packed in the remaining 48 bits
+    unsigned long long indices = 0;
+    for( int i = 0; i < 6; ++i )
+        indices |= ( unsigned long long )bytes[2 + i] << 8*i;
     
     // write out the indexed codebook values
-    for( int i = 0; i < 16; ++i )
-        rgba[4*i + 3] = codes[indices[i]];
+    for( int y = 0; y < 4; ++y )
+    {
+        unsigned char* row = rgba + y*pitch;
+        for( int x = 0; x < 4; ++x )
+            row[4*x + channel] = codes[( indices >> 3*( 4*y + x ) ) & 0x7];
+    }
 }
 
-static void DecompressDXT( unsigned char* rgba, const void* block, CompressedFormat format)
+static void DecompressDXT( unsigned char* rgba, unsigned pitch, const void* block, CompressedFormat format)
 {
+    // BC5 is two DXT5 alpha blocks, for red and green
+    if( format == CF_BC5 )
+    {
+        DecompressAlphaDXT5( rgba, pitch, block, 0 );
+        DecompressAlphaDXT5( rgba, pitch, reinterpret_cast< unsigned char const* >( block ) + 8, 1 );
+        for( int y = 0; y < 4; ++y )
+        {
+            unsigned char* row = rgba + y*pitch;
+            for( int x = 0; x < 4; ++x )
+            {
+                row[4*x + 2] = 0;
+                row[4*x + 3] = 255;
+            }
+        }
+        return;
+    }
+
     // get the block locations
     void const* colourBlock = block;
     void const* alphaBock = block;
@@ -208,63 +238,69 @@ static void DecompressDXT( unsigned char* rgba, const void* block, CompressedFor
         colourBlock = reinterpret_cast< unsigned char const* >( block ) + 8;
     
     // decompress colour
-    DecompressColourDXT( rgba, colourBlock, format == CF_DXT1 );
+    DecompressColourDXT( rgba, pitch, colourBlock, format == CF_DXT1 );
     
     // decompress alpha separately if necessary
     if( format == CF_DXT3 )
-        DecompressAlphaDXT3( rgba, alphaBock );
+        DecompressAlphaDXT3( rgba, pitch, alphaBock );
     else if ( format == CF_DXT5 )
-        DecompressAlphaDXT5( rgba, alphaBock );
+        DecompressAlphaDXT5( rgba, pitch, alphaBock );
 }
 
-void DecompressImageDXT( unsigned char* rgba, const void* blocks, int width, int height, int depth, CompressedFormat format )
+/// Minimum number of blocks decoded per work item when a surface is split across the worker threads.
+static const unsigned MIN_PARALLEL_BLOCKS = 64 * 64;
+
+/// Decompress the 4x4 blocks of a surface, stored row by row. Blocks on the right and bottom edges may be partially
+/// outside the image; those are decoded to a temporary buffer first.
+static void DecompressBlocks( unsigned char* rgba, unsigned char const* blocks, int width, int height, int depth,
+                              unsigned bytesPerBlock, WorkQueue* queue,
+                              void ( *decompressBlock )( unsigned char*, unsigned, const void*, CompressedFormat ),
+                              CompressedFormat format )
 {
-    // initialise the block input
-    unsigned char const* sourceBlock = reinterpret_cast< unsigned char const* >( blocks );
-    int bytesPerBlock = format == CF_DXT1 ? 8 : 16;
-    
-    // loop over blocks
-    for( int z = 0; z < depth; ++z )
-    {
-        int sz = width*height*4*z;
-        for( int y = 0; y < height; y += 4 )
+    unsigned blocksX = ( unsigned )( width + 3 )/4;
+    unsigned blocksY = ( unsigned )( height + 3 )/4;
+    unsigned pitch = 4*width;
+
+    auto decompressRows = [=]( unsigned start, unsigned end ) {
+        for( unsigned row = start; row < end; ++row )
         {
-            for( int x = 0; x < width; x += 4 )
+            int z = row/blocksY;
+            int y = 4*( row % blocksY );
+            unsigned char* slice = rgba + ( size_t )width*height*4*z;
+            unsigned char const* sourceBlock = blocks + ( size_t )row*blocksX*bytesPerBlock;
+
+            for( int x = 0; x < width; x += 4, sourceBlock += bytesPerBlock )
             {
-                // decompress the block
-                unsigned char targetRgba[4*16];
-                DecompressDXT( targetRgba, sourceBlock, format );
-                
-                // write the decompressed pixels to the correct image locations
-                unsigned char const* sourcePixel = targetRgba;
-                for( int py = 0; py < 4; ++py )
+                unsigned char* target = slice + 4*( width*y + x );
+                if( x + 4 <= width && y + 4 <= height )
                 {
-                    for( int px = 0; px < 4; ++px )
-                    {
-                        // get the target location
-                        int sx = x + px;
-                        int sy = y + py;
-                        if( sx < width && sy < height )
-                        {
-                            unsigned char* targetPixel = rgba + sz + 4*( width*sy + sx );
-                            
-                            // copy the rgba value
-                            for( int i = 0; i < 4; ++i )
-                                *targetPixel++ = *sourcePixel++;
-                        }
-                        else
-                        {
-                            // skip this pixel as its outside the image
-                            sourcePixel += 4;
-                        }
-                    }
+                    decompressBlock( target, pitch, sourceBlock, format );
+                    continue;
                 }
-                
-                // advance
-                sourceBlock += bytesPerBlock;
+
+                // copy only the pixels inside the image
+                unsigned char targetRgba[4*16];
+                decompressBlock( targetRgba, 16, sourceBlock, format );
+                int copyWidth = Min( width - x, 4 );
+                int copyHeight = Min( height - y, 4 );
+                for( int py = 0; py < copyHeight; ++py )
+                    memcpy( target + py*pitch, targetRgba + 16*py, 4*copyWidth );
             }
         }
-    }
+    };
+
+    unsigned numRows = blocksY*depth;
+    if( queue )
+        queue->ProcessRange( numRows, ( MIN_PARALLEL_BLOCKS + blocksX - 1 )/blocksX, decompressRows );
+    else
+        decompressRows( 0, numRows );
+}
+
+void DecompressImageDXT( unsigned char* rgba, const void* blocks, int width, int height, int depth, CompressedFormat format,
+                         WorkQueue* queue )
+{
+    DecompressBlocks( rgba, reinterpret_cast< unsigned char const* >( blocks ), width, height, depth,
+                      format == CF_DXT1 ? 8 : 16, queue, DecompressDXT, format );
 }
 
 // ETC and PVRTC decompression based on the Oolong Engine, modified for Urho3D
@@ -302,10 +338,10 @@ const int mod[8][4]={{2, 8,-2,-8},
                     {47, 183, -47, -183}};
 
 // lsb: hgfedcba ponmlkji msb: hgfedcba ponmlkji due to endianness
-static unsigned long ModifyPixel(int red, int green, int blue, int x, int y, unsigned long modBlock, int modTable)
+static unsigned ModifyPixel(int red, int green, int blue, int x, int y, unsigned modBlock, int modTable)
 {
     int index = x*4+y, pixelMod;
-    unsigned long mostSig = modBlock<<1;
+    unsigned mostSig = modBlock<<1;
     if (index<8)    //hgfedcba
         pixelMod = mod[modTable][((modBlock>>(index+24))&0x1)+((mostSig>>(index+8))&0x2)];
     else    // ponmlkj
@@ -318,17 +354,18 @@ static unsigned long ModifyPixel(int red, int green, int blue, int x, int y, uns
     return ((blue<<16) + (green<<8) + red)|0xff000000;
 }
 
-static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
+static void DecompressETC(unsigned char* pDestData, unsigned pitch, const void* pSrcData, CompressedFormat)
 {
-    unsigned long blockTop, blockBot, *input = (unsigned long*)pSrcData, *output;
+    // the block is two 32-bit words; unsigned long would read past the block where it is 64 bits
+    unsigned blockTop, blockBot, input[2], pixel;
     unsigned char red1, green1, blue1, red2, green2, blue2;
     bool bFlip, bDiff;
     int modtable1,modtable2;
     
-    blockTop = *(input++);
-    blockBot = *(input++);
+    memcpy(input, pSrcData, sizeof input);
+    blockTop = input[0];
+    blockBot = input[1];
     
-    output = (unsigned long*)pDestData;
     // check flipbit
     bFlip = (blockTop & ETC_FLIP) != 0;
     bDiff = (blockTop & ETC_DIFF) != 0;
@@ -385,8 +422,10 @@ static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
         {
             for(int k=0;k<2;k++)    // horizontal
             {
-                *(output+j*4+k) = ModifyPixel(red1,green1,blue1,k,j,blockBot,modtable1);
-                *(output+j*4+k+2) = ModifyPixel(red2,green2,blue2,k+2,j,blockBot,modtable2);
+                pixel = ModifyPixel(red1,green1,blue1,k,j,blockBot,modtable1);
+                memcpy(pDestData+j*pitch+k*4, &pixel, 4);
+                pixel = ModifyPixel(red2,green2,blue2,k+2,j,blockBot,modtable2);
+                memcpy(pDestData+j*pitch+(k+2)*4, &pixel, 4);
             }
         }
     }
@@ -396,57 +435,19 @@ static void DecompressETC(unsigned char* pDestData, const void* pSrcData)
         {
             for(int k=0;k<4;k++)
             {
-                *(output+j*4+k) = ModifyPixel(red1,green1,blue1,k,j,blockBot,modtable1);
-                *(output+(j+2)*4+k) = ModifyPixel(red2,green2,blue2,k,j+2,blockBot,modtable2);
+                pixel = ModifyPixel(red1,green1,blue1,k,j,blockBot,modtable1);
+                memcpy(pDestData+j*pitch+k*4, &pixel, 4);
+                pixel = ModifyPixel(red2,green2,blue2,k,j+2,blockBot,modtable2);
+                memcpy(pDestData+(j+2)*pitch+k*4, &pixel, 4);
             }
         }
     }
 }
 
-void DecompressImageETC( unsigned char* rgba, const void* blocks, int width, int height )
+void DecompressImageETC( unsigned char* rgba, const void* blocks, int width, int height, WorkQueue* queue )
 {
-    // initialise the block input
-    unsigned char const* sourceBlock = reinterpret_cast< unsigned char const* >( blocks );
-    int bytesPerBlock = 8;
-    
-    // loop over blocks
-    for( int y = 0; y < height; y += 4 )
-    {
-        for( int x = 0; x < width; x += 4 )
-        {
-            // decompress the block
-            unsigned char targetRgba[4*16];
-            DecompressETC( targetRgba, sourceBlock );
-            
-            // write the decompressed pixels to the correct image locations
-            unsigned char const* sourcePixel = targetRgba;
-            for( int py = 0; py < 4; ++py )
-            {
-                for( int px = 0; px < 4; ++px )
-                {
-                    // get the target location
-                    int sx = x + px;
-                    int sy = y + py;
-                    if( sx < width && sy < height )
-                    {
-                        unsigned char* targetPixel = rgba + 4*( width*sy + sx );
-                        
-                        // copy the rgba value
-                        for( int i = 0; i < 4; ++i )
-                            *targetPixel++ = *sourcePixel++;
-                    }
-                    else
-                    {
-                        // skip this pixel as its outside the image
-                        sourcePixel += 4;
-                    }
-                }
-            }
-            
-            // advance
-            sourceBlock += bytesPerBlock;
-        }
-    }
+    DecompressBlocks( rgba, reinterpret_cast< unsigned char const* >( blocks ), width, height, 1, 8, queue, DecompressETC,
+                      CF_ETC1 );
 }
 
 #define PT_INDEX    (2) /*The Punch-through index*/
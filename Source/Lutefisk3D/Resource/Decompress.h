@@ -26,11 +26,14 @@
 
 namespace Urho3D
 {
+class WorkQueue;
 
-/// Decompress a DXT compressed image to RGBA.
-LUTEFISK3D_EXPORT void DecompressImageDXT(unsigned char* dest, const void* blocks, int width, int height, int depth, CompressedFormat format);
-/// Decompress an ETC1 compressed image to RGBA.
-LUTEFISK3D_EXPORT void DecompressImageETC(unsigned char* dest, const void* blocks, int width, int height);
+/// Decompress a DXT or BC5 compressed image to RGBA. BC5 decodes to red and green, with zero blue and opaque alpha. Large
+/// images are split across the work queue's threads if one is given.
+LUTEFISK3D_EXPORT void DecompressImageDXT(unsigned char* dest, const void* blocks, int width, int height, int depth, CompressedFormat format,
+                                          WorkQueue* queue = nullptr);
+/// Decompress an ETC1 compressed image to RGBA. Large images are split across the work queue's threads if one is given.
+LUTEFISK3D_EXPORT void DecompressImageETC(unsigned char* dest, const void* blocks, int width, int height, WorkQueue* queue = nullptr);
 /// Decompress a PVRTC compressed image to RGBA.
 LUTEFISK3D_EXPORT void DecompressImagePVRTC(unsigned char* dest, const void* blocks, int width, int height, CompressedFormat format);
 /// Flip a compressed block vertically.
@@ -22,18 +22,24 @@
 #include "Image.h"
 
 #include "Lutefisk3D/Core/Context.h"
+#include "Compress.h"
 #include "Decompress.h"
 #include "Lutefisk3D/IO/File.h"
 #include "Lutefisk3D/IO/FileSystem.h"
 #include "Lutefisk3D/IO/Log.h"
 #include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
 
 #include <QBuffer>
 #include <QFileInfo>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <QtGui/QImage>
 #include <GLFW/glfw3.h>
+#ifdef LUTEFISK3D_SSE
+#include <emmintrin.h>
+#endif
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3) ((unsigned)(ch0) | ((unsigned)(ch1) << 8) | ((unsigned)(ch2) << 16) | ((unsigned)(ch3) << 24))
 #endif
@@ -44,6 +50,17 @@
 #define FOURCC_DXT4 (MAKEFOURCC('D','X','T','4'))
 #define FOURCC_DXT5 (MAKEFOURCC('D','X','T','5'))
 #define FOURCC_DX10 (MAKEFOURCC('D','X','1','0'))
+#define FOURCC_ATI2 (MAKEFOURCC('A','T','I','2'))
+#define FOURCC_BC5U (MAKEFOURCC('B','C','5','U'))
+
+static const unsigned DDSD_CAPS = 0x00000001U;
+static const unsigned DDSD_HEIGHT = 0x00000002U;
+static const unsigned DDSD_WIDTH = 0x00000004U;
+static const unsigned DDSD_PIXELFORMAT = 0x00001000U;
+static const unsigned DDSD_MIPMAPCOUNT = 0x00020000U;
+static const unsigned DDSD_LINEARSIZE = 0x00080000U;
+
+static const unsigned DDPF_FOURCC = 0x00000004U;
 
 static const unsigned DDSCAPS_COMPLEX = 0x00000008U;
 static const unsigned DDSCAPS_TEXTURE = 0x00001000U;
@@ -74,6 +91,7 @@ static const unsigned DDS_DXGI_FORMAT_BC2_UNORM = 74;
 static const unsigned DDS_DXGI_FORMAT_BC2_UNORM_SRGB = 75;
 static const unsigned DDS_DXGI_FORMAT_BC3_UNORM = 77;
 static const unsigned DDS_DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+static const unsigned DDS_DXGI_FORMAT_BC5_UNORM = 83;
 
 namespace Urho3D
 {
@@ -204,7 +222,7 @@ struct DDSurfaceDesc2
     unsigned dwTextureStage_;
 };
 
-bool CompressedLevel::Decompress(uint8_t* dest)
+bool CompressedLevel::Decompress(uint8_t* dest, WorkQueue* queue)
 {
     if (!data_)
         return false;
@@ -214,11 +232,12 @@ bool CompressedLevel::Decompress(uint8_t* dest)
     case CF_DXT1:
     case CF_DXT3:
     case CF_DXT5:
-        DecompressImageDXT(dest, data_, width_, height_, depth_, format_);
+    case CF_BC5:
+        DecompressImageDXT(dest, data_, width_, height_, depth_, format_, queue);
         return true;
 
     case CF_ETC1:
-        DecompressImageETC(dest, data_, width_, height_);
+        DecompressImageETC(dest, data_, width_, height_, queue);
         return true;
 
     case CF_PVRTC_RGB_2BPP:
@@ -296,6 +315,9 @@ bool Image::BeginLoad(Deserializer& source)
             case DDS_DXGI_FORMAT_BC3_UNORM_SRGB:
                 fourCC = FOURCC_DXT5;
                 break;
+            case DDS_DXGI_FORMAT_BC5_UNORM:
+                fourCC = FOURCC_ATI2;
+                break;
             case DDS_DXGI_FORMAT_R8G8B8A8_UNORM:
             case DDS_DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
                 fourCC = 0;
@@ -332,6 +354,12 @@ bool Image::BeginLoad(Deserializer& source)
             components_ = 4;
             break;
 
+        case FOURCC_ATI2:
+        case FOURCC_BC5U:
+            compressedFormat_ = CF_BC5;
+            components_ = 2;
+            break;
+
         case 0:
             if (ddsd.ddpfPixelFormat_.dwRGBBitCount_ != 32 && ddsd.ddpfPixelFormat_.dwRGBBitCount_ != 24 &&
                     ddsd.ddpfPixelFormat_.dwRGBBitCount_ != 16)
@@ -351,8 +379,8 @@ bool Image::BeginLoad(Deserializer& source)
         // Is it a cube map or texture array? If so determine the size of the image chain.
         imageset_ = (ddsd.ddsCaps_.dwCaps2_ & DDSCAPS2_CUBEMAP_ALL_FACES) != 0 ||
                             (hasDXGI && (dxgiHeader.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0)
-                        ? ImageSet::SINGLE
-                        : ImageSet::CUBEMAP;
+                        ? ImageSet::CUBEMAP
+                        : ImageSet::SINGLE;
         unsigned imageChainCount = 1;
         if (imageset_==ImageSet::CUBEMAP)
             imageChainCount = 6;
@@ -366,7 +394,7 @@ bool Image::BeginLoad(Deserializer& source)
         unsigned dataSize = 0;
         if (compressedFormat_ != CF_RGBA)
         {
-            const unsigned blockSize = compressedFormat_ == CF_DXT1 ? 8 : 16; //DXT1/BC1 is 8 bytes, DXT3/BC2 and DXT5/BC3 are 16 bytes
+            const unsigned blockSize = compressedFormat_ == CF_DXT1 ? 8 : 16; //DXT1/BC1 is 8 bytes, DXT3/BC2, DXT5/BC3 and BC5 are 16 bytes
             // Add 3 to ensure valid block: ie 2x2 fits uses a whole 4x4 block
             unsigned blocksWide = (ddsd.dwWidth_ + 3) / 4;
             unsigned blocksHeight = (ddsd.dwHeight_ + 3) / 4;
@@ -576,6 +604,11 @@ bool Image::BeginLoad(Deserializer& source)
             components_ = 3;
             break;
 
+        case 0x8dbd:
+            compressedFormat_ = CF_BC5;
+            components_ = 2;
+            break;
+
         case 0x8c00:
             compressedFormat_ = CF_PVRTC_RGB_4BPP;
             components_ = 3;
@@ -1068,13 +1101,179 @@ bool Image::FlipVertical()
 
     return true;
 }
-///
-/// \brief Resize image by bilinear resampling.
-/// \param width
-/// \param height
-/// \return Return true if successful.
-///
-bool Image::Resize(int width, int height)
+/// Minimum number of pixels processed per work item when image filtering is split across the worker threads.
+static const int MIN_PARALLEL_IMAGE_PIXELS = 128 * 128;
+
+/// Call a function for ranges of rows, in the worker threads when called from the main thread with enough pixels.
+static void ProcessImageRows(Context* context, int numRows, int rowPixels, const std::function<void(int, int)>& function)
+{
+    WorkQueue* queue = context->m_WorkQueueSystem.get();
+    if (!queue)
+    {
+        function(0, numRows);
+        return;
+    }
+    unsigned minRows = (unsigned)((MIN_PARALLEL_IMAGE_PIXELS + rowPixels - 1) / rowPixels);
+    queue->ProcessRange((unsigned)numRows, minRows, [&function](unsigned start, unsigned end) { function(start, end); });
+}
+
+/// Resampling weights along one image axis.
+struct ResampleAxis
+{
+    /// Compute the weights for resampling from a source size to a destination size.
+    ResampleAxis(int srcSize, int dstSize, ImageResizeFilter filter);
+
+    /// Maximum number of source pixels contributing to a destination pixel.
+    int maxTaps_;
+    /// First contributing source pixel per destination pixel.
+    std::vector<int> first_;
+    /// Number of contributing source pixels per destination pixel.
+    std::vector<int> count_;
+    /// Normalized weights, maxTaps_ per destination pixel.
+    std::vector<float> weights_;
+};
+
+/// Evaluate a resize filter at a distance measured in source pixels.
+static float ResizeFilterWeight(ImageResizeFilter filter, float x)
+{
+    x = Abs(x);
+    switch (filter)
+    {
+    case RESIZE_BOX:
+        return x < 0.5f ? 1.0f : 0.0f;
+
+    case RESIZE_LANCZOS3:
+        if (x < M_EPSILON)
+            return 1.0f;
+        if (x >= 3.0f)
+            return 0.0f;
+        x *= M_PI;
+        return 3.0f * sinf(x) * sinf(x / 3.0f) / (x * x);
+
+    default:
+        return x < 1.0f ? 1.0f - x : 0.0f;
+    }
+}
+
+ResampleAxis::ResampleAxis(int srcSize, int dstSize, ImageResizeFilter filter)
+{
+    float scale = (float)dstSize / (float)srcSize;
+    // When reducing, stretch the filter to cover all source pixels of a destination pixel
+    float filterScale = scale < 1.0f ? 1.0f / scale : 1.0f;
+    float support = (filter == RESIZE_BOX ? 0.5f : filter == RESIZE_LANCZOS3 ? 3.0f : 1.0f) * filterScale;
+
+    maxTaps_ = (int)ceilf(support * 2.0f) + 1;
+    first_.resize(dstSize);
+    count_.resize(dstSize);
+    weights_.resize(dstSize * maxTaps_);
+
+    for (int i = 0; i < dstSize; ++i)
+    {
+        float center = ((float)i + 0.5f) / scale;
+        int first = Max((int)floorf(center - support), 0);
+        int last = Min((int)ceilf(center + support), srcSize - 1);
+        float* weights = &weights_[i * maxTaps_];
+        float total = 0.0f;
+        int count = 0;
+
+        for (int j = first; j <= last && count < maxTaps_; ++j)
+        {
+            float weight = ResizeFilterWeight(filter, ((float)j + 0.5f - center) / filterScale);
+            // Skip leading zero weights
+            if (count == 0 && weight == 0.0f)
+            {
+                ++first;
+                continue;
+            }
+            weights[count++] = weight;
+            total += weight;
+        }
+        while (count > 1 && weights[count - 1] == 0.0f)
+            --count;
+
+        if (total == 0.0f)
+        {
+            // Can only happen with a box filter enlarging exactly between pixels; take the nearest pixel
+            first = Clamp((int)center, 0, srcSize - 1);
+            weights[0] = total = 1.0f;
+            count = 1;
+        }
+        for (int k = 0; k < count; ++k)
+            weights[k] /= total;
+
+        first_[i] = first;
+        count_[i] = count;
+    }
+}
+
+/// Add weighted 8-bit source values to float accumulators.
+static void AccumulateBytes(float* dest, const uint8_t* src, unsigned count, float weight)
+{
+    unsigned i = 0;
+#ifdef LUTEFISK3D_SSE
+    __m128i zero = _mm_setzero_si128();
+    __m128 weights = _mm_set1_ps(weight);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i words[2] = { _mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero) };
+        for (unsigned j = 0; j < 2; ++j)
+        {
+            float* d = dest + i + j * 8;
+            __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words[j], zero));
+            __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words[j], zero));
+            _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(low, weights)));
+            _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_mul_ps(high, weights)));
+        }
+    }
+#endif
+    for (; i < count; ++i)
+        dest[i] += (float)src[i] * weight;
+}
+
+/// Convert a float value to 8 bits with rounding and saturation.
+static inline uint8_t FloatToByte(float value)
+{
+    return (uint8_t)Clamp((int)(value + 0.5f), 0, 255);
+}
+
+/// Resample one row of float source values, with the given number of components, to 8-bit destination pixels.
+static void ResampleRow(uint8_t* dest, const float* src, const ResampleAxis& axis, unsigned components)
+{
+    int dstWidth = (int)axis.first_.size();
+    for (int x = 0; x < dstWidth; ++x)
+    {
+        const float* in = src + axis.first_[x] * components;
+        const float* weights = &axis.weights_[x * axis.maxTaps_];
+        int count = axis.count_[x];
+        uint8_t* out = dest + x * components;
+
+#ifdef LUTEFISK3D_SSE
+        if (components == 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < count; ++k)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + k * 4), _mm_set1_ps(weights[k])));
+            // Round and saturate to bytes
+            __m128i ints = _mm_cvttps_epi32(_mm_add_ps(sum, _mm_set1_ps(0.5f)));
+            ints = _mm_packs_epi32(ints, ints);
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(ints, ints));
+            memcpy(out, &packed, 4);
+            continue;
+        }
+#endif
+        for (unsigned c = 0; c < components; ++c)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < count; ++k)
+                sum += in[k * components + c] * weights[k];
+            out[c] = FloatToByte(sum);
+        }
+    }
+}
+
+/// Resize image by resampling with a separable filter. Colors are filtered in the image's own color space.
+bool Image::Resize(int width, int height, ImageResizeFilter filter)
 {
     URHO3D_PROFILE(ResizeImage);
 
@@ -1093,40 +1292,29 @@ bool Image::Resize(int width, int height)
     if (!data_ || width <= 0 || height <= 0)
         return false;
 
-    /// \todo Reducing image size does not sample all needed pixels
+    ResampleAxis horizontal(width_, width, filter);
+    ResampleAxis vertical(height_, height, filter);
     std::unique_ptr<uint8_t[]> newData(new uint8_t[width * height * components_]);
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
+    unsigned srcRowSize = width_ * components_;
+    unsigned dstRowSize = width * components_;
+
+    // Each destination row first combines the contributing source rows, then filters the combined row horizontally
+    ProcessImageRows(context_, height, width, [&](int start, int end) {
+        std::vector<float> row(srcRowSize);
+        for (int y = start; y < end; ++y)
         {
-            // Calculate float coordinates between 0 - 1 for resampling
-            float xF = (width_ > 1) ? (float)x / (float)(width - 1) : 0.0f;
-            float yF = (height_ > 1) ? (float)y / (float)(height - 1) : 0.0f;
-            unsigned uintColor = GetPixelBilinear(xF, yF).ToUInt();
-            uint8_t* dest = newData.get() + (y * width + x) * components_;
-            uint8_t* src = (uint8_t*)&uintColor;
-
-            switch (components_)
-            {
-            case 4:
-                dest[3] = src[3];
-                // Fall through
-            case 3:
-                dest[2] = src[2];
-                // Fall through
-            case 2:
-                dest[1] = src[1];
-                // Fall through
-            default:
-                dest[0] = src[0];
-                break;
-            }
+            std::fill(row.begin(), row.end(), 0.0f);
+            const float* weights = &vertical.weights_[y * vertical.maxTaps_];
+            for (int k = 0; k < vertical.count_[y]; ++k)
+                AccumulateBytes(row.data(), data_.get() + (vertical.first_[y] + k) * srcRowSize, srcRowSize, weights[k]);
+            ResampleRow(newData.get() + y * dstRowSize, row.data(), horizontal, components_);
         }
-    }
+    });
 
     width_ = width;
     height_ = height;
     data_ = std::move(newData);
+    nextLevel_.Reset();
     SetMemoryUse(width * height * depth_ * components_);
     return true;
 }
@@ -1231,6 +1419,172 @@ bool Image::SaveJPG(const QString & fileName, int quality) const
 
     return saveImageCommon(fileName,"jpg",quality);
 }
+/// Save a DXT or BC5 compressed image in DDS format. Return true if successful.
+bool Image::SaveDDS(const QString& fileName) const
+{
+    URHO3D_PROFILE(SaveImageDDS);
+
+    FileSystem* fileSystem = context_->m_FileSystem.get();
+    if (fileSystem && !fileSystem->CheckAccess(GetPath(fileName)))
+    {
+        URHO3D_LOGERROR("Access denied to " + fileName);
+        return false;
+    }
+
+    if (compressedFormat_ != CF_DXT1 && compressedFormat_ != CF_DXT3 && compressedFormat_ != CF_DXT5 && compressedFormat_ != CF_BC5)
+    {
+        URHO3D_LOGERROR("Can only save DXT and BC5 compressed images to DDS");
+        return false;
+    }
+    if (depth_ > 1 || nextSibling_)
+    {
+        URHO3D_LOGERROR("Can not save 3D, cube or array images to DDS");
+        return false;
+    }
+
+    File outFile(context_, fileName, FILE_WRITE);
+    if (!outFile.IsOpen())
+        return false;
+
+    DDSurfaceDesc2 ddsd;
+    memset(&ddsd, 0, sizeof ddsd);
+    ddsd.dwSize_ = sizeof ddsd;
+    ddsd.dwFlags_ = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    ddsd.dwHeight_ = height_;
+    ddsd.dwWidth_ = width_;
+    ddsd.dwLinearSize_ = GetCompressedLevel(0).dataSize_;
+    ddsd.ddpfPixelFormat_.dwSize_ = sizeof(DDPixelFormat);
+    ddsd.ddpfPixelFormat_.dwFlags_ = DDPF_FOURCC;
+    ddsd.ddsCaps_.dwCaps_ = DDSCAPS_TEXTURE;
+    if (numCompressedLevels_ > 1)
+    {
+        ddsd.dwFlags_ |= DDSD_MIPMAPCOUNT;
+        ddsd.dwMipMapCount_ = numCompressedLevels_;
+        ddsd.ddsCaps_.dwCaps_ |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    // sRGB can only be told apart in the DX10 header
+    DDSHeader10 dxgiHeader;
+    memset(&dxgiHeader, 0, sizeof dxgiHeader);
+    switch (compressedFormat_)
+    {
+    case CF_DXT1:
+        ddsd.ddpfPixelFormat_.dwFourCC_ = FOURCC_DXT1;
+        dxgiHeader.dxgiFormat = DDS_DXGI_FORMAT_BC1_UNORM_SRGB;
+        break;
+    case CF_DXT3:
+        ddsd.ddpfPixelFormat_.dwFourCC_ = FOURCC_DXT3;
+        dxgiHeader.dxgiFormat = DDS_DXGI_FORMAT_BC2_UNORM_SRGB;
+        break;
+    case CF_BC5:
+        ddsd.ddpfPixelFormat_.dwFourCC_ = FOURCC_ATI2;
+        dxgiHeader.dxgiFormat = DDS_DXGI_FORMAT_BC5_UNORM;
+        break;
+    default:
+        ddsd.ddpfPixelFormat_.dwFourCC_ = FOURCC_DXT5;
+        dxgiHeader.dxgiFormat = DDS_DXGI_FORMAT_BC3_UNORM_SRGB;
+        break;
+    }
+    if (sRGB_ && compressedFormat_ != CF_BC5)
+    {
+        ddsd.ddpfPixelFormat_.dwFourCC_ = FOURCC_DX10;
+        dxgiHeader.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        dxgiHeader.arraySize = 1;
+    }
+
+    outFile.WriteFileID("DDS ");
+    outFile.Write(&ddsd, sizeof ddsd);
+    if (ddsd.ddpfPixelFormat_.dwFourCC_ == FOURCC_DX10)
+        outFile.Write(&dxgiHeader, sizeof dxgiHeader);
+    return outFile.Write(data_.get(), GetMemoryUse()) == GetMemoryUse();
+}
+/// Save a compressed image in KTX format. Return true if successful.
+bool Image::SaveKTX(const QString& fileName) const
+{
+    URHO3D_PROFILE(SaveImageKTX);
+
+    FileSystem* fileSystem = context_->m_FileSystem.get();
+    if (fileSystem && !fileSystem->CheckAccess(GetPath(fileName)))
+    {
+        URHO3D_LOGERROR("Access denied to " + fileName);
+        return false;
+    }
+
+    // The internal formats the KTX loader understands
+    unsigned internalFormat = 0;
+    switch (compressedFormat_)
+    {
+    case CF_DXT1:
+        internalFormat = 0x83f1;
+        break;
+    case CF_DXT3:
+        internalFormat = 0x83f2;
+        break;
+    case CF_DXT5:
+        internalFormat = 0x83f3;
+        break;
+    case CF_ETC1:
+        internalFormat = 0x8d64;
+        break;
+    case CF_BC5:
+        internalFormat = 0x8dbd;
+        break;
+    case CF_PVRTC_RGB_4BPP:
+        internalFormat = 0x8c00;
+        break;
+    case CF_PVRTC_RGB_2BPP:
+        internalFormat = 0x8c01;
+        break;
+    case CF_PVRTC_RGBA_4BPP:
+        internalFormat = 0x8c02;
+        break;
+    case CF_PVRTC_RGBA_2BPP:
+        internalFormat = 0x8c03;
+        break;
+    default:
+        URHO3D_LOGERROR("Can only save block compressed images to KTX");
+        return false;
+    }
+    if (depth_ > 1 || nextSibling_)
+    {
+        URHO3D_LOGERROR("Can not save 3D, cube or array images to KTX");
+        return false;
+    }
+
+    File outFile(context_, fileName, FILE_WRITE);
+    if (!outFile.IsOpen())
+        return false;
+
+    static const unsigned char identifier[12] = {0xab, 0x4b, 0x54, 0x58, 0x20, 0x31, 0x31, 0xbb, 0x0d, 0x0a, 0x1a, 0x0a};
+    outFile.Write(identifier, sizeof identifier);
+    outFile.WriteUInt(0x04030201); // Endianness
+    outFile.WriteUInt(0);          // Type
+    outFile.WriteUInt(1);          // Type size
+    outFile.WriteUInt(0);          // Format
+    outFile.WriteUInt(internalFormat);
+    outFile.WriteUInt(components_ == 4 ? 0x1908 : (components_ == 2 ? 0x8227 : 0x1907)); // Base internal format, RGBA, RG or RGB
+    outFile.WriteUInt(width_);
+    outFile.WriteUInt(height_);
+    outFile.WriteUInt(0);          // Depth
+    outFile.WriteUInt(0);          // Array elements
+    outFile.WriteUInt(1);          // Faces
+    outFile.WriteUInt(numCompressedLevels_);
+    outFile.WriteUInt(0);          // Key/value data bytes
+
+    static const unsigned char padding[3] = {0, 0, 0};
+    for (unsigned i = 0; i < numCompressedLevels_; ++i)
+    {
+        CompressedLevel level = GetCompressedLevel(i);
+        if (!level.data_)
+            return false;
+        outFile.WriteUInt(level.dataSize_);
+        if (outFile.Write(level.data_, level.dataSize_) != level.dataSize_)
+            return false;
+        if (level.dataSize_ & 3)
+            outFile.Write(padding, 4 - (level.dataSize_ & 3));
+    }
+    return true;
+}
 
 /// Return a 2D pixel color.
 Color Image::GetPixel(int x, int y) const
@@ -1348,6 +1702,50 @@ Color Image::GetPixelTrilinear(float x, float y, float z) const
     Color colorFar = topColorFar.Lerp(bottomColorFar, yF);
     return colorNear.Lerp(colorFar, zF);
 }
+/// Average the 2x2 pixel blocks of two source rows into a destination row.
+static void DownsampleRow(uint8_t* out, const uint8_t* inUpper, const uint8_t* inLower, int widthOut, unsigned components)
+{
+    int x = 0;
+#ifdef LUTEFISK3D_SSE
+    __m128i zero = _mm_setzero_si128();
+    if (components == 1)
+    {
+        // 16 source bytes of each row make 8 destination pixels
+        __m128i mask = _mm_set1_epi16(0xff);
+        for (; x + 8 <= widthOut; x += 8)
+        {
+            __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inUpper + x * 2));
+            __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inLower + x * 2));
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(upper, mask), _mm_srli_epi16(upper, 8)),
+                                        _mm_add_epi16(_mm_and_si128(lower, mask), _mm_srli_epi16(lower, 8)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(_mm_srli_epi16(sum, 2), zero));
+        }
+    }
+    else if (components == 4)
+    {
+        // 4 source pixels of each row make 2 destination pixels
+        for (; x + 2 <= widthOut; x += 2)
+        {
+            __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inUpper + x * 8));
+            __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inLower + x * 8));
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+            low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+            high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+            __m128i sum = _mm_srli_epi16(_mm_unpacklo_epi64(low, high), 2);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, zero));
+        }
+    }
+#endif
+    for (; x < widthOut; ++x)
+    {
+        for (unsigned c = 0; c < components; ++c)
+        {
+            unsigned i = x * 2 * components + c;
+            out[x * components + c] = ((unsigned)inUpper[i] + inUpper[i + components] + inLower[i] + inLower[i + components]) >> 2;
+        }
+    }
+}
 /// Return next mip level by bilinear filtering. Note that if the image is already 1x1x1, will keep returning an image of that size.
 SharedPtr<Image> Image::GetNextLevel() const
 {
@@ -1436,73 +1834,15 @@ SharedPtr<Image> Image::GetNextLevel() const
     // 2D case
     else if (depth_ == 1)
     {
-        switch (components_)
-        {
-        case 1:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const uint8_t* inUpper = &pixelDataIn[(y*2)*width_];
-                const uint8_t* inLower = &pixelDataIn[(y*2+1)*width_];
-                uint8_t* out = &pixelDataOut[y*widthOut];
-
-                for (int x = 0; x < widthOut; ++x)
-                {
-                    out[x] = ((unsigned)inUpper[x*2] + inUpper[x*2+1] + inLower[x*2] + inLower[x*2+1]) >> 2;
-                }
-            }
-            break;
-
-        case 2:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const uint8_t* inUpper = &pixelDataIn[(y*2)*width_*2];
-                const uint8_t* inLower = &pixelDataIn[(y*2+1)*width_*2];
-                uint8_t* out = &pixelDataOut[y*widthOut*2];
-
-                for (int x = 0; x < widthOut*2; x += 2)
-                {
-                    out[x] = ((unsigned)inUpper[x*2] + inUpper[x*2+2] + inLower[x*2] + inLower[x*2+2]) >> 2;
-                    out[x+1] = ((unsigned)inUpper[x*2+1] + inUpper[x*2+3] + inLower[x*2+1] + inLower[x*2+3]) >> 2;
-                }
-            }
-            break;
-
-        case 3:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const uint8_t* inUpper = &pixelDataIn[(y*2)*width_*3];
-                const uint8_t* inLower = &pixelDataIn[(y*2+1)*width_*3];
-                uint8_t* out = &pixelDataOut[y*widthOut*3];
-
-                for (int x = 0; x < widthOut*3; x += 3)
-                {
-                    out[x] = ((unsigned)inUpper[x*2] + inUpper[x*2+3] + inLower[x*2] + inLower[x*2+3]) >> 2;
-                    out[x+1] = ((unsigned)inUpper[x*2+1] + inUpper[x*2+4] + inLower[x*2+1] + inLower[x*2+4]) >> 2;
-                    out[x+2] = ((unsigned)inUpper[x*2+2] + inUpper[x*2+5] + inLower[x*2+2] + inLower[x*2+5]) >> 2;
-                }
-            }
-            break;
-
-        case 4:
-            for (int y = 0; y < heightOut; ++y)
+        unsigned components = components_;
+        int width = width_;
+        ProcessImageRows(context_, heightOut, widthOut, [=](int start, int end) {
+            for (int y = start; y < end; ++y)
             {
-                const uint8_t* inUpper = &pixelDataIn[(y*2)*width_*4];
-                const uint8_t* inLower = &pixelDataIn[(y*2+1)*width_*4];
-                uint8_t* out = &pixelDataOut[y*widthOut*4];
-
-                for (int x = 0; x < widthOut*4; x += 4)
-                {
-                    out[x] = ((unsigned)inUpper[x*2] + inUpper[x*2+4] + inLower[x*2] + inLower[x*2+4]) >> 2;
-                    out[x+1] = ((unsigned)inUpper[x*2+1] + inUpper[x*2+5] + inLower[x*2+1] + inLower[x*2+5]) >> 2;
-                    out[x+2] = ((unsigned)inUpper[x*2+2] + inUpper[x*2+6] + inLower[x*2+2] + inLower[x*2+6]) >> 2;
-                    out[x+3] = ((unsigned)inUpper[x*2+3] + inUpper[x*2+7] + inLower[x*2+3] + inLower[x*2+7]) >> 2;
-                }
+                DownsampleRow(&pixelDataOut[y * widthOut * components], &pixelDataIn[(y * 2) * width * components],
+                              &pixelDataIn[(y * 2 + 1) * width * components], widthOut, components);
             }
-            break;
-        default:
-            assert(false);  // Should never reach here
-            break;
-        }
+        });
     }
     // 3D case
     else
@@ -1681,6 +2021,70 @@ SharedPtr<Image> Image::ConvertToRGBA() const
 
     return ret;
 }
+/// Compress to DXT1, DXT3 or DXT5 for saving or uploading generated images, including the mip levels down to 1x1 if
+/// requested. Return null on failure.
+SharedPtr<Image> Image::Compress(CompressedFormat format, CompressionQuality quality, bool mipmaps) const
+{
+    URHO3D_PROFILE(CompressImage);
+
+    if (IsCompressed())
+    {
+        URHO3D_LOGERROR("Image is already compressed");
+        return SharedPtr<Image>();
+    }
+    if (depth_ > 1)
+    {
+        URHO3D_LOGERROR("Can not compress a 3D image");
+        return SharedPtr<Image>();
+    }
+    if (format != CF_DXT1 && format != CF_DXT3 && format != CF_DXT5 && format != CF_BC5)
+    {
+        URHO3D_LOGERROR("Unsupported format for image compression");
+        return SharedPtr<Image>();
+    }
+
+    std::vector<SharedPtr<Image> > levels;
+    levels.push_back(ConvertToRGBA());
+    if (!levels.back())
+        return SharedPtr<Image>();
+    while (mipmaps && (levels.back()->GetWidth() > 1 || levels.back()->GetHeight() > 1))
+    {
+        SharedPtr<Image> next = levels.back()->GetNextLevel();
+        if (!next)
+            return SharedPtr<Image>();
+        levels.push_back(next);
+    }
+
+    const unsigned blockSize = format == CF_DXT1 ? 8 : 16;
+    unsigned dataSize = 0;
+    for (const SharedPtr<Image>& level : levels)
+        dataSize += ((level->GetWidth() + 3) / 4) * ((level->GetHeight() + 3) / 4) * blockSize;
+
+    SharedPtr<Image> ret(new Image(context_));
+    ret->data_.reset(new uint8_t[dataSize]);
+    WorkQueue* queue = context_->m_WorkQueueSystem.get();
+    unsigned offset = 0;
+    for (const SharedPtr<Image>& level : levels)
+    {
+        CompressImageDXT(ret->data_.get() + offset, level->GetData(), level->GetWidth(), level->GetHeight(), format, quality,
+                         queue);
+        offset += ((level->GetWidth() + 3) / 4) * ((level->GetHeight() + 3) / 4) * blockSize;
+    }
+
+    ret->width_ = width_;
+    ret->height_ = height_;
+    ret->depth_ = 1;
+    if (format == CF_BC5)
+        ret->components_ = 2;
+    else
+        ret->components_ = (format == CF_DXT1 && !HasAlphaChannel()) ? 3 : 4;
+    ret->compressedFormat_ = format;
+    ret->numCompressedLevels_ = levels.size();
+    // BC5 holds two linear channels, e.g. a normal map's X and Y
+    ret->sRGB_ = sRGB_ && format != CF_BC5;
+    ret->SetMemoryUse(dataSize);
+    return ret;
+}
 /// Return a compressed mip level.
 CompressedLevel Image::GetCompressedLevel(unsigned index) const
 {
@@ -1741,7 +2145,7 @@ CompressedLevel Image::GetCompressedLevel(unsigned index) const
             ++i;
         }
     }
-    else if (compressedFormat_ < CF_PVRTC_RGB_2BPP)
+    else if (compressedFormat_ < CF_PVRTC_RGB_2BPP || compressedFormat_ == CF_BC5)
     {
         level.blockSize_ = (compressedFormat_ == CF_DXT1 || compressedFormat_ == CF_ETC1) ? 8 : 16;
         unsigned i = 0;
@@ -2064,10 +2468,17 @@ uint8_t* Image::GetImageData(Deserializer& source, int& width, int& height, unsi
 {
     unsigned dataSize = source.GetSize();
 
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[dataSize]);
-    source.Read(buffer.get(), dataSize);
+    // Decode straight from memory-mapped or in-memory sources, otherwise read into a temporary buffer
+    std::unique_ptr<uint8_t[]> buffer;
+    const uint8_t* data = source.ReadMapped(dataSize);
+    if (!data)
+    {
+        buffer.reset(new uint8_t[dataSize]);
+        source.Read(buffer.get(), dataSize);
+        data = buffer.get();
+    }
     QString srcname = QFileInfo(source.GetName()).suffix();
-    QImage img(QImage::fromData(buffer.get(),dataSize,qPrintable(srcname.toLower())));
+    QImage img(QImage::fromData(data,dataSize,qPrintable(srcname.toLower())));
     assert(img.width()>0 && img.height()>0);
     if(((img.depth()+7)/8)==4) {
         if(!img.hasAlphaChannel()) {
@@ -32,6 +32,7 @@ struct GLFWimage;
 }
 namespace Urho3D
 {
+class WorkQueue;
 
 static const int COLOR_LUT_SIZE = 16;
 
@@ -48,6 +49,23 @@ enum CompressedFormat : unsigned
     CF_PVRTC_RGBA_2BPP,
     CF_PVRTC_RGB_4BPP,
     CF_PVRTC_RGBA_4BPP,
+    CF_BC5,
+};
+
+/// Filter used when resizing images.
+enum ImageResizeFilter : unsigned
+{
+    RESIZE_BOX = 0,   ///< Average of the covered source pixels. Nearest neighbour when enlarging.
+    RESIZE_TRIANGLE,  ///< Bilinear when enlarging, tent filter over the covered source pixels when reducing.
+    RESIZE_LANCZOS3,  ///< Three-lobed windowed sinc. Sharpest, but may ring at hard edges.
+};
+
+/// Block compression quality and speed preset.
+enum CompressionQuality : unsigned
+{
+    COMPRESS_FAST = 0,  ///< Endpoints from the bounding box of the block's colors.
+    COMPRESS_NORMAL,    ///< Endpoints along the principal axis of the block's colors, refined once. Both DXT5 alpha modes tried.
+    COMPRESS_HIGH,      ///< As normal, but the endpoints are refined until the error stops improving.
 };
 
 enum class ImageSet : uint8_t {
@@ -58,8 +76,9 @@ enum class ImageSet : uint8_t {
 /// Compressed image mip level.
 struct CompressedLevel
 {
-    /// Decompress to RGBA. The destination buffer required is width * height * 4 bytes. Return true if successful.
-    bool Decompress(uint8_t* dest);
+    /// Decompress to RGBA. The destination buffer required is width * height * 4 bytes. Large levels are split across the
+    /// work queue's threads if one is given. Return true if successful.
+    bool Decompress(uint8_t* dest, WorkQueue* queue = nullptr);
     uint8_t *        data_      = nullptr; //!< Compressed image data.
     CompressedFormat format_    = CF_NONE; //!< Compression format.
     int              width_     = 0;       //!< Width.
@@ -95,12 +114,14 @@ public:
     bool LoadColorLUT(Deserializer& source);
     bool FlipHorizontal();
     bool FlipVertical();
-    bool Resize(int width, int height);
+    bool Resize(int width, int height, ImageResizeFilter filter = RESIZE_TRIANGLE);
     void Clear(const Color& color);
     void ClearInt(unsigned uintColor);
     bool SaveBMP(const QString& fileName) const;
     bool SavePNG(const QString& fileName) const;
     bool SaveJPG(const QString& fileName, int quality) const;
+    bool SaveDDS(const QString& fileName) const;
+    bool SaveKTX(const QString& fileName) const;
     /// Whether this texture is detected as a cubemap, only relevant for DDS.
     bool IsCubemap() const { return imageset_==ImageSet::CUBEMAP; }
     /// Whether this texture has been detected as a volume, only relevant for DDS.
@@ -135,6 +156,8 @@ public:
     /// Return the next sibling image of an array or cubemap.
     SharedPtr<Image> GetNextSibling() const { return nextSibling_;  }
     SharedPtr<Image> ConvertToRGBA() const;
+    /// Return a DXT1, DXT3, DXT5 or BC5 compressed copy of an uncompressed image, optionally with its mip chain. Return null for other formats.
+    SharedPtr<Image> Compress(CompressedFormat format, CompressionQuality quality = COMPRESS_NORMAL, bool mipmaps = true) const;
     CompressedLevel GetCompressedLevel(unsigned index) const;
     Image* GetSubimage(const IntRect& rect) const;
 
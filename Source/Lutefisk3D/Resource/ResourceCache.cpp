@@ -32,12 +32,14 @@
 #include "Lutefisk3D/IO/PackageFile.h"
 #include "Lutefisk3D/Resource/PListFile.h"
 #include "Lutefisk3D/Core/Profiler.h"
+#include "Lutefisk3D/Core/Timer.h"
 #include "Lutefisk3D/Resource/ResourceCache.h"
 #include "Lutefisk3D/Resource/ResourceEvents.h"
 #include "Lutefisk3D/Core/WorkQueue.h"
 #include "Lutefisk3D/Resource/XMLFile.h"
 #include "Lutefisk3D/Core/StringUtils.h"
 #include <QtCore/QString>
+#include <algorithm>
 namespace Urho3D
 {
 
@@ -61,7 +63,11 @@ static const char* checkDirs[] =
     nullptr
 };
 
-static const SharedPtr<Resource> noResource;
+/// Return the lookup index key of a resource.
+static inline uint64_t ResourceLookupKey(StringHash type, StringHash nameHash)
+{
+    return (uint64_t(type.Value()) << 32) | nameHash.Value();
+}
 
 ResourceCache::ResourceCache(Context* context) :
     SignalObserver(context->observerAllocator()),
@@ -70,12 +76,14 @@ ResourceCache::ResourceCache(Context* context) :
     returnFailedResources_(false),
     searchPackagesFirst_(true),
     isRouting_(false),
-    finishBackgroundResourcesMs_(5)
+    finishBackgroundResourcesMs_(5),
+    totalMemoryBudget_(0),
+    recordingManifest_(false)
 {
     // Register Resource library object factories
     RegisterResourceLibrary(m_context);
 
-    // Create resource background loader. Its thread will start on the first background request
+    // Create resource background loader. Its threads will start on the first background request
     backgroundLoader_.reset(new BackgroundLoader(this));
 
     // Subscribe BeginFrame for handling directory watchers and background loaded resource finalization
@@ -86,6 +94,10 @@ ResourceCache::~ResourceCache()
 {
     // Shut down the background loader first
     backgroundLoader_.reset();
+
+    // Shutdown ends a recording that was to be saved automatically
+    if (recordingManifest_ && !manifestFileName_.isEmpty())
+        SaveResourceManifest(manifestFileName_);
 }
 /// Add a resource load directory. Optional priority parameter which will control search order.
 bool ResourceCache::AddResourceDir(const QString& pathName, unsigned priority)
@@ -113,6 +125,9 @@ bool ResourceCache::AddResourceDir(const QString& pathName, unsigned priority)
         resourceDirs_.insert(resourceDirs_.begin()+priority, fixedPath);
     else
         resourceDirs_.push_back(fixedPath);
+    UpdateResourceNamePrefixes();
+    missingResourceFiles_.clear();
+    IndexResourceDir(fixedPath);
 
     // If resource auto-reloading active, create a file watcher for the directory
     if (autoReloadResources_)
@@ -168,7 +183,10 @@ bool ResourceCache::AddManualResource(Resource* resource)
     }
 
     resource->ResetUseTimer();
-    resourceGroups_[resource->GetType()].resources_[resource->GetNameHash()] = resource;
+    ResourceGroup& group = resourceGroups_[resource->GetType()];
+    group.resources_[resource->GetNameHash()] = resource;
+    group.evicted_.erase(resource->GetNameHash());
+    IndexResource(resource->GetType(), resource->GetNameHash(), resource);
     UpdateResourceGroup(resource->GetType());
     return true;
 }
@@ -188,8 +206,18 @@ void ResourceCache::RemoveResourceDir(const QString& pathName)
     }
     if (i == fin)
         return;
-            resourceDirs_.erase(i);
-            // Remove the filewatcher with the matching path
+    resourceDirs_.erase(i);
+    UpdateResourceNamePrefixes();
+    // Files of the removed directory may also exist in a lower priority directory
+    QStringList removedFiles;
+    for (const auto& elem : resourceFileIndex_)
+    {
+        if (ELEMENT_VALUE(elem) == fixedPath)
+            removedFiles.push_back(ELEMENT_KEY(elem));
+    }
+    for (const QString& name : removedFiles)
+        ReindexResourceFile(name);
+    // Remove the filewatcher with the matching path
     for (auto j = fileWatchers_.begin(); j != fin_j; ++j)
     {
         if (0 == (*j)->GetPath().compare(fixedPath, Qt::CaseInsensitive))
@@ -200,8 +228,8 @@ void ResourceCache::RemoveResourceDir(const QString& pathName)
     }
     URHO3D_LOGINFO("Removed resource path " + fixedPath);
 }
-/// Remove a package file. Optionally release the resources loaded from it.
-void ResourceCache::RemovePackageFile(PackageFile* package, bool releaseResources, bool forceRelease)
+/// Remove a package file. Optionally release the resources loaded from it. Return false if not found, or if files are still read from its memory mapping.
+bool ResourceCache::RemovePackageFile(PackageFile* package, bool releaseResources, bool forceRelease)
 {
     MutexLock lock(resourceMutex_);
 
@@ -209,45 +237,48 @@ void ResourceCache::RemovePackageFile(PackageFile* package, bool releaseResource
     {
         if (*i == package)
         {
+            // Files opened from the package on other threads may still be reading its mapping
+            if (package->GetNumMappedFiles())
+            {
+                URHO3D_LOGERROR("Can not remove resource package " + package->GetName() + " while files are read from it");
+                return false;
+            }
             if (releaseResources)
                 ReleasePackageResources(*i, forceRelease);
             URHO3D_LOGINFO("Removed resource package " + (*i)->GetName());
             packages_.erase(i);
-            return;
+            return true;
         }
     }
+    return false;
 }
-/// Remove a package file by name. Optionally release the resources loaded from it.
-void ResourceCache::RemovePackageFile(const QString& fileName, bool releaseResources, bool forceRelease)
+/// Remove a package file by name. Optionally release the resources loaded from it. Return false if not found, or if files are still read from its memory mapping.
+bool ResourceCache::RemovePackageFile(const QString& fileName, bool releaseResources, bool forceRelease)
 {
     MutexLock lock(resourceMutex_);
 
     // Compare the name and extension only, not the path
     QString fileNameNoPath = GetFileNameAndExtension(fileName);
 
-    for (std::vector<SharedPtr<PackageFile> >::iterator i = packages_.begin(); i != packages_.end(); ++i)
+    for (const SharedPtr<PackageFile>& package : packages_)
     {
-        if (!GetFileNameAndExtension((*i)->GetName()).compare(fileNameNoPath, Qt::CaseInsensitive))
-        {
-            if (releaseResources)
-                ReleasePackageResources(*i, forceRelease);
-            URHO3D_LOGINFO("Removed resource package " + (*i)->GetName());
-            packages_.erase(i);
-            return;
-        }
+        if (!GetFileNameAndExtension(package->GetName()).compare(fileNameNoPath, Qt::CaseInsensitive))
+            return RemovePackageFile(package.Get(), releaseResources, forceRelease);
     }
+    return false;
 }
 /// Release a resource by name.
 void ResourceCache::ReleaseResource(StringHash type, const QString& name, bool force)
 {
     StringHash nameHash(name);
-    const SharedPtr<Resource>& existingRes = FindResource(type, nameHash);
+    Resource* existingRes = FindResource(type, nameHash);
     if (!existingRes)
         return;
 
     // If other references exist, do not release, unless forced
-    if ((existingRes.Refs() == 1 && existingRes.WeakRefs() == 0) || force)
+    if ((existingRes->Refs() == 1 && existingRes->WeakRefs() == 0) || force)
     {
+        UnindexResource(type, nameHash);
         resourceGroups_[type].resources_.erase(nameHash);
         UpdateResourceGroup(type);
     }
@@ -267,6 +298,7 @@ void ResourceCache::ReleaseResources(StringHash type, bool force)
         // If other references exist, do not release, unless forced
         if ((MAP_VALUE(j)->Refs() == 1 && MAP_VALUE(j)->WeakRefs() == 0) || force)
         {
+            UnindexResource(type, MAP_KEY(j));
             j = resources.erase(j);
             released = true;
         }
@@ -294,6 +326,7 @@ void ResourceCache::ReleaseResources(StringHash type, const QString& partialName
                 // If other references exist, do not release, unless forced
                 if ((MAP_VALUE(j).Refs() == 1 && MAP_VALUE(j).WeakRefs() == 0) || force)
                 {
+                    UnindexResource(type, MAP_KEY(j));
                     j = resource.erase(j);
                     released = true;
                     continue;
@@ -327,6 +360,7 @@ void ResourceCache::ReleaseResources(const QString& partialName, bool force)
                     // If other references exist, do not release, unless forced
                     if ((MAP_VALUE(j).Refs() == 1 && MAP_VALUE(j).WeakRefs() == 0) || force)
                     {
+                        UnindexResource(MAP_KEY(iter), MAP_KEY(j));
                         j = resources.erase(j);
                         released = true;
                         continue;
@@ -357,6 +391,7 @@ void ResourceCache::ReleaseAllResources(bool force)
                 // If other references exist, do not release, unless forced
                 if ((MAP_VALUE(j).Refs() == 1 && MAP_VALUE(j).WeakRefs() == 0) || force)
                 {
+                    UnindexResource(MAP_KEY(iter), MAP_KEY(j));
                     j=elem.resources_.erase(j);
                     released = true;
                 }
@@ -400,7 +435,7 @@ void ResourceCache::ReloadResourceWithDependencies(const QString& fileName)
 {
     StringHash fileNameHash(fileName);
     // If the filename is a resource we keep track of, reload it
-    const SharedPtr<Resource>& resource = FindResource(fileNameHash);
+    Resource* resource = FindResource(fileNameHash);
     if (resource)
     {
         URHO3D_LOGDEBUG("Reloading changed resource " + fileName);
@@ -421,9 +456,9 @@ void ResourceCache::ReloadResourceWithDependencies(const QString& fileName)
 
         for (const StringHash &k : MAP_VALUE(j))
         {
-            const SharedPtr<Resource>& dependent = FindResource(k);
+            Resource* dependent = FindResource(k);
             if (dependent)
-                dependents.push_back(dependent);
+                dependents.emplace_back(dependent);
         }
 
         for (unsigned k = 0; k < dependents.size(); ++k)
@@ -437,6 +472,15 @@ void ResourceCache::ReloadResourceWithDependencies(const QString& fileName)
 void ResourceCache::SetMemoryBudget(StringHash type, uint64_t budget)
 {
     resourceGroups_[type].memoryBudget_ = budget;
+    UpdateResourceGroup(type);
+}
+/// Set memory budget for all resources together, default 0 is unlimited. When exceeded, the least recently used
+/// unreferenced resources of any type are released.
+void ResourceCache::SetTotalMemoryBudget(uint64_t budget)
+{
+    totalMemoryBudget_ = budget;
+    if (totalMemoryBudget_ && GetTotalMemoryUse() > totalMemoryBudget_)
+        EvictResources(nullptr, totalMemoryBudget_);
 }
 /// Enable or disable automatic reloading of resources as files are modified. Default false.
 void ResourceCache::SetAutoReloadResources(bool enable)
@@ -496,38 +540,38 @@ void ResourceCache::RemoveResourceRouter(ResourceRouter* router)
 ///
 std::unique_ptr<File> ResourceCache::GetFile(const QString& nameIn, bool sendEventOnFailure)
 {
-    MutexLock lock(resourceMutex_);
-
-    QString name = SanitateResourceName(nameIn);
-    if (!isRouting_)
-    {
-        isRouting_ = true;
-        for (unsigned i = 0; i < resourceRouters_.size(); ++i)
-            resourceRouters_[i]->Route(name, RESOURCE_GETFILE);
-        isRouting_ = false;
-    }
-
-    if (name.length())
+    QString name;
+    std::unique_ptr<File> file;
     {
-        File* file;
+        MutexLock lock(resourceMutex_);
 
-        if (searchPackagesFirst_)
+        name = SanitateResourceName(nameIn);
+        if (!isRouting_)
         {
-            file = SearchPackages(name);
-            if (!file)
-                file = SearchResourceDirs(name);
+            isRouting_ = true;
+            for (unsigned i = 0; i < resourceRouters_.size(); ++i)
+                resourceRouters_[i]->Route(name, RESOURCE_GETFILE);
+            isRouting_ = false;
         }
-        else
+
+        // Package entries are opened under the lock, so that the package can not be removed meanwhile
+        if (name.length() && searchPackagesFirst_)
+            file.reset(SearchPackages(name));
+    }
+
+    if (name.length() && !file)
+    {
+        file.reset(SearchResourceDirs(name));
+        if (!file && !searchPackagesFirst_)
         {
-            file = SearchResourceDirs(name);
-            if (!file)
-                file = SearchPackages(name);
+            MutexLock lock(resourceMutex_);
+            file.reset(SearchPackages(name));
         }
-
-        if (file)
-            return std::unique_ptr<File>(file);
     }
 
+    if (file)
+        return file;
+
     if (sendEventOnFailure)
     {
         if (!resourceRouters_.empty() && name.isEmpty() && !nameIn.isEmpty())
@@ -544,24 +588,23 @@ std::unique_ptr<File> ResourceCache::GetFile(const QString& nameIn, bool sendEve
     return nullptr;
 }
 /// Return an already loaded resource of specific type & name, or null if not found. Will not load if does not exist.
-Resource* ResourceCache::GetExistingResource(StringHash type, const QString& nameIn)
+/// Can be called from any thread. The returned reference keeps the resource alive, but outside the main thread it should
+/// be dropped before the main thread could release the resource, so that the resource is not destroyed off the main thread.
+SharedPtr<Resource> ResourceCache::GetExistingResource(StringHash type, const QString& nameIn)
 {
     QString name = SanitateResourceName(nameIn);
 
-    if (!Thread::IsMainThread())
-    {
-        URHO3D_LOGERROR("Attempted to get resource " + name + " from outside the main thread");
-        return nullptr;
-    }
-
     // If empty name, return null pointer immediately
     if (name.isEmpty())
-        return nullptr;
+        return SharedPtr<Resource>();
 
+    // Lookup only: this neither loads nor counts as a use of the resource, which is left to GetResource(). The reference
+    // is taken under the shard lock, as the main thread removes the resource from the index before releasing it
     StringHash nameHash(name);
-
-    const SharedPtr<Resource>& existing = FindResource(type, nameHash);
-    return existing;
+    ResourceLookupShard& shard = lookupShards_[nameHash.Value() & (NUM_RESOURCE_LOOKUP_SHARDS - 1)];
+    MutexLock lock(shard.mutex_);
+    auto i = shard.resources_.find(ResourceLookupKey(type, nameHash));
+    return SharedPtr<Resource>(i != shard.resources_.end() ? MAP_VALUE(i) : nullptr);
 }
 ///
 /// \brief Return a resource by type and name. Load if not loaded yet.
@@ -586,14 +629,46 @@ Resource* ResourceCache::GetResource(StringHash type, const QString& nameIn, boo
     if (name.isEmpty())
         return nullptr;
 
+    if (recordingManifest_)
+        RecordResourceRequest(type, name);
+
     StringHash nameHash(name);
+    const bool prefetched = !prefetchedKeys_.isEmpty() && prefetchedKeys_.remove(ResourceLookupKey(type, nameHash));
+    HiresTimer hitchTimer;
 
     // Check if the resource is being background loaded but is now needed immediately
-    backgroundLoader_->WaitForResource(type, nameHash);
+    bool waited = backgroundLoader_->WaitForResource(type, nameHash);
+    if (waited)
+    {
+        ResourceGroup& group = resourceGroups_[type];
+        ++group.hitches_;
+        group.hitchTime_ += hitchTimer.GetUSec(false);
+    }
 
-    const SharedPtr<Resource>& existing = FindResource(type, nameHash);
+    Resource* existing = FindResource(type, nameHash);
     if (existing)
+    {
+        existing->ResetUseTimer();
+        ResourceGroup& group = resourceGroups_[type];
+        ++group.hits_;
+        // A prefetch that had to be waited for was too late and counts as a hitch only
+        if (prefetched && !waited)
+            ++group.prefetchHits_;
         return existing;
+    }
+    ResourceGroup& missGroup = resourceGroups_[type];
+    ++missGroup.misses_;
+    ++missGroup.hitches_;
+
+    // A resource released to stay within the memory budget is needed again. Reload it through the background loader, so
+    // that the resources it depends on are loaded by the loader threads meanwhile instead of one after another
+    if (missGroup.evicted_.find(nameHash) != missGroup.evicted_.end() &&
+        backgroundLoader_->QueueResource(type, name, sendEventOnFailure, nullptr, LOAD_PRIORITY_VISIBLE))
+    {
+        backgroundLoader_->WaitForResource(type, nameHash);
+        resourceGroups_[type].hitchTime_ += hitchTimer.GetUSec(false);
+        return FindResource(type, nameHash);
+    }
 
     // Make sure the pointer is non-null and is a Resource subclass
     SharedPtr<Resource> resource = DynamicCast<Resource>(m_context->CreateObject(type));
@@ -631,7 +706,11 @@ Resource* ResourceCache::GetResource(StringHash type, const QString& nameIn, boo
 
     // Store to cache
     resource->ResetUseTimer();
-    resourceGroups_[type].resources_[nameHash] = resource;
+    ResourceGroup& group = resourceGroups_[type];
+    group.resources_[nameHash] = resource;
+    group.evicted_.erase(nameHash);
+    group.hitchTime_ += hitchTimer.GetUSec(false);
+    IndexResource(type, nameHash, resource);
     UpdateResourceGroup(type);
 
     return resource;
@@ -644,21 +723,26 @@ Resource* ResourceCache::GetResource(StringHash type, const QString& nameIn, boo
 /// \param nameIn
 /// \param sendEventOnFailure
 /// \param caller
+/// \param priority resources with higher priority are loaded first, see ResourceLoadPriority
 /// \return
 ///
-bool ResourceCache::BackgroundLoadResource(StringHash type, const QString& nameIn, bool sendEventOnFailure, Resource* caller)
+bool ResourceCache::BackgroundLoadResource(StringHash type, const QString& nameIn, bool sendEventOnFailure, Resource* caller,
+                                           unsigned priority)
 {
     // If empty name, fail immediately
     QString name = SanitateResourceName(nameIn);
     if (name.isEmpty())
         return false;
 
+    if (recordingManifest_)
+        RecordResourceRequest(type, name);
+
     // First check if already exists as a loaded resource
     StringHash nameHash(name);
-    if (FindResource(type, nameHash) != noResource)
+    if (FindResource(type, nameHash))
         return false;
 
-    return backgroundLoader_->QueueResource(type, name, sendEventOnFailure, caller);
+    return backgroundLoader_->QueueResource(type, name, sendEventOnFailure, caller, priority);
 }
 ///
 /// \brief Load a resource without storing it in the resource cache.
@@ -716,6 +800,26 @@ unsigned ResourceCache::GetNumBackgroundLoadResources() const
 {
     return backgroundLoader_->GetNumQueuedResources();
 }
+/// Return number of background loader threads decoding resources.
+unsigned ResourceCache::GetNumBackgroundLoadThreads() const
+{
+    return backgroundLoader_->GetNumThreads();
+}
+/// Return number of background loader threads reading resource files.
+unsigned ResourceCache::GetNumBackgroundReadThreads() const
+{
+    return backgroundLoader_->GetNumReadThreads();
+}
+/// Set number of background loader threads decoding resources. Takes effect before the first background load request.
+void ResourceCache::SetNumBackgroundLoadThreads(unsigned num)
+{
+    backgroundLoader_->SetNumThreads(num);
+}
+/// Set number of background loader threads reading resource files. Takes effect before the first background load request.
+void ResourceCache::SetNumBackgroundReadThreads(unsigned num)
+{
+    backgroundLoader_->SetNumReadThreads(num);
+}
 /// Return all loaded resources of a specific type.
 void ResourceCache::GetResources(std::vector<Resource*>& result, StringHash type) const
 {
@@ -751,15 +855,11 @@ bool ResourceCache::Exists(const QString& nameIn) const
             return true;
     }
 
-    FileSystem* fileSystem = m_context->m_FileSystem.get();
-    for (unsigned i = 0; i < resourceDirs_.size(); ++i)
-    {
-        if (fileSystem->FileExists(resourceDirs_[i] + name))
-            return true;
-    }
+    if (!FindResourceFileDir(name).isEmpty())
+        return true;
 
     // Fallback using absolute path
-    return fileSystem->FileExists(name);
+    return m_context->m_FileSystem->FileExists(name);
 }
 /// Return memory budget for a resource type.
 uint64_t ResourceCache::GetMemoryBudget(StringHash type) const
@@ -784,15 +884,13 @@ uint64_t ResourceCache::GetTotalMemoryUse() const
 /// Return full absolute file name of resource if possible, or empty if not found.
 QString ResourceCache::GetResourceFileName(const QString& name) const
 {
+    MutexLock lock(resourceMutex_);
 
-    FileSystem* fileSystem = m_context->m_FileSystem.get();
-    for (unsigned i = 0; i < resourceDirs_.size(); ++i)
-    {
-        if (fileSystem->FileExists(resourceDirs_[i] + name))
-            return resourceDirs_[i] + name;
-    }
+    QString dir = FindResourceFileDir(name);
+    if (!dir.isEmpty())
+        return dir + name;
 
-    if (IsAbsolutePath(name) && fileSystem->FileExists(name))
+    if (IsAbsolutePath(name) && m_context->m_FileSystem->FileExists(name))
         return name;
     else
     return QString();
@@ -841,6 +939,10 @@ QString ResourceCache::GetPreferredResourceDir(const QString& path) const
 
 QString ResourceCache::SanitateResourceName(const QString& nameIn) const
 {
+    // Most names are already in canonical form; return them as is without allocating
+    if (IsSanitatedResourceName(nameIn))
+        return nameIn;
+
     // Sanitate unsupported constructs from the resource name
     QString name = GetInternalPath(nameIn);
     name.replace("../", "");
@@ -916,10 +1018,16 @@ void ResourceCache::ResetDependencies(Resource* resource)
 
 QString ResourceCache::PrintMemoryUsage() const
 {
-    QString output = "Resource Type                 Cnt       Avg       Max    Budget     Total\n\n";
+    QString output = "Resource Type                 Cnt       Avg       Max    Budget     Total      Hits    Misses   Evicted  Hitches  HitchMs Prefetch\n\n";
     char outputLine[256];
 
     unsigned totalResourceCt = 0;
+    unsigned totalHits = 0;
+    unsigned totalMisses = 0;
+    unsigned totalEvictions = 0;
+    unsigned totalHitches = 0;
+    uint64_t totalHitchTime = 0;
+    unsigned totalPrefetchHits = 0;
     uint64_t totalLargest = 0;
     uint64_t totalAverage = 0;
     uint64_t totalUse = GetTotalMemoryUse();
@@ -942,6 +1050,12 @@ QString ResourceCache::PrintMemoryUsage() const
         }
 
         totalResourceCt += resourceCt;
+        totalHits += ELEMENT_VALUE(entry).hits_;
+        totalMisses += ELEMENT_VALUE(entry).misses_;
+        totalEvictions += ELEMENT_VALUE(entry).evictions_;
+        totalHitches += ELEMENT_VALUE(entry).hitches_;
+        totalHitchTime += ELEMENT_VALUE(entry).hitchTime_;
+        totalPrefetchHits += ELEMENT_VALUE(entry).prefetchHits_;
 
         const QString countString = QString::number(ELEMENT_VALUE(entry).resources_.size());
         const QString memUseString = GetFileSizeString(average);
@@ -952,10 +1066,13 @@ QString ResourceCache::PrintMemoryUsage() const
 
         memset(outputLine, ' ', 256);
         outputLine[255] = 0;
-        sprintf(outputLine, "%-28s %4s %9s %9s %9s %9s\n", qPrintable(resTypeName), qPrintable(countString),
+        sprintf(outputLine, "%-28s %4s %9s %9s %9s %9s %9u %9u %9u %9u %9u %9u\n", qPrintable(resTypeName), qPrintable(countString),
                 qPrintable(memUseString),
                 qPrintable(memMaxString),
-                qPrintable(memBudgetString), qPrintable(memTotalString));
+                qPrintable(memBudgetString), qPrintable(memTotalString),
+                ELEMENT_VALUE(entry).hits_, ELEMENT_VALUE(entry).misses_, ELEMENT_VALUE(entry).evictions_,
+                ELEMENT_VALUE(entry).hitches_, unsigned(ELEMENT_VALUE(entry).hitchTime_ / 1000),
+                ELEMENT_VALUE(entry).prefetchHits_);
 
         output += outputLine;
     }
@@ -970,8 +1087,10 @@ QString ResourceCache::PrintMemoryUsage() const
 
     memset(outputLine, ' ', 256);
     outputLine[255] = 0;
-    sprintf(outputLine, "%-28s %4s %9s %9s %9s %9s\n", "All", qPrintable(countString), qPrintable(memUseString),
-            qPrintable(memMaxString), "-", qPrintable(memTotalString));
+    const QString memBudgetString = totalMemoryBudget_ ? GetFileSizeString(totalMemoryBudget_) : QString("-");
+    sprintf(outputLine, "%-28s %4s %9s %9s %9s %9s %9u %9u %9u %9u %9u %9u\n", "All", qPrintable(countString), qPrintable(memUseString),
+            qPrintable(memMaxString), qPrintable(memBudgetString), qPrintable(memTotalString), totalHits, totalMisses,
+            totalEvictions, totalHitches, unsigned(totalHitchTime / 1000), totalPrefetchHits);
     output += outputLine;
 
     return output;
@@ -981,34 +1100,68 @@ const QString &ResourceCache::GetResourceDir(unsigned index) const
 {
     return index < resourceDirs_.size() ? resourceDirs_[index] : s_dummy;
 }
-/// Find a resource.
-const SharedPtr<Resource>& ResourceCache::FindResource(StringHash type, StringHash nameHash)
+/// Find a resource. Can be called from any thread; only the shard holding the name is locked.
+Resource* ResourceCache::FindResource(StringHash type, StringHash nameHash) const
 {
-    MutexLock lock(resourceMutex_);
+    ResourceLookupShard& shard = lookupShards_[nameHash.Value() & (NUM_RESOURCE_LOOKUP_SHARDS - 1)];
+    MutexLock lock(shard.mutex_);
 
-    HashMap<StringHash, ResourceGroup>::iterator i = resourceGroups_.find(type);
-    if (i == resourceGroups_.end())
-        return noResource;
-    const ResourceGroup &grp(MAP_VALUE(i));
-    auto j = grp.resources_.find(nameHash);
-    if (j == grp.resources_.end())
-        return noResource;
-
-    return MAP_VALUE(j);
+    auto i = shard.resources_.find(ResourceLookupKey(type, nameHash));
+    return i != shard.resources_.end() ? MAP_VALUE(i) : nullptr;
 }
-/// Find a resource by name only. Searches all type groups.
-const SharedPtr<Resource>& ResourceCache::FindResource(StringHash nameHash)
+/// Find a resource by name only. Searches all type groups. Can be called only from the main thread.
+Resource* ResourceCache::FindResource(StringHash nameHash) const
 {
-    MutexLock lock(resourceMutex_);
-
-    for (auto & elem : resourceGroups_)
+    for (const auto & elem : resourceGroups_)
     {
-        HashMap<StringHash, SharedPtr<Resource> >::iterator j = ELEMENT_VALUE(elem).resources_.find(nameHash);
+        auto j = ELEMENT_VALUE(elem).resources_.find(nameHash);
         if (j != ELEMENT_VALUE(elem).resources_.end())
             return MAP_VALUE(j);
     }
 
-    return noResource;
+    return nullptr;
+}
+/// Add a resource stored to a resource group to the lookup index.
+void ResourceCache::IndexResource(StringHash type, StringHash nameHash, Resource* resource)
+{
+    ResourceLookupShard& shard = lookupShards_[nameHash.Value() & (NUM_RESOURCE_LOOKUP_SHARDS - 1)];
+    MutexLock lock(shard.mutex_);
+    shard.resources_[ResourceLookupKey(type, nameHash)] = resource;
+}
+/// Remove a resource from the lookup index. Must be called before the resource group releases it.
+void ResourceCache::UnindexResource(StringHash type, StringHash nameHash)
+{
+    ResourceLookupShard& shard = lookupShards_[nameHash.Value() & (NUM_RESOURCE_LOOKUP_SHARDS - 1)];
+    MutexLock lock(shard.mutex_);
+    shard.resources_.erase(ResourceLookupKey(type, nameHash));
+}
+/// Return whether a resource name is already in the form SanitateResourceName would produce. Does not allocate.
+bool ResourceCache::IsSanitatedResourceName(const QString& name) const
+{
+    if (name.isEmpty())
+        return true;
+    if (name.at(0).isSpace() || name.at(name.length() - 1).isSpace())
+        return false;
+    if (name.contains('\\') || name.contains(QLatin1String("./")))
+        return false;
+    for (const QString& prefix : resourceNamePrefixes_)
+    {
+        if (name.startsWith(prefix, Qt::CaseInsensitive))
+            return false;
+    }
+    return true;
+}
+/// Recalculate the paths resource names are normalized against after the resource directories changed.
+void ResourceCache::UpdateResourceNamePrefixes()
+{
+    resourceNamePrefixes_.clear();
+    QString exePath = m_context->m_FileSystem->GetProgramDir();
+    for (const QString& dir : resourceDirs_)
+    {
+        resourceNamePrefixes_.push_back(dir);
+        if (dir.startsWith(exePath) && dir.length() > exePath.length())
+            resourceNamePrefixes_.push_back(dir.mid(exePath.length()));
+    }
 }
 /// Release resources loaded from a package file.
 void ResourceCache::ReleasePackageResources(PackageFile* package, bool force)
@@ -1028,6 +1181,7 @@ void ResourceCache::ReleasePackageResources(PackageFile* package, bool force)
                 // If other references exist, do not release, unless forced
                 if ((MAP_VALUE(k).Refs() == 1 && MAP_VALUE(k).WeakRefs() == 0) || force)
                 {
+                    UnindexResource(MAP_KEY(iter), MAP_KEY(k));
                     elem.resources_.erase(k);
                     affectedGroups.insert(MAP_KEY(iter));
                 }
@@ -1045,37 +1199,67 @@ void ResourceCache::UpdateResourceGroup(StringHash type)
     HashMap<StringHash, ResourceGroup>::iterator i = resourceGroups_.find(type);
     if (i == resourceGroups_.end())
         return;
-    HashMap<StringHash, SharedPtr<Resource> > &resources(MAP_VALUE(i).resources_);
-    for (;;)
-    {
-        unsigned totalSize = 0;
-        unsigned oldestTimer = 0;
-        HashMap<StringHash, SharedPtr<Resource> >::iterator oldestResource = resources.end();
+    ResourceGroup& group = MAP_VALUE(i);
+
+    uint64_t totalSize = 0;
+    for (const auto& elem : group.resources_)
+        totalSize += ELEMENT_VALUE(elem)->GetMemoryUse();
+    group.memoryUse_ = totalSize;
 
-        for (HashMap<StringHash, SharedPtr<Resource> >::iterator j = resources.begin(); j != resources.end(); ++j)
+    if (group.memoryBudget_ && group.memoryUse_ > group.memoryBudget_)
+        EvictResources(&group, group.memoryBudget_);
+    if (totalMemoryBudget_ && GetTotalMemoryUse() > totalMemoryBudget_)
+        EvictResources(nullptr, totalMemoryBudget_);
+}
+/// Release least recently used resources of a group, or of all groups if null, until their memory use is within the budget.
+/// Resources in use elsewhere are never released.
+void ResourceCache::EvictResources(ResourceGroup* group, uint64_t budget)
+{
+    struct Candidate
+    {
+        unsigned useTimer_;
+        ResourceGroup* group_;
+        StringHash nameHash_;
+    };
+    std::vector<Candidate> candidates;
+    uint64_t memoryUse = 0;
+
+    for (auto& groupElem : resourceGroups_)
+    {
+        ResourceGroup& candidateGroup = ELEMENT_VALUE(groupElem);
+        if (group && group != &candidateGroup)
+            continue;
+        memoryUse += candidateGroup.memoryUse_;
+        // Resources in use always return a zero timer and can not be removed
+        for (auto& elem : candidateGroup.resources_)
         {
-            totalSize += MAP_VALUE(j)->GetMemoryUse();
-            unsigned useTimer = MAP_VALUE(j)->GetUseTimer();
-            if (useTimer > oldestTimer)
-            {
-                oldestTimer = useTimer;
-                oldestResource = j;
-            }
+            unsigned useTimer = ELEMENT_VALUE(elem)->GetUseTimer();
+            if (useTimer)
+                candidates.push_back(Candidate{useTimer, &candidateGroup, ELEMENT_KEY(elem)});
         }
+    }
 
-        MAP_VALUE(i).memoryUse_ = totalSize;
+    // Oldest first
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.useTimer_ > rhs.useTimer_;
+    });
 
-        // If memory budget defined and is exceeded, remove the oldest resource and loop again
-        // (resources in use always return a zero timer and can not be removed)
-        if (MAP_VALUE(i).memoryBudget_ && MAP_VALUE(i).memoryUse_ > MAP_VALUE(i).memoryBudget_ &&
-                oldestResource != resources.end())
-        {
-            URHO3D_LOGDEBUG("Resource group " + MAP_VALUE(oldestResource)->GetTypeName() +
-                     " over memory budget, releasing resource " + MAP_VALUE(oldestResource)->GetName());
-            resources.erase(oldestResource);
-        }
-        else
+    for (const Candidate& candidate : candidates)
+    {
+        if (memoryUse <= budget)
             break;
+
+        auto j = candidate.group_->resources_.find(candidate.nameHash_);
+        Resource* resource = MAP_VALUE(j);
+        URHO3D_LOGDEBUG((group ? "Resource group " + resource->GetTypeName() : QString("Resource cache")) +
+                 " over memory budget, releasing resource " + resource->GetName());
+        unsigned resourceUse = resource->GetMemoryUse();
+        memoryUse -= resourceUse;
+        candidate.group_->memoryUse_ -= resourceUse;
+        ++candidate.group_->evictions_;
+        candidate.group_->evicted_.insert(candidate.nameHash_);
+        UnindexResource(resource->GetType(), candidate.nameHash_);
+        candidate.group_->resources_.erase(j);
     }
 }
 /// Handle begin frame event. Automatic resource reloads and the finalization of background loaded resources are processed here.
@@ -1092,6 +1276,10 @@ void ResourceCache::HandleBeginFrame(unsigned FrameNumber,float timeStep)
                 ignoreResourceAutoReload_.erase(it);
                 continue;
             }
+            {
+                MutexLock lock(resourceMutex_);
+                ReindexResourceFile(fileName);
+            }
             ReloadResourceWithDependencies(fileName);
 
             // Finally send a general file changed event even if the file was not a tracked resource
@@ -1105,28 +1293,88 @@ void ResourceCache::HandleBeginFrame(unsigned FrameNumber,float timeStep)
         backgroundLoader_->FinishResources(finishBackgroundResourcesMs_);
     }
 }
-/// Search FileSystem for file.
+/// Search FileSystem for file. Only the file index lookup holds the resource mutex, the file is opened without it so
+/// that the background read threads do not wait on each other.
 File* ResourceCache::SearchResourceDirs(const QString& nameIn)
 {
-    FileSystem* fileSystem = m_context->m_FileSystem.get();
-    for (unsigned i = 0; i < resourceDirs_.size(); ++i)
+    QString dir;
     {
-        if (fileSystem->FileExists(resourceDirs_[i] + nameIn))
+        MutexLock lock(resourceMutex_);
+        dir = FindResourceFileDir(nameIn);
+    }
+    if (!dir.isEmpty())
+    {
+        // Construct the file first with full path, then rename it to not contain the resource path,
+        // so that the file's name can be used in further GetFile() calls (for example over the network)
+        std::unique_ptr<File> file(new File(m_context, dir + nameIn));
+        // The file may have been removed since it was indexed, without a file watcher noticing
+        if (!file->IsOpen())
+        {
+            {
+                MutexLock lock(resourceMutex_);
+                dir = ReindexResourceFile(nameIn);
+            }
+            if (!dir.isEmpty())
+                file.reset(new File(m_context, dir + nameIn));
+        }
+        if (file->IsOpen())
         {
-            // Construct the file first with full path, then rename it to not contain the resource path,
-            // so that the file's name can be used in further GetFile() calls (for example over the network)
-            File* file(new File(m_context, resourceDirs_[i] + nameIn));
             file->SetName(nameIn);
-            return file;
+            return file.release();
         }
     }
 
     // Fallback using absolute path
-    if (fileSystem->FileExists(nameIn))
+    if (m_context->m_FileSystem->FileExists(nameIn))
         return new File(m_context, nameIn);
 
     return nullptr;
 }
+/// Add the files of a resource directory to the file index. Files also in a higher priority directory are left as is.
+void ResourceCache::IndexResourceDir(const QString& dir)
+{
+    URHO3D_PROFILE(IndexResourceDir);
+
+    QStringList files;
+    m_context->m_FileSystem->ScanDir(files, dir, "*", SCAN_FILES, true);
+    int priority = resourceDirs_.indexOf(dir);
+    for (const QString& name : files)
+    {
+        QString& indexedDir = resourceFileIndex_[name];
+        if (indexedDir.isEmpty() || resourceDirs_.indexOf(indexedDir) > priority)
+            indexedDir = dir;
+    }
+}
+/// Return the resource directory containing a file, or empty if none. The directories are probed only for files neither
+/// indexed nor already known to be missing. Must be called with the resource mutex held.
+QString ResourceCache::FindResourceFileDir(const QString& name) const
+{
+    auto i = resourceFileIndex_.find(name);
+    if (i != resourceFileIndex_.end())
+        return MAP_VALUE(i);
+    if (missingResourceFiles_.find(name) != missingResourceFiles_.end())
+        return QString();
+    return ReindexResourceFile(name);
+}
+/// Probe the resource directories for a file missing from the file index or changed since indexing, and update its
+/// index entry. Return the directory containing the file, or empty if none.
+QString ResourceCache::ReindexResourceFile(const QString& name) const
+{
+    FileSystem* fileSystem = m_context->m_FileSystem.get();
+    for (unsigned i = 0; i < resourceDirs_.size(); ++i)
+    {
+        if (fileSystem->FileExists(resourceDirs_[i] + name))
+        {
+            resourceFileIndex_[name] = resourceDirs_[i];
+            missingResourceFiles_.erase(name);
+            return resourceDirs_[i];
+        }
+    }
+
+    resourceFileIndex_.erase(name);
+    missingResourceFiles_.insert(name);
+    return QString();
+}
 /// Search resource packages for file.
 File* ResourceCache::SearchPackages(const QString& nameIn)
 {
@@ -1246,6 +1494,12 @@ bool ResourceCache::RenameResource(QString source, QString destination)
         return false;
     }
 
+    // The renamed files may have been looked up before under their new names
+    {
+        MutexLock lock(resourceMutex_);
+        missingResourceFiles_.clear();
+    }
+
     // Update loaded resource information
     for (auto& groupPair : resourceGroups_)
     {
@@ -1262,9 +1516,11 @@ bool ResourceCache::RenameResource(QString source, QString destination)
                     ignoreResourceAutoReload_.emplace_back(resourceName);
                 }
 
+                UnindexResource(groupPair.first, resource->GetNameHash());
                 groupPair.second.resources_.erase(resource->GetNameHash());
                 resource->SetName(destinationName);
                 groupPair.second.resources_[resource->GetNameHash()] = resource;
+                IndexResource(groupPair.first, resource->GetNameHash(), resource);
                 movedAny = true;
                 g_resourceSignals.resourceRenamed(resourceName,destinationName);
             }
@@ -1285,5 +1541,121 @@ void ResourceCache::IgnoreResourceReload(const Resource* resource)
 {
     IgnoreResourceReload(resource->GetName());
 }
+/// Start recording the resources requested, in request order, for a resource manifest. Discards a previous recording.
+/// With a file name the recording is saved automatically when the cache is destroyed, unless saved or stopped before.
+/// Without one, a scene loaded from a file during the recording saves it next to the scene file when unloaded.
+void ResourceCache::StartManifestRecording(const QString& fileName)
+{
+    MutexLock lock(manifestMutex_);
+    manifest_.clear();
+    manifestKeys_.clear();
+    manifestFileName_ = fileName;
+    recordingManifest_ = true;
+}
+/// Stop recording the requested resources and discard the recording.
+void ResourceCache::StopManifestRecording()
+{
+    MutexLock lock(manifestMutex_);
+    recordingManifest_ = false;
+    manifest_.clear();
+    manifestKeys_.clear();
+    manifestFileName_.clear();
+}
+/// Stop recording the requested resources and save them as a manifest file, typically next to the scene that requested
+/// them, see GetResourceManifestName(). Return true on success.
+bool ResourceCache::SaveResourceManifest(const QString& fileName)
+{
+    SharedPtr<XMLFile> manifest(new XMLFile(m_context));
+    XMLElement root = manifest->CreateRoot("manifest");
+    {
+        MutexLock lock(manifestMutex_);
+        recordingManifest_ = false;
+        for (const std::pair<StringHash, QString>& request : manifest_)
+        {
+            const QString& typeName = m_context->GetTypeName(request.first);
+            if (typeName.isEmpty())
+                continue;
+            XMLElement resourceElem = root.CreateChild("resource");
+            resourceElem.SetAttribute("type", typeName);
+            resourceElem.SetAttribute("name", request.second);
+        }
+        URHO3D_LOGINFO(QString("Saving manifest of %1 resources to %2").arg(manifest_.size()).arg(fileName));
+        manifest_.clear();
+        manifestKeys_.clear();
+        manifestFileName_.clear();
+    }
+
+    return manifest->SaveFile(fileName);
+}
+/// Queue background loading of the resources listed in a manifest, in the recorded order, so that they are likely
+/// loaded by the time they are requested. Return the number of resources queued; a missing manifest is not an error.
+unsigned ResourceCache::PrefetchResourceManifest(const QString& manifestName)
+{
+    if (!Exists(manifestName))
+        return 0;
+
+    URHO3D_PROFILE(PrefetchResourceManifest);
+
+    SharedPtr<XMLFile> manifest(new XMLFile(m_context));
+    std::unique_ptr<File> file = GetFile(manifestName);
+    if (!file || !manifest->Load(*file))
+        return 0;
+
+    unsigned numQueued = 0;
+    for (XMLElement resourceElem = manifest->GetRoot().GetChild("resource"); resourceElem;
+         resourceElem = resourceElem.GetNext("resource"))
+    {
+        StringHash type(resourceElem.GetAttribute("type"));
+        QString name = SanitateResourceName(resourceElem.GetAttribute("name"));
+        if (name.isEmpty() || FindResource(type, StringHash(name)))
+            continue;
+        // Queue directly instead of through BackgroundLoadResource, so that an active recording only sees the
+        // resources actually requested
+        if (backgroundLoader_->QueueResource(type, name, false, nullptr, LOAD_PRIORITY_PREFETCH))
+        {
+            prefetchedKeys_.insert(ResourceLookupKey(type, StringHash(name)));
+            ++numQueued;
+        }
+    }
+
+    URHO3D_LOGDEBUG(QString("Prefetching %1 resources from manifest %2").arg(numQueued).arg(manifestName));
+    return numQueued;
+}
+/// Return the number of requests that stalled the main thread loading or waiting for the resource.
+unsigned ResourceCache::GetNumHitches() const
+{
+    unsigned hitches = 0;
+    for (const auto& elem : resourceGroups_)
+        hitches += ELEMENT_VALUE(elem).hitches_;
+    return hitches;
+}
+/// Return the main thread time in microseconds stalled by requests loading or waiting for the resource.
+uint64_t ResourceCache::GetHitchTime() const
+{
+    uint64_t hitchTime = 0;
+    for (const auto& elem : resourceGroups_)
+        hitchTime += ELEMENT_VALUE(elem).hitchTime_;
+    return hitchTime;
+}
+/// Return the number of requests served without stalling by a resource prefetched in the background from a manifest.
+unsigned ResourceCache::GetNumPrefetchHits() const
+{
+    unsigned prefetchHits = 0;
+    for (const auto& elem : resourceGroups_)
+        prefetchHits += ELEMENT_VALUE(elem).prefetchHits_;
+    return prefetchHits;
+}
+/// Record a resource request for the manifest, unless already recorded.
+void ResourceCache::RecordResourceRequest(StringHash type, const QString& name)
+{
+    MutexLock lock(manifestMutex_);
+    if (!recordingManifest_)
+        return;
+    uint64_t key = ResourceLookupKey(type, StringHash(name));
+    if (manifestKeys_.contains(key))
+        return;
+    manifestKeys_.insert(key);
+    manifest_.emplace_back(type, name);
+}
 
 }
@@ -49,6 +49,34 @@ struct ResourceGroup
     uint64_t memoryBudget_ = 0;                          ///< Memory budget.
     uint64_t memoryUse_    = 0;                          ///< Current memory use.
     HashMap<StringHash, SharedPtr<Resource>> resources_; ///< Resources.
+    HashSet<StringHash> evicted_;                        ///< Resources released to stay within memory budgets.
+    unsigned hits_         = 0;                          ///< Requests served from the cache.
+    unsigned misses_       = 0;                          ///< Requests that had to load the resource.
+    unsigned evictions_    = 0;                          ///< Resources released to stay within memory budgets.
+    unsigned hitches_      = 0;                          ///< Requests that stalled the main thread loading or waiting for the resource.
+    uint64_t hitchTime_    = 0;                          ///< Main thread time stalled by the hitches, in microseconds.
+    unsigned prefetchHits_ = 0;                          ///< Requests served by a resource a manifest prefetch had loaded in the background.
+};
+
+/// Number of lookup shards. Must be a power of two.
+static const unsigned NUM_RESOURCE_LOOKUP_SHARDS = 16;
+
+/// Part of the resource lookup index, guarded by its own lock so that lookups from several threads rarely contend.
+struct ResourceLookupShard
+{
+    Mutex mutex_;                            ///< Mutex for the lookup map.
+    HashMap<uint64_t, Resource*> resources_; ///< Resources by combined type and name hash. Owned by the resource groups.
+};
+
+/// Background load priorities. Higher priority resources are loaded first; other values in between may also be used.
+enum ResourceLoadPriority : unsigned
+{
+    /// Resource that may be needed later, e.g. prefetched ahead of a level change.
+    LOAD_PRIORITY_PREFETCH = 0,
+    /// Default priority.
+    LOAD_PRIORITY_NORMAL = 100,
+    /// Resource needed as soon as possible, e.g. visible now.
+    LOAD_PRIORITY_VISIBLE = 200
 };
 
 /// Resource request types.
@@ -89,8 +117,8 @@ public:
     bool AddManualResource(Resource* resource);
 
     void RemoveResourceDir(const QString& pathName);
-    void RemovePackageFile(PackageFile* package, bool releaseResources = true, bool forceRelease = false);
-    void RemovePackageFile(const QString& fileName, bool releaseResources = true, bool forceRelease = false);
+    bool RemovePackageFile(PackageFile* package, bool releaseResources = true, bool forceRelease = false);
+    bool RemovePackageFile(const QString& fileName, bool releaseResources = true, bool forceRelease = false);
     void ReleaseResource(StringHash type, const QString& name, bool force = false);
     void ReleaseResources(StringHash type, bool force = false);
     void ReleaseResources(StringHash type, const QString& partialName, bool force = false);
@@ -99,6 +127,7 @@ public:
     bool ReloadResource(Resource* resource);
     void ReloadResourceWithDependencies(const QString &fileName);
     void SetMemoryBudget(StringHash type, uint64_t budget);
+    void SetTotalMemoryBudget(uint64_t budget);
     void SetAutoReloadResources(bool enable);
     /// Enable or disable returning resources that failed to load. Default false. This may be useful in editing to not lose resource ref attributes.
     void SetReturnFailedResources(bool enable) { returnFailedResources_ = enable; }
@@ -106,15 +135,20 @@ public:
     void SetSearchPackagesFirst(bool value) { searchPackagesFirst_ = value; }
     /// Set how many milliseconds maximum per frame to spend on finishing background loaded resources.
     void SetFinishBackgroundResourcesMs(int ms) { finishBackgroundResourcesMs_ = std::max(ms, 1); }
+    void SetNumBackgroundLoadThreads(unsigned num);
+    void SetNumBackgroundReadThreads(unsigned num);
     void AddResourceRouter(ResourceRouter* router, bool addAsFirst = false);
     void RemoveResourceRouter(ResourceRouter* router);
     std::unique_ptr<Urho3D::File> GetFile(const QString& name, bool sendEventOnFailure = true);
     Resource* GetResource(StringHash type, const QString& name, bool sendEventOnFailure = true);
     SharedPtr<Resource> GetTempResource(StringHash type, const QString& name, bool sendEventOnFailure = true);
-    bool BackgroundLoadResource(StringHash type, const QString& name, bool sendEventOnFailure = true, Resource* caller = nullptr);
+    bool BackgroundLoadResource(StringHash type, const QString& name, bool sendEventOnFailure = true, Resource* caller = nullptr,
+                                unsigned priority = LOAD_PRIORITY_NORMAL);
     unsigned GetNumBackgroundLoadResources() const;
+    unsigned GetNumBackgroundLoadThreads() const;
+    unsigned GetNumBackgroundReadThreads() const;
     void GetResources(std::vector<Resource*>& result, StringHash type) const;
-    Resource* GetExistingResource(StringHash type, const QString& name);
+    SharedPtr<Resource> GetExistingResource(StringHash type, const QString& name);
     /// Return all loaded resources.
     const HashMap<StringHash, ResourceGroup>& GetAllResources() const { return resourceGroups_; }
     /// Return added resource load directories.
@@ -124,17 +158,20 @@ public:
     /// Template version of returning a resource by name.
     template <class T> T* GetResource(const QString& name, bool sendEventOnFailure = true);
     /// Template version of returning an existing resource by name.
-    template <class T> T* GetExistingResource(const QString& name);
+    template <class T> SharedPtr<T> GetExistingResource(const QString& name);
     /// Template version of loading a resource without storing it to the cache.
     template <class T> SharedPtr<T> GetTempResource(const QString& name, bool sendEventOnFailure = true);
     /// Template version of releasing a resource by name.
     template <class T> void ReleaseResource(const QString& name, bool force = false);
     /// Template version of queueing a resource background load.
-    template <class T> bool BackgroundLoadResource(const QString& name, bool sendEventOnFailure = true, Resource* caller = nullptr);
+    template <class T> bool BackgroundLoadResource(const QString& name, bool sendEventOnFailure = true, Resource* caller = nullptr,
+                                                   unsigned priority = LOAD_PRIORITY_NORMAL);
     /// Template version of returning loaded resources of a specific type.
     template <class T> void GetResources(std::vector<T*>& result) const;
     bool Exists(const QString& name) const;
     uint64_t GetMemoryBudget(StringHash type) const;
+    /// Return memory budget for all resources together, 0 if unlimited.
+    uint64_t GetTotalMemoryBudget() const { return totalMemoryBudget_; }
     uint64_t GetMemoryUse(StringHash type) const;
     uint64_t GetTotalMemoryUse() const;
     QString GetResourceFileName(const QString& name) const;
@@ -179,11 +216,36 @@ public:
     void IgnoreResourceReload(const QString& name);
     /// When resource auto-reloading is enabled ignore reloading resource once.
     void IgnoreResourceReload(const Resource* resource);
+
+    void StartManifestRecording(const QString& fileName = QString());
+    void StopManifestRecording();
+    bool SaveResourceManifest(const QString& fileName);
+    unsigned PrefetchResourceManifest(const QString& manifestName);
+    /// Set the file the manifest being recorded is saved to, at the latest when the resource cache is destroyed.
+    void SetManifestFileName(const QString& fileName) { manifestFileName_ = fileName; }
+    /// Return the file the manifest being recorded is saved to, or empty if saved only explicitly.
+    const QString& GetManifestFileName() const { return manifestFileName_; }
+    /// Return whether the requested resources are being recorded for a manifest.
+    bool IsRecordingManifest() const { return recordingManifest_; }
+    unsigned GetNumHitches() const;
+    uint64_t GetHitchTime() const;
+    unsigned GetNumPrefetchHits() const;
+    /// Return the name of the resource manifest belonging to a resource, such as a scene.
+    static QString GetResourceManifestName(const QString& resourceName) { return resourceName + ".manifest"; }
 private:
-    const SharedPtr<Resource>& FindResource(StringHash type, StringHash nameHash);
-    const SharedPtr<Resource>& FindResource(StringHash nameHash);
+    Resource* FindResource(StringHash type, StringHash nameHash) const;
+    Resource* FindResource(StringHash nameHash) const;
+    void IndexResource(StringHash type, StringHash nameHash, Resource* resource);
+    void UnindexResource(StringHash type, StringHash nameHash);
+    bool IsSanitatedResourceName(const QString& name) const;
+    void UpdateResourceNamePrefixes();
+    void IndexResourceDir(const QString& dir);
+    QString FindResourceFileDir(const QString& name) const;
+    QString ReindexResourceFile(const QString& name) const;
+    void RecordResourceRequest(StringHash type, const QString& name);
     void ReleasePackageResources(PackageFile* package, bool force = false);
     void UpdateResourceGroup(StringHash type);
+    void EvictResources(ResourceGroup* group, uint64_t budget);
     void HandleBeginFrame(unsigned FrameNumber, float timeStep);
     File* SearchResourceDirs(const QString& nameIn);
     File* SearchPackages(const QString& nameIn);
@@ -191,10 +253,18 @@ private:
     Context *m_context;
     /// Mutex for thread-safe access to the resource directories, resource packages and resource dependencies.
     mutable Mutex resourceMutex_;
-    /// Resources by type.
+    /// Resources by type. Modified on the main thread only.
     HashMap<StringHash, ResourceGroup> resourceGroups_;
+    /// Lookup index of the resources in resourceGroups_, sharded by name hash. Safe to query from any thread.
+    mutable ResourceLookupShard lookupShards_[NUM_RESOURCE_LOOKUP_SHARDS];
     /// Resource load directories.
     QStringList resourceDirs_;
+    /// Absolute and program directory relative resource directory paths, which resource names are normalized against.
+    QStringList resourceNamePrefixes_;
+    /// Files in the resource directories by resource name, mapped to the highest priority directory containing them.
+    mutable HashMap<QString, QString> resourceFileIndex_;
+    /// Resource names found in none of the resource directories. Cleared when directories are added or files renamed.
+    mutable HashSet<QString> missingResourceFiles_;
     /// File watchers for resource directories, if automatic reloading enabled.
     std::vector<SharedPtr<FileWatcher> > fileWatchers_;
     /// Package files.
@@ -212,13 +282,27 @@ private:
     mutable bool isRouting_; ///< Resource routing flag to prevent endless recursion.
     /// How many milliseconds maximum per frame to spend on finishing background loaded resources.
     int finishBackgroundResourcesMs_;
+    /// Memory budget for all resources together, 0 if unlimited.
+    uint64_t totalMemoryBudget_;
+    /// Mutex for the manifest recording, as resources are also requested by the background loading threads.
+    Mutex manifestMutex_;
+    /// Resources requested since the manifest recording was started, in request order.
+    std::vector<std::pair<StringHash, QString> > manifest_;
+    /// Lookup keys of the recorded resources, to record each resource once.
+    QSet<uint64_t> manifestKeys_;
+    /// File the manifest being recorded is saved to automatically, if any.
+    QString manifestFileName_;
+    /// Lookup keys of the resources queued by manifest prefetches and not requested yet.
+    QSet<uint64_t> prefetchedKeys_;
+    /// Manifest recording flag.
+    volatile bool recordingManifest_;
     /// List of resources that will not be auto-reloaded if reloading event triggers.
     std::vector<QString> ignoreResourceAutoReload_;
 };
 
-template <class T> T* ResourceCache::GetExistingResource(const QString& name)
+template <class T> SharedPtr<T> ResourceCache::GetExistingResource(const QString& name)
 {
-    return static_cast<T*>(GetExistingResource(T::GetTypeStatic(), name));
+    return StaticCast<T>(GetExistingResource(T::GetTypeStatic(), name));
 }
 template <class T> T* ResourceCache::GetResource(const QString& name, bool sendEventOnFailure)
 {
@@ -233,9 +317,10 @@ template <class T> SharedPtr<T> ResourceCache::GetTempResource(const QString& na
     return StaticCast<T>(GetTempResource(T::GetTypeStatic(), name, sendEventOnFailure));
 }
 
-template <class T> bool ResourceCache::BackgroundLoadResource(const QString& name, bool sendEventOnFailure, Resource* caller)
+template <class T> bool ResourceCache::BackgroundLoadResource(const QString& name, bool sendEventOnFailure, Resource* caller,
+                                                              unsigned priority)
 {
-    return BackgroundLoadResource(T::GetTypeStatic(), name, sendEventOnFailure, caller);
+    return BackgroundLoadResource(T::GetTypeStatic(), name, sendEventOnFailure, caller, priority);
 }
 
 template <class T> void ResourceCache::GetResources(std::vector<T*>& result) const
@@ -0,0 +1,390 @@
+#include <QTest>
+#include <QMutex>
+#include <QSemaphore>
+#include <QTemporaryDir>
+#include <QThread>
+#include "../Resource.h"
+#include "../ResourceCache.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/Thread.h"
+#include "Lutefisk3D/IO/Deserializer.h"
+#include "Lutefisk3D/IO/FileSystem.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+QMutex decodeMutex;
+/// Names of the test resources in the order they were decoded.
+QStringList decodeOrder;
+/// Names of the test resources decoded by the main thread.
+QStringList mainThreadDecodes;
+/// Decoding the resource named gatedName waits for the gate.
+QSemaphore decodeGate;
+QString gatedName;
+std::atomic<int> numTestResources(0);
+
+/// Resource that records the order it is decoded in.
+class TestResource : public Urho3D::Resource
+{
+    URHO3D_OBJECT(TestResource, Urho3D::Resource)
+
+public:
+    TestResource(Urho3D::Context* context) : Resource(context) { ++numTestResources; }
+    ~TestResource() override { --numTestResources; }
+
+    bool BeginLoad(Urho3D::Deserializer& source) override
+    {
+        if (GetName() == gatedName)
+            decodeGate.acquire();
+
+        std::vector<unsigned char> data(source.GetSize());
+        if (source.Read(data.data(), data.size()) != data.size())
+            return false;
+        for (unsigned char c : data)
+            checksum_ = Urho3D::SDBMHash(checksum_, c);
+
+        QMutexLocker lock(&decodeMutex);
+        decodeOrder.push_back(GetName());
+        if (Urho3D::Thread::IsMainThread())
+            mainThreadDecodes.push_back(GetName());
+        return true;
+    }
+
+    unsigned checksum_ = 0;
+};
+
+bool WriteFile(const QString& fileName, int size)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && file.write(QByteArray(size, 'x')) == size;
+}
+
+/// Create a resource cache loading from the given directory with one read and one decode thread.
+void CreateCache(Urho3D::Context* context, const QString& dir, unsigned numDecodeThreads = 1)
+{
+    using namespace Urho3D;
+    context->RegisterFactory<TestResource>();
+    context->m_FileSystem.reset(new FileSystem(context));
+    context->m_ResourceCache.reset(new ResourceCache(context));
+    context->m_ResourceCache->AddResourceDir(dir);
+    context->m_ResourceCache->SetNumBackgroundReadThreads(1);
+    context->m_ResourceCache->SetNumBackgroundLoadThreads(numDecodeThreads);
+}
+
+void ResetDecodeLog()
+{
+    QMutexLocker lock(&decodeMutex);
+    decodeOrder.clear();
+    mainThreadDecodes.clear();
+    gatedName.clear();
+}
+
+bool IsDecoded(const QString& name)
+{
+    QMutexLocker lock(&decodeMutex);
+    return decodeOrder.contains(name);
+}
+
+bool IsDecodedOnMainThread(const QString& name)
+{
+    QMutexLocker lock(&decodeMutex);
+    return mainThreadDecodes.contains(name);
+}
+
+/// Router recording the files opened by the read threads.
+class ReadRecorder : public Urho3D::ResourceRouter
+{
+public:
+    ReadRecorder(Urho3D::Context* context) : ResourceRouter(context) {}
+
+    void Route(QString& name, Urho3D::ResourceRequest requestType) override
+    {
+        if (requestType == Urho3D::RESOURCE_GETFILE && !Urho3D::Thread::IsMainThread())
+        {
+            QMutexLocker lock(&decodeMutex);
+            readNames_.push_back(name);
+        }
+    }
+
+    bool IsRead(const QString& name) const
+    {
+        QMutexLocker lock(&decodeMutex);
+        return readNames_.contains(name);
+    }
+
+private:
+    QStringList readNames_;
+};
+
+#ifndef _WIN32
+/// Named pipe that blocks the read thread opening it until released.
+class ReadBlocker
+{
+public:
+    explicit ReadBlocker(const QString& fileName) : fileName_(fileName) { valid_ = mkfifo(qPrintable(fileName), 0600) == 0; }
+    ~ReadBlocker() { Release(); }
+
+    bool IsValid() const { return valid_; }
+
+    /// Let the blocked reader open the pipe and see it empty. Gives up if no reader turns up.
+    void Release()
+    {
+        if (!valid_)
+            return;
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            int fd = open(qPrintable(fileName_), O_WRONLY | O_NONBLOCK);
+            if (fd >= 0)
+            {
+                close(fd);
+                break;
+            }
+            QThread::msleep(10);
+        }
+        unlink(qPrintable(fileName_));
+        valid_ = false;
+    }
+
+private:
+    QString fileName_;
+    bool valid_;
+};
+#endif
+}
+
+class BackgroundLoaderTests : public QObject {
+    Q_OBJECT
+private slots:
+    void init() {
+        ResetDecodeLog();
+    }
+    void verifyPriorityOrder() {
+#ifdef _WIN32
+        QSKIP("Needs a named pipe to hold the read thread");
+#else
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        for (const char* name : { "a.res", "b.res", "c.res" })
+            QVERIFY(WriteFile(dir.path() + "/" + name, 64));
+        ReadBlocker blocker(dir.path() + "/blocker.res");
+        QVERIFY(blocker.IsValid());
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        // Everything is queued while the read thread waits on the pipe
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("blocker.res", false));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("a.res", true, nullptr, 0));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("b.res", true, nullptr, 5));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("c.res", true, nullptr, 10));
+        blocker.Release();
+
+        // Requesting a resource before it is decoded would load it on the main thread, out of order
+        QTRY_VERIFY(IsDecoded("a.res"));
+        for (const char* name : { "a.res", "b.res", "c.res" })
+            QVERIFY(cache->GetResource<TestResource>(name));
+        QMutexLocker lock(&decodeMutex);
+        decodeOrder.removeAll("blocker.res");
+        QCOMPARE(decodeOrder, QStringList({ "c.res", "b.res", "a.res" }));
+        QVERIFY(mainThreadDecodes.isEmpty());
+#endif
+    }
+    void verifyDependencyPriorityRaised() {
+#ifdef _WIN32
+        QSKIP("Needs a named pipe to hold the read thread");
+#else
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        for (const char* name : { "p.res", "q.res", "x.res" })
+            QVERIFY(WriteFile(dir.path() + "/" + name, 64));
+        ReadBlocker blocker(dir.path() + "/blocker.res");
+        QVERIFY(blocker.IsValid());
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        SharedPtr<TestResource> caller(new TestResource(&context));
+        caller->SetName("p.res");
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("blocker.res", false));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("p.res"));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("q.res"));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("x.res", true, caller.Get()));
+        // Requesting p.res sooner also moves x.res, which it depends on, ahead of q.res
+        QVERIFY(!cache->BackgroundLoadResource<TestResource>("p.res", true, nullptr, 10));
+        blocker.Release();
+
+        QTRY_VERIFY(IsDecoded("q.res"));
+        for (const char* name : { "p.res", "q.res", "x.res" })
+            QVERIFY(cache->GetResource<TestResource>(name));
+        QMutexLocker lock(&decodeMutex);
+        QVERIFY(decodeOrder.indexOf("p.res") < decodeOrder.indexOf("q.res"));
+        QVERIFY(decodeOrder.indexOf("x.res") < decodeOrder.indexOf("q.res"));
+#endif
+    }
+    void verifyWaitForQueuedResource() {
+#ifdef _WIN32
+        QSKIP("Needs a named pipe to hold the read thread");
+#else
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(WriteFile(dir.path() + "/queued.res", 64));
+        ReadBlocker blocker(dir.path() + "/blocker.res");
+        QVERIFY(blocker.IsValid());
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("blocker.res", false));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("queued.res"));
+        // The read thread stays blocked opening the pipe, so the main thread reads and decodes the resource itself. This
+        // must not wait for the read thread's file open
+        TestResource* resource = cache->GetResource<TestResource>("queued.res");
+        QVERIFY(resource);
+        QCOMPARE(resource->GetAsyncLoadState(), ASYNC_DONE);
+        QVERIFY(IsDecodedOnMainThread("queued.res"));
+        blocker.Release();
+#endif
+    }
+    void verifyWaitForReadResource() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        for (const char* name : { "gated.res", "read.res", "last.res" })
+            QVERIFY(WriteFile(dir.path() + "/" + name, 64));
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        SharedPtr<ReadRecorder> recorder(new ReadRecorder(&context));
+        cache->AddResourceRouter(recorder);
+        gatedName = "gated.res";
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("gated.res"));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("read.res"));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("last.res"));
+
+        // The decode thread is held on gated.res. Once the read thread has moved on to last.res, read.res waits for
+        // decoding; the main thread decodes it instead of waiting behind the gate
+        QTRY_VERIFY(recorder->IsRead("last.res"));
+        TestResource* resource = cache->GetResource<TestResource>("read.res");
+        QVERIFY(resource);
+        QVERIFY(IsDecodedOnMainThread("read.res"));
+        QVERIFY(!IsDecoded("gated.res"));
+
+        decodeGate.release();
+        QVERIFY(cache->GetResource<TestResource>("gated.res"));
+        QVERIFY(cache->GetResource<TestResource>("last.res"));
+    }
+    void verifyWaitForDecodingResource() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(WriteFile(dir.path() + "/gated.res", 64));
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        gatedName = "gated.res";
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("gated.res"));
+
+        // The main thread waits for the decode thread to finish the resource
+        std::thread opener([]() {
+            QThread::msleep(100);
+            decodeGate.release();
+        });
+        TestResource* resource = cache->GetResource<TestResource>("gated.res");
+        opener.join();
+        QVERIFY(resource);
+        QCOMPARE(resource->GetAsyncLoadState(), ASYNC_DONE);
+        QVERIFY(!IsDecodedOnMainThread("gated.res"));
+    }
+    void verifyWaitForDecodedResource() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(WriteFile(dir.path() + "/decoded.res", 64));
+
+        Context context;
+        CreateCache(&context, dir.path());
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("decoded.res"));
+        QTRY_VERIFY(IsDecoded("decoded.res"));
+
+        // Decoded but not finished yet: the main thread only finishes it
+        QVERIFY(!cache->GetExistingResource<TestResource>("decoded.res"));
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 1U);
+        TestResource* resource = cache->GetResource<TestResource>("decoded.res");
+        QVERIFY(resource);
+        QCOMPARE(resource->GetAsyncLoadState(), ASYNC_DONE);
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 0U);
+        QVERIFY(!IsDecodedOnMainThread("decoded.res"));
+    }
+    void verifyShutdownWithQueuedResources() {
+        using namespace Urho3D;
+        const unsigned NUM_RESOURCES = 200;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+            QVERIFY(WriteFile(dir.path() + QString("/file%1.res").arg(i), 64));
+
+        {
+            Context context;
+            CreateCache(&context, dir.path());
+            ResourceCache* cache = context.m_ResourceCache.get();
+            gatedName = "file0.res";
+            for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+                QVERIFY(cache->BackgroundLoadResource<TestResource>(QString("file%1.res").arg(i)));
+            QVERIFY(numTestResources > 0);
+
+            // Shutting down waits for the decode thread to come back from the gated resource, then drops the rest
+            std::thread opener([]() {
+                QThread::msleep(100);
+                decodeGate.release();
+            });
+            context.m_ResourceCache.reset();
+            opener.join();
+            QCOMPARE(numTestResources.load(), 0);
+        }
+        QMutexLocker lock(&decodeMutex);
+        QVERIFY((unsigned)decodeOrder.size() < NUM_RESOURCES);
+    }
+    void benchmarkThroughput_data() {
+        QTest::addColumn<unsigned>("decodeThreads");
+        QTest::newRow("1 decode thread") << 1U;
+        QTest::newRow("4 decode threads") << 4U;
+    }
+    void benchmarkThroughput() {
+        using namespace Urho3D;
+        QFETCH(unsigned, decodeThreads);
+        const unsigned NUM_RESOURCES = 2000;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+            QVERIFY(WriteFile(dir.path() + QString("/file%1.res").arg(i), 16384));
+
+        Context context;
+        CreateCache(&context, dir.path(), decodeThreads);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QBENCHMARK {
+            for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+                cache->BackgroundLoadResource<TestResource>(QString("file%1.res").arg(i));
+            for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+                cache->GetResource<TestResource>(QString("file%1.res").arg(i));
+            cache->ReleaseAllResources(true);
+        }
+    }
+};
+
+QTEST_MAIN(BackgroundLoaderTests)
+#include "BackgroundLoaderTests.moc"
@@ -0,0 +1,287 @@
+#include <QTest>
+#include "../Decompress.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+// Scalar block decoders as they were before the SSE2 and threaded rewrite, kept as the reference output.
+
+void UnpackReference565(const uint8_t* packed, uint8_t* colour)
+{
+    int value = packed[0] | (packed[1] << 8);
+    uint8_t red = (value >> 11) & 0x1f;
+    uint8_t green = (value >> 5) & 0x3f;
+    uint8_t blue = value & 0x1f;
+    colour[0] = (red << 3) | (red >> 2);
+    colour[1] = (green << 2) | (green >> 4);
+    colour[2] = (blue << 3) | (blue >> 2);
+    colour[3] = 255;
+}
+
+void DecodeReferenceColourDXT(uint8_t* rgba, const uint8_t* bytes, bool isDxt1)
+{
+    uint8_t codes[16];
+    UnpackReference565(bytes, codes);
+    UnpackReference565(bytes + 2, codes + 4);
+    int a = bytes[0] | (bytes[1] << 8);
+    int b = bytes[2] | (bytes[3] << 8);
+    bool threeColour = isDxt1 && a <= b;
+    for (int i = 0; i < 3; ++i)
+    {
+        int c = codes[i];
+        int d = codes[4 + i];
+        if (threeColour)
+        {
+            codes[8 + i] = (uint8_t)((c + d) / 2);
+            codes[12 + i] = 0;
+        }
+        else
+        {
+            codes[8 + i] = (uint8_t)((2 * c + d) / 3);
+            codes[12 + i] = (uint8_t)((c + 2 * d) / 3);
+        }
+    }
+    codes[8 + 3] = 255;
+    codes[12 + 3] = threeColour ? 0 : 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        int index = (bytes[4 + i / 4] >> (2 * (i % 4))) & 0x3;
+        memcpy(rgba + 4 * i, codes + 4 * index, 4);
+    }
+}
+
+void DecodeReferenceAlphaDXT3(uint8_t* rgba, const uint8_t* bytes)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        uint8_t lo = bytes[i] & 0x0f;
+        uint8_t hi = bytes[i] & 0xf0;
+        rgba[8 * i + 3] = lo | (lo << 4);
+        rgba[8 * i + 7] = hi | (hi >> 4);
+    }
+}
+
+void DecodeReferenceAlphaDXT5(uint8_t* rgba, const uint8_t* bytes)
+{
+    int alpha0 = bytes[0];
+    int alpha1 = bytes[1];
+    uint8_t codes[8] = { (uint8_t)alpha0, (uint8_t)alpha1 };
+    if (alpha0 <= alpha1)
+    {
+        for (int i = 1; i < 5; ++i)
+            codes[1 + i] = (uint8_t)(((5 - i) * alpha0 + i * alpha1) / 5);
+        codes[6] = 0;
+        codes[7] = 255;
+    }
+    else
+    {
+        for (int i = 1; i < 7; ++i)
+            codes[1 + i] = (uint8_t)(((7 - i) * alpha0 + i * alpha1) / 7);
+    }
+    for (int half = 0; half < 2; ++half)
+    {
+        const uint8_t* src = bytes + 2 + 3 * half;
+        int value = src[0] | (src[1] << 8) | (src[2] << 16);
+        for (int j = 0; j < 8; ++j)
+            rgba[4 * (half * 8 + j) + 3] = codes[(value >> (3 * j)) & 0x7];
+    }
+}
+
+void DecodeReferenceDXT(uint8_t* rgba, const uint8_t* block, Urho3D::CompressedFormat format)
+{
+    DecodeReferenceColourDXT(rgba, format == Urho3D::CF_DXT1 ? block : block + 8, format == Urho3D::CF_DXT1);
+    if (format == Urho3D::CF_DXT3)
+        DecodeReferenceAlphaDXT3(rgba, block);
+    else if (format == Urho3D::CF_DXT5)
+        DecodeReferenceAlphaDXT5(rgba, block);
+}
+
+const int etcModifiers[8][4] = { { 2, 8, -2, -8 },       { 5, 17, -5, -17 },     { 9, 29, -9, -29 },     { 13, 42, -13, -42 },
+                                 { 18, 60, -18, -60 },   { 24, 80, -24, -80 },   { 33, 106, -33, -106 }, { 47, 183, -47, -183 } };
+
+uint32_t ModifyReferencePixel(int red, int green, int blue, int x, int y, uint32_t modBlock, int modTable)
+{
+    int index = x * 4 + y;
+    uint32_t mostSig = modBlock << 1;
+    int pixelMod;
+    if (index < 8)
+        pixelMod = etcModifiers[modTable][((modBlock >> (index + 24)) & 0x1) + ((mostSig >> (index + 8)) & 0x2)];
+    else
+        pixelMod = etcModifiers[modTable][((modBlock >> (index + 8)) & 0x1) + ((mostSig >> (index - 8)) & 0x2)];
+    red = qBound(0, red + pixelMod, 255);
+    green = qBound(0, green + pixelMod, 255);
+    blue = qBound(0, blue + pixelMod, 255);
+    return ((blue << 16) + (green << 8) + red) | 0xff000000;
+}
+
+void DecodeReferenceETC(uint8_t* rgba, const uint8_t* block)
+{
+    uint32_t blockTop, blockBot;
+    memcpy(&blockTop, block, 4);
+    memcpy(&blockBot, block + 4, 4);
+    uint32_t output[16];
+    uint8_t red1, green1, blue1, red2, green2, blue2;
+    if (blockTop & 0x02000000)
+    {
+        // Differential mode: 5 colour bits and 3 difference bits
+        blue1 = (uint8_t)((blockTop & 0xf80000) >> 16);
+        green1 = (uint8_t)((blockTop & 0xf800) >> 8);
+        red1 = (uint8_t)(blockTop & 0xf8);
+        blue2 = (uint8_t)((signed char)(blue1 >> 3) + ((signed char)((blockTop & 0x70000) >> 11) >> 5));
+        green2 = (uint8_t)((signed char)(green1 >> 3) + ((signed char)((blockTop & 0x700) >> 3) >> 5));
+        red2 = (uint8_t)((signed char)(red1 >> 3) + ((signed char)((blockTop & 0x7) << 5) >> 5));
+        red1 = red1 + (red1 >> 5);
+        green1 = green1 + (green1 >> 5);
+        blue1 = blue1 + (blue1 >> 5);
+        red2 = (red2 << 3) + (red2 >> 2);
+        green2 = (green2 << 3) + (green2 >> 2);
+        blue2 = (blue2 << 3) + (blue2 >> 2);
+    }
+    else
+    {
+        // Individual mode: 4 + 4 colour bits
+        blue1 = (uint8_t)((blockTop & 0xf00000) >> 16);
+        blue1 = blue1 + (blue1 >> 4);
+        green1 = (uint8_t)((blockTop & 0xf000) >> 8);
+        green1 = green1 + (green1 >> 4);
+        red1 = (uint8_t)(blockTop & 0xf0);
+        red1 = red1 + (red1 >> 4);
+        blue2 = (uint8_t)((blockTop & 0xf0000) >> 12);
+        blue2 = blue2 + (blue2 >> 4);
+        green2 = (uint8_t)((blockTop & 0xf00) >> 4);
+        green2 = green2 + (green2 >> 4);
+        red2 = (uint8_t)((blockTop & 0xf) << 4);
+        red2 = red2 + (red2 >> 4);
+    }
+    int modTable1 = (blockTop >> 29) & 0x7;
+    int modTable2 = (blockTop >> 26) & 0x7;
+    if (!(blockTop & 0x01000000))
+    {
+        // Two 2x4 subblocks side by side
+        for (int j = 0; j < 4; ++j)
+        {
+            for (int k = 0; k < 2; ++k)
+            {
+                output[j * 4 + k] = ModifyReferencePixel(red1, green1, blue1, k, j, blockBot, modTable1);
+                output[j * 4 + k + 2] = ModifyReferencePixel(red2, green2, blue2, k + 2, j, blockBot, modTable2);
+            }
+        }
+    }
+    else
+    {
+        // Two 4x2 subblocks on top of each other
+        for (int j = 0; j < 2; ++j)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                output[j * 4 + k] = ModifyReferencePixel(red1, green1, blue1, k, j, blockBot, modTable1);
+                output[(j + 2) * 4 + k] = ModifyReferencePixel(red2, green2, blue2, k, j + 2, blockBot, modTable2);
+            }
+        }
+    }
+    memcpy(rgba, output, sizeof(output));
+}
+
+/// Decode a whole image block by block with the reference decoders, clipping the blocks at the right and bottom edges.
+void DecodeReferenceImage(uint8_t* rgba, const uint8_t* blocks, int width, int height, int depth, Urho3D::CompressedFormat format)
+{
+    const int bytesPerBlock = format == Urho3D::CF_DXT1 || format == Urho3D::CF_ETC1 ? 8 : 16;
+    for (int z = 0; z < depth; ++z)
+    {
+        for (int y = 0; y < height; y += 4)
+        {
+            for (int x = 0; x < width; x += 4)
+            {
+                uint8_t block[4 * 16];
+                if (format == Urho3D::CF_ETC1)
+                    DecodeReferenceETC(block, blocks);
+                else
+                    DecodeReferenceDXT(block, blocks, format);
+                for (int py = 0; py < 4 && y + py < height; ++py)
+                {
+                    for (int px = 0; px < 4 && x + px < width; ++px)
+                        memcpy(rgba + 4 * ((z * height + y + py) * width + x + px), block + 4 * (py * 4 + px), 4);
+                }
+                blocks += bytesPerBlock;
+            }
+        }
+    }
+}
+
+/// Return random compressed blocks covering an image of the given size.
+std::vector<uint8_t> CreateRandomBlocks(int width, int height, int depth, Urho3D::CompressedFormat format, unsigned seed)
+{
+    const int bytesPerBlock = format == Urho3D::CF_DXT1 || format == Urho3D::CF_ETC1 ? 8 : 16;
+    std::vector<uint8_t> blocks((size_t)((width + 3) / 4) * ((height + 3) / 4) * depth * bytesPerBlock);
+    std::mt19937 random(seed);
+    for (uint8_t& byte : blocks)
+        byte = (uint8_t)random();
+    return blocks;
+}
+}
+
+class DecompressTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyMatchesReference_data() {
+        QTest::addColumn<unsigned>("format");
+        QTest::addColumn<int>("width");
+        QTest::addColumn<int>("height");
+        QTest::addColumn<int>("depth");
+        const struct { const char* name; Urho3D::CompressedFormat format; } formats[] = {
+            { "DXT1", Urho3D::CF_DXT1 }, { "DXT3", Urho3D::CF_DXT3 }, { "DXT5", Urho3D::CF_DXT5 }, { "ETC1", Urho3D::CF_ETC1 }
+        };
+        // Single pixels, partial edge blocks, exact blocks and an image large enough to be split across threads
+        const int sizes[][2] = { { 1, 1 }, { 3, 2 }, { 4, 4 }, { 5, 7 }, { 13, 9 }, { 64, 64 }, { 517, 263 } };
+        for (const auto& format : formats)
+        {
+            for (const auto& size : sizes)
+                QTest::newRow(QString("%1 %2x%3").arg(format.name).arg(size[0]).arg(size[1]).toLatin1())
+                    << (unsigned)format.format << size[0] << size[1] << 1;
+            if (format.format != Urho3D::CF_ETC1)
+                QTest::newRow(QString("%1 volume").arg(format.name).toLatin1()) << (unsigned)format.format << 6 << 5 << 3;
+        }
+    }
+    void verifyMatchesReference() {
+        QFETCH(unsigned, format);
+        QFETCH(int, width);
+        QFETCH(int, height);
+        QFETCH(int, depth);
+        Urho3D::Context context;
+        context.m_WorkQueueSystem.reset(new Urho3D::WorkQueue(&context));
+        context.m_WorkQueueSystem->CreateThreads(3);
+
+        const Urho3D::CompressedFormat compressedFormat = (Urho3D::CompressedFormat)format;
+        const std::vector<uint8_t> blocks = CreateRandomBlocks(width, height, depth, compressedFormat, width * 31 + height);
+        std::vector<uint8_t> expected((size_t)width * height * depth * 4);
+        DecodeReferenceImage(expected.data(), blocks.data(), width, height, depth, compressedFormat);
+
+        for (Urho3D::WorkQueue* queue : { (Urho3D::WorkQueue*)nullptr, context.m_WorkQueueSystem.get() })
+        {
+            std::vector<uint8_t> rgba(expected.size(), 0xcd);
+            if (compressedFormat == Urho3D::CF_ETC1)
+                Urho3D::DecompressImageETC(rgba.data(), blocks.data(), width, height, queue);
+            else
+                Urho3D::DecompressImageDXT(rgba.data(), blocks.data(), width, height, depth, compressedFormat, queue);
+            QVERIFY(rgba == expected);
+        }
+    }
+    void benchmarkDecompress() {
+        Urho3D::Context context;
+        context.m_WorkQueueSystem.reset(new Urho3D::WorkQueue(&context));
+        context.m_WorkQueueSystem->CreateThreads(3);
+        const std::vector<uint8_t> blocks = CreateRandomBlocks(1024, 1024, 1, Urho3D::CF_DXT5, 1);
+        std::vector<uint8_t> rgba(1024 * 1024 * 4);
+        QBENCHMARK {
+            Urho3D::DecompressImageDXT(rgba.data(), blocks.data(), 1024, 1024, 1, Urho3D::CF_DXT5, context.m_WorkQueueSystem.get());
+        }
+    }
+};
+
+QTEST_MAIN(DecompressTests)
+#include "DecompressTests.moc"
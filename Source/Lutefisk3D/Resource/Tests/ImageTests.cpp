@@ -0,0 +1,340 @@
+#include <QTest>
+#include <QTemporaryDir>
+#include "../Decompress.h"
+#include "../Image.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/WorkQueue.h"
+#include "Lutefisk3D/IO/File.h"
+#include "Lutefisk3D/Math/MathDefs.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+/// Return an RGBA image filled with a non-uniform pattern.
+Urho3D::SharedPtr<Urho3D::Image> CreatePatternImage(Urho3D::Context* context, int size)
+{
+    Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(context));
+    image->SetSize(size, size, 4);
+    uint8_t* data = image->GetData();
+    for (size_t i = 0; i < (size_t)size * size * 4; ++i)
+        data[i] = (uint8_t)(i * 13 + (i >> 12));
+    return image;
+}
+
+/// Return an RGBA image of smooth gradients with some noise, closer to real textures than a pattern.
+Urho3D::SharedPtr<Urho3D::Image> CreateGradientImage(Urho3D::Context* context, int size)
+{
+    Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(context));
+    image->SetSize(size, size, 4);
+    uint8_t* pixel = image->GetData();
+    unsigned noise = 1;
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x, pixel += 4)
+        {
+            noise = noise * 1103515245 + 12345;
+            int n = (int)((noise >> 16) & 15) - 8;
+            pixel[0] = (uint8_t)Urho3D::Clamp(x * 255 / size + n, 0, 255);
+            pixel[1] = (uint8_t)Urho3D::Clamp(y * 255 / size + n, 0, 255);
+            pixel[2] = (uint8_t)Urho3D::Clamp((int)(127.5f + 127.5f * std::sin(x * 0.05f) * std::cos(y * 0.03f)) + n, 0, 255);
+            pixel[3] = (uint8_t)((x + y) * 255 / (2 * size));
+        }
+    }
+    return image;
+}
+
+/// Return the root mean square error of the decompressed first level of a compressed image, over the channels the format keeps.
+/// Pixels DXT1 made transparent are left out.
+double GetCompressionError(const Urho3D::Image& image, const Urho3D::Image& compressed)
+{
+    std::vector<unsigned char> rgba((size_t)image.GetWidth() * image.GetHeight() * 4);
+    if (!compressed.GetCompressedLevel(0).Decompress(rgba.data()))
+        return Urho3D::M_INFINITY;
+    const Urho3D::CompressedFormat format = compressed.GetCompressedFormat();
+    const unsigned numChannels = format == Urho3D::CF_BC5 ? 2 : (format == Urho3D::CF_DXT1 ? 3 : 4);
+    double error = 0.0;
+    size_t numValues = 0;
+    for (size_t i = 0; i < rgba.size(); i += 4)
+    {
+        if (format == Urho3D::CF_DXT1 && !rgba[i + 3])
+            continue;
+        for (unsigned c = 0; c < numChannels; ++c)
+            error += std::pow((double)rgba[i + c] - image.GetData()[i + c], 2.0);
+        numValues += numChannels;
+    }
+    return numValues ? std::sqrt(error / numValues) : 0.0;
+}
+}
+
+class ImageTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyResizeKeepsFlatColor() {
+        Urho3D::Context context;
+        for (unsigned filter = Urho3D::RESIZE_BOX; filter <= Urho3D::RESIZE_LANCZOS3; ++filter)
+        {
+            Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+            image->SetSize(67, 45, 4);
+            image->ClearInt(0x80402010);
+            QVERIFY(image->Resize(19, 13, (Urho3D::ImageResizeFilter)filter));
+            QCOMPARE(image->GetPixelInt(0, 0), 0x80402010U);
+            QCOMPARE(image->GetPixelInt(18, 12), 0x80402010U);
+            QVERIFY(image->Resize(101, 77, (Urho3D::ImageResizeFilter)filter));
+            QCOMPARE(image->GetPixelInt(50, 38), 0x80402010U);
+        }
+    }
+    void verifyResizeAveragesWhenReducing() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+        image->SetSize(64, 64, 1);
+        // Alternating black and white columns reduce to mid grey instead of picking either
+        for (int y = 0; y < 64; ++y)
+            for (int x = 0; x < 64; ++x)
+                image->GetData()[y * 64 + x] = (x & 1) ? 255 : 0;
+        QVERIFY(image->Resize(8, 8, Urho3D::RESIZE_BOX));
+        QCOMPARE((int)image->GetData()[3 * 8 + 3], 128);
+    }
+    void verifyNextLevel() {
+        Urho3D::Context context;
+        for (unsigned components : { 1U, 3U, 4U })
+        {
+            Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+            image->SetSize(34, 6, components);
+            for (unsigned i = 0; i < 34 * 6 * components; ++i)
+                image->GetData()[i] = (uint8_t)(i * 7);
+            Urho3D::SharedPtr<Urho3D::Image> level = image->GetNextLevel();
+            QCOMPARE(level->GetWidth(), 17);
+            QCOMPARE(level->GetHeight(), 3);
+            const uint8_t* in = image->GetData();
+            for (int y = 0; y < 3; ++y)
+            {
+                for (unsigned x = 0; x < 17 * components; ++x)
+                {
+                    unsigned i = (y * 2 * 34 * components) + (x / components) * 2 * components + x % components;
+                    unsigned j = i + 34 * components;
+                    unsigned expected = ((unsigned)in[i] + in[i + components] + in[j] + in[j + components]) >> 2;
+                    QCOMPARE((unsigned)level->GetData()[y * 17 * components + x], expected);
+                }
+            }
+        }
+    }
+    void verifyDXT1Decode() {
+        // Red and blue endpoints with the four palette entries used along each row, on a 6x5 image to cover edge blocks
+        const unsigned char block[8] = { 0x00, 0xf8, 0x1f, 0x00, 0xe4, 0xe4, 0xe4, 0xe4 };
+        std::vector<unsigned char> blocks;
+        for (int i = 0; i < 4; ++i)
+            blocks.insert(blocks.end(), block, block + 8);
+        std::vector<unsigned char> rgba(6 * 5 * 4);
+        Urho3D::DecompressImageDXT(rgba.data(), blocks.data(), 6, 5, 1, Urho3D::CF_DXT1);
+        const unsigned expected[4] = { 0xff0000ff, 0xffff0000, 0xff5500aa, 0xffaa0055 };
+        for (int y = 0; y < 5; ++y)
+        {
+            for (int x = 0; x < 6; ++x)
+            {
+                unsigned pixel;
+                memcpy(&pixel, &rgba[(y * 6 + x) * 4], 4);
+                QCOMPARE(pixel, expected[x & 3]);
+            }
+        }
+    }
+    void verifyCompressRoundTrip() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+        image->SetSize(37, 29, 4);
+        for (int y = 0; y < 29; ++y)
+        {
+            for (int x = 0; x < 37; ++x)
+            {
+                uint8_t* pixel = image->GetData() + (y * 37 + x) * 4;
+                pixel[0] = (uint8_t)(x * 7);
+                pixel[1] = (uint8_t)(y * 8);
+                pixel[2] = (uint8_t)(x + y * 2);
+                pixel[3] = (x / 5) % 3 ? 255 : 0;
+            }
+        }
+
+        for (Urho3D::CompressedFormat format : { Urho3D::CF_DXT1, Urho3D::CF_DXT5 })
+        {
+            Urho3D::SharedPtr<Urho3D::Image> compressed = image->Compress(format);
+            QVERIFY(compressed);
+            QCOMPARE(compressed->GetNumCompressedLevels(), 6U);
+
+            std::vector<unsigned char> rgba(37 * 29 * 4);
+            QVERIFY(compressed->GetCompressedLevel(0).Decompress(rgba.data()));
+            double error = 0.0;
+            for (unsigned i = 0; i < rgba.size(); i += 4)
+            {
+                // DXT1 keeps cut-out alpha, DXT5 the exact alpha of the two values
+                QCOMPARE(rgba[i + 3], image->GetData()[i + 3]);
+                for (unsigned c = 0; c < 3; ++c)
+                {
+                    if (rgba[i + 3])
+                        error += std::pow((double)rgba[i + c] - image->GetData()[i + c], 2.0);
+                }
+            }
+            QVERIFY(std::sqrt(error / rgba.size()) < 8.0);
+        }
+
+        QTemporaryDir dir;
+        QString fileName = dir.path() + "/compressed.dds";
+        Urho3D::SharedPtr<Urho3D::Image> compressed = image->Compress(Urho3D::CF_DXT5, Urho3D::COMPRESS_FAST, false);
+        QVERIFY(compressed->SaveDDS(fileName));
+        Urho3D::File file(&context, fileName);
+        Urho3D::SharedPtr<Urho3D::Image> loaded(new Urho3D::Image(&context));
+        QVERIFY(loaded->Load(file));
+        QCOMPARE(loaded->GetCompressedFormat(), Urho3D::CF_DXT5);
+        QCOMPARE(loaded->GetWidth(), 37);
+        QCOMPARE(loaded->GetNumCompressedLevels(), 1U);
+        QVERIFY(!loaded->IsCubemap());
+        QCOMPARE(memcmp(loaded->GetData(), compressed->GetData(), compressed->GetMemoryUse()), 0);
+    }
+    void verifyBC5RoundTrip() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+        image->SetSize(21, 14, 4);
+        for (int y = 0; y < 14; ++y)
+        {
+            for (int x = 0; x < 21; ++x)
+                image->SetPixelInt(x, y, 0xff000000 | ((y * 18) << 8) | (x * 12));
+        }
+
+        Urho3D::SharedPtr<Urho3D::Image> compressed = image->Compress(Urho3D::CF_BC5, Urho3D::COMPRESS_HIGH);
+        QVERIFY(compressed);
+        QCOMPARE(compressed->GetComponents(), 2U);
+        QCOMPARE(compressed->GetNumCompressedLevels(), 5U);
+        std::vector<unsigned char> rgba(21 * 14 * 4);
+        QVERIFY(compressed->GetCompressedLevel(0).Decompress(rgba.data()));
+        for (unsigned i = 0; i < rgba.size(); i += 4)
+        {
+            // Red and green keep eight interpolated values per block, blue and alpha are dropped
+            QVERIFY(qAbs(rgba[i] - image->GetData()[i]) <= 4);
+            QVERIFY(qAbs(rgba[i + 1] - image->GetData()[i + 1]) <= 4);
+            QCOMPARE((int)rgba[i + 2], 0);
+            QCOMPARE((int)rgba[i + 3], 255);
+        }
+
+        QTemporaryDir dir;
+        QString fileName = dir.path() + "/normals.dds";
+        QVERIFY(compressed->SaveDDS(fileName));
+        Urho3D::File file(&context, fileName);
+        Urho3D::SharedPtr<Urho3D::Image> loaded(new Urho3D::Image(&context));
+        QVERIFY(loaded->Load(file));
+        QCOMPARE(loaded->GetCompressedFormat(), Urho3D::CF_BC5);
+        QCOMPARE(loaded->GetNumCompressedLevels(), 5U);
+        QCOMPARE(memcmp(loaded->GetData(), compressed->GetData(), compressed->GetMemoryUse()), 0);
+    }
+    void verifyHighQualityNotWorse() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image = CreateGradientImage(&context, 128);
+        for (Urho3D::CompressedFormat format : { Urho3D::CF_DXT1, Urho3D::CF_DXT5, Urho3D::CF_BC5 })
+        {
+            // The high preset starts from the normal endpoints and only keeps refinements that lower the error
+            Urho3D::SharedPtr<Urho3D::Image> normal = image->Compress(format, Urho3D::COMPRESS_NORMAL, false);
+            Urho3D::SharedPtr<Urho3D::Image> high = image->Compress(format, Urho3D::COMPRESS_HIGH, false);
+            QVERIFY(normal && high);
+            QVERIFY(GetCompressionError(*image, *high) <= GetCompressionError(*image, *normal));
+        }
+    }
+    void verifyKTXRoundTrip() {
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+        image->SetSize(45, 19, 4);
+        for (unsigned i = 0; i < 45 * 19 * 4; ++i)
+            image->GetData()[i] = (uint8_t)(i * 13);
+
+        QTemporaryDir dir;
+        for (Urho3D::CompressedFormat format : { Urho3D::CF_DXT1, Urho3D::CF_DXT3, Urho3D::CF_DXT5, Urho3D::CF_BC5 })
+        {
+            Urho3D::SharedPtr<Urho3D::Image> compressed = image->Compress(format, Urho3D::COMPRESS_FAST);
+            QVERIFY(compressed);
+            QString fileName = dir.path() + "/compressed.ktx";
+            QVERIFY(compressed->SaveKTX(fileName));
+
+            Urho3D::File file(&context, fileName);
+            Urho3D::SharedPtr<Urho3D::Image> loaded(new Urho3D::Image(&context));
+            QVERIFY(loaded->Load(file));
+            QCOMPARE(loaded->GetCompressedFormat(), format);
+            QCOMPARE(loaded->GetWidth(), 45);
+            QCOMPARE(loaded->GetHeight(), 19);
+            QCOMPARE(loaded->GetNumCompressedLevels(), compressed->GetNumCompressedLevels());
+            for (unsigned i = 0; i < compressed->GetNumCompressedLevels(); ++i)
+            {
+                Urho3D::CompressedLevel expected = compressed->GetCompressedLevel(i);
+                Urho3D::CompressedLevel level = loaded->GetCompressedLevel(i);
+                QCOMPARE(level.width_, expected.width_);
+                QCOMPARE(level.height_, expected.height_);
+                QCOMPARE(level.dataSize_, expected.dataSize_);
+                QCOMPARE(memcmp(level.data_, expected.data_, expected.dataSize_), 0);
+            }
+        }
+    }
+    void benchmarkCompress_data() {
+        QTest::addColumn<unsigned>("format");
+        QTest::addColumn<unsigned>("quality");
+        const struct { const char* name; Urho3D::CompressedFormat format; } formats[] = {
+            { "DXT1", Urho3D::CF_DXT1 }, { "DXT5", Urho3D::CF_DXT5 }, { "BC5", Urho3D::CF_BC5 }
+        };
+        const char* qualityNames[] = { "fast", "normal", "high" };
+        for (const auto& format : formats)
+        {
+            for (unsigned quality = Urho3D::COMPRESS_FAST; quality <= Urho3D::COMPRESS_HIGH; ++quality)
+                QTest::newRow(QString("%1 %2").arg(format.name).arg(qualityNames[quality]).toLatin1()) << (unsigned)format.format << quality;
+        }
+    }
+    void benchmarkCompress() {
+        QFETCH(unsigned, format);
+        QFETCH(unsigned, quality);
+        Urho3D::Context context;
+        context.m_WorkQueueSystem.reset(new Urho3D::WorkQueue(&context));
+        context.m_WorkQueueSystem->CreateThreads(3);
+        Urho3D::SharedPtr<Urho3D::Image> image = CreateGradientImage(&context, 2048);
+        Urho3D::SharedPtr<Urho3D::Image> compressed;
+        QBENCHMARK {
+            compressed = image->Compress((Urho3D::CompressedFormat)format, (Urho3D::CompressionQuality)quality, false);
+        }
+        QVERIFY(compressed);
+        qDebug("RMSE %.3f", GetCompressionError(*image, *compressed));
+    }
+    void benchmarkResize_data() {
+        QTest::addColumn<int>("size");
+        QTest::addColumn<unsigned>("filter");
+        QTest::newRow("box 4096") << 4096 << (unsigned)Urho3D::RESIZE_BOX;
+        QTest::newRow("lanczos 4096") << 4096 << (unsigned)Urho3D::RESIZE_LANCZOS3;
+        QTest::newRow("box 8192") << 8192 << (unsigned)Urho3D::RESIZE_BOX;
+        QTest::newRow("lanczos 8192") << 8192 << (unsigned)Urho3D::RESIZE_LANCZOS3;
+    }
+    void benchmarkResize() {
+        QFETCH(int, size);
+        QFETCH(unsigned, filter);
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> source = CreatePatternImage(&context, size);
+        Urho3D::SharedPtr<Urho3D::Image> image(new Urho3D::Image(&context));
+        QBENCHMARK {
+            // Resizing is in place, so each iteration starts again from the source pixels
+            image->SetSize(size, size, 4);
+            image->SetData(source->GetData());
+            QVERIFY(image->Resize(size * 3 / 8, size * 3 / 8, (Urho3D::ImageResizeFilter)filter));
+        }
+    }
+    void benchmarkMipChain_data() {
+        QTest::addColumn<int>("size");
+        QTest::newRow("4096") << 4096;
+        QTest::newRow("8192") << 8192;
+    }
+    void benchmarkMipChain() {
+        QFETCH(int, size);
+        Urho3D::Context context;
+        Urho3D::SharedPtr<Urho3D::Image> image = CreatePatternImage(&context, size);
+        QBENCHMARK {
+            Urho3D::SharedPtr<Urho3D::Image> level = image;
+            while (level->GetWidth() > 1 || level->GetHeight() > 1)
+                level = level->GetNextLevel();
+        }
+    }
+};
+
+QTEST_MAIN(ImageTests)
+#include "ImageTests.moc"
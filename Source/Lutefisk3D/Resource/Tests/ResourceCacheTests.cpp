@@ -0,0 +1,286 @@
+#include <QTest>
+#include <QDir>
+#include <QTemporaryDir>
+#include <QThread>
+#include "../Resource.h"
+#include "../ResourceCache.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/IO/Deserializer.h"
+#include "Lutefisk3D/IO/FileSystem.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+const unsigned RESOURCE_SIZE = 1000;
+
+/// Resource of a fixed size. When background loaded, a file starting with "dep:" queues the named resource as a dependency.
+class TestResource : public Urho3D::Resource
+{
+    URHO3D_OBJECT(TestResource, Urho3D::Resource)
+
+public:
+    TestResource(Urho3D::Context* context) : Resource(context) { SetMemoryUse(RESOURCE_SIZE); }
+
+    bool BeginLoad(Urho3D::Deserializer& source) override
+    {
+        QByteArray data(source.GetSize(), 0);
+        if (source.Read(data.data(), data.size()) != (unsigned)data.size())
+            return false;
+        if (GetAsyncLoadState() == Urho3D::ASYNC_LOADING && data.startsWith("dep:"))
+            context_->m_ResourceCache->BackgroundLoadResource<TestResource>(QString(data.mid(4)), true, this);
+        return true;
+    }
+};
+
+/// Resource of another type, to share the total memory budget with.
+class OtherResource : public Urho3D::Resource
+{
+    URHO3D_OBJECT(OtherResource, Urho3D::Resource)
+
+public:
+    OtherResource(Urho3D::Context* context) : Resource(context) { SetMemoryUse(RESOURCE_SIZE); }
+
+    bool BeginLoad(Urho3D::Deserializer& source) override
+    {
+        Q_UNUSED(source);
+        return true;
+    }
+};
+
+void CreateCache(Urho3D::Context* context)
+{
+    using namespace Urho3D;
+    context->RegisterFactory<TestResource>();
+    context->RegisterFactory<OtherResource>();
+    context->m_FileSystem.reset(new FileSystem(context));
+    context->m_ResourceCache.reset(new ResourceCache(context));
+}
+
+/// Add an in-memory resource, referenced only by the cache. Resources added in turn are a few milliseconds apart in use.
+template <class T> void AddResource(Urho3D::ResourceCache* cache, const QString& name)
+{
+    QThread::msleep(20);
+    T* resource = new T(cache->GetContext());
+    resource->SetName(name);
+    cache->AddManualResource(resource);
+}
+
+const Urho3D::ResourceGroup& GetGroup(Urho3D::ResourceCache* cache, Urho3D::StringHash type)
+{
+    return cache->GetAllResources().find(type)->second;
+}
+
+bool WriteFile(const QString& fileName, const QByteArray& contents)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && file.write(contents) == contents.size();
+}
+}
+
+class ResourceCacheTests : public QObject {
+    Q_OBJECT
+private slots:
+    void verifyLeastRecentlyUsedEvicted() {
+        using namespace Urho3D;
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        cache->SetMemoryBudget(TestResource::GetTypeStatic(), 3 * RESOURCE_SIZE);
+        AddResource<TestResource>(cache, "a.res");
+        AddResource<TestResource>(cache, "b.res");
+        AddResource<TestResource>(cache, "c.res");
+        QThread::msleep(20);
+        QVERIFY(cache->GetResource<TestResource>("a.res"));
+
+        // b.res is now the least recently used
+        AddResource<TestResource>(cache, "d.res");
+        QVERIFY(cache->GetExistingResource<TestResource>("a.res"));
+        QVERIFY(!cache->GetExistingResource<TestResource>("b.res"));
+        QVERIFY(cache->GetExistingResource<TestResource>("c.res"));
+        QVERIFY(cache->GetExistingResource<TestResource>("d.res"));
+        QCOMPARE(cache->GetMemoryUse(TestResource::GetTypeStatic()), uint64_t(3 * RESOURCE_SIZE));
+        const ResourceGroup& group = GetGroup(cache, TestResource::GetTypeStatic());
+        QCOMPARE(group.hits_, 1U);
+        QCOMPARE(group.evictions_, 1U);
+    }
+    void verifyReferencedNotEvicted() {
+        using namespace Urho3D;
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        cache->SetMemoryBudget(TestResource::GetTypeStatic(), 2 * RESOURCE_SIZE);
+        AddResource<TestResource>(cache, "a.res");
+        SharedPtr<TestResource> held(cache->GetResource<TestResource>("a.res"));
+        AddResource<TestResource>(cache, "b.res");
+        AddResource<TestResource>(cache, "c.res");
+        QVERIFY(cache->GetExistingResource<TestResource>("a.res"));
+        QVERIFY(!cache->GetExistingResource<TestResource>("b.res"));
+    }
+    void verifyTotalBudget() {
+        using namespace Urho3D;
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        cache->SetTotalMemoryBudget(2 * RESOURCE_SIZE + RESOURCE_SIZE / 2);
+        AddResource<TestResource>(cache, "a.res");
+        AddResource<OtherResource>(cache, "o.res");
+        // Over the total budget, the oldest resource goes whatever its type
+        AddResource<TestResource>(cache, "b.res");
+        QVERIFY(!cache->GetExistingResource<TestResource>("a.res"));
+        QVERIFY(cache->GetExistingResource<OtherResource>("o.res"));
+        QVERIFY(cache->GetExistingResource<TestResource>("b.res"));
+        QCOMPARE(cache->GetTotalMemoryUse(), uint64_t(2 * RESOURCE_SIZE));
+        QCOMPARE(GetGroup(cache, TestResource::GetTypeStatic()).evictions_, 1U);
+        QCOMPARE(GetGroup(cache, OtherResource::GetTypeStatic()).evictions_, 0U);
+    }
+    void verifyEvictedReloadedInBackground() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        QVERIFY(WriteFile(dir.path() + "/material.res", "dep:texture.res"));
+        QVERIFY(WriteFile(dir.path() + "/texture.res", "texture"));
+        QVERIFY(WriteFile(dir.path() + "/big1.res", "big"));
+        QVERIFY(WriteFile(dir.path() + "/big2.res", "big"));
+
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QVERIFY(cache->AddResourceDir(dir.path()));
+        cache->SetMemoryBudget(TestResource::GetTypeStatic(), 2 * RESOURCE_SIZE + RESOURCE_SIZE / 2);
+        QVERIFY(cache->GetResource<TestResource>("material.res"));
+        QThread::msleep(20);
+        QVERIFY(cache->GetResource<TestResource>("big1.res"));
+        QThread::msleep(20);
+        QVERIFY(cache->GetResource<TestResource>("big2.res"));
+        QVERIFY(!cache->GetExistingResource<TestResource>("material.res"));
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 0U);
+
+        // Needed again after eviction: the reload goes through the background loader, which queues its dependency
+        QThread::msleep(20);
+        QVERIFY(cache->GetResource<TestResource>("material.res"));
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 1U);
+        QVERIFY(cache->GetResource<TestResource>("texture.res"));
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 0U);
+        QVERIFY(cache->GetExistingResource<TestResource>("material.res"));
+
+        const ResourceGroup& group = GetGroup(cache, TestResource::GetTypeStatic());
+        QCOMPARE(group.misses_, 4U);
+        QCOMPARE(group.hits_, 1U);
+        QCOMPARE(group.evictions_, 3U);
+        QVERIFY(group.evicted_.find(StringHash("material.res")) == group.evicted_.end());
+    }
+    void verifyLookupFromWorkerKeepsResource() {
+        using namespace Urho3D;
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        AddResource<TestResource>(cache, "a.res");
+
+        SharedPtr<TestResource> found;
+        std::thread worker([&]() { found = cache->GetExistingResource<TestResource>("a.res"); });
+        worker.join();
+        QVERIFY(found);
+        QCOMPARE(found->Refs(), 2);
+        // The reference taken by the worker outlives the cache's
+        cache->ReleaseResource<TestResource>("a.res", true);
+        QVERIFY(!cache->GetExistingResource<TestResource>("a.res"));
+        QCOMPARE(found->Refs(), 1);
+        QCOMPARE(found->GetName(), QString("a.res"));
+    }
+    void verifyMissingFileFoundInAddedDir() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QTemporaryDir laterDir;
+        QVERIFY(dir.isValid() && laterDir.isValid());
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QVERIFY(cache->AddResourceDir(dir.path()));
+        QVERIFY(!cache->Exists("late.res"));
+
+        // A file missing before is found once a directory containing it is added
+        QVERIFY(WriteFile(laterDir.path() + "/late.res", "late"));
+        QVERIFY(!cache->Exists("late.res"));
+        QVERIFY(cache->AddResourceDir(laterDir.path()));
+        QVERIFY(cache->Exists("late.res"));
+        QVERIFY(cache->GetResource<TestResource>("late.res"));
+    }
+    void benchmarkStartupLookups() {
+        using namespace Urho3D;
+        const unsigned NUM_DIRS = 4;
+        const unsigned NUM_SUBDIRS = 20;
+        const unsigned NUM_FILES = 50;
+        QTemporaryDir root;
+        QVERIFY(root.isValid());
+        QStringList names;
+        for (unsigned d = 0; d < NUM_DIRS; ++d)
+        {
+            for (unsigned s = 0; s < NUM_SUBDIRS; ++s)
+            {
+                QString subDir = QString("Dir%1/Sub%2").arg(d).arg(s);
+                QVERIFY(QDir(root.path()).mkpath(subDir));
+                for (unsigned f = 0; f < NUM_FILES; ++f)
+                {
+                    QString name = QString("Sub%1/File%2_%3.res").arg(s).arg(d).arg(f);
+                    QVERIFY(WriteFile(root.path() + QString("/Dir%1/").arg(d) + name, "x"));
+                    names.push_back(name);
+                    // Startup code also asks for files that are in none of the directories, often repeatedly
+                    names.push_back(QString("Sub%1/Missing%2_%3.res").arg(s).arg(d).arg(f % 10));
+                }
+            }
+        }
+
+        // Adding the directories and resolving the names, as a program starting up would
+        QBENCHMARK {
+            Context context;
+            CreateCache(&context);
+            ResourceCache* cache = context.m_ResourceCache.get();
+            for (unsigned d = 0; d < NUM_DIRS; ++d)
+                cache->AddResourceDir(root.path() + QString("/Dir%1").arg(d));
+            for (const QString& name : names)
+                cache->Exists(name);
+        }
+    }
+    void benchmarkConcurrentLookup_data() {
+        QTest::addColumn<unsigned>("numThreads");
+        QTest::newRow("1 thread") << 1U;
+        QTest::newRow("4 threads") << 4U;
+        QTest::newRow("8 threads") << 8U;
+    }
+    void benchmarkConcurrentLookup() {
+        using namespace Urho3D;
+        QFETCH(unsigned, numThreads);
+        const unsigned NUM_RESOURCES = 1000;
+        const unsigned NUM_LOOKUPS = 100000;
+        Context context;
+        CreateCache(&context);
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QStringList names;
+        for (unsigned i = 0; i < NUM_RESOURCES; ++i)
+        {
+            names.push_back(QString("Textures/Resource%1.res").arg(i));
+            TestResource* resource = new TestResource(&context);
+            resource->SetName(names.back());
+            cache->AddManualResource(resource);
+        }
+
+        // Each thread resolves the same number of names, as worker threads resolving materials and textures would
+        QBENCHMARK {
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < numThreads; ++t)
+            {
+                threads.emplace_back([&, t]() {
+                    for (unsigned i = 0; i < NUM_LOOKUPS; ++i)
+                        cache->GetExistingResource<TestResource>(names[(i * 7 + t) % NUM_RESOURCES]);
+                });
+            }
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+    }
+};
+
+QTEST_MAIN(ResourceCacheTests)
+#include "ResourceCacheTests.moc"
@@ -152,6 +152,8 @@ Scene::Scene(Context* context) :
 
 Scene::~Scene()
 {
+    SaveRecordedManifest();
+
     // Remove root-level components first, so that scene subsystems such as the octree destroy themselves. This will speed up
     // the removal of child nodes' components
     RemoveAllComponents();
@@ -197,6 +199,7 @@ bool Scene::Load(Deserializer& source)
     URHO3D_LOGINFO("Loading scene from " + source.GetName());
 
     Clear();
+    PrefetchResources(source.GetName());
 
     // Load the whole scene, then perform post-load if successfully loaded
     if (Node::Load(source))
@@ -297,6 +300,7 @@ bool Scene::LoadXML(Deserializer& source)
     URHO3D_LOGINFO("Loading scene from " + source.GetName());
 
     Clear();
+    PrefetchResources(source.GetName());
 
     if (Node::LoadXML(xml->GetRoot()))
     {
@@ -320,6 +324,7 @@ bool Scene::LoadJSON(Deserializer& source)
     URHO3D_LOGINFO("Loading scene from " + source.GetName());
 
     Clear();
+    PrefetchResources(source.GetName());
 
     if (Node::LoadJSON(json->GetRoot()))
     {
@@ -446,6 +451,10 @@ bool Scene::LoadAsync(File* file, LoadMode mode)
         PreloadResources(file, isSceneFile);
     }
 
+    // Resources the scene requested on earlier runs, but which are not referenced by its file, e.g. those of materials
+    // and prefabs; queued after the preloaded ones, so that those are tracked by the loading progress
+    PrefetchResources(file->GetName());
+
     return true;
 }
 
@@ -515,6 +524,8 @@ bool Scene::LoadAsyncXML(File* file, LoadMode mode)
         PreloadResourcesXML(xml->GetRoot());
     }
 
+    PrefetchResources(file->GetName());
+
     return true;
 }
 
@@ -580,6 +591,8 @@ bool Scene::LoadAsyncJSON(File* file, LoadMode mode)
         PreloadResourcesJSON(json->GetRoot());
     }
 
+    PrefetchResources(file->GetName());
+
     return true;
 }
 
@@ -678,6 +691,8 @@ Node* Scene::InstantiateJSON(Deserializer& source, const Vector3& position, cons
 void Scene::Clear(bool clearReplicated, bool clearLocal)
 {
     StopAsyncLoading();
+    if (clearReplicated && clearLocal)
+        SaveRecordedManifest();
 
     RemoveChildren(clearReplicated, clearLocal, true);
     RemoveComponents(clearReplicated, clearLocal);
@@ -1558,6 +1573,38 @@ void Scene::PreloadResourcesJSON(const JSONValue& value)
     }
 }
 
+void Scene::PrefetchResources(const QString& fileName)
+{
+    if (fileName.isEmpty())
+        return;
+
+    ResourceCache* cache = context_->resourceCache();
+    cache->PrefetchResourceManifest(ResourceCache::GetResourceManifestName(fileName));
+
+    // A recording started without a file name belongs to the first scene loaded from a file during it, and is saved
+    // next to that scene when it is unloaded
+    if (cache->IsRecordingManifest() && cache->GetManifestFileName().isEmpty())
+    {
+        QString sceneFileName = cache->GetResourceFileName(fileName);
+        if (!sceneFileName.isEmpty())
+        {
+            manifestFileName_ = ResourceCache::GetResourceManifestName(sceneFileName);
+            cache->SetManifestFileName(manifestFileName_);
+        }
+    }
+}
+
+void Scene::SaveRecordedManifest()
+{
+    if (manifestFileName_.isEmpty())
+        return;
+
+    ResourceCache* cache = context_->resourceCache();
+    if (cache && cache->IsRecordingManifest() && cache->GetManifestFileName() == manifestFileName_)
+        cache->SaveResourceManifest(manifestFileName_);
+    manifestFileName_.clear();
+}
+
 void RegisterSceneLibrary(Context* context)
 {
     ValueAnimation::RegisterObject(context);
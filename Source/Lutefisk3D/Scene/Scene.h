@@ -234,9 +234,15 @@ private:
     void PreloadResourcesXML(const XMLElement& element);
     /// Preload resources from a JSON scene or object prefab file.
     void PreloadResourcesJSON(const JSONValue& value);
+    /// Queue background loading of the resources recorded in the resource manifest of a scene file, if it has one.
+    void PrefetchResources(const QString& fileName);
+    /// Save the resource manifest being recorded for this scene, if any, as the scene is unloaded.
+    void SaveRecordedManifest();
 
     /// Source file name.
     mutable QString fileName_;
+    /// Resource manifest file recorded for the loaded scene, saved when the scene is unloaded.
+    QString manifestFileName_;
     /// Required package files for networking.
     std::vector<SharedPtr<PackageFile> > requiredPackageFiles_;
     /// Scene source file checksum.
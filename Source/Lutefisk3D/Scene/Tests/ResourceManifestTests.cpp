@@ -0,0 +1,178 @@
+#include <QTest>
+#include <QMutex>
+#include <QTemporaryDir>
+#include <QThread>
+#include "../Scene.h"
+#include "Lutefisk3D/Core/Context.h"
+#include "Lutefisk3D/Core/CoreEvents.h"
+#include "Lutefisk3D/IO/File.h"
+#include "Lutefisk3D/IO/FileSystem.h"
+#include "Lutefisk3D/Resource/Resource.h"
+#include "Lutefisk3D/Resource/ResourceCache.h"
+#include "Lutefisk3D/Resource/XMLFile.h"
+
+namespace
+{
+QMutex decodeMutex;
+/// Names of the test resources in the order they were decoded.
+QStringList decodeOrder;
+
+/// Resource that records the order it is decoded in.
+class TestResource : public Urho3D::Resource
+{
+    URHO3D_OBJECT(TestResource, Urho3D::Resource)
+
+public:
+    TestResource(Urho3D::Context* context) : Resource(context) {}
+
+    bool BeginLoad(Urho3D::Deserializer& source) override
+    {
+        Q_UNUSED(source);
+        QMutexLocker lock(&decodeMutex);
+        decodeOrder.push_back(GetName());
+        return true;
+    }
+};
+
+int GetNumDecoded()
+{
+    QMutexLocker lock(&decodeMutex);
+    return decodeOrder.size();
+}
+
+bool WriteFile(const QString& fileName, const QByteArray& contents)
+{
+    QFile file(fileName);
+    return file.open(QFile::WriteOnly) && file.write(contents) == contents.size();
+}
+
+/// Create the subsystems and a resource directory holding the given test resources.
+void CreateSubsystems(Urho3D::Context* context, const QString& dir, const QStringList& names)
+{
+    using namespace Urho3D;
+    RegisterSceneLibrary(context);
+    context->RegisterFactory<TestResource>();
+    context->m_FileSystem.reset(new FileSystem(context));
+    context->m_ResourceCache.reset(new ResourceCache(context));
+    for (const QString& name : names)
+        WriteFile(dir + "/" + name, "x");
+    context->m_ResourceCache->AddResourceDir(dir);
+    context->m_ResourceCache->SetNumBackgroundReadThreads(1);
+    context->m_ResourceCache->SetNumBackgroundLoadThreads(1);
+}
+
+/// Return the resource names listed in a manifest file.
+QStringList ReadManifest(Urho3D::Context* context, const QString& fileName)
+{
+    using namespace Urho3D;
+    QStringList names;
+    File file(context, fileName);
+    SharedPtr<XMLFile> manifest(new XMLFile(context));
+    if (!file.IsOpen() || !manifest->Load(file))
+        return names;
+    for (XMLElement elem = manifest->GetRoot().GetChild("resource"); elem; elem = elem.GetNext("resource"))
+    {
+        if (elem.GetAttribute("type") == TestResource::GetTypeNameStatic())
+            names.push_back(elem.GetAttribute("name"));
+    }
+    return names;
+}
+}
+
+class ResourceManifestTests : public QObject {
+    Q_OBJECT
+private slots:
+    void init() {
+        QMutexLocker lock(&decodeMutex);
+        decodeOrder.clear();
+    }
+    void verifyRecordingOrder() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        Context context;
+        CreateSubsystems(&context, dir.path(), { "a.res", "b.res", "c.res" });
+        ResourceCache* cache = context.m_ResourceCache.get();
+
+        cache->StartManifestRecording();
+        QVERIFY(cache->GetResource<TestResource>("b.res"));
+        QVERIFY(cache->GetResource<TestResource>("a.res"));
+        // Requested again: recorded once, at the first request
+        QVERIFY(cache->GetResource<TestResource>("b.res"));
+        QVERIFY(cache->BackgroundLoadResource<TestResource>("c.res"));
+        const QString manifestName = dir.path() + "/test.manifest";
+        QVERIFY(cache->SaveResourceManifest(manifestName));
+        QVERIFY(!cache->IsRecordingManifest());
+        QCOMPARE(ReadManifest(&context, manifestName), QStringList({ "b.res", "a.res", "c.res" }));
+    }
+    void verifySavedWhenSceneCleared() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        Context context;
+        CreateSubsystems(&context, dir.path(), { "a.res" });
+        ResourceCache* cache = context.m_ResourceCache.get();
+        {
+            Scene emptyScene(&context);
+            File sceneFile(&context, dir.path() + "/scene.xml", FILE_WRITE);
+            QVERIFY(emptyScene.SaveXML(sceneFile));
+        }
+
+        // A recording without a file name belongs to the next scene loaded, and is saved next to it
+        cache->StartManifestRecording();
+        SharedPtr<Scene> scene(new Scene(&context));
+        std::unique_ptr<File> sceneFile = cache->GetFile("scene.xml");
+        QVERIFY(sceneFile);
+        QVERIFY(scene->LoadXML(*sceneFile));
+        const QString manifestName = ResourceCache::GetResourceManifestName(cache->GetResourceFileName("scene.xml"));
+        QCOMPARE(cache->GetManifestFileName(), manifestName);
+        QVERIFY(cache->GetResource<TestResource>("a.res"));
+        QVERIFY(!QFile::exists(manifestName));
+
+        scene->Clear();
+        QVERIFY(!cache->IsRecordingManifest());
+        QCOMPARE(ReadManifest(&context, manifestName), QStringList({ "a.res" }));
+    }
+    void verifyPrefetchOrderAndCounters() {
+        using namespace Urho3D;
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        Context context;
+        CreateSubsystems(&context, dir.path(), { "a.res", "b.res", "c.res", "other.res" });
+        ResourceCache* cache = context.m_ResourceCache.get();
+        QVERIFY(WriteFile(dir.path() + "/scene.xml.manifest",
+                          "<manifest>"
+                          "<resource type=\"TestResource\" name=\"c.res\"/>"
+                          "<resource type=\"TestResource\" name=\"a.res\"/>"
+                          "<resource type=\"TestResource\" name=\"b.res\"/>"
+                          "</manifest>"));
+
+        QCOMPARE(cache->PrefetchResourceManifest("scene.xml.manifest"), 3U);
+        {
+            // One read and one decode thread load the resources in the recorded order
+            QTRY_COMPARE(GetNumDecoded(), 3);
+            QMutexLocker lock(&decodeMutex);
+            QCOMPARE(decodeOrder, QStringList({ "c.res", "a.res", "b.res" }));
+        }
+        for (unsigned frame = 1; cache->GetNumBackgroundLoadResources() && frame < 100; ++frame)
+        {
+            g_coreSignals.beginFrame(frame, 0.0f);
+            QThread::msleep(10);
+        }
+        QCOMPARE(cache->GetNumBackgroundLoadResources(), 0U);
+
+        // Served by the prefetch without stalling
+        for (const char* name : { "a.res", "b.res", "c.res" })
+            QVERIFY(cache->GetResource<TestResource>(name));
+        QCOMPARE(cache->GetNumPrefetchHits(), 3U);
+        QCOMPARE(cache->GetNumHitches(), 0U);
+        // A repeated request is a plain hit, and a resource not prefetched stalls to load
+        QVERIFY(cache->GetResource<TestResource>("a.res"));
+        QCOMPARE(cache->GetNumPrefetchHits(), 3U);
+        QVERIFY(cache->GetResource<TestResource>("other.res"));
+        QCOMPARE(cache->GetNumHitches(), 1U);
+    }
+};
+
+QTEST_MAIN(ResourceManifestTests)
+#include "ResourceManifestTests.moc"
@@ -344,7 +344,14 @@ dtCrowd::dtCrowd() :
 	m_maxPathResult(0),
 	m_maxAgentRadius(0),
 	m_velocitySampleCount(0),
-	m_navquery(0)
+	m_navquery(0),
+	// Urho3D: Add parallel update support
+	m_parallelFor(0),
+	m_parallelForUserData(0),
+	m_maxParts(0),
+	m_partNavQueries(0),
+	m_partObstacleQueries(0),
+	m_partSampleCounts(0)
 {
 }
 
@@ -355,6 +362,9 @@ dtCrowd::~dtCrowd()
 
 void dtCrowd::purge()
 {
+	// Urho3D: Add parallel update support
+	purgeParts();
+
 	for (int i = 0; i < m_maxAgents; ++i)
 		m_agents[i].~dtCrowdAgent();
 	dtFree(m_agents);
@@ -464,6 +474,70 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	if (dtStatusFailed(m_navquery->init(nav, MAX_COMMON_NODES)))
 		return false;
 	
+	// Urho3D: Add parallel update support
+	return setParallelFor(0, 0, 1);
+}
+
+// Urho3D: Add parallel update support
+void dtCrowd::purgeParts()
+{
+	// Part 0 uses the crowd's own queries
+	for (int i = 1; i < m_maxParts; ++i)
+	{
+		dtFreeNavMeshQuery(m_partNavQueries[i]);
+		dtFreeObstacleAvoidanceQuery(m_partObstacleQueries[i]);
+	}
+	dtFree(m_partNavQueries);
+	m_partNavQueries = 0;
+	dtFree(m_partObstacleQueries);
+	m_partObstacleQueries = 0;
+	dtFree(m_partSampleCounts);
+	m_partSampleCounts = 0;
+	m_maxParts = 0;
+	m_parallelFor = 0;
+	m_parallelForUserData = 0;
+}
+
+bool dtCrowd::setParallelFor(dtParallelForCallback cb, void* userData, const int maxParts)
+{
+	purgeParts();
+	if (!m_navquery || !m_obstacleQuery)
+		return false;
+
+	const int nparts = dtMax(maxParts, 1);
+	m_partNavQueries = (dtNavMeshQuery**)dtAlloc(sizeof(dtNavMeshQuery*)*nparts, DT_ALLOC_PERM);
+	m_partObstacleQueries = (dtObstacleAvoidanceQuery**)dtAlloc(sizeof(dtObstacleAvoidanceQuery*)*nparts, DT_ALLOC_PERM);
+	m_partSampleCounts = (int*)dtAlloc(sizeof(int)*nparts, DT_ALLOC_PERM);
+	bool success = m_partNavQueries && m_partObstacleQueries && m_partSampleCounts;
+	if (success)
+	{
+		memset(m_partNavQueries, 0, sizeof(dtNavMeshQuery*)*nparts);
+		memset(m_partObstacleQueries, 0, sizeof(dtObstacleAvoidanceQuery*)*nparts);
+		m_maxParts = nparts;
+		m_partNavQueries[0] = m_navquery;
+		m_partObstacleQueries[0] = m_obstacleQuery;
+	}
+
+	for (int i = 1; success && i < nparts; ++i)
+	{
+		m_partNavQueries[i] = dtAllocNavMeshQuery();
+		m_partObstacleQueries[i] = dtAllocObstacleAvoidanceQuery();
+		success = m_partNavQueries[i] && m_partObstacleQueries[i] &&
+			dtStatusSucceed(m_partNavQueries[i]->init(m_navquery->getAttachedNavMesh(), MAX_COMMON_NODES)) &&
+			m_partObstacleQueries[i]->init(6, 8);
+	}
+
+	if (!success)
+	{
+		// Fall back to updating in the calling thread with the crowd's own queries
+		purgeParts();
+		if (nparts > 1)
+			setParallelFor(0, 0, 1);
+		return false;
+	}
+
+	m_parallelFor = cb;
+	m_parallelForUserData = userData;
 	return true;
 }
 
@@ -1051,36 +1125,54 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 	}
 }
 	
-void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
-{
-	m_velocitySampleCount = 0;
-	
-	const int debugIdx = debug ? debug->idx : -1;
-	
-	dtCrowdAgent** agents = m_activeAgents;
-	int nagents = getActiveAgents(agents, m_maxAgents);
+// Urho3D: Add parallel update support
+static const int MIN_AGENTS_PER_PART = 64;
 
-	// Check that all agents still have valid paths.
-	checkPathValidity(agents, nagents, dt);
-	
-	// Update async move request and path finder.
-	updateMoveRequest(dt);
+struct dtCrowd::dtCrowdPhaseTask
+{
+	dtCrowd* crowd;
+	dtCrowdPhase phase;
+	dtCrowdAgent** agents;
+	int nagents;
+	int nparts;
+	float dt;
+	dtCrowdAgentDebugInfo* debug;
+};
+
+void dtCrowd::runPhasePart(void* taskData, int part)
+{
+	const dtCrowdPhaseTask* task = (const dtCrowdPhaseTask*)taskData;
+	const int begin = (int)((long long)task->nagents * part / task->nparts);
+	const int end = (int)((long long)task->nagents * (part+1) / task->nparts);
+	(task->crowd->*task->phase)(task->agents, task->nagents, begin, end, part, task->dt, task->debug);
+}
 
-	// Optimize path topology.
-	updateTopologyOptimization(agents, nagents, dt);
-	
-	// Register agents to proximity grid.
-	m_grid->clear();
-	for (int i = 0; i < nagents; ++i)
+void dtCrowd::runPhase(dtCrowdPhase phase, dtCrowdAgent** agents, const int nagents, const float dt, dtCrowdAgentDebugInfo* debug)
+{
+	const int nparts = m_parallelFor ? dtMax(1, dtMin(m_maxParts, nagents / MIN_AGENTS_PER_PART)) : 1;
+	if (nparts < 2)
 	{
-		dtCrowdAgent* ag = agents[i];
-		const float* p = ag->npos;
-		const float r = ag->params.radius;
-		m_grid->addItem((unsigned short)i, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
+		(this->*phase)(agents, nagents, 0, nagents, 0, dt, debug);
+		return;
 	}
 	
-	// Get nearby navmesh segments and agents to collide with.
-	for (int i = 0; i < nagents; ++i)
+	dtCrowdPhaseTask task;
+	task.crowd = this;
+	task.phase = phase;
+	task.agents = agents;
+	task.nagents = nagents;
+	task.nparts = nparts;
+	task.dt = dt;
+	task.debug = debug;
+	(*m_parallelFor)(m_parallelForUserData, nparts, runPhasePart, &task);
+}
+
+void dtCrowd::updateNeighbours(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+							   const float /*dt*/, dtCrowdAgentDebugInfo* /*debug*/)
+{
+	dtNavMeshQuery* navquery = m_partNavQueries[part];
+	
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
@@ -1090,10 +1182,10 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		// if it has become invalid.
 		const float updateThr = ag->params.collisionQueryRange*0.25f;
 		if (dtVdist2DSqr(ag->npos, ag->boundary.getCenter()) > dtSqr(updateThr) ||
-			!ag->boundary.isValid(m_navquery, &m_filters[ag->params.queryFilterType]))
+			!ag->boundary.isValid(navquery, &m_filters[ag->params.queryFilterType]))
 		{
 			ag->boundary.update(ag->corridor.getFirstPoly(), ag->npos, ag->params.collisionQueryRange,
-								m_navquery, &m_filters[ag->params.queryFilterType]);
+								navquery, &m_filters[ag->params.queryFilterType]);
 		}
 		// Query neighbour agents
 		ag->nneis = getNeighbours(ag->npos, ag->params.height, ag->params.collisionQueryRange,
@@ -1102,9 +1194,15 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		for (int j = 0; j < ag->nneis; j++)
 			ag->neis[j].idx = getAgentIndex(agents[ag->neis[j].idx]);
 	}
+}
+
+void dtCrowd::updateCorners(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int part,
+							const float /*dt*/, dtCrowdAgentDebugInfo* debug)
+{
+	dtNavMeshQuery* navquery = m_partNavQueries[part];
+	const int debugIdx = debug ? debug->idx : -1;
 	
-	// Find next corner to steer to.
-	for (int i = 0; i < nagents; ++i)
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 		
@@ -1115,14 +1213,14 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		
 		// Find corners for steering
 		ag->ncorners = ag->corridor.findCorners(ag->cornerVerts, ag->cornerFlags, ag->cornerPolys,
-												DT_CROWDAGENT_MAX_CORNERS, m_navquery, &m_filters[ag->params.queryFilterType]);
+												DT_CROWDAGENT_MAX_CORNERS, navquery, &m_filters[ag->params.queryFilterType]);
 		
 		// Check to see if the corner after the next corner is directly visible,
 		// and short cut to there.
 		if ((ag->params.updateFlags & DT_CROWD_OPTIMIZE_VIS) && ag->ncorners > 0)
 		{
 			const float* target = &ag->cornerVerts[dtMin(1,ag->ncorners-1)*3];
-			ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, m_navquery, &m_filters[ag->params.queryFilterType]);
+			ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, navquery, &m_filters[ag->params.queryFilterType]);
 			
 			// Copy data for debug purposes.
 			if (debugIdx == i)
@@ -1141,50 +1239,12 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			}
 		}
 	}
-	
-	// Trigger off-mesh connections (depends on corners).
-	for (int i = 0; i < nagents; ++i)
-	{
-		dtCrowdAgent* ag = agents[i];
-		
-		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-			continue;
-		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
-			continue;
-		
-		// Check 
-		const float triggerRadius = ag->params.radius*2.25f;
-		if (overOffmeshConnection(ag, triggerRadius))
-		{
-			// Prepare to off-mesh connection.
-			const int idx = (int)(ag - m_agents);
-			dtCrowdAgentAnimation* anim = &m_agentAnims[idx];
-			
-			// Adjust the path over the off-mesh connection.
-			dtPolyRef refs[2];
-			if (ag->corridor.moveOverOffmeshConnection(ag->cornerPolys[ag->ncorners-1], refs,
-													   anim->startPos, anim->endPos, m_navquery))
-			{
-				dtVcopy(anim->initPos, ag->npos);
-				anim->polyRef = refs[1];
-				anim->active = true;
-				anim->t = 0.0f;
-				anim->tmax = (dtVdist2D(anim->startPos, anim->endPos) / ag->params.maxSpeed) * 0.5f;
-				
-				ag->state = DT_CROWDAGENT_STATE_OFFMESH;
-				ag->ncorners = 0;
-				ag->nneis = 0;
-				continue;
-			}
-			else
-			{
-				// Path validity check will ensure that bad/blocked connections will be replanned.
-			}
-		}
-	}
-		
-	// Calculate steering.
-	for (int i = 0; i < nagents; ++i)
+}
+
+void dtCrowd::updateSteering(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int /*part*/,
+							 const float /*dt*/, dtCrowdAgentDebugInfo* /*debug*/)
+{
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 
@@ -1261,9 +1321,15 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		// Set the desired velocity.
 		dtVcopy(ag->dvel, dvel);
 	}
+}
+
+void dtCrowd::updateVelocityPlanning(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int part,
+									 const float /*dt*/, dtCrowdAgentDebugInfo* debug)
+{
+	dtObstacleAvoidanceQuery* obstacleQuery = m_partObstacleQueries[part];
+	const int debugIdx = debug ? debug->idx : -1;
 	
-	// Velocity planning.	
-	for (int i = 0; i < nagents; ++i)
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 		
@@ -1272,13 +1338,13 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 		
 		if (ag->params.updateFlags & DT_CROWD_OBSTACLE_AVOIDANCE)
 		{
-			m_obstacleQuery->reset();
+			obstacleQuery->reset();
 			
 			// Add neighbours as obstacles.
 			for (int j = 0; j < ag->nneis; ++j)
 			{
 				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				m_obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
+				obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
 			}
 
 			// Append neighbour segments as obstacles.
@@ -1287,7 +1353,7 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				const float* s = ag->boundary.getSegment(j);
 				if (dtTriArea2D(ag->npos, s, s+3) < 0.0f)
 					continue;
-				m_obstacleQuery->addSegment(s, s+3);
+				obstacleQuery->addSegment(s, s+3);
 			}
 
 			dtObstacleAvoidanceDebugData* vod = 0;
@@ -1302,15 +1368,15 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 				
 			if (adaptive)
 			{
-				ns = m_obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
+				ns = obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
 															 ag->vel, ag->dvel, ag->nvel, params, vod);
 			}
 			else
 			{
-				ns = m_obstacleQuery->sampleVelocityGrid(ag->npos, ag->params.radius, ag->desiredSpeed,
+				ns = obstacleQuery->sampleVelocityGrid(ag->npos, ag->params.radius, ag->desiredSpeed,
 														 ag->vel, ag->dvel, ag->nvel, params, vod);
 			}
-			m_velocitySampleCount += ns;
+			m_partSampleCounts[part] += ns;
 		}
 		else
 		{
@@ -1318,91 +1384,91 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			dtVcopy(ag->nvel, ag->dvel);
 		}
 	}
+}
 
-	// Integrate.
-	for (int i = 0; i < nagents; ++i)
+void dtCrowd::updateIntegration(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int /*part*/,
+								const float dt, dtCrowdAgentDebugInfo* /*debug*/)
+{
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 		integrate(ag, dt);
 	}
-	
-	// Handle collisions.
-	static const float COLLISION_RESOLVE_FACTOR = 0.7f;
-	
-	for (int iter = 0; iter < 4; ++iter)
+}
+
+static const float COLLISION_RESOLVE_FACTOR = 0.7f;
+
+void dtCrowd::updateCollisionDisplacement(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int /*part*/,
+										  const float /*dt*/, dtCrowdAgentDebugInfo* /*debug*/)
+{
+	for (int i = begin; i < end; ++i)
 	{
-		for (int i = 0; i < nagents; ++i)
+		dtCrowdAgent* ag = agents[i];
+		const int idx0 = getAgentIndex(ag);
+		
+		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+
+		dtVset(ag->disp, 0,0,0);
+		
+		float w = 0;
+
+		for (int j = 0; j < ag->nneis; ++j)
 		{
-			dtCrowdAgent* ag = agents[i];
-			const int idx0 = getAgentIndex(ag);
-			
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
+			const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
+			const int idx1 = getAgentIndex(nei);
 
-			dtVset(ag->disp, 0,0,0);
+			float diff[3];
+			dtVsub(diff, ag->npos, nei->npos);
+			diff[1] = 0;
 			
-			float w = 0;
-
-			for (int j = 0; j < ag->nneis; ++j)
+			float dist = dtVlenSqr(diff);
+			if (dist > dtSqr(ag->params.radius + nei->params.radius))
+				continue;
+			dist = dtMathSqrtf(dist);
+			float pen = (ag->params.radius + nei->params.radius) - dist;
+			if (dist < 0.0001f)
 			{
-				const dtCrowdAgent* nei = &m_agents[ag->neis[j].idx];
-				const int idx1 = getAgentIndex(nei);
-
-				float diff[3];
-				dtVsub(diff, ag->npos, nei->npos);
-				diff[1] = 0;
-				
-				float dist = dtVlenSqr(diff);
-				if (dist > dtSqr(ag->params.radius + nei->params.radius))
-					continue;
-				dist = dtMathSqrtf(dist);
-				float pen = (ag->params.radius + nei->params.radius) - dist;
-				if (dist < 0.0001f)
-				{
-					// Agents on top of each other, try to choose diverging separation directions.
-					if (idx0 > idx1)
-						dtVset(diff, -ag->dvel[2],0,ag->dvel[0]);
-					else
-						dtVset(diff, ag->dvel[2],0,-ag->dvel[0]);
-					pen = 0.01f;
-				}
+				// Agents on top of each other, try to choose diverging separation directions.
+				if (idx0 > idx1)
+					dtVset(diff, -ag->dvel[2],0,ag->dvel[0]);
 				else
-				{
-					pen = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
-				}
-				
-				dtVmad(ag->disp, ag->disp, diff, pen);			
-				
-				w += 1.0f;
+					dtVset(diff, ag->dvel[2],0,-ag->dvel[0]);
+				pen = 0.01f;
 			}
-			
-			if (w > 0.0001f)
+			else
 			{
-				const float iw = 1.0f / w;
-				dtVscale(ag->disp, ag->disp, iw);
+				pen = (1.0f/dist) * (pen*0.5f) * COLLISION_RESOLVE_FACTOR;
 			}
+			
+			dtVmad(ag->disp, ag->disp, diff, pen);			
+			
+			w += 1.0f;
 		}
 		
-		for (int i = 0; i < nagents; ++i)
+		if (w > 0.0001f)
 		{
-			dtCrowdAgent* ag = agents[i];
-			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
-				continue;
-			
-			dtVadd(ag->npos, ag->npos, ag->disp);
+			const float iw = 1.0f / w;
+			dtVscale(ag->disp, ag->disp, iw);
 		}
 	}
+}
+
+void dtCrowd::updateMovePosition(dtCrowdAgent** agents, const int /*nagents*/, const int begin, const int end, const int part,
+								 const float /*dt*/, dtCrowdAgentDebugInfo* /*debug*/)
+{
+	dtNavMeshQuery* navquery = m_partNavQueries[part];
 	
-	for (int i = 0; i < nagents; ++i)
+	for (int i = begin; i < end; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
 		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
 			continue;
 		
 		// Move along navmesh.
-		ag->corridor.movePosition(ag->npos, m_navquery, &m_filters[ag->params.queryFilterType]);
+		ag->corridor.movePosition(ag->npos, navquery, &m_filters[ag->params.queryFilterType]);
 		// Get valid constrained position back.
 		dtVcopy(ag->npos, ag->corridor.getPos());
 
@@ -1412,10 +1478,126 @@ void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
 			ag->corridor.reset(ag->corridor.getFirstPoly(), ag->npos);
 			ag->partial = false;
 		}
+	}
+}
+
+void dtCrowd::update(const float dt, dtCrowdAgentDebugInfo* debug)
+{
+	m_velocitySampleCount = 0;
+	
+	dtCrowdAgent** agents = m_activeAgents;
+	int nagents = getActiveAgents(agents, m_maxAgents);
+
+	// Check that all agents still have valid paths.
+	checkPathValidity(agents, nagents, dt);
+	
+	// Update async move request and path finder.
+	updateMoveRequest(dt);
+
+	// Optimize path topology.
+	updateTopologyOptimization(agents, nagents, dt);
+	
+	// Register agents to proximity grid.
+	m_grid->clear();
+	for (int i = 0; i < nagents; ++i)
+	{
+		dtCrowdAgent* ag = agents[i];
+		const float* p = ag->npos;
+		const float r = ag->params.radius;
+		m_grid->addItem((unsigned short)i, p[0]-r, p[2]-r, p[0]+r, p[2]+r);
+	}
+	
+	// Urho3D: Add parallel update support
+	// The per-agent phases only write to the agent being processed, and read from the other agents what the previous
+	// phases have written, so they give the same results when split into parts.
+	
+	// Get nearby navmesh segments and agents to collide with.
+	runPhase(&dtCrowd::updateNeighbours, agents, nagents, dt, debug);
+	
+	// Find next corner to steer to.
+	runPhase(&dtCrowd::updateCorners, agents, nagents, dt, debug);
+	
+	// Trigger off-mesh connections (depends on corners).
+	for (int i = 0; i < nagents; ++i)
+	{
+		dtCrowdAgent* ag = agents[i];
+		
+		if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+			continue;
+		if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+			continue;
+		
+		// Check 
+		const float triggerRadius = ag->params.radius*2.25f;
+		if (overOffmeshConnection(ag, triggerRadius))
+		{
+			// Prepare to off-mesh connection.
+			const int idx = (int)(ag - m_agents);
+			dtCrowdAgentAnimation* anim = &m_agentAnims[idx];
+			
+			// Adjust the path over the off-mesh connection.
+			dtPolyRef refs[2];
+			if (ag->corridor.moveOverOffmeshConnection(ag->cornerPolys[ag->ncorners-1], refs,
+													   anim->startPos, anim->endPos, m_navquery))
+			{
+				dtVcopy(anim->initPos, ag->npos);
+				anim->polyRef = refs[1];
+				anim->active = true;
+				anim->t = 0.0f;
+				anim->tmax = (dtVdist2D(anim->startPos, anim->endPos) / ag->params.maxSpeed) * 0.5f;
+				
+				ag->state = DT_CROWDAGENT_STATE_OFFMESH;
+				ag->ncorners = 0;
+				ag->nneis = 0;
+				continue;
+			}
+			else
+			{
+				// Path validity check will ensure that bad/blocked connections will be replanned.
+			}
+		}
+	}
+		
+	// Calculate steering.
+	runPhase(&dtCrowd::updateSteering, agents, nagents, dt, debug);
+	
+	// Velocity planning.
+	memset(m_partSampleCounts, 0, sizeof(int)*m_maxParts);
+	runPhase(&dtCrowd::updateVelocityPlanning, agents, nagents, dt, debug);
+	for (int i = 0; i < m_maxParts; ++i)
+		m_velocitySampleCount += m_partSampleCounts[i];
 
-		// Urho3D: Add update callback support
-		if (m_updateCallback)
+	// Integrate.
+	runPhase(&dtCrowd::updateIntegration, agents, nagents, dt, debug);
+	
+	// Handle collisions.
+	for (int iter = 0; iter < 4; ++iter)
+	{
+		runPhase(&dtCrowd::updateCollisionDisplacement, agents, nagents, dt, debug);
+		
+		for (int i = 0; i < nagents; ++i)
+		{
+			dtCrowdAgent* ag = agents[i];
+			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+				continue;
+			
+			dtVadd(ag->npos, ag->npos, ag->disp);
+		}
+	}
+	
+	// Move along navmesh.
+	runPhase(&dtCrowd::updateMovePosition, agents, nagents, dt, debug);
+	
+	// Urho3D: Add update callback support
+	if (m_updateCallback)
+	{
+		for (int i = 0; i < nagents; ++i)
+		{
+			dtCrowdAgent* ag = agents[i];
+			if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+				continue;
 			(*m_updateCallback)(ag, dt);
+		}
 	}
 	
 	// Update agents using off-mesh connection.
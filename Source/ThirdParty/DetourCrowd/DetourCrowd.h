@@ -204,6 +204,15 @@ struct dtCrowdAgentDebugInfo
 /// Type for the update callback.
 typedef void (*dtUpdateCallback)(dtCrowdAgent* ag, float dt);
 
+// Urho3D: Add parallel update support
+/// Type for the parallel for callback. Must call @p task once for every part in [0, @p count) and return when all
+/// of them have finished. The parts may be run at the same time on different threads.
+///  @param[in]		userData		The user data given to dtCrowd::setParallelFor().
+///  @param[in]		count			The number of parts.
+///  @param[in]		task			The function processing one part.
+///  @param[in]		taskData		The data to pass to @p task.
+typedef void (*dtParallelForCallback)(void* userData, int count, void (*task)(void* taskData, int part), void* taskData);
+
 /// Provides local steering behaviors for a group of agents. 
 /// @ingroup crowd
 class dtCrowd
@@ -234,6 +243,36 @@ class dtCrowd
 
 	dtNavMeshQuery* m_navquery;
 
+	// Urho3D: Add parallel update support
+	dtParallelForCallback m_parallelFor;
+	void* m_parallelForUserData;
+	int m_maxParts;
+	dtNavMeshQuery** m_partNavQueries;
+	dtObstacleAvoidanceQuery** m_partObstacleQueries;
+	int* m_partSampleCounts;
+
+	typedef void (dtCrowd::*dtCrowdPhase)(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+										  const float dt, dtCrowdAgentDebugInfo* debug);
+	struct dtCrowdPhaseTask;
+
+	void runPhase(dtCrowdPhase phase, dtCrowdAgent** agents, const int nagents, const float dt, dtCrowdAgentDebugInfo* debug);
+	static void runPhasePart(void* taskData, int part);
+	void updateNeighbours(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateCorners(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateSteering(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateVelocityPlanning(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateIntegration(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateCollisionDisplacement(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void updateMovePosition(dtCrowdAgent** agents, const int nagents, const int begin, const int end, const int part,
+						  const float dt, dtCrowdAgentDebugInfo* debug);
+	void purgeParts();
+
 	void updateTopologyOptimization(dtCrowdAgent** agents, const int nagents, const float dt);
 	void updateMoveRequest(const float dt);
 	void checkPathValidity(dtCrowdAgent** agents, const int nagents, const float dt);
@@ -256,6 +295,16 @@ public:
 	///  @param[in]		cb				The update callback.
 	/// @return True if the initialization succeeded.
 	bool init(const int maxAgents, const float maxAgentRadius, dtNavMesh* nav, dtUpdateCallback cb = 0);
+
+	// Urho3D: Add parallel update support
+	/// Sets the callback used to run the per-agent phases of the update in parts. Every part has its own navigation
+	/// mesh and obstacle avoidance queries. The update callback is still called from the thread calling update().
+	/// Must be called after init(), which resets it.
+	///  @param[in]		cb				The parallel for callback, or null to update in the calling thread only.
+	///  @param[in]		userData		The user data passed to the callback.
+	///  @param[in]		maxParts		The maximum number of parts a phase is split into. [Limit: >= 1]
+	/// @return True if the queries of the parts could be allocated.
+	bool setParallelFor(dtParallelForCallback cb, void* userData, const int maxParts);
 	
 	/// Sets the shared avoidance configuration for the specified index.
 	///  @param[in]		idx		The index. [Limits: 0 <= value < #DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS]
@@ -37,6 +37,7 @@
 #include <Lutefisk3D/Graphics/Zone.h>
 #include <Lutefisk3D/IO/File.h>
 #include <Lutefisk3D/IO/FileSystem.h>
+#include <Lutefisk3D/IO/MemoryBuffer.h>
 #ifdef LUTEFISK3D_PHYSICS
 #include <Lutefisk3D/Physics/PhysicsWorld.h>
 #endif
@@ -160,6 +161,7 @@ bool emissiveAO_ = false;
 bool noOverwriteMaterial_ = false;
 bool noOverwriteTexture_ = false;
 bool noOverwriteNewerTexture_ = false;
+bool compressTextures_ = false;
 bool checkUniqueModel_ = true;
 bool moveToBindPose_ = false;
 unsigned maxBones_ = 64;
@@ -199,6 +201,7 @@ void BuildAndSaveScene(OutScene& scene, bool asPrefab);
 void ExportMaterials(HashSet<QString>& usedTextures);
 void BuildAndSaveMaterial(aiMaterial* material, HashSet<QString>& usedTextures);
 void CopyTextures(const HashSet<QString>& usedTextures, const QString& sourcePath);
+bool SaveCompressedTexture(const Image& image, const QString& fullDestName);
 
 void CombineLods(const std::vector<float>& lodDistances, const std::vector<QString>& modelNames, const QString& outName);
 
@@ -300,6 +303,8 @@ void Run(const QStringList& arguments)
             "-cm         Check and do not overwrite if material exists\n"
             "-ct         Check and do not overwrite if texture exists\n"
             "-ctn        Check and do not overwrite if texture has newer timestamp\n"
+            "-dds        Compress material textures to DXT1, or DXT5 if they have alpha, and\n"
+            "            save them as DDS with mipmaps\n"
             "-am         Export all meshes even if identical (scene mode only)\n"
             "-bp         Move bones to bind pose before saving model\n"
             "-split <start> <end> (animation model only)\n"
@@ -451,6 +456,8 @@ void Run(const QStringList& arguments)
                 noOverwriteTexture_ = true;
             else if (argument == "ctn")
                 noOverwriteNewerTexture_ = true;
+            else if (argument == "dds")
+                compressTextures_ = true;
             else if (argument == "am")
                 checkUniqueModel_ = false;
             else if (argument == "bp")
@@ -1985,6 +1992,11 @@ void CopyTextures(const HashSet<QString>& usedTextures, const QString& sourcePat
     if (useSubdirs_)
         fileSystem->CreateDir(resourcePath_ + "Textures");
 
+    // Spread the block encoding of large textures over the worker threads
+    unsigned numThreads = Max(GetNumPhysicalCPUs(), 1U) - 1;
+    if (compressTextures_ && numThreads && !context_->m_WorkQueueSystem->GetNumThreads())
+        context_->m_WorkQueueSystem->CreateThreads(numThreads);
+
     for (auto i = usedTextures.begin(); i != usedTextures.end(); ++i)
     {
         // Handle assimp embedded textures
@@ -1996,15 +2008,31 @@ void CopyTextures(const HashSet<QString>& usedTextures, const QString& sourcePat
             else
             {
                 aiTexture* tex = scene_->mTextures[texIndex];
-                QString fullDestName = resourcePath_ + GenerateTextureName(texIndex);
+                QString fullDestName = resourcePath_ + GetMaterialTextureName(*i);
                 bool destExists = fileSystem->FileExists(fullDestName);
                 if (destExists && noOverwriteTexture_)
                 {
                     PrintLine("Skipping copy of existing embedded texture " + GetFileNameAndExtension(fullDestName));
                     continue;
                 }
+                if (compressTextures_)
+                {
+                    PrintLine("Compressing embedded texture " + GetFileNameAndExtension(fullDestName));
+                    Image image(context_.get());
+                    if (!tex->mHeight)
+                    {
+                        MemoryBuffer source(tex->pcData, tex->mWidth);
+                        image.Load(source);
+                    }
+                    else
+                    {
+                        image.SetSize(tex->mWidth, tex->mHeight, 4);
+                        memcpy(image.GetData(), (const void*)tex->pcData, (size_t)tex->mWidth * tex->mHeight * 4);
+                    }
+                    SaveCompressedTexture(image, fullDestName);
+                }
                 // Encoded texture
-                if (!tex->mHeight)
+                else if (!tex->mHeight)
                 {
                     PrintLine("Saving embedded texture " + GetFileNameAndExtension(fullDestName));
                     File dest(context_.get(), fullDestName, FILE_WRITE);
@@ -2024,7 +2052,7 @@ void CopyTextures(const HashSet<QString>& usedTextures, const QString& sourcePat
         else
         {
             QString fullSourceName = sourcePath + *i;
-            QString fullDestName = resourcePath_ + (useSubdirs_ ? "Textures/" : "") + *i;
+            QString fullDestName = resourcePath_ + GetMaterialTextureName(*i);
 
             if (!fileSystem->FileExists(fullSourceName))
             {
@@ -2053,8 +2081,20 @@ void CopyTextures(const HashSet<QString>& usedTextures, const QString& sourcePat
                 continue;
             }
 
-            PrintLine("Copying material texture " + *i);
-            fileSystem->Copy(fullSourceName, fullDestName);
+            // Textures that are DDS already are copied as they are
+            if (compressTextures_ && GetExtension(*i) != ".dds")
+            {
+                PrintLine("Compressing material texture " + *i);
+                File source(context_.get(), fullSourceName);
+                Image image(context_.get());
+                image.Load(source);
+                SaveCompressedTexture(image, fullDestName);
+            }
+            else
+            {
+                PrintLine("Copying material texture " + *i);
+                fileSystem->Copy(fullSourceName, fullDestName);
+            }
         }
     }
 }
@@ -2375,13 +2415,43 @@ QString GenerateMaterialName(aiMaterial* material)
     return QString();
 }
 
+bool SaveCompressedTexture(const Image& image, const QString& fullDestName)
+{
+    if (!image.GetData() || image.IsCompressed() || image.GetDepth() > 1)
+    {
+        PrintLine("Could not compress texture " + GetFileNameAndExtension(fullDestName) + ", it is not a 2D uncompressed image");
+        return false;
+    }
+
+    // Cut-out alpha would fit DXT1 as well, but only DXT5 keeps partial transparency
+    bool transparent = false;
+    if (image.HasAlphaChannel())
+    {
+        const unsigned char* data = image.GetData();
+        const unsigned components = image.GetComponents();
+        const size_t numPixels = (size_t)image.GetWidth() * image.GetHeight();
+        for (size_t j = 0; j < numPixels && !transparent; ++j)
+            transparent = data[j * components + components - 1] != 255;
+    }
+
+    SharedPtr<Image> compressed = image.Compress(transparent ? CF_DXT5 : CF_DXT1, COMPRESS_HIGH);
+    if (!compressed || !compressed->SaveDDS(fullDestName))
+    {
+        PrintLine("Could not save compressed texture " + GetFileNameAndExtension(fullDestName));
+        return false;
+    }
+    return true;
+}
+
 QString GetMaterialTextureName(const QString& nameIn)
 {
+    QString name;
     // Detect assimp embedded texture
     if (nameIn.length() && nameIn[0] == '*')
-        return GenerateTextureName(nameIn.midRef(1).toInt());
+        name = GenerateTextureName(nameIn.midRef(1).toInt());
     else
-        return (useSubdirs_ ? "Textures/" : "") + nameIn;
+        name = (useSubdirs_ ? "Textures/" : "") + nameIn;
+    return compressTextures_ ? ReplaceExtension(name, ".dds") : name;
 }
 
 QString GenerateTextureName(unsigned texIndex)
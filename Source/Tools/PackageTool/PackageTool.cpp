@@ -23,6 +23,8 @@
 #include <Lutefisk3D/Core/Context.h>
 #include <Lutefisk3D/Container/ArrayPtr.h>
 #include <Lutefisk3D/Core/ProcessUtils.h>
+#include <Lutefisk3D/Core/Timer.h>
+#include <Lutefisk3D/Core/WorkQueue.h>
 #include <Lutefisk3D/IO/File.h>
 #include <Lutefisk3D/IO/FileSystem.h>
 #include <Lutefisk3D/IO/PackageFile.h>
@@ -37,6 +39,7 @@
 using namespace Urho3D;
 
 static const unsigned COMPRESSED_BLOCK_SIZE = 32768;
+static const unsigned INDEXED_BLOCK_SIZE = 65536;
 
 struct FileEntry
 {
@@ -52,8 +55,10 @@ QString basePath_;
 std::vector<FileEntry> entries_;
 unsigned checksum_ = 0;
 bool compress_ = false;
+bool highCompression_ = false;
+bool streamFormat_ = false;
 bool quiet_ = false;
-unsigned blockSize_ = COMPRESSED_BLOCK_SIZE;
+unsigned blockSize_ = INDEXED_BLOCK_SIZE;
 
 QString ignoreExtensions_[] = {
     ".bak",
@@ -66,6 +71,8 @@ void Run(const QStringList &arguments);
 void ProcessFile(const QString& fileName, const QString &rootDir);
 void WritePackageFile(const QString &fileName, const QString& rootDir);
 void WriteHeader(File& dest);
+unsigned CompressBlock(const unsigned char* src, unsigned char* dest, unsigned srcSize);
+void Benchmark(PackageFile* packageFile);
 
 int main(int argc, char** argv)
 {
@@ -88,7 +95,9 @@ void Run(const QStringList &arguments)
             "Usage: PackageTool <directory to process> <package name> [basepath] [options]\n"
             "\n"
             "Options:\n"
-            "-c      Enable package file LZ4 compression\n"
+            "-c      Enable package file LZ4 compression in independently decompressible blocks\n"
+            "-h      Use high compression LZ4HC, slower to write but as fast to read\n"
+            "-s      Use the legacy sequential LZ4 stream format, which does not allow seeking or parallel decompression\n"
             "-q      Enable quiet mode\n"
             "\n"
             "Basepath is an optional prefix that will be added to the file entries.\n\n"
@@ -97,6 +106,7 @@ void Run(const QStringList &arguments)
             "-i      Output package file information\n"
             "-l      Output file names (including their paths) contained in the package\n"
             "-L      Similar to -l but also output compression ratio (compressed package file only)\n"
+            "-b      Read all files in the package and output the read throughput\n"
         );
 
     const QString& dirName = arguments[0];
@@ -117,6 +127,12 @@ void Run(const QStringList &arguments)
                     case 'c':
                         compress_ = true;
                         break;
+                    case 'h':
+                        highCompression_ = true;
+                        break;
+                    case 's':
+                        streamFormat_ = true;
+                        break;
                     case 'q':
                         quiet_ = true;
                         break;
@@ -128,6 +144,9 @@ void Run(const QStringList &arguments)
         }
     }
 
+    if (streamFormat_)
+        blockSize_ = COMPRESSED_BLOCK_SIZE;
+
     if (!isOutputMode)
     {
         if (!quiet_)
@@ -170,6 +189,11 @@ void Run(const QStringList &arguments)
             PrintLine("Package size: " + QString::number(packageFile->GetTotalSize()));
             PrintLine("Checksum: " + QString::number(packageFile->GetChecksum()));
             PrintLine("Compressed: " + QString(packageFile->IsCompressed() ? "yes" : "no"));
+            if (packageFile->GetBlockSize())
+                PrintLine("Block size: " + QString::number(packageFile->GetBlockSize()));
+            break;
+        case 'b':
+            Benchmark(packageFile);
             break;
         case 'L':
             if (!packageFile->IsCompressed())
@@ -272,7 +296,7 @@ void WritePackageFile(const QString& fileName, const QString &rootDir)
                 PrintLine(entries_[i].name_ + " size " + QString::number(dataSize));
             dest.Write(&buffer[0], entries_[i].size_);
         }
-        else
+        else if (streamFormat_)
         {
             SharedArrayPtr<unsigned char> compressBuffer(new unsigned char[LZ4_compressBound(blockSize_)]);
 
@@ -284,7 +308,7 @@ void WritePackageFile(const QString& fileName, const QString &rootDir)
                 if (pos + unpackedSize > dataSize)
                     unpackedSize = dataSize - pos;
 
-                auto packedSize = (unsigned)LZ4_compress_HC((const char*)&buffer[pos], (char*)compressBuffer.get(), unpackedSize, LZ4_compressBound(unpackedSize), 0);
+                auto packedSize = (unsigned)LZ4_compress_HC((const char*)&buffer[pos], (char*)compressBuffer.get(), unpackedSize, LZ4_compressBound(unpackedSize), highCompression_ ? LZ4HC_CLEVEL_MAX : 0);
                 if (!packedSize)
                     ErrorExit("LZ4 compression failed for file " + entries_[i].name_ + " at offset " + QString::number(pos));
 
@@ -294,15 +318,51 @@ void WritePackageFile(const QString& fileName, const QString &rootDir)
 
                 pos += unpackedSize;
             }
-
-            if (!quiet_)
+        }
+        else
+        {
+            // Block index of packed sizes first, then the blocks. Blocks that do not compress are stored as is, which the
+            // reader recognizes from the packed size being equal to the unpacked size
+            unsigned numBlocks = (dataSize + blockSize_ - 1) / blockSize_;
+            std::vector<unsigned> packedSizes(numBlocks);
+            SharedArrayPtr<unsigned char> compressBuffer(new unsigned char[dataSize + LZ4_compressBound(blockSize_)]);
+            std::vector<unsigned char*> blockData(numBlocks);
+
+            unsigned char* compressPos = compressBuffer.get();
+            for (unsigned j = 0; j < numBlocks; ++j)
             {
-                unsigned totalPackedBytes = dest.GetSize() - lastOffset;
-                QString fileEntry(entries_[i].name_);
-                fileEntry+=QString::asprintf("\tin: %u\tout: %u\tratio: %f", dataSize, totalPackedBytes,
-                    totalPackedBytes ? 1.f * dataSize / totalPackedBytes : 0.f);
-                PrintLine(fileEntry);
+                unsigned pos = j * blockSize_;
+                unsigned unpackedSize = Min(blockSize_, dataSize - pos);
+                unsigned packedSize = CompressBlock(&buffer[pos], compressPos, unpackedSize);
+                if (!packedSize)
+                    ErrorExit("LZ4 compression failed for file " + entries_[i].name_ + " at offset " + QString::number(pos));
+
+                if (packedSize < unpackedSize)
+                {
+                    blockData[j] = compressPos;
+                    compressPos += packedSize;
+                }
+                else
+                {
+                    blockData[j] = &buffer[pos];
+                    packedSize = unpackedSize;
+                }
+                packedSizes[j] = packedSize;
             }
+
+            for (unsigned j = 0; j < numBlocks; ++j)
+                dest.WriteUInt(packedSizes[j]);
+            for (unsigned j = 0; j < numBlocks; ++j)
+                dest.Write(blockData[j], packedSizes[j]);
+        }
+
+        if (compress_ && !quiet_)
+        {
+            unsigned totalPackedBytes = dest.GetSize() - lastOffset;
+            QString fileEntry(entries_[i].name_);
+            fileEntry+=QString::asprintf("\tin: %u\tout: %u\tratio: %f", dataSize, totalPackedBytes,
+                totalPackedBytes ? 1.f * dataSize / totalPackedBytes : 0.f);
+            PrintLine(fileEntry);
         }
     }
 
@@ -336,8 +396,49 @@ void WriteHeader(File& dest)
 {
     if (!compress_)
         dest.WriteFileID("UPAK");
-    else
+    else if (streamFormat_)
         dest.WriteFileID("ULZ4");
+    else
+        dest.WriteFileID("ULZB");
     dest.WriteUInt(entries_.size());
     dest.WriteUInt(checksum_);
+    if (compress_ && !streamFormat_)
+        dest.WriteUInt(blockSize_);
+}
+
+unsigned CompressBlock(const unsigned char* src, unsigned char* dest, unsigned srcSize)
+{
+    if (highCompression_)
+        return (unsigned)LZ4_compress_HC((const char*)src, (char*)dest, srcSize, LZ4_compressBound(srcSize), LZ4HC_CLEVEL_MAX);
+    else
+        return (unsigned)LZ4_compress_default((const char*)src, (char*)dest, srcSize, LZ4_compressBound(srcSize));
+}
+
+void Benchmark(PackageFile* packageFile)
+{
+    // Use worker threads as the engine would, so that large block-compressed files are decompressed in parallel
+    context_->m_WorkQueueSystem.reset(new WorkQueue(context_.get()));
+    unsigned numThreads = Max(GetNumPhysicalCPUs(), 1U) - 1;
+    if (numThreads)
+        context_->m_WorkQueueSystem->CreateThreads(numThreads);
+
+    const HashMap<QString, PackageEntry>& entries = packageFile->GetEntries();
+    std::vector<unsigned char> buffer;
+    unsigned long long totalBytes = 0;
+    HiresTimer timer;
+
+    for (const auto& entry : entries)
+    {
+        File file(context_.get(), packageFile, entry.first);
+        if (!file.IsOpen())
+            ErrorExit("Could not open file " + entry.first);
+        buffer.resize(file.GetSize());
+        if (file.Read(buffer.data(), file.GetSize()) != file.GetSize())
+            ErrorExit("Could not read file " + entry.first);
+        totalBytes += file.GetSize();
+    }
+
+    long long usec = Max(timer.GetUSec(false), 1LL);
+    PrintLine(QString::asprintf("Read %u files, %llu bytes in %.3f ms: %.1f MB/s", (unsigned)entries.size(), totalBytes,
+        usec / 1000.0, totalBytes / (usec / 1000000.0) / (1024.0 * 1024.0)));
 }
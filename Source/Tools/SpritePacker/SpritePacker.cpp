@@ -23,6 +23,7 @@
 #include <Lutefisk3D/Core/Context.h>
 #include <Lutefisk3D/Core/ProcessUtils.h>
 #include <Lutefisk3D/Core/StringUtils.h>
+#include <Lutefisk3D/Core/WorkQueue.h>
 #include <Lutefisk3D/IO/File.h>
 #include <Lutefisk3D/IO/FileSystem.h>
 #include <Lutefisk3D/IO/Log.h>
@@ -74,7 +75,9 @@ public:
 
 void Help()
 {
-    ErrorExit("Usage: SpritePacker -options <input file> <input file> <output png file>\n"
+    ErrorExit("Usage: SpritePacker -options <input file> <input file> <output png, dds or ktx file>\n"
+        "\n"
+        "A dds or ktx output file is DXT5 compressed with mipmaps.\n"
         "\n"
         "Options:\n"
         "-h Shows this help message.\n"
@@ -407,7 +410,21 @@ void Run(QStringList &arguments)
     }
 
     URHO3D_LOGINFO("Saving output image.");
-    spriteSheetImage.SavePNG(outputFile);
+    QString outputExtension = GetExtension(outputFile);
+    if (outputExtension == ".dds" || outputExtension == ".ktx")
+    {
+        // Spread the block encoding over the worker threads
+        context.m_WorkQueueSystem.reset(new WorkQueue(&context));
+        unsigned numThreads = Max(GetNumPhysicalCPUs(), 1U) - 1;
+        if (numThreads)
+            context.m_WorkQueueSystem->CreateThreads(numThreads);
+
+        SharedPtr<Image> compressed = spriteSheetImage.Compress(CF_DXT5, COMPRESS_HIGH);
+        if (!compressed || !(outputExtension == ".dds" ? compressed->SaveDDS(outputFile) : compressed->SaveKTX(outputFile)))
+            ErrorExit("Could not save compressed output image " + outputFile);
+    }
+    else
+        spriteSheetImage.SavePNG(outputFile);
 
     URHO3D_LOGINFO("Saving SpriteSheet xml file.");
     File spriteSheetFile(&context);